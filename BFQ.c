@@ -0,0 +1,175 @@
+/*! \file BFQ.c
+    \brief Implementation of the BFQ (budget fair queueing) scheduling algorithm.
+
+    Each queue (reads or writes to a file) has a budget, in bytes. BFQ selects a queue and serves it exclusively until its budget is exhausted, it has no more requests, or its limits on outstanding requests are full (like aIOLi with its quantum), so sequential accesses are kept together. To be fair, each queue also has a finish tag, and the scheduler has a virtual time. The queue with the smallest start tag, max(virtual time, finish tag), is selected, and after it is served its finish tag becomes its start tag plus the time it took from the device. This time is estimated from the service times of its released requests, so a queue of random accesses, that makes the device slower, is charged more than a sequential one for the same amount of data. Requests still have to be released for that. Until the queue has measurements, it is charged with the service time per byte of all released requests (and by size only until any request is released).
+    Budgets grow (up to bfq_max_budget) for sequential queues that exhaust them, and shrink back to what was used (down to bfq_budget) for other queues that go idle.
+ */
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "agios_config.h"
+#include "agios_counters.h"
+#include "agios_request.h"
+#include "BFQ.h"
+#include "common_functions.h"
+#include "mylist.h"
+#include "performance.h"
+#include "process_request.h"
+#include "req_hashtable.h"
+#include "scheduling_algorithms.h"
+#include "statistics.h"
+#include "throttle.h"
+#include "waiting_common.h"
+
+static int64_t g_BFQ_vtime = 0; /**< the virtual time, start tag of the last served queue. */
+
+/**
+ * function called to initialize BFQ. It is called with all data structures locked, so we reset the budgets and tags of all queues (they could be from a previous time BFQ was used).
+ * @return true (it cannot fail).
+ */
+bool BFQ_init(void)
+{
+	struct file_t *req_file; /**< used to go over all files in a line of the hashtable. */
+
+	for (int32_t i=0; i< AGIOS_HASH_ENTRIES; i++) {
+		agios_list_for_each_entry (req_file, &hashlist[i], hashlist) {
+			req_file->read_queue.bfq_budget = config_bfq_budget;
+			req_file->read_queue.bfq_finish = 0;
+			req_file->write_queue.bfq_budget = config_bfq_budget;
+			req_file->write_queue.bfq_finish = 0;
+		}
+	}
+	g_BFQ_vtime = 0;
+	return true;
+}
+/**
+ * answers if a queue is being accessed sequentially, from the average distance between consecutive requests.
+ * @param queue the queue.
+ * @return true if the offset distance between consecutive requests is usually smaller than the requests.
+ */
+bool BFQ_is_sequential(struct queue_t *queue)
+{
+	return (queue->stats.receivedreq_nb > 1) && (queue->stats.avg_distance <= queue->stats.avg_req_size);
+}
+/**
+ * estimates for how long the device was busy with the data served from a queue. The caller must hold the lock to the hashtable line where the queue is.
+ * @param queue the queue.
+ * @param used how much data was served from it (in bytes).
+ * @return the estimated service time, in ns. Before requests from the queue are released, we use the median service time of all released requests for the average request size. Before any request is released, we return used (as if the device did one byte per ns).
+ */
+int64_t BFQ_charge(struct queue_t *queue, int64_t used)
+{
+	struct global_statistics_t global; /**< to get the average size of all requests. */
+	int64_t service_time; /**< the median service time of all released requests. */
+
+	if ((queue->stats.releasedreq_nb > 0) && (queue->stats.avg_req_size > 0)) return (int64_t) (((double) used * queue->stats.avg_service_time) / queue->stats.avg_req_size);
+	//no measurements for this queue, it must be charged in the same unit as the others, or new files would have an arbitrary advantage (or disadvantage) over measured ones
+	service_time = get_global_service_time();
+	get_global_stats(&global);
+	if ((service_time < 0) || (global.avg_request_size <= 0)) return used;
+	return (int64_t) (((double) used * service_time) / global.avg_request_size);
+}
+/**
+ * goes over the whole hashtable to find the queue with the smallest start tag. The caller must NOT hold the mutex for any line of the hashtable.
+ * @param selected_hash the line of the hashtable where the returned queue is (it will be modified by this function).
+ * @param selected_start the start tag of the returned queue (it will be modified by this function).
+ * @return the selected queue, NULL if we can't find one (or all queues are waiting for their limits on outstanding requests).
+ */
+struct queue_t *BFQ_select_queue(int32_t *selected_hash, int64_t *selected_start)
+{
+	struct agios_list_head *reqfile_l; /**< used to access the line of the hashtable. */
+	struct file_t *req_file; /**< used to go over all files in a line of the hashtable. */
+	struct queue_t *queues[2]; /**< the read and write queues of a file. */
+	struct queue_t *selected_queue = NULL; /**< the queue we will return. */
+	int64_t selected_timestamp = LONG_MAX; /**< the timestamp of the first request of the selected queue, used to ensure FIFO between queues with the same start tag. */
+	int64_t start; /**< the start tag of a queue. */
+	int64_t timestamp; /**< the timestamp of the first request of a queue. */
+	int32_t evaluated_reqfiles=0; /**< counter of how many files were checked. */
+
+	for (int32_t i=0; i< AGIOS_HASH_ENTRIES; i++) { //go over all lines of the hashtable
+		reqfile_l = hashtable_lock(i);
+		agios_list_for_each_entry (req_file, reqfile_l, hashlist) { //go over all files in this line
+			if (agios_list_empty(&req_file->read_queue.list) && agios_list_empty(&req_file->write_queue.list)) continue;
+			evaluated_reqfiles++; //we count only files that have requests
+			queues[0] = &req_file->read_queue;
+			queues[1] = &req_file->write_queue;
+			for (int32_t j = 0; j < 2; j++) {
+				if (agios_list_empty(&queues[j]->list)) continue;
+				start = agios_max(g_BFQ_vtime, queues[j]->bfq_finish);
+				timestamp = agios_list_entry(queues[j]->list.next, struct request_t, related)->timestamp;
+				if (((!selected_queue) || (start < *selected_start) || ((start == *selected_start) && (timestamp < selected_timestamp))) && 
+					outstanding_allows(req_file, agios_list_entry(queues[j]->list.next, struct request_t, related)->queue_id)) { //queues waiting for their limits on outstanding requests are left alone
+					selected_queue = queues[j];
+					*selected_start = start;
+					selected_timestamp = timestamp;
+					*selected_hash = i;
+				}
+			}
+		} //end of for all files
+		hashtable_unlock(i);
+		if (evaluated_reqfiles >= current_filenb) break; //shortcut out in case we know the rest of the hashtable is empty
+	} //end go over all the hashtable
+	return selected_queue;
+}
+/**
+ * function called after serving a queue, to charge it for the service and decide its next budget. The caller must hold the lock to the hashtable line where the queue is.
+ * @param queue the queue.
+ * @param start its start tag.
+ * @param used how much data was served from it (in bytes).
+ */
+void BFQ_update_queue(struct queue_t *queue, int64_t start, int64_t used)
+{
+	if (queue->bfq_budget <= 0) queue->bfq_budget = config_bfq_budget; //a new queue
+	queue->bfq_finish = start + BFQ_charge(queue, used);
+	if (used >= queue->bfq_budget) { //ran out of budget
+		if (BFQ_is_sequential(queue)) queue->bfq_budget = agios_min(queue->bfq_budget*2, config_bfq_max_budget);
+	} else if (!BFQ_is_sequential(queue)) { //went idle, it does not need that much
+		queue->bfq_budget = agios_max(used, config_bfq_budget);
+	}
+}
+/**
+ * main function for the BFQ scheduler. It is called by the AGIOS thread to schedule some requests. It will continue to consume requests until there are no more requests or if notified by the process_requests_step2 function.
+ * @return 0 (because we will never decide to sleep)
+ */
+int64_t BFQ(void)
+{
+	struct queue_t *queue; /**< the queue being served. */
+	int32_t hash = 0; /**< the line of the hashtable where it is. */
+	int64_t start = 0; /**< its start tag. */
+	int64_t budget; /**< its budget. */
+	int64_t used; /**< how much of the budget was used so far. */
+	struct request_t *req; /**< the request we will process. */
+	bool BFQ_stop=false; /**< the return of the process_requests_step2 function may notify us it is time to stop because of a periodic event. */
+	struct processing_info_t *info; /**< the struct with information about requests to be processed, filled by process_requests_step1 and added to info_list */
+	AGIOS_LIST_HEAD(info_list); /**< we serve many requests from a queue while holding the lock, and call process_requests_step2 for all of them after unlocking it. */
+
+	while ((current_reqnb > 0) && (!BFQ_stop)) {
+		/*1. find the queue with the smallest start tag*/
+		queue = BFQ_select_queue(&hash, &start);
+		if (!queue) break; //the requests we have were not added to the hashtable yet
+		hashtable_lock(hash);
+		if (agios_list_empty(&queue->list)) { //its requests were cancelled since we selected it
+			hashtable_unlock(hash);
+			continue;
+		}
+		/*2. serve it until it runs out of budget or requests*/
+		g_BFQ_vtime = start;
+		budget = (queue->bfq_budget > 0) ? queue->bfq_budget : config_bfq_budget;
+		used = 0;
+		do {
+			req = agios_list_entry(queue->list.next, struct request_t, related);
+			used += req->len;
+			hashtable_del_req(req);
+			info = process_requests_step1(req, hash);
+			agios_list_add_tail(&info->list, &info_list);
+			generic_post_process(req);
+		} while ((!agios_list_empty(&queue->list)) && (used < budget) && 
+			outstanding_allows(queue->req_file, agios_list_entry(queue->list.next, struct request_t, related)->queue_id));
+		/*3. charge it and adjust its budget*/
+		BFQ_update_queue(queue, start, used);
+		hashtable_unlock(hash);
+		BFQ_stop = call_step2_for_info_list(&info_list);
+	}
+	return 0;
+}
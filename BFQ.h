@@ -0,0 +1,10 @@
+/*! \file BFQ.h
+    \brief Headers for the implementation of the BFQ scheduling algorithm.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+bool BFQ_init(void);
+int64_t BFQ(void);
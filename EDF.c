@@ -0,0 +1,222 @@
+/*! \file EDF.c
+    \brief Implementation of the EDF (earliest deadline first) scheduling algorithm.
+
+    Every request has a deadline, given to agios_add_request_with_deadline or config_edf_deadline after its arrival. EDF uses the hashtable, so requests are aggregated as with SJF, and a virtual request has the earliest deadline among its requests. A heap keeps, for every queue (read or write queue of a file) with requests, an entry with a key not larger than the earliest deadline in the queue. The queue remembers the key of its current entry (edf_key), so a new request only adds an entry when its deadline is earlier than that. Entries are not removed when requests leave the queue (because they were processed, cancelled, or aggregated), instead we check them when they reach the top of the heap: entries that are not the current one of their queue are dropped, and if the queue has no request with that deadline anymore, the entry is replaced by one with the current earliest deadline of the queue. 
+    The request with the earliest deadline is processed (with all requests aggregated to it). But when even the earliest deadline is more than config_edf_slack in the future, we have time to favor throughput, so we process the shortest queue instead, as SJF would do. Queues whose limits on outstanding requests are full are left alone: their entries are put aside and go back to the heap when EDF returns.
+ */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "agios_config.h"
+#include "agios_counters.h"
+#include "agios_request.h"
+#include "common_functions.h"
+#include "EDF.h"
+#include "hash.h"
+#include "heap.h"
+#include "mylist.h"
+#include "process_request.h"
+#include "req_hashtable.h"
+#include "scheduling_algorithms.h"
+#include "SJF.h"
+#include "throttle.h"
+
+static struct agios_heap_t g_EDF_heap; /**< the deadlines of queues with requests, each entry points to a struct queue_t. */
+static pthread_mutex_t g_EDF_heap_lock = PTHREAD_MUTEX_INITIALIZER; /**< protects g_EDF_heap and g_EDF_rebuild. When holding the lock of a line of the hashtable, this one must be acquired after it. */
+static bool g_EDF_rebuild; /**< does the heap have to be rebuilt from the hashtable (because requests were migrated to it, or we could not allocate memory)? */
+static struct agios_heap_t g_EDF_skipped; /**< entries taken from g_EDF_heap for queues waiting for their limits on outstanding requests, during a call to EDF (only used by the agios thread). */
+
+/**
+ * function called to initialize EDF. Requests already in the hashtable (or being migrated to it) will be added to the heap when EDF is first called.
+ * @return true or false for success
+ */
+bool EDF_init(void)
+{
+	pthread_mutex_lock(&g_EDF_heap_lock);
+	heap_clear(&g_EDF_heap);
+	g_EDF_rebuild = true;
+	pthread_mutex_unlock(&g_EDF_heap_lock);
+	return true;
+}
+/**
+ * function called when stopping the use of EDF, to free the heap.
+ */
+void EDF_exit(void)
+{
+	pthread_mutex_lock(&g_EDF_heap_lock);
+	heap_cleanup(&g_EDF_heap);
+	pthread_mutex_unlock(&g_EDF_heap_lock);
+	heap_cleanup(&g_EDF_skipped);
+}
+/**
+ * adds an entry to the heap for a queue, which becomes its current entry. The caller must hold the lock to the line of the hashtable where its file is.
+ * @param queue the queue.
+ * @param deadline the key of the entry.
+ */
+void EDF_push(struct queue_t *queue, int64_t deadline)
+{
+	queue->edf_key = deadline;
+	pthread_mutex_lock(&g_EDF_heap_lock);
+	if (!heap_push(&g_EDF_heap, deadline, queue)) g_EDF_rebuild = true; //we'll try again later
+	pthread_mutex_unlock(&g_EDF_heap_lock);
+}
+/**
+ * called by hashtable_add_req when a new request arrives while EDF is in use. The caller must hold the lock to the line of the hashtable where its file is.
+ * @param req the new request (which may have been aggregated into a virtual request already).
+ */
+void EDF_new_request(struct request_t *req)
+{
+	if (req->deadline < req->globalinfo->edf_key) EDF_push(req->globalinfo, req->deadline); //otherwise the current entry of the queue is early enough
+}
+/**
+ * finds the (possibly virtual) request with the earliest deadline in a queue. The caller must hold the lock to the line of the hashtable where its file is.
+ * @param queue the queue.
+ * @return the request, NULL if the queue is empty.
+ */
+struct request_t *EDF_earliest_request(struct queue_t *queue)
+{
+	struct request_t *tmp; /**< used to iterate over the queue. */
+	struct request_t *chosen = NULL; /**< the request with the earliest deadline. */
+
+	agios_list_for_each_entry (tmp, &queue->list, related) {
+		if ((!chosen) || (tmp->deadline < chosen->deadline)) chosen = tmp;
+	}
+	return chosen;
+}
+/**
+ * rebuilds the heap by adding an entry for each queue of the hashtable that has requests. The caller must NOT hold any lock.
+ */
+void EDF_fill_heap(void)
+{
+	struct agios_list_head *reqfile_l; /**< used to access the line of the hashtable. */
+	struct file_t *req_file; /**< used to go over all files in a line of the hashtable. */
+	struct request_t *req; /**< the request with the earliest deadline in a queue. */
+
+	pthread_mutex_lock(&g_EDF_heap_lock);
+	heap_clear(&g_EDF_heap);
+	g_EDF_rebuild = false;
+	pthread_mutex_unlock(&g_EDF_heap_lock);
+	for (int32_t i=0; i < AGIOS_HASH_ENTRIES; i++) {
+		reqfile_l = hashtable_lock(i);
+		agios_list_for_each_entry (req_file, reqfile_l, hashlist) {
+			req = EDF_earliest_request(&req_file->read_queue);
+			if (req) EDF_push(&req_file->read_queue, req->deadline);
+			else req_file->read_queue.edf_key = INT64_MAX;
+			req = EDF_earliest_request(&req_file->write_queue);
+			if (req) EDF_push(&req_file->write_queue, req->deadline);
+			else req_file->write_queue.edf_key = INT64_MAX;
+		}
+		hashtable_unlock(i);
+	}
+}
+/**
+ * processes the first request of the shortest queue, as SJF does.
+ * @param processed will be set to true if a request was processed, false if there was none (or all queues are waiting for their limits on outstanding requests).
+ * @return the return of process_requests_step2 (true if we have to stop).
+ */
+bool EDF_process_shortest_job(bool *processed)
+{
+	int32_t hash=0; /**< the line of the hashtable we are going to take requests from. */
+	struct queue_t *queue; /**< the queue from which we will take requests. */
+	struct request_t *req; /**< the request we will process. */
+	struct processing_info_t *info; /**< the struct with information about requests to be processed, filled by process_requests_step1 and given as parameter to process_requests_step2 */
+
+	*processed = false;
+	queue = SJF_get_shortest_job(&hash);
+	if (!queue) return false;
+	hashtable_lock(hash);
+	if (agios_list_empty(&queue->list)) { //it was processed or cancelled since SJF_get_shortest_job unlocked it
+		hashtable_unlock(hash);
+		return false;
+	}
+	req = agios_list_entry(queue->list.next, struct request_t, related);
+	hashtable_del_req(req);
+	info = process_requests_step1(req, hash);
+	generic_post_process(req);
+	hashtable_unlock(hash);
+	*processed = true;
+	return process_requests_step2(info);
+}
+/**
+ * main function for the EDF scheduler. Selects requests, processes and then cleans up them. Returns only after consuming all requests, or earlier if notified by the process_requests_step2 function. 
+ * @return 0 (because we will never decide to sleep)
+ */
+int64_t EDF(void)
+{
+	bool EDF_stop=false; /**< the return of the process_requests_step2 function may notify us it is time to stop because of a periodic event. */
+	struct heap_entry_t entry; /**< the entry at the top of the heap. */
+	struct queue_t *queue; /**< the queue it points to. */
+	struct request_t *req; /**< the request with the earliest deadline in that queue. */
+	struct request_t *next_req; /**< the request with the earliest deadline after req is processed. */
+	struct processing_info_t *info; /**< the struct with information about requests to be processed, filled by process_requests_step1 and given as parameter to process_requests_step2 */
+	struct timespec now; /**< used to compare deadlines to the current time. */
+	int32_t hash; /**< the line of the hashtable where the file of queue is. */
+	bool has_entry; /**< did we get an entry from the heap? */
+	bool rebuild; /**< copy of g_EDF_rebuild. */
+	bool processed = true; /**< did EDF_process_shortest_job find a request to process? */
+
+	while ((current_reqnb > 0) && (EDF_stop == false) && processed) {
+		pthread_mutex_lock(&g_EDF_heap_lock);
+		rebuild = g_EDF_rebuild;
+		has_entry = (!rebuild) && heap_pop(&g_EDF_heap, &entry);
+		pthread_mutex_unlock(&g_EDF_heap_lock);
+		if (!has_entry) { //we have requests, so there should be something in the heap
+			if (rebuild) EDF_fill_heap();
+			else EDF_stop = EDF_process_shortest_job(&processed); //the requests we have were added after we looked at current_reqnb, we could not rebuild the heap, or all queues are waiting for their limits
+			continue;
+		}
+		queue = (struct queue_t *) entry.data;
+		hash = get_hashtable_position(queue->req_file->file_id);
+		hashtable_lock(hash);
+		if (entry.key != queue->edf_key) { //this entry is outdated, the queue has another one
+			hashtable_unlock(hash);
+			continue;
+		}
+		req = EDF_earliest_request(queue);
+		if (!req) { //this entry is outdated, the queue is empty
+			queue->edf_key = INT64_MAX;
+			hashtable_unlock(hash);
+			continue;
+		}
+		if (req->deadline > entry.key) { //this entry is outdated, we replace it by the current earliest deadline of the queue
+			EDF_push(queue, req->deadline);
+			hashtable_unlock(hash);
+			continue;
+		}
+		if (!outstanding_allows(queue->req_file, req->queue_id)) { //we put it aside until we return
+			if (!heap_push(&g_EDF_skipped, req->deadline, queue)) { //we would find it again
+				EDF_push(queue, req->deadline);
+				hashtable_unlock(hash);
+				break;
+			}
+			queue->edf_key = req->deadline;
+			hashtable_unlock(hash);
+			continue;
+		}
+		//req has the earliest deadline among all queued requests
+		agios_gettime(&now);
+		if (req->deadline - get_timespec2long(now) > config_edf_slack) { //we have time, so we favor throughput
+			EDF_push(queue, req->deadline);
+			hashtable_unlock(hash);
+			EDF_stop = EDF_process_shortest_job(&processed);
+			continue;
+		}
+		hashtable_del_req(req);
+		info = process_requests_step1(req, hash);
+		generic_post_process(req);
+		next_req = EDF_earliest_request(queue);
+		if (next_req) EDF_push(queue, next_req->deadline);
+		else queue->edf_key = INT64_MAX;
+		hashtable_unlock(hash);
+		EDF_stop = process_requests_step2(info);
+	}
+	//the queues we put aside go back to the heap
+	pthread_mutex_lock(&g_EDF_heap_lock);
+	while (heap_pop(&g_EDF_skipped, &entry)) {
+		if (!heap_push(&g_EDF_heap, entry.key, entry.data)) g_EDF_rebuild = true;
+	}
+	pthread_mutex_unlock(&g_EDF_heap_lock);
+	return 0;
+}
@@ -0,0 +1,11 @@
+/*! \file EDF.h
+    \brief Headers for the implementation of the EDF scheduling algorithm.
+ */
+#pragma once
+
+#include "agios_request.h"
+
+bool EDF_init(void);
+int64_t EDF(void);
+void EDF_exit(void);
+void EDF_new_request(struct request_t *req);
@@ -15,6 +15,7 @@
 #include "mylist.h"
 #include "process_request.h"
 #include "req_hashtable.h"
+#include "throttle.h"
 #include "waiting_common.h"
 
 static int MLF_current_hash=0;  /**< position of the hashtable we are accessing. Used so we do a round robin on the hashtable even across different calls to MLF(). */
@@ -40,6 +41,8 @@ bool MLF_init(void)
 void MLF_exit()
 {
 	if (MLF_lock_tries) free(MLF_lock_tries);
+	MLF_lock_tries = NULL;
+	cleanup_waiting_files();
 }
 /**
  * Selects a request to be processed from a queue (and updates the schedule factor for all requests in this queue.
@@ -57,7 +60,7 @@ struct request_t *applyMLFonlist(struct queue_t *reqlist)
 		increment_sched_factor(req);
 		if (!found) { //we select the first request that can be selected
 			/*see if the request's quantum is large enough to allow its execution*/
-			if ((req->sched_factor*config_mlf_quantum) >= req->len) {
+			if (((int64_t)req->sched_factor*config_mlf_quantum) >= req->len) {
 				selectedreq = req; 
 				found = true; /*we select the first possible request because we want to process them by offset order, and the list is ordered by offset. However, we do not stop the for loop here because we still have to increment the sched_factor of all requests (which is equivalent to increase their quanta)*/
 			}
@@ -100,6 +103,7 @@ int64_t MLF(void)
 	struct processing_info_t *info; /**< the struct with information about requests to be processed, filled by process_requests_step1 and given as parameter to process_requests_step2 */
 	AGIOS_LIST_HEAD(info_list); /**< we will select multiple requests from a queue if the quantum allows, so we'll make a list of the struct processing_info_t structs returned by the multiple calls to process_requests_step1 to call process_requests_step2 later, when we are done with the queue and can unlock the mutex. */
 
+	update_waiting_files(&shortest_waiting_time); //files that are done waiting have their waiting_time set to 0
 	/*search through all the files for requests to process*/
 	while ((current_reqnb > 0) && (!mlf_stop)) {
 		/*try to lock the line of the hashtable. If we can't get it, we will move on to the next line. If a line has been tried without success MAX_MLF_LOCK_TRIES times, we will perform a regular lock to wait until it is available. The idea is to decrease the cost of waiting for locks but without starving queues. */
@@ -114,10 +118,9 @@ int64_t MLF(void)
 			MLF_lock_tries[MLF_current_hash]=0;
 			if (hashlist_reqcounter[MLF_current_hash] > 0) { //see if we have requests for this line of the hashtable
 		                agios_list_for_each_entry (req_file, reqfile_l, hashlist) { //go through all files in this line of the hashtable
-					/*do a MLF step to this file, potentially selecting a request to be processed, but before we need to see if we are waiting new requests to this file*/
-					if (req_file->waiting_time > 0) update_waiting_time_counters(req_file, &shortest_waiting_time);
+					/*do a MLF step to this file, potentially selecting a request to be processed (check_selection does not let us process it if we are waiting new requests to this file)*/
 					req = MLF_select_request(req_file);
-					if ((req) && (req_file->waiting_time <= 0)) { //if we could select a request to this file and we are not waiting on it
+					if ((req) && (req_file->waiting_time <= 0) && outstanding_allows(req_file, req->queue_id)) { //if we could select a request to this file, we are not waiting on it, and its limits on outstanding requests allow it
 						/*removes the request from the hastable*/
 						hashtable_del_req(req);
 						/*sends it back to the file system*/
@@ -139,8 +142,9 @@ int64_t MLF(void)
 			MLF_current_hash++;
 			if (MLF_current_hash >= AGIOS_HASH_ENTRIES) MLF_current_hash = 0;
 			if (MLF_current_hash == starting_hash) { /*it means we already went through all the file structures*/
-				if (!processed_requests) { //and we could not process anything even after going through ALL files
-					waiting_time = shortest_waiting_time;
+				shortest_waiting_time = INT_MAX;
+				if ((update_waiting_files(&shortest_waiting_time) == 0) && (!processed_requests)) { //and we could not process anything even after going through ALL files (and no file is done waiting since we started)
+					if (shortest_waiting_time < INT_MAX) waiting_time = shortest_waiting_time; //all files with requests are waiting. If no file is waiting, we could not select requests because their quanta are still too small, so we return 0 to be called again right away
 					break; //get out of the while
 				}
 				processed_requests=false; /*restart the counting*/
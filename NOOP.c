@@ -35,6 +35,10 @@ int64_t NOOP(void)
 		if (!stop_processing) { //if the list is not empty
 			//just take one request and process it
 			req = timeline_oldest_req(&hash);
+			if (!req) { //they are waiting for their limits on outstanding requests
+				timeline_unlock();
+				break;
+			}
 			debug("NOOP is processing leftover requests %s %ld %ld", req->file_id, req->offset, req->len);
 			info = process_requests_step1(req, hash);
 			generic_post_process(req);
@@ -0,0 +1,228 @@
+/*! \file PATTERN_MATCHING.c
+    \brief Implementation of the PATTERN_MATCHING dynamic scheduling algorithm.
+
+    PATTERN_MATCHING periodically (every select_algorithm_period) selects the scheduling algorithm to be used, from the access pattern of the requests (see pattern_tracker.c). It keeps a history of up to pattern_matching_history known access patterns, and for each of them the average bandwidth observed with each scheduling algorithm in periods with that pattern, and how many times each known pattern came right after it. At the end of a period, the pattern of the period is matched against the history (the closest known pattern, if it is within pattern_matching_threshold, otherwise it becomes a new one, replacing the least recently seen if the history is full), and the bandwidth of the period is credited to it and to the scheduling algorithm in use. Then, instead of using the best algorithm for the pattern that just ended, it predicts the next pattern (the one that most often came after the current one, or the current one itself if there is no history yet), and selects the best scheduling algorithm for the predicted pattern, so the change happens before the next period starts instead of a full period late. Algorithms that were never tried with the predicted pattern are tried first (starting_algorithm before the others), so all of them are eventually measured.
+    If pattern_matching_file is set, the history is read by agios_init and written by agios_exit, so it is not learned again in every execution. The file is only meant to be read by the same build of AGIOS.
+*/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "agios_config.h"
+#include "common_functions.h"
+#include "pattern_tracker.h"
+#include "PATTERN_MATCHING.h"
+#include "performance.h"
+#include "req_timeline.h"
+#include "scheduling_algorithms.h"
+
+#define PATTERN_MATCHING_FILE_MAGIC "AGIOSPM1" /**< identifies files written by PATTERN_MATCHING */
+
+/*! \struct known_pattern_t
+    \brief An access pattern in the history of PATTERN_MATCHING, with the performance observed with it.
+ */
+struct known_pattern_t {
+	struct access_pattern_t pattern; /**< the description of the first period with this pattern (matching periods are close to it) */
+	int64_t bandwidth[IO_SCHEDULER_COUNT]; /**< average bandwidth observed in periods with this pattern with each scheduling algorithm (fixed point, see BANDWIDTH_FIXED_POINT_SHIFT), 0 if it was not tried */
+	int64_t last_seen; /**< the last period where this pattern was seen, used to choose the one to be replaced when the history is full */
+};
+
+static struct known_pattern_t *g_known_patterns = NULL; /**< the history of access patterns (config_pattern_matching_history positions). */
+static int32_t g_known_patterns_nb = 0; /**< how many positions of g_known_patterns are used. */
+static int32_t *g_pattern_transitions = NULL; /**< g_pattern_transitions[i*config_pattern_matching_history + j] is how many times pattern j came right after pattern i. */
+static int32_t g_previous_pattern = -1; /**< the pattern of the previous period, -1 if unknown. */
+static int64_t g_period_nb = 0; /**< number of periods since agios_init. */
+
+/**
+ * reads the history from pattern_matching_file, if it exists. A file that cannot be read, or that has more patterns than pattern_matching_history, is ignored (the history starts empty).
+ */
+void read_PATTERN_MATCHING_file(void)
+{
+	FILE *file; /**< the file */
+	char magic[sizeof(PATTERN_MATCHING_FILE_MAGIC)]; /**< used to check the file */
+	int32_t count, scheduler_count; /**< number of patterns and of scheduling algorithms in the file */
+	int32_t *transitions = NULL; /**< the transitions in the file */
+	struct known_pattern_t *patterns = NULL; /**< the patterns in the file */
+	bool ok; /**< could we read the file? */
+
+	file = fopen(config_pattern_matching_file, "r");
+	if (!file) return; //first execution
+	ok = (fread(magic, sizeof(magic), 1, file) == 1) && (memcmp(magic, PATTERN_MATCHING_FILE_MAGIC, sizeof(magic)) == 0) &&
+	     (fread(&count, sizeof(int32_t), 1, file) == 1) && (fread(&scheduler_count, sizeof(int32_t), 1, file) == 1) &&
+	     (count >= 0) && (count <= config_pattern_matching_history) && (scheduler_count == IO_SCHEDULER_COUNT);
+	if (ok) {
+		transitions = malloc(sizeof(int32_t)*(size_t)count*(size_t)count);
+		patterns = malloc(sizeof(struct known_pattern_t)*(size_t)count);
+		ok = transitions && patterns &&
+		     (fread(patterns, sizeof(struct known_pattern_t), (size_t)count, file) == (size_t)count) &&
+		     (fread(transitions, sizeof(int32_t), (size_t)count*(size_t)count, file) == (size_t)count*(size_t)count);
+		if (ok) {
+			g_known_patterns_nb = count;
+			for (int32_t i = 0; i < g_known_patterns_nb; i++) {
+				g_known_patterns[i] = patterns[i];
+				g_known_patterns[i].last_seen = 0;
+				for (int32_t j = 0; j < g_known_patterns_nb; j++) g_pattern_transitions[i*config_pattern_matching_history + j] = transitions[i*count + j];
+			}
+		}
+		if (transitions) free(transitions);
+		if (patterns) free(patterns);
+	}
+	fclose(file);
+	if (!ok) agios_print("could not read access patterns from %s, starting without them", config_pattern_matching_file);
+	else debug("read %d access patterns from %s", g_known_patterns_nb, config_pattern_matching_file);
+}
+/**
+ * writes the history to pattern_matching_file (to a temporary file renamed at the end, so a previous file is not lost if it fails).
+ */
+void write_PATTERN_MATCHING_file(void)
+{
+	char tmp_path[strlen(config_pattern_matching_file) + 5]; /**< the temporary file. */
+	FILE *file; /**< the file */
+	int32_t scheduler_count = IO_SCHEDULER_COUNT; /**< written to check the file when it is read */
+	bool ok; /**< could we write the file? */
+
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", config_pattern_matching_file);
+	file = fopen(tmp_path, "w");
+	if (!file) {
+		agios_print("could not write access patterns to %s", config_pattern_matching_file);
+		return;
+	}
+	ok = (fwrite(PATTERN_MATCHING_FILE_MAGIC, sizeof(PATTERN_MATCHING_FILE_MAGIC), 1, file) == 1) &&
+	     (fwrite(&g_known_patterns_nb, sizeof(int32_t), 1, file) == 1) && (fwrite(&scheduler_count, sizeof(int32_t), 1, file) == 1) &&
+	     (fwrite(g_known_patterns, sizeof(struct known_pattern_t), g_known_patterns_nb, file) == (size_t)g_known_patterns_nb);
+	for (int32_t i = 0; ok && (i < g_known_patterns_nb); i++) ok = (fwrite(&g_pattern_transitions[i*config_pattern_matching_history], sizeof(int32_t), g_known_patterns_nb, file) == (size_t)g_known_patterns_nb);
+	if (fclose(file) != 0) ok = false;
+	if ((!ok) || (rename(tmp_path, config_pattern_matching_file) != 0)) {
+		agios_print("could not write access patterns to %s", config_pattern_matching_file);
+		unlink(tmp_path);
+	}
+}
+/**
+ * function called to initialize PATTERN_MATCHING, when it is the default_algorithm. Starts tracking access patterns.
+ * @return true or false for success.
+ */
+bool PATTERN_MATCHING_init(void)
+{
+	cleanup_PATTERN_MATCHING();
+	g_known_patterns = calloc(config_pattern_matching_history, sizeof(struct known_pattern_t));
+	g_pattern_transitions = calloc((size_t)config_pattern_matching_history*(size_t)config_pattern_matching_history, sizeof(int32_t));
+	if ((!g_known_patterns) || (!g_pattern_transitions)) {
+		cleanup_PATTERN_MATCHING();
+		return false;
+	}
+	g_known_patterns_nb = 0;
+	g_previous_pattern = -1;
+	g_period_nb = 0;
+	if (config_pattern_matching_file) read_PATTERN_MATCHING_file();
+	enable_pattern_tracker(true);
+	return true;
+}
+/**
+ * called by agios_exit to stop tracking access patterns, write the history to pattern_matching_file (if set) and free it. It must be called before the configuration parameters are freed.
+ */
+void cleanup_PATTERN_MATCHING(void)
+{
+	if ((!g_known_patterns) && (!g_pattern_transitions)) return;
+	enable_pattern_tracker(false);
+	if (config_pattern_matching_file && g_known_patterns && g_pattern_transitions) write_PATTERN_MATCHING_file();
+	if (g_known_patterns) free(g_known_patterns);
+	g_known_patterns = NULL;
+	if (g_pattern_transitions) free(g_pattern_transitions);
+	g_pattern_transitions = NULL;
+	g_known_patterns_nb = 0;
+}
+/**
+ * finds the known pattern matching an access pattern, or includes it in the history.
+ * @param pattern the access pattern.
+ * @return its position in g_known_patterns.
+ */
+int32_t match_access_pattern(struct access_pattern_t *pattern)
+{
+	int32_t best = -1; /**< the closest known pattern */
+	int32_t best_distance = 0; /**< its distance */
+	int32_t distance; /**< used to compare patterns */
+
+	for (int32_t i = 0; i < g_known_patterns_nb; i++) {
+		distance = get_pattern_distance(pattern, &g_known_patterns[i].pattern);
+		if ((best < 0) || (distance < best_distance)) {
+			best = i;
+			best_distance = distance;
+		}
+	}
+	if ((best >= 0) && (best_distance <= config_pattern_matching_threshold)) return best;
+	//a new pattern
+	if (g_known_patterns_nb < config_pattern_matching_history) best = g_known_patterns_nb++;
+	else { //we forget the least recently seen one, and what came before and after it
+		best = 0;
+		for (int32_t i = 1; i < g_known_patterns_nb; i++) {
+			if (g_known_patterns[i].last_seen < g_known_patterns[best].last_seen) best = i;
+		}
+		for (int32_t i = 0; i < g_known_patterns_nb; i++) {
+			g_pattern_transitions[best*config_pattern_matching_history + i] = 0;
+			g_pattern_transitions[i*config_pattern_matching_history + best] = 0;
+		}
+		if (g_previous_pattern == best) g_previous_pattern = -1;
+	}
+	memset(&g_known_patterns[best], 0, sizeof(struct known_pattern_t));
+	g_known_patterns[best].pattern = *pattern;
+	debug("new access pattern %d: %d requests, %d%% reads, %d%% contiguous, %d%% strided", best, pattern->reqnb, pattern->read_permille/10, pattern->contiguous_permille/10, pattern->strided_permille/10);
+	return best;
+}
+/**
+ * answers if PATTERN_MATCHING can select a scheduling algorithm.
+ * @param alg the identifier of the scheduling algorithm.
+ * @return true if it can be selected.
+ */
+bool PATTERN_MATCHING_can_select(int32_t alg)
+{
+	struct io_scheduler_instance_t *scheduler = find_io_scheduler(alg); /**< the scheduling algorithm */
+
+	return scheduler->can_be_dynamically_selected && (!scheduler->is_dynamic) && ((!scheduler->needs_multi_timeline) || (multi_timeline_size > 0));
+}
+/**
+ * function called by the agios thread at the end of each period, to select the scheduling algorithm for the next one.
+ * @return the identifier of the selected scheduling algorithm.
+ */
+int32_t PATTERN_MATCHING_select(void)
+{
+	struct access_pattern_t pattern; /**< the access pattern of the period that ended */
+	int32_t index; /**< its position in the history */
+	int32_t predicted; /**< the predicted pattern for the next period */
+	int64_t bandwidth; /**< the bandwidth observed in the period that ended */
+	int32_t ret = -1; /**< the return of this function */
+
+	get_current_pattern(&pattern);
+	if ((pattern.reqnb == 0) || (!g_known_patterns)) return current_alg; //nothing to learn from
+	g_period_nb++;
+	index = match_access_pattern(&pattern);
+	g_known_patterns[index].last_seen = g_period_nb;
+	//credit the performance of the period to its pattern
+	bandwidth = get_current_performance_bandwidth();
+	if (bandwidth > 0) {
+		if (g_known_patterns[index].bandwidth[current_alg] == 0) g_known_patterns[index].bandwidth[current_alg] = bandwidth;
+		else g_known_patterns[index].bandwidth[current_alg] = (g_known_patterns[index].bandwidth[current_alg] + bandwidth) / 2;
+	}
+	//learn and predict the sequence of patterns
+	if (g_previous_pattern >= 0) g_pattern_transitions[g_previous_pattern*config_pattern_matching_history + index]++;
+	g_previous_pattern = index;
+	predicted = index;
+	for (int32_t i = 0; i < g_known_patterns_nb; i++) {
+		if (g_pattern_transitions[index*config_pattern_matching_history + i] > g_pattern_transitions[index*config_pattern_matching_history + predicted]) predicted = i;
+	}
+	//algorithms not tried with the predicted pattern go first, then the best one
+	if (PATTERN_MATCHING_can_select(config_agios_starting_algorithm) && (g_known_patterns[predicted].bandwidth[config_agios_starting_algorithm] == 0)) ret = config_agios_starting_algorithm;
+	for (int32_t i = 0; (i < IO_SCHEDULER_COUNT) && (ret < 0); i++) {
+		if (PATTERN_MATCHING_can_select(i) && (g_known_patterns[predicted].bandwidth[i] == 0)) ret = i;
+	}
+	if (ret < 0) {
+		ret = current_alg;
+		for (int32_t i = 0; i < IO_SCHEDULER_COUNT; i++) {
+			if (PATTERN_MATCHING_can_select(i) && (g_known_patterns[predicted].bandwidth[i] > g_known_patterns[predicted].bandwidth[ret])) ret = i;
+		}
+	}
+	debug("access pattern %d ended, predicting %d, selecting %s", index, predicted, get_algorithm_name_from_index(ret));
+	return ret;
+}
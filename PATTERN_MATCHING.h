@@ -0,0 +1,11 @@
+/*! \file PATTERN_MATCHING.h
+    \brief Headers for the implementation of the PATTERN_MATCHING dynamic scheduling algorithm.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+bool PATTERN_MATCHING_init(void);
+int32_t PATTERN_MATCHING_select(void);
+void cleanup_PATTERN_MATCHING(void);
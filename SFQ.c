@@ -0,0 +1,135 @@
+/*! \file SFQ.c
+    \brief Implementation of the SFQ (start-time fair queueing) scheduling algorithm.
+
+    SFQ gives each queue_id (usually an application) a share of the bandwidth proportional to its weight. Like TWINS, it uses the multi_timeline, with one FIFO queue per queue_id. Each queue has a finish tag, and the scheduler has a virtual time, which is the start tag of the last processed request. The first request of a queue has start tag max(virtual time, finish tag of the queue), and the request with the smallest start tag is processed. Then the finish tag of its queue becomes its start tag plus its size divided by the weight of the queue. A queue that was idle starts at the current virtual time, so it cannot accumulate credit, and a queue with a lot of requests (a checkpointing application, for instance) cannot delay the others by more than one request.
+    Weights are given in the configuration file (sfq_weights) or with agios_set_queue_weight, and can be changed while SFQ is used.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "agios.h"
+#include "agios_config.h"
+#include "agios_counters.h"
+#include "common_functions.h"
+#include "hash.h"
+#include "mylist.h"
+#include "process_request.h"
+#include "req_timeline.h"
+#include "scheduling_algorithms.h"
+#include "SFQ.h"
+#include "throttle.h"
+
+#define SFQ_COST_SHIFT 10 /**< request sizes are multiplied by 2^SFQ_COST_SHIFT before being divided by weights, so small requests with large weights still advance the tags. */
+
+static int32_t *g_SFQ_weights = NULL; /**< the weight of each queue of the multi_timeline. */
+static int64_t *g_SFQ_finish = NULL; /**< the finish tag of each queue of the multi_timeline. */
+static int64_t g_SFQ_vtime = 0; /**< the virtual time, start tag of the last processed request. */
+
+/**
+ * called by agios_init to create the weights of the queues (one per queue of the multi_timeline), from the sfq_weights configuration parameter. Queues without a weight in the configuration file have weight 1.
+ * @return true or false for success.
+ */
+bool init_SFQ_weights(void)
+{
+	if (multi_timeline_size == 0) return true; //SFQ cannot be used
+	g_SFQ_weights = malloc(sizeof(int32_t)*multi_timeline_size);
+	if (!g_SFQ_weights) return false;
+	for (int32_t i = 0; i < multi_timeline_size; i++) {
+		if (i < config_sfq_weights_len) g_SFQ_weights[i] = config_sfq_weights[i];
+		else g_SFQ_weights[i] = 1;
+	}
+	return true;
+}
+/**
+ * called by agios_exit to free the weights.
+ */
+void cleanup_SFQ_weights(void)
+{
+	if (g_SFQ_weights) {
+		free(g_SFQ_weights);
+		g_SFQ_weights = NULL;
+	}
+}
+/**
+ * function called by the user to change the weight of a queue_id, used by the SFQ scheduling algorithm. It can be called while SFQ is used, the new weight applies to requests processed from then on.
+ * @param queue_id the queue_id given to agios_add_request.
+ * @param weight the new weight, larger than 0. A queue_id with weight 2 receives twice the bandwidth of one with weight 1 (when both have requests).
+ * @return true or false for success (false if the weight is not valid or the queue_id is larger than the max_queue_id given to agios_init).
+ */
+bool agios_set_queue_weight(int32_t queue_id, int32_t weight)
+{
+	if ((!g_SFQ_weights) || (queue_id < 0) || (queue_id >= multi_timeline_size) || (weight <= 0)) return false;
+	__atomic_store_n(&g_SFQ_weights[queue_id], weight, __ATOMIC_RELAXED);
+	return true;
+}
+/**
+ * function called to initialize SFQ. All tags start at 0.
+ * @return true or false for success (false if agios_init was given no queues).
+ */
+bool SFQ_init(void)
+{
+	if ((multi_timeline_size == 0) || (!g_SFQ_weights)) {
+		agios_print("SFQ needs a max_queue_id larger than 0 in agios_init");
+		return false;
+	}
+	g_SFQ_finish = calloc(multi_timeline_size, sizeof(int64_t));
+	if (!g_SFQ_finish) return false;
+	g_SFQ_vtime = 0;
+	return true;
+}
+/**
+ * function called when stopping the use of SFQ, to free the tags.
+ */
+void SFQ_exit(void)
+{
+	if (g_SFQ_finish) {
+		free(g_SFQ_finish);
+		g_SFQ_finish = NULL;
+	}
+}
+/**
+ * main function for the SFQ scheduler. It is called by the AGIOS thread to schedule some requests. It will continue to consume requests until there are no more requests or if notified by the process_requests_step2 function.
+ * @return 0 (because we will never decide to sleep)
+ */
+int64_t SFQ(void)
+{
+	bool SFQ_stop=false; /**< the return of the process_requests_step2 function may notify us it is time to stop because of a periodic event */
+	struct request_t *req; /**< the request we will process */
+	int32_t chosen; /**< the queue with the smallest start tag */
+	int64_t start; /**< the start tag of the first request of a queue */
+	int64_t chosen_start = 0; /**< the start tag of the first request of the chosen queue */
+	int32_t hash; /**< after selecting a request to be processed, we need to find out its hash to give to the process_requests function */
+	struct processing_info_t *info; /**< the struct with information about requests to be processed, filled by process_requests_step1 and given as parameter to process_requests_step2 */
+
+	PRINT_FUNCTION_NAME;
+	while ((current_reqnb > 0) && (!SFQ_stop)) {
+		timeline_lock();
+		//find the queue whose first request has the smallest start tag
+		chosen = -1;
+		for (int32_t i = 0; i < multi_timeline_size; i++) {
+			if (agios_list_empty(&multi_timeline[i])) continue;
+			req = agios_list_entry(multi_timeline[i].next, struct request_t, related);
+			start = agios_max(g_SFQ_vtime, g_SFQ_finish[i]);
+			if (((chosen < 0) || (start < chosen_start)) && outstanding_allows(req->globalinfo->req_file, req->queue_id)) { //queues waiting for their limits on outstanding requests are left alone
+				chosen = i;
+				chosen_start = start;
+			}
+		}
+		if (chosen < 0) { //the requests we have were not added to the multi_timeline yet, or they are waiting for their limits
+			timeline_unlock();
+			break;
+		}
+		//process its first request and update the tags
+		req = agios_list_entry(multi_timeline[chosen].next, struct request_t, related);
+		agios_list_del(&req->related);
+		g_SFQ_vtime = chosen_start;
+		g_SFQ_finish[chosen] = chosen_start + (req->len << SFQ_COST_SHIFT) / __atomic_load_n(&g_SFQ_weights[chosen], __ATOMIC_RELAXED);
+		hash = get_hashtable_position(req->file_id);
+		info = process_requests_step1(req, hash);
+		generic_post_process(req);
+		timeline_unlock();
+		SFQ_stop = process_requests_step2(info);
+	}
+	return 0;
+}
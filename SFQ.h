@@ -0,0 +1,13 @@
+/*! \file SFQ.h
+    \brief Headers for the implementation of the SFQ scheduling algorithm.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+bool init_SFQ_weights(void);
+void cleanup_SFQ_weights(void);
+bool SFQ_init(void);
+int64_t SFQ(void);
+void SFQ_exit(void);
@@ -15,9 +15,10 @@
 #include "process_request.h"
 #include "req_hashtable.h"
 #include "scheduling_algorithms.h"
+#include "throttle.h"
 
 /**
- * answers if a queue could be selected to process requests, given a current minimum queue size. The queue may only be selected if it has requests in it and its size is smaller than the provided min size.
+ * answers if a queue could be selected to process requests, given a current minimum queue size. The queue may only be selected if it has requests in it, its size is smaller than the provided min size, and its limits on outstanding requests allow it.
  * @param queue the queue.
  * @param min_size the current minimum queue size.
  * @return true or false if the queue is to be selected or not.
@@ -26,14 +27,14 @@ bool SJF_check_queue(struct queue_t *queue, int64_t min_size)
 {
 	if (queue->current_size <= 0) return false; //we dont have requests, cannot select this queue
 	else {
-		if (queue->current_size < min_size) return true;
+		if (queue->current_size < min_size) return outstanding_allows(queue->req_file, agios_list_entry(queue->list.next, struct request_t, related)->queue_id);
 		else return false;
 	}
 }
 /**
  * goes over the whole hashtable to find the shortest queue. The caller must NOT hold the mutex for any line of the hashtable.
  * @param current_hash the line of the hashtable where the returned request is (it will be modified by this function). 
- * @return the shortest queue that contains requests, NULL if we can't find one.
+ * @return the shortest queue that contains requests and is allowed by its limits on outstanding requests, NULL if we can't find one.
  */
 struct queue_t *SJF_get_shortest_job(int32_t *current_hash)
 {
@@ -101,7 +102,7 @@ int64_t SJF(void)
 				hashtable_unlock(SJF_current_hash);
 				SJF_stop = process_requests_step2(info);
 			} else hashtable_unlock(SJF_current_hash);
-		}
+		} else break; //all queues are waiting for their limits on outstanding requests
 	}
 	return 0;
 }
@@ -3,4 +3,7 @@
  */
 #pragma once
 
+#include "agios_request.h"
+
+struct queue_t *SJF_get_shortest_job(int32_t *current_hash);
 int64_t SJF(void);
@@ -27,7 +27,10 @@ int64_t timeorder(void)
 	while ((current_reqnb > 0) && (TO_stop == false)) {
 		timeline_lock();
 		req = timeline_oldest_req(&hash);
-		assert(req); //sanity check
+		if (!req) { //the requests we have were not added to the timeline yet, or they are waiting for their limits on outstanding requests
+			timeline_unlock();
+			break;
+		}
 		info = process_requests_step1(req, hash); 
 		generic_post_process(req);
 		timeline_unlock();
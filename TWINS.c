@@ -18,6 +18,7 @@
 #include "req_hashtable.h"
 #include "req_timeline.h"
 #include "scheduling_algorithms.h"
+#include "throttle.h"
 
 static bool g_twins_first_req; /**< used to know when twins is being used for the first time (so we'll reset it) */
 static int g_current_twins_server; /**< the current queue from where we are taking requests */
@@ -68,9 +69,13 @@ int64_t TWINS(void)
 			debug("time is up, moving on to window %d", g_current_twins_server);
 		}
 		//process requests!
+		req = NULL;
 		if (!(agios_list_empty(&(multi_timeline[g_current_twins_server])))) { //we can only process requests from the current app_id
 			//take request from the right queue
 			req = agios_list_entry(multi_timeline[g_current_twins_server].next, struct request_t, related);
+			if (!outstanding_allows(req->globalinfo->req_file, req->queue_id)) req = NULL; //we have to wait for its limits on outstanding requests
+		}
+		if (req) {
 			//remove from the queue
 			agios_list_del(&req->related);
 			/*send it back to the file system*/
@@ -80,7 +85,7 @@ int64_t TWINS(void)
 			generic_post_process(req);
 			timeline_unlock();
 			TWINS_stop = process_requests_step2(info);
-		} else { //if there are no requests for this queue, we return control to the AGIOS thread and it will sleep a little 
+		} else { //if there are no requests for this queue (or they are waiting for their limits), we return control to the AGIOS thread and it will sleep a little 
 			timeline_unlock();
 			break; //get out of the while 
 		}
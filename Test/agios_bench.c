@@ -0,0 +1,337 @@
+/*! \file agios_bench.c
+    \brief Benchmark of the AGIOS library with synthetic workloads, to compare the cost and the behavior of the scheduling algorithms.
+
+    A number of client threads generate requests following one of the workload generators and give them to AGIOS, either in a closed loop (each client keeps a fixed number of outstanding requests) or in an open loop (Poisson arrivals at a given rate). Requests given back by AGIOS are served by a fixed pool of worker threads following a service-time model (see replay_common.c). For each scheduling algorithm we report throughput, latency, the time spent in agios_add_request and agios_release_request, and the CPU time used by the agios thread (the CPU time of the process minus the time used by the benchmark threads).
+    @see replay_common.c
+ */
+#define _GNU_SOURCE
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <agios.h>
+
+#include "replay_common.h"
+
+char * get_algorithm_name_from_index(int32_t index); /**< from scheduling_algorithms.c, used to go through all algorithms in io_schedulers[] */
+
+/*! \struct bench_generator_t
+    \brief A workload generator, that gives the file and offset of the i-th request of a client.
+ */
+struct bench_generator_t {
+	const char *name; /**< used to select the generator in the command line */
+	const char *description;
+	void (*generate)(int32_t client, int64_t i, int32_t *file, int64_t *offset); /**< the generator itself */
+};
+/*! \struct bench_client_t
+    \brief A thread issuing requests.
+ */
+struct bench_client_t {
+	pthread_t thread;
+	int32_t index;
+	int32_t outstanding; /**< requests given to AGIOS and not released yet (closed loop) */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
+int32_t g_clientnb=16;
+int64_t g_reqnb_perclient=1000;
+int32_t g_workers=16;
+bool g_open_loop=false;
+double g_rate=10000.0; /**< open loop: requests per second (all clients together) */
+int32_t g_depth=1; /**< closed loop: outstanding requests per client */
+int64_t g_req_size=65536;
+int64_t g_file_size=1L << 30; /**< random generator: requests fall inside the file */
+int32_t g_filenb=1000; /**< smallfiles generator: number of files */
+int32_t g_read_percent=100;
+int32_t g_queue_ids=1; /**< queue_id given to agios_add_request is the client index modulo this */
+uint32_t g_seed=1; /**< used to generate requests */
+char **g_file_names=NULL;
+int32_t g_file_namenb=0;
+struct bench_generator_t *g_generator=NULL;
+struct bench_client_t *g_clients=NULL;
+int64_t g_clients_cpu_time=0; /**< CPU time (ns) used by the client threads */
+
+/*
+ * workload generators
+ */
+/* all clients share file 0, and their requests are interleaved: client c accesses blocks c, c+clients, c+2*clients... */
+void strided_generate(int32_t client, int64_t i, int32_t *file, int64_t *offset)
+{
+	*file = 0;
+	*offset = ((i * g_clientnb) + client) * g_req_size;
+}
+/* each client accesses its own file at random aligned offsets */
+void random_generate(int32_t client, int64_t i, int32_t *file, int64_t *offset)
+{
+	*file = client;
+	*offset = (int64_t)((g_file_size / g_req_size) * (rand_r(&g_seed) / (RAND_MAX + 1.0))) * g_req_size;
+}
+/* all clients share file 0, each one accesses its own contiguous segment sequentially (N-to-1 segmented) */
+void shared_generate(int32_t client, int64_t i, int32_t *file, int64_t *offset)
+{
+	*file = 0;
+	*offset = ((client * g_reqnb_perclient) + i) * g_req_size;
+}
+/* each request reads or writes a whole small file, chosen at random among g_filenb */
+void smallfiles_generate(int32_t client, int64_t i, int32_t *file, int64_t *offset)
+{
+	*file = (int32_t)(g_filenb * (rand_r(&g_seed) / (RAND_MAX + 1.0)));
+	*offset = 0;
+}
+struct bench_generator_t g_generators[] = {
+	{.name = "strided", .description = "all clients share a file, with interleaved accesses", .generate = strided_generate},
+	{.name = "random", .description = "each client accesses its own file at random offsets (see -F)", .generate = random_generate},
+	{.name = "shared", .description = "all clients share a file, each one accesses its own segment sequentially (N-to-1)", .generate = shared_generate},
+	{.name = "smallfiles", .description = "each request accesses a whole small file (see -f)", .generate = smallfiles_generate},
+};
+#define GENERATOR_COUNT (sizeof(g_generators) / sizeof(g_generators[0]))
+
+/**
+ * generates all requests in g_reqs (client c issues requests c*g_reqnb_perclient to (c+1)*g_reqnb_perclient-1). In open loop, timestamps are the arrival times (each client has Poisson arrivals at g_rate/g_clientnb, so together they have Poisson arrivals at g_rate).
+ */
+void generate_requests(void)
+{
+	char name[64];
+	int32_t file;
+	int64_t offset, timestamp;
+
+	g_file_namenb = (g_generator->generate == smallfiles_generate) ? g_filenb : g_clientnb;
+	g_file_names = malloc(sizeof(char *)*g_file_namenb);
+	assert(g_file_names);
+	for (int32_t i = 0; i < g_file_namenb; i++) {
+		snprintf(name, sizeof(name), "bench.%d.out", i);
+		g_file_names[i] = strdup(name);
+	}
+	for (int32_t client = 0; client < g_clientnb; client++) {
+		timestamp = 0;
+		for (int64_t i = 0; i < g_reqnb_perclient; i++) {
+			g_generator->generate(client, i, &file, &offset);
+			if (g_open_loop) timestamp += (int64_t)(-log(1.0 - (rand_r(&g_seed) / (RAND_MAX + 1.0))) * ((g_clientnb * 1000000000.0) / g_rate));
+			add_trace_request(g_file_names[file],
+					((rand_r(&g_seed) % 100) < g_read_percent) ? RT_READ : RT_WRITE,
+					offset,
+					g_req_size,
+					client % g_queue_ids,
+					timestamp);
+			g_reqs[g_reqnb-1].client = client;
+		}
+	}
+}
+/*
+ * clients
+ */
+void client_release(int64_t req)
+{
+	struct bench_client_t *client = &g_clients[g_reqs[req].client];
+
+	pthread_mutex_lock(&client->mutex);
+	client->outstanding--;
+	pthread_cond_signal(&client->cond);
+	pthread_mutex_unlock(&client->mutex);
+}
+void * client_thr(void *arg)
+{
+	struct bench_client_t *me = arg;
+	struct replay_req_t *req;
+	int64_t first = me->index * g_reqnb_perclient;
+	int64_t start = get_now();
+	int64_t target;
+	struct timespec timeout;
+
+	for (int64_t i = first; i < first + g_reqnb_perclient; i++) {
+		req = &g_reqs[i];
+		if (g_open_loop) {
+			target = start + req->timestamp;
+			timeout.tv_sec = target / 1000000000L;
+			timeout.tv_nsec = target % 1000000000L;
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &timeout, NULL);
+		} else {
+			pthread_mutex_lock(&me->mutex);
+			while (me->outstanding >= g_depth) pthread_cond_wait(&me->cond, &me->mutex);
+			me->outstanding++;
+			pthread_mutex_unlock(&me->mutex);
+		}
+		req->add_time = get_now();
+		if (!agios_add_request(req->file_id, req->type, req->offset, req->len, i, req->queue_id)) {
+			printf("PANIC! agios_add_request failed!\n");
+			exit(1);
+		}
+		req->add_call = get_now() - req->add_time;
+	}
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &timeout);
+	__sync_fetch_and_add(&g_clients_cpu_time, (timeout.tv_sec * 1000000000L) + timeout.tv_nsec);
+	return 0;
+}
+/*
+ * reporting
+ */
+void print_bench_report_header(void)
+{
+	printf("%-8s %10s %8s %10s %10s %8s %8s %8s %8s %8s %8s %10s %8s %6s\n", "alg", "reqs/s", "MB/s", "lat p50", "lat p99", "add p50", "add p99", "add p999", "rel p50", "rel p99", "rel p999", "sched cpu", "cpu/req", "avg");
+	printf("%-8s %10s %8s %10s %10s %8s %8s %8s %8s %8s %8s %10s %8s %6s\n", "", "", "", "(us)", "(us)", "(ns)", "(ns)", "(ns)", "(ns)", "(ns)", "(ns)", "(ms)", "(ns)", "group");
+	fflush(stdout);
+}
+void print_bench_report(const char *algorithm, int64_t elapsed, int64_t sched_cpu_time)
+{
+	int64_t *latencies = malloc(sizeof(int64_t)*g_reqnb);
+	int64_t *adds = malloc(sizeof(int64_t)*g_reqnb);
+	int64_t *releases = malloc(sizeof(int64_t)*g_reqnb);
+	int64_t bytes = 0;
+
+	assert(latencies && adds && releases);
+	for (int64_t i = 0; i < g_reqnb; i++) {
+		latencies[i] = g_reqs[i].release_time - g_reqs[i].add_time;
+		adds[i] = g_reqs[i].add_call;
+		releases[i] = g_reqs[i].release_call;
+		bytes += g_reqs[i].len;
+	}
+	qsort(latencies, g_reqnb, sizeof(int64_t), compare_int64);
+	qsort(adds, g_reqnb, sizeof(int64_t), compare_int64);
+	qsort(releases, g_reqnb, sizeof(int64_t), compare_int64);
+	printf("%-8s %10.1f %8.2f %10.1f %10.1f %8ld %8ld %8ld %8ld %8ld %8ld %10.1f %8ld %6.2f\n",
+		algorithm,
+		(g_reqnb * 1000000000.0) / elapsed,
+		(bytes * 1000.0) / elapsed,
+		get_percentile(latencies, g_reqnb, 50.0) / 1000.0,
+		get_percentile(latencies, g_reqnb, 99.0) / 1000.0,
+		get_percentile(adds, g_reqnb, 50.0),
+		get_percentile(adds, g_reqnb, 99.0),
+		get_percentile(adds, g_reqnb, 99.9),
+		get_percentile(releases, g_reqnb, 50.0),
+		get_percentile(releases, g_reqnb, 99.0),
+		get_percentile(releases, g_reqnb, 99.9),
+		sched_cpu_time / 1000000.0,
+		sched_cpu_time / g_reqnb,
+		(double) g_reqnb / g_dispatchnb);
+	fflush(stdout);
+	free(latencies);
+	free(adds);
+	free(releases);
+}
+/**
+ * runs the benchmark with a scheduling algorithm. Runs in its own process, so AGIOS starts from scratch every time.
+ */
+void bench(const char *algorithm, char *config_file)
+{
+	int64_t start, elapsed, process_cpu_time, main_cpu_time;
+	struct timespec cpu_time;
+
+	if (!agios_init(replay_process, replay_process_list, config_file, g_queue_ids)) {
+		printf("PANIC! Could not initialize AGIOS with %s!\n", algorithm);
+		unlink(config_file);
+		exit(1);
+	}
+	g_release_callback = g_open_loop ? NULL : client_release;
+	start_workers(g_workers);
+	g_clients = malloc(sizeof(struct bench_client_t)*g_clientnb);
+	assert(g_clients);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_time);
+	process_cpu_time = (cpu_time.tv_sec * 1000000000L) + cpu_time.tv_nsec;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_time);
+	main_cpu_time = (cpu_time.tv_sec * 1000000000L) + cpu_time.tv_nsec;
+	start = get_now();
+	for (int32_t i = 0; i < g_clientnb; i++) {
+		g_clients[i].index = i;
+		g_clients[i].outstanding = 0;
+		pthread_mutex_init(&g_clients[i].mutex, NULL);
+		pthread_cond_init(&g_clients[i].cond, NULL);
+		if (pthread_create(&g_clients[i].thread, NULL, client_thr, &g_clients[i]) != 0) {
+			printf("PANIC! Unable to create client thread %d!\n", i);
+			exit(1);
+		}
+	}
+	wait_for_releases();
+	elapsed = get_now() - start;
+	for (int32_t i = 0; i < g_clientnb; i++) pthread_join(g_clients[i].thread, NULL);
+	stop_workers();
+	//the CPU time used by the process since the beginning of the run, minus the time used by our threads, is the time used by the agios thread
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_time);
+	main_cpu_time = (cpu_time.tv_sec * 1000000000L) + cpu_time.tv_nsec - main_cpu_time;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_time);
+	process_cpu_time = (cpu_time.tv_sec * 1000000000L) + cpu_time.tv_nsec - process_cpu_time;
+	agios_exit();
+	print_bench_report(algorithm, elapsed, process_cpu_time - main_cpu_time - g_clients_cpu_time - g_workers_cpu_time);
+	free(g_clients);
+}
+void usage(char *name)
+{
+	printf("Usage: %s [-g <generator>] [-l closed|open] [-d <depth>] [-r <rate>] [-t <clients>] [-n <requests per client>] [-b <request size>] [-F <file size>] [-f <files>] [-R <read percent>] [-q <queue ids>] [-m <model>] [-w <workers>] [-a <algorithms>] [-c <config file>] [-e <seed>]\n", name);
+	printf("\t-g: workload generator (default strided), one of:\n");
+	for (int32_t i = 0; i < GENERATOR_COUNT; i++) printf("\t\t%s: %s\n", g_generators[i].name, g_generators[i].description);
+	printf("\t-l: closed loop (each client keeps depth outstanding requests) or open loop (Poisson arrivals at rate requests/s) (default closed)\n");
+	printf("\t-d: outstanding requests per client in closed loop (default 1)\n");
+	printf("\t-r: requests per second (all clients together) in open loop (default 10000)\n");
+	printf("\t-t: number of client threads (default 16)\n");
+	printf("\t-n: number of requests issued by each client (default 1000)\n");
+	printf("\t-b: request size in bytes (default 65536)\n");
+	printf("\t-F: file size in bytes for the random generator (default 1GB)\n");
+	printf("\t-f: number of files for the smallfiles generator (default 1000)\n");
+	printf("\t-R: percentage of reads (default 100)\n");
+	printf("\t-q: number of queue ids (servers or applications) used by SW and TWINS, given round-robin to clients (default 1)\n");
+	printf("\t-m: service-time model (default none), one of:\n");
+	print_service_models_usage();
+	printf("\t-w: number of worker threads serving requests (default 16)\n");
+	printf("\t-a: comma-separated list of scheduling algorithms to compare (default all)\n");
+	printf("\t-c: configuration file used as base for all runs (default /tmp/agios.conf)\n");
+	printf("\t-e: random seed (default 1)\n");
+	exit(1);
+}
+int main(int argc, char **argv)
+{
+	char model[256] = "none";
+	char algorithms[256] = "";
+	char *generator = "strided";
+	char *base_config = "/tmp/agios.conf";
+	char *name;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "g:l:d:r:t:n:b:F:f:R:q:m:w:a:c:e:")) != -1) {
+		switch (opt) {
+			case 'g': generator = optarg; break;
+			case 'l':
+				if (strcmp(optarg, "open") == 0) g_open_loop = true;
+				else if (strcmp(optarg, "closed") == 0) g_open_loop = false;
+				else usage(argv[0]);
+				break;
+			case 'd': g_depth = atoi(optarg); break;
+			case 'r': g_rate = atof(optarg); break;
+			case 't': g_clientnb = atoi(optarg); break;
+			case 'n': g_reqnb_perclient = atol(optarg); break;
+			case 'b': g_req_size = atol(optarg); break;
+			case 'F': g_file_size = atol(optarg); break;
+			case 'f': g_filenb = atoi(optarg); break;
+			case 'R': g_read_percent = atoi(optarg); break;
+			case 'q': g_queue_ids = atoi(optarg); break;
+			case 'm': snprintf(model, sizeof(model), "%s", optarg); break;
+			case 'w': g_workers = atoi(optarg); break;
+			case 'a': snprintf(algorithms, sizeof(algorithms), "%s", optarg); break;
+			case 'c': base_config = optarg; break;
+			case 'e': g_seed = (uint32_t) atol(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+	for (int32_t i = 0; i < GENERATOR_COUNT; i++) {
+		if (strcmp(generator, g_generators[i].name) == 0) g_generator = &g_generators[i];
+	}
+	if ((!g_generator) || (g_depth <= 0) || (g_rate <= 0.0) || (g_clientnb <= 0) || (g_reqnb_perclient <= 0) || (g_req_size <= 0) || (g_file_size < g_req_size) || (g_filenb <= 0) || (g_read_percent < 0) || (g_read_percent > 100) || (g_queue_ids <= 0) || (g_workers <= 0)) usage(argv[0]);
+	if (!parse_service_model(model)) usage(argv[0]);
+	if (algorithms[0] == '\0') { //all algorithms from io_schedulers[]
+		for (int32_t i = 0; (name = get_algorithm_name_from_index(i)); i++) {
+			if (i > 0) strncat(algorithms, ",", sizeof(algorithms) - strlen(algorithms) - 1);
+			strncat(algorithms, name, sizeof(algorithms) - strlen(algorithms) - 1);
+		}
+	}
+	generate_requests();
+	if (g_open_loop) printf("Benchmarking %ld requests of %ld bytes from %d clients (%s), open loop at %.1f requests/s, %d workers, service model %s\n", g_reqnb, g_req_size, g_clientnb, g_generator->name, g_rate, g_workers, g_model->name);
+	else printf("Benchmarking %ld requests of %ld bytes from %d clients (%s), closed loop with depth %d, %d workers, service model %s\n", g_reqnb, g_req_size, g_clientnb, g_generator->name, g_depth, g_workers, g_model->name);
+	print_bench_report_header();
+	run_algorithms(algorithms, base_config, bench);
+	return 0;
+}
@@ -0,0 +1,340 @@
+/*! \file agios_micro.c
+    \brief Microbenchmarks of agios_add_request, agios_cancel_request, agios_release_request and of the scheduler, as a function of the number of files and of queued requests.
+
+    Uses the simulation build (libagios_sim.so), where there is no agios thread, so requests stay queued until we call agios_sim_run. For each scheduling algorithm (in its own process), number of files N, number of queued requests per file M and number of threads T, we:
+    1. queue N*M read requests at scattered offsets (not timed),
+    2. add: T threads add K requests each (to random files), timing every call,
+    3. cancel: the same threads cancel these requests, so we are back to N*M queued requests,
+    4. schedule: call agios_sim_run (advancing the virtual clock by the waiting times it asks for) until all requests were given back, timing every call,
+    5. release: T threads release K requests each (in random order), timing every call, then the remaining ones are released.
+    Results are printed as CSV or JSON lines, one line per operation, so runs can be compared to catch regressions. The library is built with AGIOS_DEBUG by default, which prints on every call, so for meaningful numbers build it with "make simulation ccflags-y=".
+    @see replay_common.c
+ */
+#define _GNU_SOURCE
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <agios.h>
+#include <agios_sim.h>
+
+#include "replay_common.h"
+
+char * get_algorithm_name_from_index(int32_t index); /**< from scheduling_algorithms.c, used to go through all algorithms in io_schedulers[] */
+
+#define MICRO_REQ_SIZE 4096
+#define MICRO_MAX_VALUES 16
+#define micro_max(a, b) (((a) > (b)) ? (a) : (b))
+#define micro_min(a, b) (((a) < (b)) ? (a) : (b))
+
+/*! \struct micro_req_t
+    \brief A request used in the microbenchmark.
+ */
+struct micro_req_t {
+	char *file_id;
+	int64_t offset;
+	bool dispatched; /**< AGIOS gave it back */
+};
+/*! \struct micro_thread_t
+    \brief A thread timing calls to the library.
+ */
+struct micro_thread_t {
+	pthread_t thread;
+	int32_t index;
+	int64_t *durations; /**< this thread's part of the array of durations of the current operation */
+	int32_t failed; /**< calls that returned false */
+	int64_t start; /**< when it started calling the library */
+	int64_t end; /**< when it finished */
+};
+
+int32_t g_files[MICRO_MAX_VALUES] = {1, 16, 64}; /**< values of N */
+int32_t g_filesnb = 3;
+int32_t g_depths[MICRO_MAX_VALUES] = {16, 256, 1024}; /**< values of M */
+int32_t g_depthsnb = 3;
+int32_t g_threads[MICRO_MAX_VALUES] = {1, 4}; /**< values of T */
+int32_t g_threadsnb = 2;
+int32_t g_calls=1000; /**< K */
+bool g_json=false;
+uint32_t g_seed=1;
+
+char **g_file_names=NULL;
+struct micro_req_t *g_micro_reqs=NULL;
+int64_t g_queuednb=0; /**< N*M, requests 0 to N*M-1 are queued in the first step, the next T*K are added in the second */
+int64_t *g_dispatched=NULL; /**< ids of the requests given back by AGIOS, in order */
+int64_t g_dispatchednb=0;
+int32_t g_threadnb=1; /**< T for the current run */
+int32_t g_filenb=1; /**< N for the current run */
+int32_t g_operation=0; /**< what the threads are doing now */
+int32_t g_thread_calls=0; /**< how many calls each thread makes in the current operation (K, or less for releases if fewer requests were queued) */
+pthread_barrier_t g_start_barrier;
+int64_t *g_durations=NULL;
+
+enum {
+	MICRO_ADD = 0,
+	MICRO_CANCEL = 1,
+	MICRO_SCHEDULE = 2,
+	MICRO_RELEASE = 3,
+};
+const char *g_operation_names[] = {"add", "cancel", "schedule", "release"};
+
+/**
+ * gives distinct offsets that are scattered over the file, so queues are not filled in offset order.
+ */
+int64_t scattered_offset(int64_t seq)
+{
+	return ((int64_t)(((uint64_t) seq * 2654435761UL) & 0xFFFFFFFFUL)) * MICRO_REQ_SIZE;
+}
+/*
+ * callbacks
+ */
+void mark_dispatched(int64_t req_id)
+{
+	g_micro_reqs[req_id].dispatched = true;
+	g_dispatched[__sync_fetch_and_add(&g_dispatchednb, 1)] = req_id; //with NOOP, callbacks come from agios_add_request in multiple threads
+}
+void * micro_process(int64_t req_id)
+{
+	mark_dispatched(req_id);
+	return 0;
+}
+void * micro_process_list(int64_t *reqs, int32_t reqnb)
+{
+	for (int32_t i = 0; i < reqnb; i++) mark_dispatched(reqs[i]);
+	return 0;
+}
+/*
+ * timed operations
+ */
+void * micro_thr(void *arg)
+{
+	struct micro_thread_t *me = arg;
+	struct micro_req_t *req;
+	int64_t id, start;
+	bool ret = true;
+
+	pthread_barrier_wait(&g_start_barrier);
+	me->start = get_now();
+	for (int32_t i = 0; i < g_thread_calls; i++) {
+		if (g_operation == MICRO_RELEASE) id = g_dispatched[(me->index * g_thread_calls) + i];
+		else id = g_queuednb + (me->index * g_thread_calls) + i;
+		req = &g_micro_reqs[id];
+		start = get_now();
+		switch (g_operation) {
+			case MICRO_ADD: ret = agios_add_request(req->file_id, RT_READ, req->offset, MICRO_REQ_SIZE, id, 0); break;
+			case MICRO_CANCEL: ret = agios_cancel_request(req->file_id, RT_READ, MICRO_REQ_SIZE, req->offset); break;
+			case MICRO_RELEASE: ret = agios_release_request(req->file_id, RT_READ, MICRO_REQ_SIZE, req->offset); break;
+		}
+		me->durations[i] = get_now() - start;
+		if (!ret) me->failed++;
+	}
+	me->end = get_now();
+	return 0;
+}
+void print_result(const char *algorithm, int32_t operation, int32_t depth, int64_t *durations, int64_t calls, int32_t failed, int64_t elapsed)
+{
+	int64_t total = 0;
+
+	if (calls == 0) return;
+	for (int64_t i = 0; i < calls; i++) total += durations[i];
+	qsort(durations, calls, sizeof(int64_t), compare_int64);
+	if (g_json) printf("{\"algorithm\": \"%s\", \"operation\": \"%s\", \"threads\": %d, \"files\": %d, \"depth\": %d, \"calls\": %ld, \"failed\": %d, \"mean_ns\": %.1f, \"p50_ns\": %ld, \"p99_ns\": %ld, \"p999_ns\": %ld, \"max_ns\": %ld, \"calls_per_s\": %.1f}\n",
+		algorithm, g_operation_names[operation], g_threadnb, g_filenb, depth, calls, failed, (double) total / calls,
+		get_percentile(durations, calls, 50.0), get_percentile(durations, calls, 99.0), get_percentile(durations, calls, 99.9), durations[calls-1],
+		(calls * 1000000000.0) / elapsed);
+	else printf("%s,%s,%d,%d,%d,%ld,%d,%.1f,%ld,%ld,%ld,%ld,%.1f\n",
+		algorithm, g_operation_names[operation], g_threadnb, g_filenb, depth, calls, failed, (double) total / calls,
+		get_percentile(durations, calls, 50.0), get_percentile(durations, calls, 99.0), get_percentile(durations, calls, 99.9), durations[calls-1],
+		(calls * 1000000000.0) / elapsed);
+	fflush(stdout);
+}
+/**
+ * runs one of the timed operations with g_threadnb threads and prints the results.
+ */
+void run_threads(const char *algorithm, int32_t operation, int32_t depth, int32_t calls)
+{
+	struct micro_thread_t *threads = calloc(g_threadnb, sizeof(struct micro_thread_t));
+	int32_t failed = 0;
+	int64_t start = INT64_MAX, end = 0;
+
+	assert(threads);
+	g_operation = operation;
+	g_thread_calls = calls;
+	pthread_barrier_init(&g_start_barrier, NULL, g_threadnb+1);
+	for (int32_t i = 0; i < g_threadnb; i++) {
+		threads[i].index = i;
+		threads[i].durations = &g_durations[i * calls];
+		if (pthread_create(&threads[i].thread, NULL, micro_thr, &threads[i]) != 0) {
+			printf("PANIC! Unable to create thread %d!\n", i);
+			exit(1);
+		}
+	}
+	pthread_barrier_wait(&g_start_barrier);
+	for (int32_t i = 0; i < g_threadnb; i++) {
+		pthread_join(threads[i].thread, NULL);
+		failed += threads[i].failed;
+		start = micro_min(start, threads[i].start);
+		end = micro_max(end, threads[i].end);
+	}
+	print_result(algorithm, operation, depth, g_durations, (int64_t) g_threadnb * calls, failed, end - start);
+	pthread_barrier_destroy(&g_start_barrier);
+	free(threads);
+}
+/**
+ * one run of the microbenchmark, with N files, M requests per file and T threads.
+ */
+void micro_run(const char *algorithm, char *config_file, int32_t filenb, int32_t depth, int32_t threadnb)
+{
+	int64_t reqnb, id, tmp, start, elapsed, calls = 0, now = 0, waiting_time = 0;
+	int64_t *durations;
+	bool wake_on_arrival;
+
+	g_filenb = filenb;
+	g_threadnb = threadnb;
+	g_queuednb = (int64_t) filenb * depth;
+	reqnb = g_queuednb + ((int64_t) threadnb * g_calls);
+	g_micro_reqs = malloc(sizeof(struct micro_req_t)*reqnb);
+	g_dispatched = malloc(sizeof(int64_t)*reqnb);
+	g_durations = malloc(sizeof(int64_t)*micro_max(reqnb, (int64_t) threadnb * g_calls));
+	assert(g_micro_reqs && g_dispatched && g_durations);
+	for (int64_t i = 0; i < reqnb; i++) {
+		g_micro_reqs[i].file_id = g_file_names[(i < g_queuednb) ? (i % filenb) : (rand_r(&g_seed) % filenb)];
+		g_micro_reqs[i].offset = scattered_offset(i);
+		g_micro_reqs[i].dispatched = false;
+	}
+	g_dispatchednb = 0;
+	agios_sim_set_time(now);
+	if (!agios_init(micro_process, micro_process_list, config_file, 1)) {
+		printf("PANIC! Could not initialize AGIOS with %s!\n", algorithm);
+		unlink(config_file);
+		exit(1);
+	}
+	//1. queue N*M requests
+	for (int64_t i = 0; i < g_queuednb; i++) {
+		if (!agios_add_request(g_micro_reqs[i].file_id, RT_READ, g_micro_reqs[i].offset, MICRO_REQ_SIZE, i, 0)) {
+			printf("PANIC! agios_add_request failed!\n");
+			exit(1);
+		}
+	}
+	//2. and 3. add and cancel T*K requests
+	run_threads(algorithm, MICRO_ADD, depth, g_calls);
+	run_threads(algorithm, MICRO_CANCEL, depth, g_calls);
+	//4. schedule everything that is still queued (with NOOP the requests were given back when they were added, and the ones we could not cancel are released with the others)
+	durations = g_durations;
+	start = get_now();
+	while (waiting_time >= 0) {
+		agios_sim_set_time(now);
+		tmp = get_now();
+		waiting_time = agios_sim_run(&wake_on_arrival);
+		durations[calls++] = get_now() - tmp;
+		now += (waiting_time > 0) ? waiting_time : 1000;
+		if (calls >= micro_max(reqnb, (int64_t) threadnb * g_calls)) break; //we only have room for this many durations, schedulers that give back one request per call stop here
+	}
+	elapsed = get_now() - start;
+	while (agios_sim_run(&wake_on_arrival) >= 0) agios_sim_set_time(now += 1000); //if we stopped timing early
+	print_result(algorithm, MICRO_SCHEDULE, depth, durations, calls, 0, elapsed);
+	//5. release in random order
+	for (int64_t i = g_dispatchednb - 1; i > 0; i--) {
+		id = rand_r(&g_seed) % (i + 1);
+		tmp = g_dispatched[i];
+		g_dispatched[i] = g_dispatched[id];
+		g_dispatched[id] = tmp;
+	}
+	tmp = micro_min((int64_t) g_calls, g_dispatchednb / threadnb);
+	if (tmp > 0) run_threads(algorithm, MICRO_RELEASE, depth, (int32_t) tmp);
+	start = tmp * threadnb;
+	for (int64_t i = start; i < g_dispatchednb; i++) {
+		if (!agios_release_request(g_micro_reqs[g_dispatched[i]].file_id, RT_READ, MICRO_REQ_SIZE, g_micro_reqs[g_dispatched[i]].offset)) printf("PANIC! release request failed!\n");
+	}
+	agios_exit();
+	free(g_micro_reqs);
+	free(g_dispatched);
+	free(g_durations);
+}
+/**
+ * runs all combinations of N, M and T with a scheduling algorithm. Runs in its own process, so AGIOS starts from scratch every time.
+ */
+void micro(const char *algorithm, char *config_file)
+{
+	for (int32_t f = 0; f < g_filesnb; f++) {
+		for (int32_t d = 0; d < g_depthsnb; d++) {
+			for (int32_t t = 0; t < g_threadsnb; t++) micro_run(algorithm, config_file, g_files[f], g_depths[d], g_threads[t]);
+		}
+	}
+}
+/**
+ * parses a comma-separated list of positive integers.
+ * @return the number of values, 0 on error.
+ */
+int32_t parse_list(char *list, int32_t *values)
+{
+	int32_t nb = 0;
+
+	for (char *value = strtok(list, ","); value; value = strtok(NULL, ",")) {
+		if ((nb >= MICRO_MAX_VALUES) || (atoi(value) <= 0)) return 0;
+		values[nb++] = atoi(value);
+	}
+	return nb;
+}
+void usage(char *name)
+{
+	printf("Usage: %s [-f <files>] [-d <depths>] [-t <threads>] [-k <calls>] [-o csv|json] [-a <algorithms>] [-c <config file>] [-e <seed>]\n", name);
+	printf("\t-f: comma-separated list of numbers of files (default 1,16,64)\n");
+	printf("\t-d: comma-separated list of numbers of queued requests per file (default 16,256,1024)\n");
+	printf("\t-t: comma-separated list of numbers of threads (default 1,4)\n");
+	printf("\t-k: number of timed calls per thread and operation (default 1000)\n");
+	printf("\t-o: output format, CSV or one JSON object per line (default csv)\n");
+	printf("\t-a: comma-separated list of scheduling algorithms to compare (default all)\n");
+	printf("\t-c: configuration file used as base for all runs (default /tmp/agios.conf)\n");
+	printf("\t-e: random seed (default 1)\n");
+	exit(1);
+}
+int main(int argc, char **argv)
+{
+	char algorithms[256] = "";
+	char *base_config = "/tmp/agios.conf";
+	char name[64];
+	char *alg_name;
+	int32_t max_files = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:d:t:k:o:a:c:e:")) != -1) {
+		switch (opt) {
+			case 'f': if (!(g_filesnb = parse_list(optarg, g_files))) usage(argv[0]); break;
+			case 'd': if (!(g_depthsnb = parse_list(optarg, g_depths))) usage(argv[0]); break;
+			case 't': if (!(g_threadsnb = parse_list(optarg, g_threads))) usage(argv[0]); break;
+			case 'k': g_calls = atoi(optarg); break;
+			case 'o':
+				if (strcmp(optarg, "json") == 0) g_json = true;
+				else if (strcmp(optarg, "csv") == 0) g_json = false;
+				else usage(argv[0]);
+				break;
+			case 'a': snprintf(algorithms, sizeof(algorithms), "%s", optarg); break;
+			case 'c': base_config = optarg; break;
+			case 'e': g_seed = (uint32_t) atol(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+	if (g_calls <= 0) usage(argv[0]);
+	if (algorithms[0] == '\0') { //all algorithms from io_schedulers[]
+		for (int32_t i = 0; (alg_name = get_algorithm_name_from_index(i)); i++) {
+			if (i > 0) strncat(algorithms, ",", sizeof(algorithms) - strlen(algorithms) - 1);
+			strncat(algorithms, alg_name, sizeof(algorithms) - strlen(algorithms) - 1);
+		}
+	}
+	for (int32_t i = 0; i < g_filesnb; i++) max_files = micro_max(max_files, g_files[i]);
+	g_file_names = malloc(sizeof(char *)*max_files);
+	assert(g_file_names);
+	for (int32_t i = 0; i < max_files; i++) {
+		snprintf(name, sizeof(name), "micro.%d.out", i);
+		g_file_names[i] = strdup(name);
+	}
+	if (!g_json) printf("algorithm,operation,threads,files,depth,calls,failed,mean_ns,p50_ns,p99_ns,p999_ns,max_ns,calls_per_s\n");
+	fflush(stdout);
+	run_algorithms(algorithms, base_config, micro);
+	return 0;
+}
@@ -0,0 +1,97 @@
+/*! \file agios_replay.c
+    \brief Replays trace files generated by AGIOS through the library, to compare scheduling algorithms.
+
+    Reads a trace and issues its arrivals with agios_add_request, keeping the recorded inter-arrival times (possibly scaled, or as fast as possible). Requests given back by AGIOS are served by a fixed pool of worker threads, which wait for the time given by a service-time model and then release them. An aggregated request is served as a single access covering all its requests. This runs in real time, see agios_sim.c for the simulated version.
+    @see replay_common.c
+ */
+#define _GNU_SOURCE
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <agios.h>
+
+#include "replay_common.h"
+
+double g_speed=1.0; /**< inter-arrival times are divided by this, 0 means as fast as possible */
+int32_t g_workers=16;
+
+/**
+ * replays the whole trace with a scheduling algorithm. Runs in its own process, so AGIOS starts from scratch every time.
+ */
+void replay(const char *algorithm, char *config_file)
+{
+	int64_t start, target, elapsed;
+	struct timespec timeout;
+
+	if (!agios_init(replay_process, replay_process_list, config_file, g_max_queue_id+1)) {
+		printf("PANIC! Could not initialize AGIOS with %s!\n", algorithm);
+		unlink(config_file);
+		exit(1);
+	}
+	start_workers(g_workers);
+	start = get_now();
+	for (int64_t i = 0; i < g_reqnb; i++) {
+		if (g_speed > 0.0) {
+			target = start + (int64_t)((g_reqs[i].timestamp - g_reqs[0].timestamp) / g_speed);
+			timeout.tv_sec = target / 1000000000L;
+			timeout.tv_nsec = target % 1000000000L;
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &timeout, NULL);
+		}
+		g_reqs[i].add_time = get_now();
+		if (!agios_add_request(g_reqs[i].file_id, g_reqs[i].type, g_reqs[i].offset, g_reqs[i].len, i, g_reqs[i].queue_id)) {
+			printf("PANIC! agios_add_request failed!\n");
+			exit(1);
+		}
+	}
+	wait_for_releases();
+	elapsed = get_now() - start;
+	stop_workers();
+	agios_exit();
+	print_report(algorithm, elapsed);
+}
+void usage(char *name)
+{
+	printf("Usage: %s [-s <speed>] [-m <model>] [-w <workers>] [-a <algorithms>] [-c <config file>] <trace file>\n", name);
+	printf("\t-s: inter-arrival times from the trace are divided by speed, 0 replays as fast as possible (default 1)\n");
+	printf("\t-m: service-time model (default none), one of:\n");
+	print_service_models_usage();
+	printf("\t-w: number of worker threads serving requests (default 16)\n");
+	printf("\t-a: comma-separated list of scheduling algorithms to compare (default %s, plus %s if the trace has queue ids)\n", DEFAULT_ALGORITHMS, DEFAULT_QUEUE_ID_ALGORITHMS);
+	printf("\t-c: configuration file used as base for all runs (default /tmp/agios.conf)\n");
+	exit(1);
+}
+int main(int argc, char **argv)
+{
+	char model[256] = "none";
+	char algorithms[256] = "";
+	char *base_config = "/tmp/agios.conf";
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:m:w:a:c:")) != -1) {
+		switch (opt) {
+			case 's': g_speed = atof(optarg); break;
+			case 'm': snprintf(model, sizeof(model), "%s", optarg); break;
+			case 'w': g_workers = atoi(optarg); break;
+			case 'a': snprintf(algorithms, sizeof(algorithms), "%s", optarg); break;
+			case 'c': base_config = optarg; break;
+			default: usage(argv[0]);
+		}
+	}
+	if ((optind >= argc) || (g_speed < 0.0) || (g_workers <= 0)) usage(argv[0]);
+	if (!parse_service_model(model)) usage(argv[0]);
+	if (!read_trace(argv[optind])) {
+		printf("PANIC! Could not read requests from %s\n", argv[optind]);
+		exit(1);
+	}
+	if (algorithms[0] == '\0') default_algorithms(algorithms, sizeof(algorithms));
+	printf("Replaying %ld requests from %s, speed %.2f, %d workers, service model %s\n", g_reqnb, argv[optind], g_speed, g_workers, g_model->name);
+	print_report_header();
+	run_algorithms(algorithms, base_config, replay);
+	return 0;
+}
@@ -0,0 +1,358 @@
+/*! \file agios_sim.c
+    \brief Discrete-event simulation of AGIOS serving a trace with a model of the storage device, to compare scheduling algorithms quickly and deterministically.
+
+    Uses the simulation build of AGIOS (libagios_sim.so, see agios_sim.h), where time is virtual and there is no agios thread. Events (trace arrivals, agios thread wake-ups and request completions) are processed in time order in a single thread, so hours of workload take seconds, and two runs with the same parameters give the same results. Requests given back by AGIOS are submitted to a device model that gives their completion time, when they are released. An aggregated request is submitted as a single access covering all its requests.
+    Device models:
+	- hdd: a single disk head. An access pays a seek (that depends on the distance from the previous access, the average seek time is paid when changing files) and half a rotation unless it is contiguous to the previous one, then the transfer time. Accesses are served one at a time.
+	- ssd: a number of independent channels, each one serving one access at a time with a fixed latency and a transfer time. An access goes to the first channel that becomes free, so the device benefits from having many requests outstanding.
+	- pfs: a parallel file system with a number of data servers. Files are striped over all servers (starting from a server chosen by the file handle), and an access is split into stripes. Each server serves its pieces one at a time with a fixed latency and a transfer time, and an access completes when all its pieces are done.
+    @see replay_common.c
+ */
+#define _GNU_SOURCE
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <agios.h>
+#include <agios_sim.h>
+
+#include "replay_common.h"
+
+#define HDD_FULL_SEEK_DISTANCE (1L << 30) /**< distance (in bytes) inside a file from which an hdd pays the average seek time */
+
+/** \enum
+ *  \brief The types of events in the simulation.
+ */
+enum {
+	SIM_RELEASE = 0, /**< a request was served by the device */
+	SIM_RUN = 1, /**< the agios thread wakes up */
+};
+/*! \struct sim_event_t
+    \brief An event in the simulation, kept in a min-heap ordered by time (ties are broken by creation order, so the simulation is deterministic).
+ */
+struct sim_event_t {
+	int64_t time;
+	int64_t seq; /**< creation order */
+	int32_t type; /**< SIM_RELEASE or SIM_RUN */
+	int64_t arg; /**< the request (SIM_RELEASE) or the generation of the wake-up (SIM_RUN) */
+};
+/*! \struct sim_device_t
+    \brief A device model. Servers are resources that serve one access (or piece of access) at a time.
+ */
+struct sim_device_t {
+	const char *name;
+	const char *usage;
+	int32_t paramnb; /**< number of parameters in the command line */
+	int64_t (*submit)(const char *file_id, int64_t offset, int64_t len, int64_t now); /**< gives the completion time of an access */
+};
+
+struct sim_event_t *g_events=NULL; /**< the min-heap */
+int64_t g_eventnb=0;
+int64_t g_events_size=0;
+int64_t g_event_seq=0;
+int64_t g_run_generation=0; /**< only the SIM_RUN event with the current generation is valid */
+bool g_run_on_arrival=true; /**< should the agios thread wake up when a request arrives? */
+double g_speed=1.0; /**< inter-arrival times are divided by this */
+double g_params[4]; /**< parameters of the device model */
+struct sim_device_t *g_device=NULL;
+int64_t *g_server_free=NULL; /**< when each server (head, channel or data server) becomes free */
+int32_t g_servernb=1;
+const char *g_hdd_file=NULL; /**< hdd model: position of the head after the last access */
+int64_t g_hdd_position=0;
+int64_t g_released_reqnb=0;
+int64_t g_dispatchnb_in_run=0; /**< used to detect agios_sim_run calls that did nothing */
+
+/*
+ * event heap
+ */
+bool event_before(struct sim_event_t *a, struct sim_event_t *b)
+{
+	return (a->time < b->time) || ((a->time == b->time) && (a->seq < b->seq));
+}
+void push_event(int64_t time, int32_t type, int64_t arg)
+{
+	struct sim_event_t tmp;
+	int64_t i;
+
+	if (g_eventnb == g_events_size) {
+		g_events_size = (g_events_size == 0) ? 1024 : g_events_size*2;
+		g_events = realloc(g_events, sizeof(struct sim_event_t)*g_events_size);
+		assert(g_events);
+	}
+	i = g_eventnb++;
+	g_events[i].time = time;
+	g_events[i].seq = g_event_seq++;
+	g_events[i].type = type;
+	g_events[i].arg = arg;
+	while ((i > 0) && event_before(&g_events[i], &g_events[(i-1)/2])) {
+		tmp = g_events[i];
+		g_events[i] = g_events[(i-1)/2];
+		g_events[(i-1)/2] = tmp;
+		i = (i-1)/2;
+	}
+}
+struct sim_event_t pop_event(void)
+{
+	struct sim_event_t ret = g_events[0];
+	struct sim_event_t tmp;
+	int64_t i = 0, smallest;
+
+	g_events[0] = g_events[--g_eventnb];
+	while (true) {
+		smallest = i;
+		if ((2*i+1 < g_eventnb) && event_before(&g_events[2*i+1], &g_events[smallest])) smallest = 2*i+1;
+		if ((2*i+2 < g_eventnb) && event_before(&g_events[2*i+2], &g_events[smallest])) smallest = 2*i+2;
+		if (smallest == i) break;
+		tmp = g_events[i];
+		g_events[i] = g_events[smallest];
+		g_events[smallest] = tmp;
+		i = smallest;
+	}
+	return ret;
+}
+/*
+ * device models
+ */
+int64_t transfer_time(int64_t len, double mbps)
+{
+	return (int64_t)((len * 1000.0) / mbps);
+}
+/* g_params: rpm, average seek time (ms), bandwidth (MB/s) */
+int64_t hdd_submit(const char *file_id, int64_t offset, int64_t len, int64_t now)
+{
+	int64_t start = (now > g_server_free[0]) ? now : g_server_free[0];
+	int64_t service = transfer_time(len, g_params[2]);
+	int64_t avg_seek = (int64_t)(g_params[1] * 1000000.0);
+	int64_t distance;
+
+	if ((file_id != g_hdd_file) || (offset != g_hdd_position)) {
+		if (file_id != g_hdd_file) service += avg_seek;
+		else { //short seeks are cheaper, a third of the average is the time to settle the head
+			distance = llabs(offset - g_hdd_position);
+			if (distance > HDD_FULL_SEEK_DISTANCE) distance = HDD_FULL_SEEK_DISTANCE;
+			service += (avg_seek / 3) + (int64_t)(((2 * avg_seek) / 3) * sqrt((double) distance / HDD_FULL_SEEK_DISTANCE));
+		}
+		service += (int64_t)(30000000000.0 / g_params[0]); //half a rotation
+	}
+	g_hdd_file = file_id;
+	g_hdd_position = offset + len;
+	g_server_free[0] = start + service;
+	return g_server_free[0];
+}
+/* g_params: channels, latency (us), bandwidth per channel (MB/s) */
+int64_t ssd_submit(const char *file_id, int64_t offset, int64_t len, int64_t now)
+{
+	int32_t channel = 0;
+
+	for (int32_t i = 1; i < g_servernb; i++) {
+		if (g_server_free[i] < g_server_free[channel]) channel = i;
+	}
+	if (g_server_free[channel] < now) g_server_free[channel] = now;
+	g_server_free[channel] += (int64_t)(g_params[1] * 1000.0) + transfer_time(len, g_params[2]);
+	return g_server_free[channel];
+}
+/* g_params: servers, stripe size (KB), latency (us), bandwidth per server (MB/s) */
+int64_t pfs_submit(const char *file_id, int64_t offset, int64_t len, int64_t now)
+{
+	int64_t stripe = (int64_t)(g_params[1] * 1024);
+	uint32_t first = 5381; //djb2 hash of the file handle gives the first server
+	int64_t piece_start, piece_end, server, completion = now;
+
+	for (const char *c = file_id; *c; c++) first = (first * 33) + *c;
+	for (piece_start = offset; piece_start < offset + len; piece_start = piece_end) {
+		piece_end = ((piece_start / stripe) + 1) * stripe;
+		if (piece_end > offset + len) piece_end = offset + len;
+		server = ((piece_start / stripe) + first) % g_servernb;
+		if (g_server_free[server] < now) g_server_free[server] = now;
+		g_server_free[server] += (int64_t)(g_params[2] * 1000.0) + transfer_time(piece_end - piece_start, g_params[3]);
+		if (g_server_free[server] > completion) completion = g_server_free[server];
+	}
+	return completion;
+}
+struct sim_device_t g_devices[] = {
+	{.name = "hdd", .usage = "hdd:<rpm>:<average seek time in ms>:<MB/s>", .paramnb = 3, .submit = hdd_submit},
+	{.name = "ssd", .usage = "ssd:<channels>:<latency in us>:<MB/s per channel>", .paramnb = 3, .submit = ssd_submit},
+	{.name = "pfs", .usage = "pfs:<servers>:<stripe size in KB>:<latency in us>:<MB/s per server>", .paramnb = 4, .submit = pfs_submit},
+};
+#define SIM_DEVICE_COUNT (sizeof(g_devices) / sizeof(g_devices[0]))
+
+/**
+ * parses a device description such as "ssd:8:50:500".
+ * @return true or false for success.
+ */
+bool parse_device(char *description)
+{
+	char *name = strtok(description, ":");
+	char *param;
+	int32_t paramnb = 0;
+
+	if (!name) return false;
+	for (int32_t i = 0; i < SIM_DEVICE_COUNT; i++) {
+		if (strcmp(name, g_devices[i].name) == 0) g_device = &g_devices[i];
+	}
+	if (!g_device) return false;
+	while ((param = strtok(NULL, ":")) && (paramnb < 4)) g_params[paramnb++] = atof(param);
+	if (paramnb != g_device->paramnb) return false;
+	for (int32_t i = 0; i < paramnb; i++) {
+		if (g_params[i] <= 0.0) return false;
+	}
+	if (g_device->submit != hdd_submit) g_servernb = (int32_t) g_params[0];
+	return true;
+}
+/*
+ * callbacks
+ */
+void submit_requests(int64_t *reqs, int32_t reqnb)
+{
+	int64_t now = agios_sim_get_time();
+	int64_t start = g_reqs[reqs[0]].offset;
+	int64_t end = start + g_reqs[reqs[0]].len;
+	int64_t completion;
+
+	for (int32_t i = 1; i < reqnb; i++) {
+		if (g_reqs[reqs[i]].offset < start) start = g_reqs[reqs[i]].offset;
+		if (g_reqs[reqs[i]].offset + g_reqs[reqs[i]].len > end) end = g_reqs[reqs[i]].offset + g_reqs[reqs[i]].len;
+	}
+	completion = g_device->submit(g_reqs[reqs[0]].file_id, start, end - start, now);
+	for (int32_t i = 0; i < reqnb; i++) {
+		g_reqs[reqs[i]].dispatch_time = now;
+		push_event(completion, SIM_RELEASE, reqs[i]);
+	}
+	count_dispatch(reqnb);
+	g_dispatchnb_in_run++;
+}
+void * sim_process(int64_t req_id)
+{
+	submit_requests(&req_id, 1);
+	return 0;
+}
+void * sim_process_list(int64_t *reqs, int32_t reqnb)
+{
+	submit_requests(reqs, reqnb);
+	return 0;
+}
+/*
+ * simulation
+ */
+void schedule_run(int64_t time)
+{
+	g_run_generation++;
+	push_event(time, SIM_RUN, g_run_generation);
+}
+/**
+ * does what the agios thread would do when waking up now, and schedules its next wake-up.
+ */
+void run_agios(void)
+{
+	int64_t now = agios_sim_get_time();
+	int64_t waiting_time;
+
+	g_dispatchnb_in_run = 0;
+	waiting_time = agios_sim_run(&g_run_on_arrival);
+	if (waiting_time < 0) { //nothing to do until a request arrives
+		g_run_generation++; //cancels pending wake-ups
+		g_run_on_arrival = true;
+		return;
+	}
+	//the real agios thread would loop without sleeping, but if nothing was dispatched, virtual time must advance or we would loop forever
+	if ((waiting_time == 0) && (g_dispatchnb_in_run == 0)) waiting_time = 1000;
+	schedule_run(now + waiting_time);
+}
+/**
+ * simulates the whole trace with a scheduling algorithm. Runs in its own process, so AGIOS starts from scratch every time.
+ */
+void simulate(const char *algorithm, char *config_file)
+{
+	int64_t next_arrival = 0; /**< index of the next request from the trace to arrive */
+	int64_t arrival_time;
+	int64_t start_time, wall_start;
+	int64_t eventnb = 0;
+	struct sim_event_t event;
+
+	g_server_free = calloc(g_servernb, sizeof(int64_t));
+	assert(g_server_free);
+	start_time = (int64_t)(g_reqs[0].timestamp / g_speed);
+	agios_sim_set_time(start_time);
+	if (!agios_init(sim_process, sim_process_list, config_file, g_max_queue_id+1)) {
+		printf("PANIC! Could not initialize AGIOS with %s!\n", algorithm);
+		unlink(config_file);
+		exit(1);
+	}
+	wall_start = get_now();
+	while (g_released_reqnb < g_reqnb) {
+		arrival_time = (next_arrival < g_reqnb) ? (int64_t)(g_reqs[next_arrival].timestamp / g_speed) : INT64_MAX;
+		eventnb++;
+		if ((g_eventnb == 0) || (arrival_time <= g_events[0].time)) { //arrivals go first when they happen at the same time as other events
+			assert(arrival_time != INT64_MAX);
+			agios_sim_set_time(arrival_time);
+			g_reqs[next_arrival].add_time = arrival_time;
+			if (!agios_add_request(g_reqs[next_arrival].file_id, g_reqs[next_arrival].type, g_reqs[next_arrival].offset, g_reqs[next_arrival].len, next_arrival, g_reqs[next_arrival].queue_id)) {
+				printf("PANIC! agios_add_request failed!\n");
+				exit(1);
+			}
+			next_arrival++;
+			if (g_run_on_arrival) {
+				g_run_on_arrival = false; //until the agios thread runs, it does not have to be woken up again
+				schedule_run(arrival_time);
+			}
+			continue;
+		}
+		event = pop_event();
+		agios_sim_set_time(event.time);
+		if (event.type == SIM_RELEASE) {
+			if (!agios_release_request(g_reqs[event.arg].file_id, g_reqs[event.arg].type, g_reqs[event.arg].len, g_reqs[event.arg].offset)) printf("PANIC! release request failed!\n");
+			g_reqs[event.arg].release_time = event.time;
+			g_released_reqnb++;
+			if (g_run_on_arrival) { //it may let requests waiting for their limits on outstanding requests go
+				g_run_on_arrival = false;
+				schedule_run(event.time);
+			}
+		} else if (event.arg == g_run_generation) run_agios();
+	}
+	agios_exit();
+	print_report(algorithm, agios_sim_get_time() - start_time);
+	printf("\t%ld events, %.3fs of workload simulated in %.3fs\n", eventnb, (agios_sim_get_time() - start_time) / 1000000000.0, (get_now() - wall_start) / 1000000000.0);
+	free(g_server_free);
+}
+void usage(char *name)
+{
+	printf("Usage: %s -d <device> [-s <speed>] [-a <algorithms>] [-c <config file>] <trace file>\n", name);
+	printf("\t-d: device model, one of:\n");
+	for (int32_t i = 0; i < SIM_DEVICE_COUNT; i++) printf("\t\t%s\n", g_devices[i].usage);
+	printf("\t-s: inter-arrival times from the trace are divided by speed (default 1)\n");
+	printf("\t-a: comma-separated list of scheduling algorithms to compare (default %s, plus %s if the trace has queue ids)\n", DEFAULT_ALGORITHMS, DEFAULT_QUEUE_ID_ALGORITHMS);
+	printf("\t-c: configuration file used as base for all runs (default /tmp/agios.conf)\n");
+	exit(1);
+}
+int main(int argc, char **argv)
+{
+	char device[256] = "";
+	char algorithms[256] = "";
+	char *base_config = "/tmp/agios.conf";
+	int opt;
+
+	while ((opt = getopt(argc, argv, "d:s:a:c:")) != -1) {
+		switch (opt) {
+			case 'd': snprintf(device, sizeof(device), "%s", optarg); break;
+			case 's': g_speed = atof(optarg); break;
+			case 'a': snprintf(algorithms, sizeof(algorithms), "%s", optarg); break;
+			case 'c': base_config = optarg; break;
+			default: usage(argv[0]);
+		}
+	}
+	if ((optind >= argc) || (g_speed <= 0.0)) usage(argv[0]);
+	if (!parse_device(device)) usage(argv[0]);
+	if (!read_trace(argv[optind])) {
+		printf("PANIC! Could not read requests from %s\n", argv[optind]);
+		exit(1);
+	}
+	if (algorithms[0] == '\0') default_algorithms(algorithms, sizeof(algorithms));
+	printf("Simulating %ld requests from %s, speed %.2f, device %s\n", g_reqnb, argv[optind], g_speed, g_device->name);
+	print_report_header();
+	run_algorithms(algorithms, base_config, simulate);
+	return 0;
+}
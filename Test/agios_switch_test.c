@@ -0,0 +1,138 @@
+/*! \file agios_switch_test.c
+    \brief Checks that requests processed in a batch are all given back when the scheduling algorithm must change in the middle of it.
+
+    Uses the simulation build (libagios_sim.so). PATTERN_MATCHING is the dynamic scheduler and it must select an algorithm at every call (select_algorithm_period is 0), and requests are released as soon as they are given back, so process_requests_step2 asks the scheduler to stop right after the first request of a batch. For each algorithm that serves many requests at once (BFQ, aIOLi and MLF), in its own process, we queue requests to a single file that cannot be aggregated (there is a hole between them), call agios_sim_run until there is nothing left to do, and check every request was given back exactly once.
+ */
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <agios.h>
+#include <agios_sim.h>
+
+#define SWITCH_REQ_SIZE 4096
+#define SWITCH_REQNB 64
+#define SWITCH_MAX_RUNS 100000
+
+char *g_file_id = "switch_test_file";
+int32_t g_given[SWITCH_REQNB]; /**< how many times each request was given back */
+
+/**
+ * gives a request back to AGIOS right away, as a device without latency would. Releases count as processed requests, so after the first one PATTERN_MATCHING must select an algorithm, and process_requests_step2 asks the scheduler to stop.
+ */
+void * switch_process(int64_t req_id)
+{
+	assert((req_id >= 0) && (req_id < SWITCH_REQNB));
+	g_given[req_id]++;
+	if (!agios_release_request(g_file_id, RT_READ, SWITCH_REQ_SIZE, (2*req_id)*SWITCH_REQ_SIZE)) printf("PANIC! release request failed!\n");
+	return 0;
+}
+void * switch_process_list(int64_t *reqs, int32_t reqnb)
+{
+	for (int32_t i = 0; i < reqnb; i++) switch_process(reqs[i]);
+	return 0;
+}
+/**
+ * writes the configuration file used by the test.
+ * @return true or false for success.
+ */
+bool write_switch_config(const char *algorithm, char *filename)
+{
+	FILE *out;
+	int fd = mkstemp(filename);
+
+	if ((fd < 0) || (!(out = fdopen(fd, "w")))) {
+		printf("PANIC! Could not create temporary configuration file\n");
+		return false;
+	}
+	fprintf(out, "library_options:\n{\n");
+	fprintf(out, "\ttrace = false ;\n");
+	fprintf(out, "\ttrace_file_prefix = \"/tmp/agios_tracefile\"\n");
+	fprintf(out, "\ttrace_file_sufix = \"out\"\n");
+	fprintf(out, "\twaiting_time = 900000\n");
+	fprintf(out, "\tadaptive_waiting_time = false ;\n");
+	fprintf(out, "\taioli_quantum = 65536\n");
+	fprintf(out, "\tmlf_quantum = 8192\n");
+	fprintf(out, "\tbfq_budget = 1024\n");
+	fprintf(out, "\tbfq_max_budget = 1024\n");
+	fprintf(out, "\tdefault_algorithm = \"PATTERN_MATCHING\" ;\n");
+	fprintf(out, "\tstarting_algorithm = \"%s\" ;\n", algorithm);
+	fprintf(out, "\tselect_algorithm_period = 0\n");
+	fprintf(out, "\tselect_algorithm_min_reqnumber = 1\n");
+	fprintf(out, "\tperformance_values = 5\n");
+	fprintf(out, "\tpattern_matching_history = 32\n");
+	fprintf(out, "\tpattern_matching_threshold = 300\n");
+	fprintf(out, "};\n");
+	fclose(out);
+	return true;
+}
+/**
+ * the test with one starting algorithm.
+ * @return true if every request was given back once.
+ */
+bool switch_run(const char *algorithm, char *config_file)
+{
+	int64_t now = 0, waiting_time;
+	bool wake_on_arrival, ok = true;
+
+	memset(g_given, 0, sizeof(g_given));
+	agios_sim_set_time(now);
+	if (!agios_init(switch_process, switch_process_list, config_file, 1)) {
+		printf("PANIC! Could not initialize AGIOS with %s!\n", algorithm);
+		return false;
+	}
+	for (int64_t i = 0; i < SWITCH_REQNB; i++) {
+		if (!agios_add_request(g_file_id, RT_READ, (2*i)*SWITCH_REQ_SIZE, SWITCH_REQ_SIZE, i, 0)) {
+			printf("PANIC! agios_add_request failed!\n");
+			exit(1);
+		}
+	}
+	for (int32_t runs = 0; runs < SWITCH_MAX_RUNS; runs++) {
+		waiting_time = agios_sim_run(&wake_on_arrival);
+		if (waiting_time < 0) break;
+		agios_sim_set_time(now += (waiting_time > 0) ? waiting_time : 1000);
+	}
+	for (int64_t i = 0; i < SWITCH_REQNB; i++) {
+		if (g_given[i] != 1) {
+			printf("%s: request %ld was given back %d times\n", algorithm, i, g_given[i]);
+			ok = false;
+		}
+	}
+	agios_exit();
+	return ok;
+}
+int main(int argc, char **argv)
+{
+	const char *algorithms[] = {"BFQ", "aIOLi", "MLF"};
+	char config_file[] = "/tmp/agios_switch.XXXXXX";
+	int32_t failed = 0;
+	int status;
+	pid_t pid;
+
+	for (int32_t i = 0; i < 3; i++) {
+		pid = fork();
+		if (pid < 0) {
+			printf("PANIC! Could not fork to test %s\n", algorithms[i]);
+			exit(1);
+		} else if (pid == 0) {
+			if (!write_switch_config(algorithms[i], config_file)) exit(1);
+			status = switch_run(algorithms[i], config_file) ? 0 : 1;
+			unlink(config_file);
+			exit(status);
+		}
+		waitpid(pid, &status, 0);
+		if (WIFSIGNALED(status)) {
+			printf("%-8s failed (signal %d)\n", algorithms[i], WTERMSIG(status));
+			failed++;
+		} else if (WEXITSTATUS(status) != 0) {
+			printf("%-8s failed\n", algorithms[i]);
+			failed++;
+		} else printf("%-8s ok\n", algorithms[i]);
+		fflush(stdout);
+	}
+	return (failed > 0) ? 1 : 0;
+}
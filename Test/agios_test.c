@@ -25,7 +25,12 @@ struct request_info_t {
 };
 struct request_info_t *requests; /**< the list containing ALL requests generated in this test */
 pthread_barrier_t test_start;
-pthread_t *processing_threads;
+pthread_t *processing_threads; /**< the fixed pool of threads that process requests given back by AGIOS */
+int64_t *g_ready_reqs; /**< ids of the requests given back by AGIOS and waiting for a processing thread (each request enters it once, so it never holds more than g_generated_reqnb) */
+int32_t g_ready_head=0, g_ready_tail=0;
+bool g_ready_end=false; /**< tells the processing threads to stop */
+pthread_mutex_t g_ready_mutex=PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t g_ready_cond=PTHREAD_COND_INITIALIZER;
 
 void inc_processed_reqnb()
 {
@@ -38,26 +43,35 @@ void inc_processed_reqnb()
 
 void * process_thr(void *arg)
 {
-	struct request_info_t *req = (struct request_info_t *)arg;
+	struct request_info_t *req;
 	struct timespec timeout;
 
-	timeout.tv_sec = req->process_time / 1000000000L;
-	timeout.tv_nsec = req->process_time % 1000000000L;
-	nanosleep(&timeout, NULL);
-	if (!agios_release_request(req->fileid, req->type, req->len, req->offset)) {
-		printf("PANIC! release request failed!\n");
+	while (true) {
+		pthread_mutex_lock(&g_ready_mutex);
+		while ((g_ready_head == g_ready_tail) && (!g_ready_end)) pthread_cond_wait(&g_ready_cond, &g_ready_mutex);
+		if (g_ready_head == g_ready_tail) { //we were told to stop
+			pthread_mutex_unlock(&g_ready_mutex);
+			break;
+		}
+		req = &requests[g_ready_reqs[g_ready_head++]];
+		pthread_mutex_unlock(&g_ready_mutex);
+		timeout.tv_sec = req->process_time / 1000000000L;
+		timeout.tv_nsec = req->process_time % 1000000000L;
+		nanosleep(&timeout, NULL);
+		if (!agios_release_request(req->fileid, req->type, req->len, req->offset)) {
+			printf("PANIC! release request failed!\n");
+		}
+		inc_processed_reqnb();	
 	}
-	inc_processed_reqnb();	
 	return 0;
 }
 void * test_process(int64_t req_id)
 {
-	//create a thread to process this request (so AGIOS does not have to wait for us). Another solution (possibly better depending on the user) would be to have a producer-consumer set up where here we put requests into a ready queue and a fixed number of threads consume them.
-	int32_t ret = pthread_create(&(processing_threads[req_id]), NULL, process_thr, (void *)&requests[req_id]);		
-	if (ret != 0) {
-		printf("PANIC! Could not create processing thread for request %ld\n", req_id);
-		inc_processed_reqnb(); //so the program can end
-	}
+	//put the request in the ready queue, a thread from the processing pool will take it (so AGIOS does not have to wait for us, and we do not pay for creating a thread per request)
+	pthread_mutex_lock(&g_ready_mutex);
+	g_ready_reqs[g_ready_tail++] = req_id;
+	pthread_cond_signal(&g_ready_cond);
+	pthread_mutex_unlock(&g_ready_mutex);
 	return 0;
 }
 /**
@@ -170,8 +184,19 @@ int main (int argc, char **argv)
 		printf("PANIC! Could not initialize AGIOS!\n");
 		exit(1);
 	}
-	// allocate the vector of requet-processing threads
-	processing_threads = (pthread_t *)malloc(sizeof(pthread_t)*g_generated_reqnb);
+	// create the pool of request-processing threads (one per request-issuing thread)
+	processing_threads = (pthread_t *)malloc(sizeof(pthread_t)*g_thread_nb);
+	g_ready_reqs = (int64_t *)malloc(sizeof(int64_t)*g_generated_reqnb);
+	if ((!processing_threads) || (!g_ready_reqs)) {
+		printf("PANIC! Could not allocate memory\n");
+		exit(1);
+	}
+	for (int32_t i = 0; i < g_thread_nb; i++) {
+		if (pthread_create(&(processing_threads[i]), NULL, process_thr, NULL) != 0) {
+			printf("PANIC! Unable to create processing thread %d!\n", i);
+			exit(1);
+		}
+	}
 	/*generate the request-issuing threads*/
 	thread_index = (int64_t *)malloc(sizeof(int64_t)*g_thread_nb);
 	if (!thread_index) {
@@ -204,11 +229,16 @@ int main (int argc, char **argv)
 	//end agios, wait for the end of all threads, free stuff
 	agios_exit();
 	for (int32_t i = 0; i < g_thread_nb; i++) pthread_join(threads[i], NULL);
-	for (int32_t i = 0; i < g_generated_reqnb; i++) pthread_join(processing_threads[i], NULL);
+	pthread_mutex_lock(&g_ready_mutex);
+	g_ready_end = true;
+	pthread_cond_broadcast(&g_ready_cond);
+	pthread_mutex_unlock(&g_ready_mutex);
+	for (int32_t i = 0; i < g_thread_nb; i++) pthread_join(processing_threads[i], NULL);
 	//TODO free other stuff?
 	free(threads);
 	free(thread_index);
 	free(requests);
 	free(processing_threads);
+	free(g_ready_reqs);
 	return 0;
 }
@@ -0,0 +1,506 @@
+/*! \file replay_common.c
+    \brief Functions shared by the tools that replay traces: reading traces, running each scheduling algorithm in its own process, and reporting results.
+
+    Traces can be text or binary (see trace.c and agios_trace_format.h), only arrivals are used. Requests given back by AGIOS are served by a fixed pool of worker threads, which wait for the time given by a service-time model and then release them. An aggregated request is served as a single access covering all its requests. Each scheduling algorithm runs in a forked process, so AGIOS starts from scratch every time, with a copy of the base configuration file where only default_algorithm is changed (and tracing is disabled).
+ */
+#define _GNU_SOURCE
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <agios.h>
+#include <agios_trace_format.h>
+
+#include "replay_common.h"
+
+struct replay_req_t *g_reqs=NULL; /**< all requests from the trace, ordered by timestamp */
+int64_t g_reqnb=0;
+int32_t g_max_queue_id=0;
+int64_t g_dispatchnb=0; /**< how many times AGIOS gave requests back */
+static int64_t g_aggregated_reqnb=0; /**< how many requests were given back as part of a group */
+static int32_t g_max_group=0; /**< largest group of requests given back together */
+
+int64_t get_now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec * 1000000000L) + now.tv_nsec;
+}
+/*
+ * trace reading
+ */
+/**
+ * adds a request to g_reqs (used when reading traces and by generators).
+ */
+void add_trace_request(char *file_id, int32_t type, int64_t offset, int64_t len, int32_t queue_id, int64_t timestamp)
+{
+	static int64_t allocated = 0;
+
+	if (g_reqnb == allocated) {
+		allocated = (allocated == 0) ? 1024 : allocated*2;
+		g_reqs = realloc(g_reqs, sizeof(struct replay_req_t)*allocated);
+		if (!g_reqs) {
+			printf("PANIC! Could not allocate memory\n");
+			exit(1);
+		}
+	}
+	g_reqs[g_reqnb].file_id = file_id;
+	g_reqs[g_reqnb].type = type;
+	g_reqs[g_reqnb].offset = offset;
+	g_reqs[g_reqnb].len = len;
+	g_reqs[g_reqnb].queue_id = queue_id;
+	g_reqs[g_reqnb].timestamp = timestamp;
+	g_reqs[g_reqnb].client = 0;
+	if (queue_id > g_max_queue_id) g_max_queue_id = queue_id;
+	g_reqnb++;
+}
+/**
+ * reads a text trace. Only arrivals (lines with 5 fields) are used, lifecycle events are ignored.
+ */
+void read_text_trace(FILE *fd)
+{
+	char line[1024];
+	char *fields[6];
+	int32_t fieldnb;
+	char *last_file = NULL;
+	char *file_id;
+
+	while (fgets(line, sizeof(line), fd)) {
+		line[strcspn(line, "\n")] = '\0';
+		fieldnb = 0;
+		for (char *field = strtok(line, "\t"); field && (fieldnb < 6); field = strtok(NULL, "\t")) fields[fieldnb++] = field;
+		if ((fieldnb != 5) || ((fields[2][0] != 'R') && (fields[2][0] != 'W'))) continue;
+		//consecutive requests are often to the same file, so we avoid keeping a copy of its name for each one of them
+		if ((last_file) && (strcmp(last_file, fields[1]) == 0)) file_id = last_file;
+		else file_id = last_file = strdup(fields[1]);
+		add_trace_request(file_id, (fields[2][0] == 'R') ? RT_READ : RT_WRITE, atol(fields[3]), atol(fields[4]), 0, atol(fields[0]));
+	}
+}
+/**
+ * reads a binary trace (see agios_trace_format.h). Only arrivals are used.
+ * @return true or false for success.
+ */
+bool read_binary_trace(FILE *fd)
+{
+	struct agios_trace_file_header_t header;
+	struct agios_trace_chunk_header_t chunk;
+	struct agios_trace_record_t record;
+	char **files = NULL;
+	uint32_t filenb = 0;
+	uint32_t index, len;
+
+	if ((fread(&header, sizeof(header), 1, fd) != 1) || (header.version != AGIOS_TRACE_VERSION) || (header.record_size != sizeof(struct agios_trace_record_t))) {
+		printf("PANIC! Unsupported binary trace version\n");
+		return false;
+	}
+	while (fread(&chunk, sizeof(chunk), 1, fd) == 1) {
+		for (uint32_t i = 0; i < chunk.count; i++) {
+			if (chunk.kind == AGIOS_TRACE_CHUNK_FILES) {
+				if ((fread(&index, sizeof(uint32_t), 1, fd) != 1) || (fread(&len, sizeof(uint32_t), 1, fd) != 1)) return false;
+				if (index >= filenb) {
+					files = realloc(files, sizeof(char *)*(index+1));
+					assert(files);
+					memset(files+filenb, 0, sizeof(char *)*(index+1-filenb));
+					filenb = index+1;
+				}
+				files[index] = malloc(len+1);
+				assert(files[index]);
+				if (fread(files[index], 1, len, fd) != len) return false;
+				files[index][len] = '\0';
+			} else {
+				if (fread(&record, sizeof(record), 1, fd) != 1) return false;
+				if ((record.event != AGIOS_TRACE_ARRIVAL) || (record.file_index >= filenb) || (!files[record.file_index])) continue;
+				add_trace_request(files[record.file_index], record.type, record.offset, record.len, record.queue_id, record.timestamp);
+			}
+		}
+	}
+	free(files); //the names are still used by the requests
+	return true;
+}
+int compare_timestamps(const void *a, const void *b)
+{
+	const struct replay_req_t *ra = a, *rb = b;
+	return (ra->timestamp > rb->timestamp) - (ra->timestamp < rb->timestamp);
+}
+bool read_trace(char *filename)
+{
+	FILE *fd = fopen(filename, "r");
+	char magic[8];
+	bool ret = true;
+
+	if (!fd) {
+		printf("PANIC! Could not open trace file %s\n", filename);
+		return false;
+	}
+	if ((fread(magic, 1, sizeof(magic), fd) == sizeof(magic)) && (memcmp(magic, AGIOS_TRACE_MAGIC, sizeof(magic)) == 0)) {
+		rewind(fd);
+		ret = read_binary_trace(fd);
+	} else {
+		rewind(fd);
+		read_text_trace(fd);
+	}
+	fclose(fd);
+	//records from different threads may be out of order in binary traces
+	qsort(g_reqs, g_reqnb, sizeof(struct replay_req_t), compare_timestamps);
+	return ret && (g_reqnb > 0);
+}
+/**
+ * accounts for a list of requests given back together by AGIOS. The caller must serialize calls.
+ */
+void count_dispatch(int32_t reqnb)
+{
+	g_dispatchnb++;
+	if (reqnb > 1) g_aggregated_reqnb += reqnb;
+	if (reqnb > g_max_group) g_max_group = reqnb;
+}
+/*
+ * service-time models and workers
+ */
+/*! \struct replay_job_t
+    \brief A list of requests given back together by AGIOS, to be served by a worker.
+ */
+struct replay_job_t {
+	int64_t *reqs; /**< indexes in g_reqs */
+	int32_t reqnb;
+	struct replay_job_t *next;
+};
+
+static double g_params[2]; /**< parameters of the service-time model */
+struct service_model_t *g_model=NULL;
+void (*g_release_callback)(int64_t req)=NULL;
+int64_t g_workers_cpu_time=0;
+
+static struct replay_job_t *g_jobs_head=NULL, *g_jobs_tail=NULL; /**< requests waiting for a worker */
+static bool g_jobs_end=false; /**< tells workers to stop */
+static pthread_mutex_t g_jobs_mutex=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_jobs_cond=PTHREAD_COND_INITIALIZER;
+static int64_t g_released_reqnb=0;
+static pthread_cond_t g_released_cond=PTHREAD_COND_INITIALIZER;
+static pthread_t *g_worker_threads=NULL;
+static int32_t g_worker_nb=0;
+static char *g_last_file=NULL; /**< used by the hdd model: position of the device after the last access */
+static int64_t g_last_end=0;
+static pthread_mutex_t g_device_mutex=PTHREAD_MUTEX_INITIALIZER;
+static __thread uint32_t g_worker_seed=0; /**< used by the uniform model */
+
+void sleep_for(int64_t ns)
+{
+	struct timespec timeout;
+	if (ns <= 0) return;
+	timeout.tv_sec = ns / 1000000000L;
+	timeout.tv_nsec = ns % 1000000000L;
+	nanosleep(&timeout, NULL);
+}
+int64_t none_service_time(const char *file_id, int32_t type, int64_t offset, int64_t len)
+{
+	return 0;
+}
+int64_t fixed_service_time(const char *file_id, int32_t type, int64_t offset, int64_t len)
+{
+	return (int64_t) g_params[0];
+}
+/* g_params[0] is the maximum service time in ns, each access takes between 0 and that */
+int64_t uniform_service_time(const char *file_id, int32_t type, int64_t offset, int64_t len)
+{
+	return (int64_t)(g_params[0] * (rand_r(&g_worker_seed) / (RAND_MAX + 1.0)));
+}
+/* g_params[0] is the bandwidth in MB/s, g_params[1] a fixed latency per access in ns */
+int64_t bandwidth_service_time(const char *file_id, int32_t type, int64_t offset, int64_t len)
+{
+	return (int64_t) g_params[1] + (int64_t)((len * 1000.0) / g_params[0]);
+}
+/* a single disk head: g_params[0] is the seek time in ns (paid when the access is not contiguous to the previous one), g_params[1] the bandwidth in MB/s */
+int64_t hdd_service_time(const char *file_id, int32_t type, int64_t offset, int64_t len)
+{
+	int64_t ret = (int64_t)((len * 1000.0) / g_params[1]);
+
+	pthread_mutex_lock(&g_device_mutex);
+	if ((g_last_file != file_id) || (g_last_end != offset)) ret += (int64_t) g_params[0];
+	g_last_file = (char *) file_id;
+	g_last_end = offset + len;
+	pthread_mutex_unlock(&g_device_mutex);
+	return ret;
+}
+static struct service_model_t g_models[] = {
+	{.name = "none", .usage = "none (requests are released right away)", .paramnb = 0, .service_time = none_service_time},
+	{.name = "fixed", .usage = "fixed:<ns>", .paramnb = 1, .service_time = fixed_service_time},
+	{.name = "uniform", .usage = "uniform:<maximum ns>", .paramnb = 1, .service_time = uniform_service_time},
+	{.name = "bandwidth", .usage = "bandwidth:<MB/s>[:<latency in ns>]", .paramnb = 1, .service_time = bandwidth_service_time},
+	{.name = "hdd", .usage = "hdd:<seek time in ns>:<MB/s>", .paramnb = 2, .service_time = hdd_service_time},
+};
+#define SERVICE_MODEL_COUNT (sizeof(g_models) / sizeof(g_models[0]))
+
+void print_service_models_usage(void)
+{
+	for (int32_t i = 0; i < SERVICE_MODEL_COUNT; i++) printf("\t\t%s\n", g_models[i].usage);
+}
+/**
+ * parses a model description such as "bandwidth:500:100000" and sets g_model.
+ * @return true or false for success.
+ */
+bool parse_service_model(char *description)
+{
+	char *name = strtok(description, ":");
+	char *param;
+	int32_t paramnb = 0;
+
+	if (!name) return false;
+	for (int32_t i = 0; i < SERVICE_MODEL_COUNT; i++) {
+		if (strcmp(name, g_models[i].name) == 0) g_model = &g_models[i];
+	}
+	if (!g_model) return false;
+	g_params[0] = g_params[1] = 0.0;
+	while ((param = strtok(NULL, ":")) && (paramnb < 2)) g_params[paramnb++] = atof(param);
+	if (paramnb < g_model->paramnb) return false;
+	if ((g_model->service_time == bandwidth_service_time) && (g_params[0] <= 0.0)) return false;
+	if ((g_model->service_time == hdd_service_time) && (g_params[1] <= 0.0)) return false;
+	return true;
+}
+void add_job(int64_t *reqs, int32_t reqnb)
+{
+	struct replay_job_t *job = malloc(sizeof(struct replay_job_t));
+	int64_t now = get_now();
+
+	assert(job);
+	job->reqs = malloc(sizeof(int64_t)*reqnb);
+	assert(job->reqs);
+	memcpy(job->reqs, reqs, sizeof(int64_t)*reqnb); //AGIOS frees its list after the callback returns
+	job->reqnb = reqnb;
+	job->next = NULL;
+	for (int32_t i = 0; i < reqnb; i++) g_reqs[reqs[i]].dispatch_time = now;
+	pthread_mutex_lock(&g_jobs_mutex);
+	if (g_jobs_tail) g_jobs_tail->next = job;
+	else g_jobs_head = job;
+	g_jobs_tail = job;
+	count_dispatch(reqnb);
+	pthread_cond_signal(&g_jobs_cond);
+	pthread_mutex_unlock(&g_jobs_mutex);
+}
+void * replay_process(int64_t req_id)
+{
+	add_job(&req_id, 1);
+	return 0;
+}
+void * replay_process_list(int64_t *reqs, int32_t reqnb)
+{
+	add_job(reqs, reqnb);
+	return 0;
+}
+void * worker_thr(void *arg)
+{
+	struct replay_job_t *job;
+	struct replay_req_t *req;
+	int64_t start, end, now;
+	struct timespec cpu_time;
+
+	g_worker_seed = (uint32_t)(int64_t) arg;
+	while (true) {
+		pthread_mutex_lock(&g_jobs_mutex);
+		while ((!g_jobs_head) && (!g_jobs_end)) pthread_cond_wait(&g_jobs_cond, &g_jobs_mutex);
+		job = g_jobs_head;
+		if (job) {
+			g_jobs_head = job->next;
+			if (!g_jobs_head) g_jobs_tail = NULL;
+		}
+		pthread_mutex_unlock(&g_jobs_mutex);
+		if (!job) break;
+		//serve the whole group as a single access
+		start = g_reqs[job->reqs[0]].offset;
+		end = start + g_reqs[job->reqs[0]].len;
+		for (int32_t i = 1; i < job->reqnb; i++) {
+			req = &g_reqs[job->reqs[i]];
+			if (req->offset < start) start = req->offset;
+			if (req->offset + req->len > end) end = req->offset + req->len;
+		}
+		req = &g_reqs[job->reqs[0]];
+		sleep_for(g_model->service_time(req->file_id, req->type, start, end - start));
+		for (int32_t i = 0; i < job->reqnb; i++) {
+			req = &g_reqs[job->reqs[i]];
+			now = get_now();
+			if (!agios_release_request(req->file_id, req->type, req->len, req->offset)) printf("PANIC! release request failed!\n");
+			req->release_time = get_now();
+			req->release_call = req->release_time - now;
+			if (g_release_callback) g_release_callback(job->reqs[i]);
+		}
+		pthread_mutex_lock(&g_jobs_mutex);
+		g_released_reqnb += job->reqnb;
+		if (g_released_reqnb >= g_reqnb) pthread_cond_signal(&g_released_cond);
+		pthread_mutex_unlock(&g_jobs_mutex);
+		free(job->reqs);
+		free(job);
+	}
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_time);
+	__sync_fetch_and_add(&g_workers_cpu_time, (cpu_time.tv_sec * 1000000000L) + cpu_time.tv_nsec);
+	return 0;
+}
+/**
+ * creates the pool of worker threads that serve requests given back by AGIOS (through replay_process and replay_process_list).
+ */
+void start_workers(int32_t workers)
+{
+	g_worker_nb = workers;
+	g_worker_threads = malloc(sizeof(pthread_t)*workers);
+	assert(g_worker_threads);
+	for (int64_t i = 0; i < workers; i++) {
+		if (pthread_create(&g_worker_threads[i], NULL, worker_thr, (void *) (i+1)) != 0) {
+			printf("PANIC! Unable to create worker thread %ld!\n", i);
+			exit(1);
+		}
+	}
+}
+/**
+ * waits until all g_reqnb requests have been released.
+ */
+void wait_for_releases(void)
+{
+	pthread_mutex_lock(&g_jobs_mutex);
+	while (g_released_reqnb < g_reqnb) pthread_cond_wait(&g_released_cond, &g_jobs_mutex);
+	pthread_mutex_unlock(&g_jobs_mutex);
+}
+/**
+ * ends the worker threads, after that g_workers_cpu_time holds the CPU time they used.
+ */
+void stop_workers(void)
+{
+	pthread_mutex_lock(&g_jobs_mutex);
+	g_jobs_end = true;
+	pthread_cond_broadcast(&g_jobs_cond);
+	pthread_mutex_unlock(&g_jobs_mutex);
+	for (int32_t i = 0; i < g_worker_nb; i++) pthread_join(g_worker_threads[i], NULL);
+	free(g_worker_threads);
+}
+/*
+ * reporting
+ */
+int compare_int64(const void *a, const void *b)
+{
+	int64_t va = *((const int64_t *) a), vb = *((const int64_t *) b);
+	return (va > vb) - (va < vb);
+}
+int64_t get_percentile(int64_t *sorted, int64_t count, double percentile)
+{
+	int64_t index = (int64_t) ceil((percentile / 100.0) * count) - 1;
+	if (index < 0) index = 0;
+	if (index >= count) index = count - 1;
+	return sorted[index];
+}
+void print_report(const char *algorithm, int64_t elapsed)
+{
+	int64_t *latencies = malloc(sizeof(int64_t)*g_reqnb);
+	int64_t *waits = malloc(sizeof(int64_t)*g_reqnb);
+	int64_t bytes = 0;
+
+	assert(latencies && waits);
+	for (int64_t i = 0; i < g_reqnb; i++) {
+		latencies[i] = g_reqs[i].release_time - g_reqs[i].add_time;
+		waits[i] = g_reqs[i].dispatch_time - g_reqs[i].add_time;
+		bytes += g_reqs[i].len;
+	}
+	qsort(latencies, g_reqnb, sizeof(int64_t), compare_int64);
+	qsort(waits, g_reqnb, sizeof(int64_t), compare_int64);
+	printf("%-8s %10ld %10.1f %8.2f %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %8ld %6.2f %5.1f%% %5d\n",
+		algorithm,
+		g_reqnb,
+		(g_reqnb * 1000000000.0) / elapsed,
+		(bytes * 1000.0) / elapsed,
+		get_percentile(latencies, g_reqnb, 50.0) / 1000.0,
+		get_percentile(latencies, g_reqnb, 90.0) / 1000.0,
+		get_percentile(latencies, g_reqnb, 99.0) / 1000.0,
+		get_percentile(latencies, g_reqnb, 99.9) / 1000.0,
+		get_percentile(waits, g_reqnb, 50.0) / 1000.0,
+		get_percentile(waits, g_reqnb, 99.0) / 1000.0,
+		g_dispatchnb,
+		(double) g_reqnb / g_dispatchnb,
+		(100.0 * g_aggregated_reqnb) / g_reqnb,
+		g_max_group);
+	fflush(stdout);
+	free(latencies);
+	free(waits);
+}
+/**
+ * writes a copy of the base configuration file where default_algorithm is the given one and tracing is disabled.
+ * @return true or false for success.
+ */
+bool write_config(const char *base_config, const char *algorithm, char *filename)
+{
+	FILE *in = fopen(base_config, "r");
+	FILE *out;
+	char line[1024];
+	char *name;
+	bool found = false;
+	int fd;
+
+	if (!in) {
+		printf("PANIC! Could not open configuration file %s\n", base_config);
+		return false;
+	}
+	fd = mkstemp(filename);
+	if ((fd < 0) || (!(out = fdopen(fd, "w")))) {
+		printf("PANIC! Could not create temporary configuration file\n");
+		fclose(in);
+		return false;
+	}
+	while (fgets(line, sizeof(line), in)) {
+		name = line + strspn(line, " \t");
+		if (strncmp(name, "default_algorithm", strlen("default_algorithm")) == 0) {
+			fprintf(out, "\tdefault_algorithm = \"%s\" ;\n", algorithm);
+			found = true;
+		} else if ((strncmp(name, "trace", strlen("trace")) == 0) && (strchr(" \t=", name[strlen("trace")]))) {
+			fprintf(out, "\ttrace = false ;\n"); //replaying with tracing enabled would measure the trace overhead
+		} else fputs(line, out);
+	}
+	fclose(in);
+	fclose(out);
+	if (!found) printf("PANIC! There is no default_algorithm in %s\n", base_config);
+	return found;
+}
+void print_report_header(void)
+{
+	printf("%-8s %10s %10s %8s %10s %10s %10s %10s %10s %10s %8s %6s %6s %5s\n", "alg", "reqs", "reqs/s", "MB/s", "lat p50", "lat p90", "lat p99", "lat p999", "wait p50", "wait p99", "groups", "avg", "aggr", "max");
+	printf("%-8s %10s %10s %8s %10s %10s %10s %10s %10s %10s %8s %6s %6s %5s\n", "", "", "", "", "(us)", "(us)", "(us)", "(us)", "(us)", "(us)", "", "size", "", "size");
+	fflush(stdout);
+}
+/**
+ * fills the list of scheduling algorithms to compare when the user did not give one. Must be called after the trace was read.
+ * @param algorithms where the comma-separated list is written.
+ * @param size the size of that buffer.
+ */
+void default_algorithms(char *algorithms, size_t size)
+{
+	if (g_max_queue_id > 0) snprintf(algorithms, size, "%s,%s", DEFAULT_ALGORITHMS, DEFAULT_QUEUE_ID_ALGORITHMS);
+	else snprintf(algorithms, size, "%s", DEFAULT_ALGORITHMS);
+}
+/**
+ * runs the whole trace once for each scheduling algorithm, each one in its own process.
+ * @param algorithms comma-separated list of scheduling algorithms (it is modified).
+ * @param base_config the configuration file to be copied for each algorithm.
+ * @param run the function that replays the trace with the given algorithm and configuration file, and prints the report. 
+ */
+void run_algorithms(char *algorithms, const char *base_config, void (*run)(const char *algorithm, char *config_file))
+{
+	char config_file[] = "/tmp/agios_replay.XXXXXX";
+	int status;
+	pid_t pid;
+
+	for (char *algorithm = strtok(algorithms, ","); algorithm; algorithm = strtok(NULL, ",")) {
+		pid = fork();
+		if (pid < 0) {
+			printf("PANIC! Could not fork to replay with %s\n", algorithm);
+			exit(1);
+		} else if (pid == 0) {
+			if (!write_config(base_config, algorithm, config_file)) exit(1);
+			run(algorithm, config_file);
+			unlink(config_file);
+			exit(0);
+		}
+		waitpid(pid, &status, 0);
+		if (WIFSIGNALED(status)) printf("%-8s failed (signal %d)\n", algorithm, WTERMSIG(status));
+		else if (WEXITSTATUS(status) != 0) printf("%-8s failed\n", algorithm);
+		fflush(stdout);
+	}
+}
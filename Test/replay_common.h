@@ -0,0 +1,66 @@
+/*! \file replay_common.h
+    \brief Headers of the functions shared by the tools that replay traces (agios_replay, agios_sim and agios_bench).
+
+    @see replay_common.c
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*! \struct replay_req_t
+    \brief A request read from the trace, and what happened to it during the replay.
+ */
+struct replay_req_t {
+	char *file_id; /**< the file handle (shared by all requests to the same file) */
+	int32_t type; /**< RT_READ or RT_WRITE */
+	int64_t offset;
+	int64_t len;
+	int32_t queue_id;
+	int64_t timestamp; /**< arrival time in the trace (ns since its beginning) */
+	int64_t add_time; /**< when we gave it to AGIOS */
+	int64_t dispatch_time; /**< when AGIOS gave it back to us */
+	int64_t release_time; /**< when we released it */
+	int32_t client; /**< the thread that issues it (used by agios_bench) */
+	int64_t add_call; /**< how long agios_add_request took (ns) */
+	int64_t release_call; /**< how long agios_release_request took (ns) */
+};
+/*! \struct service_model_t
+    \brief A service-time model, that says how long a worker takes to serve an access.
+ */
+struct service_model_t {
+	const char *name; /**< used to select the model in the command line */
+	const char *usage; /**< parameters of the model */
+	int32_t paramnb; /**< how many parameters are mandatory */
+	int64_t (*service_time)(const char *file_id, int32_t type, int64_t offset, int64_t len); /**< the model itself */
+};
+
+#define DEFAULT_ALGORITHMS "MLF,TO-agg,SJF,aIOLi,TO,SW,EDF,BFQ,NOOP" /**< compared when the user does not give a list */
+#define DEFAULT_QUEUE_ID_ALGORITHMS "TWINS,SFQ" /**< also compared by default, but only if the trace has queue ids (otherwise all requests are in the same queue) */
+
+extern struct replay_req_t *g_reqs;
+extern int64_t g_reqnb;
+extern int32_t g_max_queue_id;
+extern int64_t g_dispatchnb; /**< how many times AGIOS gave requests back */
+extern struct service_model_t *g_model;
+extern void (*g_release_callback)(int64_t req); /**< if set, called by workers after releasing each request */
+extern int64_t g_workers_cpu_time; /**< CPU time (ns) used by the worker threads, set by stop_workers */
+
+int64_t get_now(void);
+void add_trace_request(char *file_id, int32_t type, int64_t offset, int64_t len, int32_t queue_id, int64_t timestamp);
+bool read_trace(char *filename);
+void print_service_models_usage(void);
+bool parse_service_model(char *description);
+void * replay_process(int64_t req_id);
+void * replay_process_list(int64_t *reqs, int32_t reqnb);
+void start_workers(int32_t workers);
+void wait_for_releases(void);
+void stop_workers(void);
+void count_dispatch(int32_t reqnb);
+int compare_int64(const void *a, const void *b);
+int64_t get_percentile(int64_t *sorted, int64_t count, double percentile);
+void print_report_header(void);
+void print_report(const char *algorithm, int64_t elapsed);
+void default_algorithms(char *algorithms, size_t size);
+void run_algorithms(char *algorithms, const char *base_config, void (*run)(const char *algorithm, char *config_file));
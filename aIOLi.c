@@ -16,6 +16,7 @@
 #include "process_request.h"
 #include "req_hashtable.h"
 #include "scheduling_algorithms.h"
+#include "throttle.h"
 #include "waiting_common.h"
 
 /**
@@ -34,7 +35,7 @@ bool aIOLi_select_from_list(struct queue_t *queue,
 	agios_list_for_each_entry (req, &queue->list, related) { //iterate over requests in this queue
 		increment_sched_factor(req);
 		if (&(req->related) == queue->list.next) { //we only try to select the first request from the queue (to respect offset order), but we don't break the loop because we want all requests to have their sched_factor incremented.
-			if (req->len <= req->sched_factor*config_aioli_quantum) { //all requests start by a fixed size quantum (aIOLi_QUANTUM), which is increased every step (by increasing the sched_factor). The request can only be processed when its quantum is large enough to fit its size.
+			if (req->len <= (int64_t)req->sched_factor*config_aioli_quantum) { //all requests start by a fixed size quantum (aIOLi_QUANTUM), which is increased every step (by increasing the sched_factor). The request can only be processed when its quantum is large enough to fit its size.
 				ret = true;
 				*selected_queue = queue;
 				*selected_timestamp = req->timestamp;
@@ -64,9 +65,10 @@ bool aIOLi_select_from_file(struct file_t *req_file,
  * function called by the aIOLi schedule function to select one of the queues to process requests from.
  * @param selected_index an integer that will be modified here to contain the position of the hashtable where the selcted queue is.
  * @param sleeping_time will be modified here to contain for how long we should sleep IN CASE all files are waiting so we have nothing to process. in that case, we return NULL
+ * @param blocked will be set to true IN CASE all files that have requests we could select are waiting for their limits on outstanding requests. in that case, we return NULL
  * @return a pointer to the selected queue (or NULL if we can't process requests)
  */
-struct queue_t *aIOLi_select_queue(int32_t *selected_index, int64_t *sleeping_time)
+struct queue_t *aIOLi_select_queue(int32_t *selected_index, int64_t *sleeping_time, bool *blocked)
 {
 	struct agios_list_head *reqfile_l; /**< used to iterate over the hashtable */
 	struct file_t *req_file; /**< used to iterate over a hashtable line */
@@ -77,28 +79,29 @@ struct queue_t *aIOLi_select_queue(int32_t *selected_index, int64_t *sleeping_ti
 	struct queue_t *selected_queue = NULL; /**< the selected queue, will be returned */
 	int64_t selected_timestamp=INT_MAX; /**< the earliest timestamp from the selected queue, used to ensure FIFO between different files */
 	int32_t waiting_options=0; /**< how many files we are skipping because they are currently waiting? */
+	int32_t blocked_options=0; /**< how many files we are skipping because their limits on outstanding requests are full? */
+	int32_t pending_options=0; /**< how many files have requests whose quanta are still too small? */
 	struct request_t *req=NULL; /**< used to gather the first request from the selected queue to test if we should make this file wait */ 
 		
+	update_waiting_files(&shortest_waiting_time); //files that are done waiting have their waiting_time set to 0
 	//go through all queues in the system to make the best choice
 	for (int32_t i=0; i< AGIOS_HASH_ENTRIES; i++) { //go through all entries of the hashtable
 		reqfile_l = hashtable_lock(i);
 		if (!agios_list_empty(reqfile_l)) { 
 			agios_list_for_each_entry (req_file, reqfile_l, hashlist) { //go through all the files in this entry of the hashtable
-				if (req_file->waiting_time > 0) { //if this file is waiting
-					update_waiting_time_counters(req_file, &shortest_waiting_time);	
-					if (req_file->waiting_time > 0) waiting_options++;
-				}
-				if (req_file->waiting_time <= 0) { //this file is not waiting. It is a new if (not an else) because waiting time was updated inside the previous if
+				if (req_file->waiting_time > 0) waiting_options++; //this file is waiting
+				else { //this file is not waiting
 					tmp_selected_queue=NULL;
 					//see if there are "selectable" requests for this file
 					reqnb = aIOLi_select_from_file(req_file, &tmp_selected_queue, &tmp_timestamp );
 					if (reqnb > 0) { //there are
-						if (tmp_timestamp < selected_timestamp) { //FIFO between the different files
+						if (!outstanding_allows(req_file, agios_list_entry(tmp_selected_queue->list.next, struct request_t, related)->queue_id)) blocked_options++; //but we cannot process them now
+						else if (tmp_timestamp < selected_timestamp) { //FIFO between the different files
 							selected_timestamp = tmp_timestamp;
 							selected_queue = tmp_selected_queue;
 							*selected_index = i;
 						}
-					}	
+					} else if ((!agios_list_empty(&req_file->read_queue.list)) || (!agios_list_empty(&req_file->write_queue.list))) pending_options++;
 				} //end if this file is not waiting
 			} //end for going though all files in this hashtable entry
 		} //end if this hashtable entry is not empty
@@ -117,6 +120,9 @@ struct queue_t *aIOLi_select_queue(int32_t *selected_index, int64_t *sleeping_ti
 	else if (waiting_options) { // we could not select a queue, because all the files are waiting. So we should wait
 		*sleeping_time = shortest_waiting_time;
 	}
+	else if ((blocked_options > 0) && (pending_options == 0)) { //the queues we could select are waiting for their limits, it is no use to grow the quanta of the others
+		*blocked = true;
+	}
 	return selected_queue;
 }
 /**
@@ -142,6 +148,30 @@ int32_t adjust_quantum(int32_t used_quantum, int32_t quantum)
 	}
 	return requiredqt;
 }
+/**
+ * called when config_aioli_quantum changes, so all queues start over from the new quantum instead of the ones adjusted from the old value. The caller must NOT hold any lock.
+ */
+void aIOLi_reset_quanta(void)
+{
+	struct agios_list_head *reqfile_l; /**< used to access the line of the hashtable. */
+	struct file_t *req_file; /**< used to go over all files in a line of the hashtable. */
+
+	for (int32_t i = 0; i < AGIOS_HASH_ENTRIES; i++) {
+		reqfile_l = hashtable_lock(i);
+		agios_list_for_each_entry (req_file, reqfile_l, hashlist) {
+			req_file->read_queue.nextquantum = config_aioli_quantum;
+			req_file->write_queue.nextquantum = config_aioli_quantum;
+		}
+		hashtable_unlock(i);
+	}
+}
+/**
+ * called to stop aIOLi.
+ */
+void aIOLi_exit(void)
+{
+	cleanup_waiting_files();
+}
 /** 
  * function used to schedule requests. 
  * @return the timeout to be used by the agios thread to sleep, in case we decide to sleep because ALL files are waiting and thus we have nothing to process (even if there are queued requests) 
@@ -155,6 +185,8 @@ int64_t aIOLi(void)
 	int32_t used_quantum = 0; /**< how much of the current quantum was used so far */
 	bool aioli_stop= false; /**< this flag will be returned by the process_requests function to notify us we should stop scheduling requests because it is time for some periodic event */
 	bool first_req; /**< used to ensure the first request of a selected queue is always processed (otherwise a small quantum will cause problems */
+	bool limited; /**< did we stop processing requests from the selected queue because its limits on outstanding requests are full? */
+	bool blocked; /**< are all the queues we could select waiting for their limits on outstanding requests? */
 	int64_t waiting_time; /**< in case all files are currently waiting, for how long we should wait*/
 	int64_t ret = 0; /**< the timeout we are returning */
 	struct processing_info_t *info; /**< the struct with information about requests to be processed, filled by process_requests_step1 and given as parameter to process_requests_step2 */
@@ -162,7 +194,9 @@ int64_t aIOLi(void)
 
 	//we are not locking the current_reqnb_mutex, so we could be using outdated information. We have chosen to do this for performance reasons
 	while ((current_reqnb > 0) && (!aioli_stop)) {
-		aIOLi_selected_queue = aIOLi_select_queue(&selected_hash, &waiting_time);
+		waiting_time = 0; //aIOLi_select_queue only sets it if all files are waiting
+		blocked = false;
+		aIOLi_selected_queue = aIOLi_select_queue(&selected_hash, &waiting_time, &blocked);
 		if (aIOLi_selected_queue) { //if we were able to select a queue
 			hashtable_lock(selected_hash);
 			//here we assume the list is NOT empty. It makes sense, since the other thread could have obtained the mutex, but only to include more requests, which would not make the list empty. If we ever have more than one thread consuming requests, this needs to be ensured somehow.
@@ -170,11 +204,16 @@ int64_t aIOLi(void)
 			current_quantum = aIOLi_selected_queue->nextquantum;
 			used_quantum = 0;
 			first_req = true; 
+			limited = false;
 			do {
 				//get the first request from this queue (because we need to keep the offset order within each queue
 				agios_list_for_each_entry (req, &(aIOLi_selected_queue->list), related) break;
 
 				if ((!first_req) && (req->len > (current_quantum - used_quantum))) break; //we are using leftover quantum, but the next request is not small enough to fit in this space, so we just stop processing requests from this queue. 
+				if ((!first_req) && (!outstanding_allows(aIOLi_selected_queue->req_file, req->queue_id))) { //its limits on outstanding requests are full, it will continue later
+					limited = true;
+					break;
+				}
 				first_req = false; //we are always sure to process at least one request of the queue, even if the quantum is too small
 				//if we are here, then we have a request to be processed that fits the quantum
 				used_quantum += req->len;
@@ -198,7 +237,7 @@ int64_t aIOLi(void)
 				}
 			} //end if we ran out of quantum
 			else { /*ran out of requests*/
-				if(!aioli_stop) { //if aioli_stop, we have stopped for this queue because it was time to refresh things, not because there were no more requests or quantum left. If we adjust quantum anyway, we would penalize this queue for no reason
+				if((!aioli_stop) && (!limited)) { //if aioli_stop (or limited), we have stopped for this queue because it was time to refresh things (or because of its limits), not because there were no more requests or quantum left. If we adjust quantum anyway, we would penalize this queue for no reason
 					aIOLi_selected_queue->nextquantum = adjust_quantum(used_quantum, current_quantum);
 				}
 			}
@@ -210,6 +249,8 @@ int64_t aIOLi(void)
 			ret = waiting_time;
 			break; //get out of the while 
 		}
+		else if (blocked) break; //we cannot process them until some requests are released, the agios thread will be woken up then
+
 	} //end if we have requests
 	return ret;
 }
@@ -5,3 +5,5 @@
 
 
 int64_t aIOLi(void);
+void aIOLi_exit(void);
+void aIOLi_reset_quanta(void);
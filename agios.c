@@ -6,24 +6,41 @@
 #include <stdbool.h>
 
 #include "agios.h"
+#include "agios_sim.h"
 #include "agios_config.h"
+#include "agios_reload_config.h"
+#include "agios_stats.h"
 #include "agios_thread.h"
 #include "common_functions.h"
 #include "data_structures.h"
+#include "metrics.h"
+#include "PATTERN_MATCHING.h"
 #include "performance.h"
 #include "process_request.h"
 #include "scheduling_algorithms.h"
+#include "SFQ.h"
+#include "stripes.h"
+#include "throttle.h"
 #include "trace.h"
 
+#ifndef AGIOS_SIMULATION
 static pthread_t g_agios_thread; /**< AGIOS thread that will run the AGIOS_thread function.  */
+#endif
 
 /**
  * function used by agios_exit and agios_init (in case of errors) to clean up all allocated memory.
  */
 void cleanup_agios(void)
 {
+	stop_metrics_exporter(); //it reads the data structures
+	stop_config_watcher(); //it reads the configuration file path
+	cleanup_PATTERN_MATCHING(); //it writes the known access patterns to pattern_matching_file
 	cleanup_config_parameters();
 	cleanup_performance_module();
+	cleanup_stats_module();
+	cleanup_SFQ_weights();
+	cleanup_throttle();
+	cleanup_stripes();
 	cleanup_data_structures();
 	if (config_trace_agios) {
 		close_agios_trace();
@@ -36,7 +53,7 @@ void cleanup_agios(void)
  * @param process_request the callback function from the user code used by AGIOS to process a single request. (required)
  * @param process_requests the callback function from the user code used by AGIOS to process a list of requests. (optional)
  * @param config_file the path to a configuration file. If NULL, the DEFAULT_CONFIGFILE will be read instead. If the default configuration file does not exist, it will use default values.
- * @param max_queue_id for schedulers that use multiple queues, one per server/application (TWINS and SW), define the number of queues to be used. If it is not relevant to the used scheduler, it is better to provide 0. With each request being added, a value between 0 and max_queue_id-1 is to be provided.
+ * @param max_queue_id for schedulers that use multiple queues, one per server/application (TWINS, SFQ and SW), define the number of queues to be used. If it is not relevant to the used scheduler, it is better to provide 0. With each request being added, a value between 0 and max_queue_id-1 is to be provided.
  * @see agios_config.c
  * @return true of false for success.
  */
@@ -52,18 +69,37 @@ bool agios_init(void * process_request_user(int64_t req_id),
 	}
 	user_callbacks.process_request_cb = process_request_user;
 	user_callbacks.process_requests_cb = process_requests_user;
+	user_callbacks.process_duplicates_cb = NULL; //it is set later by agios_set_duplicates_callback
+	user_callbacks.process_absorbed_cb = NULL; //it is set later by agios_set_absorbed_callback
+	user_callbacks.process_split_cb = NULL; //it is set later by agios_set_split_callback
+	user_callbacks.read_ahead_cb = NULL; //it is set later by agios_set_read_ahead_callback
 	if (!read_configuration_file(config_file)) goto cleanup_on_error; 
+	//TWINS and SFQ keep one queue per queue_id, they cannot be used without queues
+	if ((max_queue_id <= 0) && (find_io_scheduler(config_agios_default_algorithm)->needs_multi_timeline || 
+	   (find_io_scheduler(config_agios_default_algorithm)->is_dynamic && find_io_scheduler(config_agios_starting_algorithm)->needs_multi_timeline))) {
+		agios_print("%s needs a max_queue_id larger than 0 in agios_init", find_io_scheduler(config_agios_default_algorithm)->is_dynamic ? get_algorithm_name_from_index(config_agios_starting_algorithm) : get_algorithm_name_from_index(config_agios_default_algorithm));
+		goto cleanup_on_error;
+	}
 	if (!allocate_data_structures(max_queue_id)) goto cleanup_on_error;
+	if (!init_SFQ_weights()) goto cleanup_on_error;
+	if (!init_throttle(max_queue_id)) goto cleanup_on_error;
 	//if we are going to generate traces, init the tracing module
 	if (config_trace_agios) {
 		if (!init_trace_module()) goto cleanup_on_error;
 	}
+	if (!init_metrics_exporter()) goto cleanup_on_error;
+	if (!init_config_watcher()) goto cleanup_on_error;
+#ifdef AGIOS_SIMULATION
+	//there is no agios thread in the simulation build, the simulator calls agios_sim_run instead
+	agios_thread_setup();
+#else
 	//init the AGIOS thread
 	int32_t ret = pthread_create(&g_agios_thread, NULL, agios_thread, NULL);
 	if (ret != 0) {
                 agios_print("Unable to start a thread to agios!\n");
 		goto cleanup_on_error;
 	}
+#endif
 	//success, finish the function call
 	return true;
 cleanup_on_error:  //used to abort the initialization if anything goes wrong
@@ -71,14 +107,64 @@ cleanup_on_error:  //used to abort the initialization if anything goes wrong
 	return false;
 }
 
+/**
+ * function called by the user, after agios_init, to be told when read requests given back together are duplicates of one another (identical, or contained in another one). Instead of the callback for a list of requests, AGIOS will call this one for these lists. The user can then read only the requests for which served_by[i] == reqs[i], and give the data of served_by[i] to reqs[i] for the others. All requests still have to be released. Lists that include pieces of split requests (see agios_set_split_callback) are given one request at a time instead, without this information.
+ * @param process_duplicates_user the callback, called with the list of requests, the list of requests whose data contains each of them, and the length of the lists. NULL to stop using it.
+ * @return true or false for success (false if AGIOS is not initialized).
+ */
+bool agios_set_duplicates_callback(void * process_duplicates_user(int64_t *reqs, int64_t *served_by, int32_t reqnb))
+{
+	if (!user_callbacks.process_request_cb) return false;
+	__atomic_store_n(&user_callbacks.process_duplicates_cb, process_duplicates_user, __ATOMIC_RELEASE);
+	return true;
+}
+
+/**
+ * function called by the user, after agios_init, to enable write absorption. With it, when a write request arrives and covers the whole range of write requests to the same file that are still queued (not given back to the user yet), these requests are removed from the queues and given to this callback instead of being processed. The user must consider them done (their data is overwritten by the new request), and must NOT release them. Pieces of requests split at stripe boundaries (see agios_set_split_callback) are never absorbed. A write that absorbed others cannot be cancelled anymore (agios_cancel_request returns false), it is given back as usual. Only requests that arrive afterwards are affected, and only with scheduling algorithms that use the hashtable (aIOLi, MLF and SJF).
+ * @param process_absorbed_user the callback, called with the list of absorbed requests and its length. It is called by agios_add_request, so it must not call agios_add_request itself. NULL to disable write absorption.
+ * @return true or false for success (false if AGIOS is not initialized).
+ */
+bool agios_set_absorbed_callback(void * process_absorbed_user(int64_t *reqs, int32_t reqnb))
+{
+	if (!user_callbacks.process_request_cb) return false;
+	__atomic_store_n(&user_callbacks.process_absorbed_cb, process_absorbed_user, __ATOMIC_RELEASE);
+	return true;
+}
+
+/**
+ * function called by the user, after agios_init, to enable the splitting of requests to striped files (see the stripes configuration parameter and agios_set_file_stripes). With it, requests that arrive afterwards and cross stripe boundaries are split into stripe-aligned pieces, scheduled independently so different servers can serve them in parallel. Each piece is given to this callback (instead of the usual ones) with the identifier of its request, and must be released (or cancelled) with its own offset and size. A request is done when all its pieces were released. Cancelling a request with its original offset and size cancels the pieces that are still queued.
+ * @param process_split_user the callback, called with the identifier of the request, and the offset and size of the piece. NULL to stop splitting new requests (pieces already queued are then given to the callback for a single request).
+ * @return true or false for success (false if AGIOS is not initialized).
+ */
+bool agios_set_split_callback(void * process_split_user(int64_t req_id, int64_t offset, int64_t len))
+{
+	if (!user_callbacks.process_request_cb) return false;
+	__atomic_store_n(&user_callbacks.process_split_cb, process_split_user, __ATOMIC_RELEASE);
+	return true;
+}
+
+/**
+ * function called by the user, after agios_init, to receive read-ahead hints. With it, AGIOS looks for sequential and strided streams among the reads that arrive to each file, and once it is confident about a stream (see the read_ahead_confidence configuration parameter), it predicts the next requests of the stream and gives them to this callback, so the user can prefetch them into a cache before they are requested. Hints do not have to be answered, and requests for hinted ranges are added and released as usual.
+ * @param read_ahead_user the callback, called with the file handle, and the offset and size of the range that should be prefetched. It is called by agios_add_request (after the request was queued), so it must not call agios_add_request itself. NULL to stop detecting streams.
+ * @return true or false for success (false if AGIOS is not initialized).
+ */
+bool agios_set_read_ahead_callback(void * read_ahead_user(char *file_id, int64_t offset, int64_t len))
+{
+	if (!user_callbacks.process_request_cb) return false;
+	__atomic_store_n(&user_callbacks.read_ahead_cb, read_ahead_user, __ATOMIC_RELEASE);
+	return true;
+}
+
 /**
  * function called by the user to stop AGIOS. It will stop the AGIOS thread and free all allocated memory.
  */
 void agios_exit(void)
 {
 	//stop the agios thread
+#ifndef AGIOS_SIMULATION
 	stop_the_agios_thread();
 	pthread_join(g_agios_thread, NULL);
+#endif
 	if (current_scheduler->exit) current_scheduler->exit(); //the exit function is not mandatory for schedulers
 	//cleanup memory
 	cleanup_agios();
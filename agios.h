@@ -19,17 +19,95 @@ enum {
 	RT_READ = 0,
 	RT_WRITE = 1,
 };
+#define AGIOS_STATS_MAX_ALGORITHMS 16 /**< size of the algorithms array in struct agios_stats_t */
+/*! \struct agios_algorithm_stats_t
+    \brief Performance observed with one scheduling algorithm since agios_init, part of struct agios_stats_t.
+ */
+struct agios_algorithm_stats_t {
+	const char *name; /**< name of the scheduling algorithm */
+	int64_t released_reqnb; /**< number of released requests that were dispatched by this algorithm */
+	int64_t released_bytes; /**< sum of their sizes */
+	double bandwidth; /**< average bandwidth observed by these requests, in bytes per second */
+};
+/*! \struct agios_stats_t
+    \brief Snapshot of the library state, filled by agios_get_stats.
+ */
+struct agios_stats_t {
+	int32_t current_alg; /**< identifier of the scheduling algorithm in use */
+	const char *current_alg_name; /**< its name */
+	int32_t queued_reqnb; /**< requests waiting in the scheduler queues */
+	int32_t queued_filenb; /**< files with requests waiting in the scheduler queues */
+	int64_t received_reqnb; /**< requests received since the last statistics reset */
+	int64_t reads; /**< read requests received since the last statistics reset */
+	int64_t writes; /**< write requests received since the last statistics reset */
+	int64_t avg_request_size; /**< average size of the received requests in bytes, -1 if none */
+	int64_t avg_time_between_requests; /**< average time between arrivals in ns, -1 if unknown */
+	int64_t aggs_no; /**< number of aggregations (virtual requests with more than one request) since the last statistics reset */
+	double avg_agg_size; /**< average number of requests in these aggregations */
+	double current_bandwidth; /**< average bandwidth observed since the current scheduling algorithm was selected, in bytes per second */
+	int32_t algorithm_count; /**< number of entries in algorithms */
+	struct agios_algorithm_stats_t algorithms[AGIOS_STATS_MAX_ALGORITHMS]; /**< one entry per scheduling algorithm, indexed by identifier */
+};
+/*! \struct agios_scheduler_switch_t
+    \brief Cost of a change of scheduling algorithm, filled by agios_set_scheduler.
+ */
+struct agios_scheduler_switch_t {
+	int32_t previous_alg; /**< identifier of the scheduling algorithm before the change */
+	int32_t new_alg; /**< identifier of the scheduling algorithm after the change */
+	int32_t migrated_reqnb; /**< queued requests that were moved to the new scheduling algorithm */
+	bool changed_data_structure; /**< did requests move between the hashtable and the timeline? */
+	int64_t blocked_ns; /**< for how long adding, releasing and cancelling requests was blocked by the migration, in ns */
+	int64_t waited_ns; /**< for how long the caller waited for the end of the current scheduling round, in ns */
+};
+/*! \struct agios_queue_stats_t
+    \brief Statistics of the read or write queue of a file, part of struct agios_file_stats_t.
+ */
+struct agios_queue_stats_t {
+	int64_t queued_bytes; /**< sum of the sizes of the requests waiting in this queue */
+	int64_t received_reqnb; /**< number of received requests */
+	int64_t released_reqnb; /**< number of released requests */
+	int64_t processed_bytes; /**< sum of the sizes of released requests */
+	double bandwidth; /**< average bandwidth observed by released requests, in bytes per second */
+	int64_t avg_req_size; /**< average request size in bytes, -1 if none */
+	int64_t avg_time_between_requests; /**< average time between arrivals in ns, -1 if unknown */
+	int64_t avg_distance; /**< average offset distance between consecutive requests in bytes, -1 if unknown */
+	int64_t aggs_no; /**< number of aggregations */
+	double avg_agg_size; /**< average number of requests in these aggregations */
+	int64_t wait_p99; /**< 99th percentile of the time released requests waited in the queue, in ns, -1 if none */
+	int64_t service_p50; /**< median time the user took to process released requests, in ns, -1 if none */
+	int64_t service_p99; /**< 99th percentile of that service time, in ns, -1 if none */
+};
+/*! \struct agios_file_stats_t
+    \brief Snapshot of the statistics of one file, filled by agios_get_file_stats.
+ */
+struct agios_file_stats_t {
+	int64_t queued_reqnb; /**< requests to this file waiting in the scheduler queues */
+	struct agios_queue_stats_t read; /**< read queue */
+	struct agios_queue_stats_t write; /**< write queue */
+};
 bool agios_init(void * process_request_user(int64_t req_id), 
 		void * process_requests_user(int64_t *reqs, int32_t reqnb), 
 		char *config_file, 
 		int32_t max_queue_id);
 void agios_exit(void);
+bool agios_set_duplicates_callback(void * process_duplicates_user(int64_t *reqs, int64_t *served_by, int32_t reqnb));
+bool agios_set_absorbed_callback(void * process_absorbed_user(int64_t *reqs, int32_t reqnb));
+bool agios_set_split_callback(void * process_split_user(int64_t req_id, int64_t offset, int64_t len));
+bool agios_set_read_ahead_callback(void * read_ahead_user(char *file_id, int64_t offset, int64_t len));
+bool agios_set_file_stripes(char *file_id, int64_t stripe_size, int32_t stripe_count, int32_t first_server);
 bool agios_add_request(char *file_id, 
 			int32_t type, 
 			int64_t offset, 
 			int64_t len, 
 			int64_t identifier, 
 			int32_t queue_id);
+bool agios_add_request_with_deadline(char *file_id, 
+			int32_t type, 
+			int64_t offset, 
+			int64_t len, 
+			int64_t identifier, 
+			int32_t queue_id,
+			int64_t deadline);
 bool agios_release_request(char *file_id, 
 				int32_t type, 
 				int64_t len, 
@@ -38,6 +116,11 @@ bool agios_cancel_request(char *file_id,
 				int32_t type, 
 				int64_t len, 
 				int64_t offset);
+bool agios_reload_config(void);
+bool agios_set_scheduler(const char *name, struct agios_scheduler_switch_t *report);
+bool agios_set_queue_weight(int32_t queue_id, int32_t weight);
+bool agios_get_stats(struct agios_stats_t *stats);
+bool agios_get_file_stats(char *file_id, struct agios_file_stats_t *stats);
 #ifdef __cplusplus
 }
 #endif
@@ -10,22 +10,28 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "agios.h"
 #include "agios_add_request.h"
 #include "agios_config.h"
 #include "agios_counters.h"
 #include "agios_request.h"
+#include "agios_stats.h"
 #include "agios_thread.h"
 #include "common_functions.h"
 #include "data_structures.h"
 #include "hash.h"
 #include "mylist.h"
-//#include "pattern_tracker.h"
+#include "pattern_tracker.h"
 #include "process_request.h"
 #include "req_hashtable.h"
 #include "req_timeline.h"
 #include "scheduling_algorithms.h"
 #include "statistics.h"
+#include "stream_detector.h"
+#include "stripes.h"
+#include "throttle.h"
 #include "trace.h"
+#include "waiting_common.h"
 
 
 static int32_t g_last_timestamp=0; /**< We increase this number at every new request, just so each one of them has an unique identifier. */
@@ -45,6 +51,8 @@ void init_queue_statistics(struct queue_statistics_t *stats)
 	stats->avg_time_between_requests = -1;
 	stats->avg_distance = -1;
 	stats->aggs_no = 0;
+	stats->avg_service_time = -1;
+	stats->histograms = NULL;
 }
 /** 
  * initializes a queue (struct queue_t).
@@ -67,6 +75,10 @@ void init_queue(struct queue_t *queue,
 	queue->last_received_finaloffset = 0;
 	queue->shift_phenomena = 0;
 	queue->better_aggregation = 0;
+	queue->bfq_budget = 0;
+	queue->bfq_finish = 0;
+	queue->edf_key = INT64_MAX;
+	init_stream(&queue->stream);
 	init_queue_statistics(&queue->stats);
 }
 /** 
@@ -83,7 +95,17 @@ bool file_init(struct file_t *req_file,
 	strcpy(req_file->file_id, file_id);
 	req_file->first_request_time=0;
 	req_file->waiting_time = 0;
+	req_file->waiting_end = 0;
+	req_file->wait_factor = ADAPTIVE_WAIT_INITIAL_FACTOR;
+	req_file->wait_queue = NULL;
+	req_file->wait_offset = 0;
+	req_file->wait_reqnb = 0;
+	req_file->wait_probe = 0;
 	req_file->timeline_reqnb=0;
+	req_file->trace_index = -1;
+	req_file->stats_seq = 0;
+	memset(&req_file->outstanding, 0, sizeof(struct outstanding_t));
+	find_stripe_geometry(file_id, &req_file->stripes);
 	init_queue(&req_file->read_queue, req_file);
 	init_queue(&req_file->write_queue, req_file);
 	return true;
@@ -122,15 +144,23 @@ struct request_t * request_constructor(char *file_id,
 	strcpy(new->file_id, file_id);
 	//fill the structure
 	new->queue_id = queue_id;
+	new->dispatch_queue_id = queue_id;
+	new->server = -1;
 	new->type = type;
 	new->user_id = identifier;
 	new->offset = offset;
 	new->len = len;
 	new->sched_factor = 0;
 	new->arrival_time = arrival_time;
+	new->deadline = arrival_time + config_edf_deadline;
 	new->reqnb = 1;
 	init_agios_list_head(&new->reqs_list);
 	new->agg_head=NULL;
+	new->duplicates = 0;
+	new->piece = false;
+	new->absorbing = false;
+	new->pieces = 0;
+	new->trace_group = 0;
 	g_last_timestamp++;
 	new->timestamp = g_last_timestamp;
 	init_agios_list_head(&new->related);
@@ -158,14 +188,35 @@ struct request_t *make_virtual_request(struct request_t *aggregation_head,
 					aggregation_head->queue_id);
 	newreq->sched_factor = aggregation_head->sched_factor;
 	newreq->timestamp = aggregation_head->timestamp;
+	newreq->deadline = aggregation_head->deadline;
+	newreq->server = aggregation_head->server;
+	if (aggregation_head->piece) newreq->pieces = 1;
 	/*replaces the request on the hashtable*/
 	__agios_list_add(&newreq->related, prev, next);
 	newreq->globalinfo = aggregation_head->globalinfo;
 	aggregation_head->agg_head = newreq;
+	if (TRACE_LIFECYCLE) newreq->trace_group = agios_trace_new_group();
 	/*adds the replaced request on the requests list of the aggregation head*/
 	agios_list_add_tail(&aggregation_head->related, &newreq->reqs_list);
 	return newreq;
 }
+/**
+ * checks if a read request is a duplicate of one of the requests of a virtual request, i.e. if it is identical to, contained in or contains one of them. Then the user can read the larger one and give the same data to both.
+ * @param req the request being included in the virtual request.
+ * @param agg_req the virtual request.
+ * @return true if req is a duplicate.
+ */
+bool is_duplicate_read(struct request_t *req, struct request_t *agg_req)
+{
+	struct request_t *tmp; /**< used to iterate over the requests of the virtual request. */
+
+	if (req->type != RT_READ) return false;
+	agios_list_for_each_entry (tmp, &agg_req->reqs_list, related) {
+		if (((tmp->offset <= req->offset) && ((tmp->offset + tmp->len) >= (req->offset + req->len))) || 
+			((req->offset <= tmp->offset) && ((req->offset + req->len) >= (tmp->offset + tmp->len)))) return true;
+	}
+	return false;
+}
 /**
  * Aggregates two requests by inserting a single request in a virtual one. 
  * @param req the request to be included, it is not in the queue yet. 
@@ -175,29 +226,56 @@ void include_in_aggregation(struct request_t *req, struct request_t **agg_req)
 {
 	struct agios_list_head *prev; /**< prev and next define the position of the virtual request in the queue. */
 	struct agios_list_head *next;
+	struct timespec now; /**< used to trace the aggregation. */
 
+	if (TRACE_LIFECYCLE) agios_gettime(&now);
 	if ((*agg_req)->reqnb == 1) { /*agg_req is not a virtual request yet, we have to prepare it*/
 		prev = (*agg_req)->related.prev;
 		next = (*agg_req)->related.next;
 		agios_list_del(&((*agg_req)->related));
 		(*agg_req) = make_virtual_request((*agg_req), prev, next);
+		if (TRACE_LIFECYCLE) agios_trace_request_event(agios_list_entry((*agg_req)->reqs_list.next, struct request_t, related), AGIOS_TRACE_AGGREGATE, get_timespec2long(now), (*agg_req)->trace_group, 0); //the former head is now part of the virtual request
 	}
+	if (is_duplicate_read(req, *agg_req)) (*agg_req)->duplicates++;
+	if (req->piece) (*agg_req)->pieces++;
+	/*the virtual request goes from the smallest offset to the largest end among its requests (including holes between them)*/
+	if ((req->offset + req->len) > ((*agg_req)->offset + (*agg_req)->len))
+		(*agg_req)->len = (req->offset + req->len) - (*agg_req)->offset;
 	if (req->offset <= (*agg_req)->offset) { /*it has to be inserted in the beginning*/
 		agios_list_add(&req->related, &((*agg_req)->reqs_list));
 		(*agg_req)->len += (*agg_req)->offset - req->offset;
 		(*agg_req)->offset = req->offset;
 	}
-	else { /*it has to be inserted in the end*/
-		agios_list_add_tail(&req->related, &((*agg_req)->reqs_list));
-		(*agg_req)->len = (*agg_req)->len + ((req->offset + req->len) - ((*agg_req)->offset + (*agg_req)->len));
-	}
+	else agios_list_add_tail(&req->related, &((*agg_req)->reqs_list)); /*it has to be inserted in the end*/
 	(*agg_req)->reqnb++;
 	if((*agg_req)->arrival_time > req->arrival_time)
 		(*agg_req)->arrival_time = req->arrival_time;
 	if((*agg_req)->timestamp > req->timestamp)
 		(*agg_req)->timestamp = req->timestamp;
+	if((*agg_req)->deadline > req->deadline)
+		(*agg_req)->deadline = req->deadline;
 	(*agg_req)->sched_factor += req->sched_factor;
 	req->agg_head = (*agg_req);
+	if (TRACE_LIFECYCLE) agios_trace_request_event(req, AGIOS_TRACE_AGGREGATE, get_timespec2long(now), (*agg_req)->trace_group, 0);
+}
+/**
+ * the aggregation policy: says if two requests (each of them possibly virtual) to the same file should be aggregated. They must be contiguous, overlapping or (for reads) separated by at most config_max_aggregation_hole bytes, and the result cannot have more than max_aggreg_size requests (of the current scheduling algorithm), cover more than config_max_aggregation_size bytes (if it is set), or cross a stripe boundary (if the file is striped, see stripes.c).
+ * @param req the request with the smallest offset.
+ * @param nextreq the other request.
+ * @return true if they should be aggregated.
+ */
+bool should_aggregate(struct request_t *req, struct request_t *nextreq)
+{
+	int64_t end; /**< the end of the aggregation. */
+	int64_t hole = (req->type == RT_READ) ? config_max_aggregation_hole : 0; /**< a write covering a hole would overwrite it with garbage, so holes are only allowed between reads. */
+
+	if ((req->offset > nextreq->offset) || ((req->offset + req->len + hole) < nextreq->offset)) return false;
+	if ((req->reqnb + nextreq->reqnb) > current_scheduler->max_aggreg_size) return false;
+	end = req->offset + req->len;
+	if ((nextreq->offset + nextreq->len) > end) end = nextreq->offset + nextreq->len;
+	if ((config_max_aggregation_size > 0) && ((end - req->offset) > config_max_aggregation_size)) return false;
+	if (crosses_stripes(&req->globalinfo->req_file->stripes, req->offset, end)) return false; //the file system would split it again, and it would wait for two servers
+	return true;
 }
 /**
  * function called when we have two virtual requests which are going to become one because we've added a new one which fills the gap between them. Aggregate them into a single virtual request.
@@ -247,7 +325,7 @@ int32_t insert_aggregations(struct request_t *req,
 	if (insertion_place != list_head) {
 		/*if it is not the first request of the queue, we could aggregate it with the previous one*/
 		prev_req = agios_list_entry(insertion_place, struct request_t, related);
-		if (CHECK_AGGREGATE(prev_req, req) && ((prev_req->reqnb + req->reqnb) <= current_scheduler->max_aggreg_size)) { //if we should aggregate these requests
+		if (should_aggregate(prev_req, req)) { //if we should aggregate these requests
 			if (req->reqnb > 1) join_aggregations(&prev_req, &req);
 			else include_in_aggregation(req,&prev_req);
 			insertion_place = &(prev_req->related);
@@ -255,14 +333,14 @@ int32_t insert_aggregations(struct request_t *req,
 			/*maybe this request is also contiguous to the next one, so we will join everything*/
 			if (insertion_place->next != list_head) { /*if the request was not to be the last of the queue*/
 				next_req = agios_list_entry(insertion_place->next, struct request_t, related);
-				if (CHECK_AGGREGATE(prev_req, next_req) && ((next_req->reqnb + prev_req->reqnb) <= current_scheduler->max_aggreg_size)) join_aggregations(&prev_req, &next_req); //if we should aggregate
+				if (should_aggregate(prev_req, next_req)) join_aggregations(&prev_req, &next_req); //if we should aggregate
 			}
 		} //end if we should aggregate
 	} //end check aggregation with the previous one
 	if ((!aggregated) && (insertion_place->next != list_head)) {
 		/*if we could not aggregated with the previous one, or there is no previous one, and this request is not to be the last of the queue, lets try with the next one*/
 		next_req = agios_list_entry(insertion_place->next, struct request_t, related);
-		if (CHECK_AGGREGATE(req, next_req) && ((next_req->reqnb + req->reqnb) <= current_scheduler->max_aggreg_size)) { //if we should aggregate
+		if (should_aggregate(req, next_req)) { //if we should aggregate
 			if (req->reqnb > 1) join_aggregations(&req, &next_req); //we could be adding a virtual request (because we are migrating between data structures), and then if we get here we will not add this new request anywhere, we'll actually remove the next one and copy its requests to the new one's list. So we cannot return aggregated = 1, because we still need to add this request
 			else {
 				include_in_aggregation(req, &next_req);
@@ -287,16 +365,19 @@ struct file_t * file_constructor(char *file_id)
 		free(req_file);
 		return NULL;
 	}
+	stats_register_file(req_file);
 	return req_file;
 }
 /** 
- * goes through a list of file_t structures searching for the given file_id. If such structure does not exist in the list, creates a new one and includes it. The caller MUST hold relevant lock (timeline or hashtable entry).
+ * goes through a list of file_t structures searching for the given file_id. The caller MUST hold relevant lock (timeline or hashtable entry).
  * @param hash_list the list of file_t structures where we will look.
  * @param file_id the file handle.
- * @return a pointer to the found or newly allocated struct file_t of file_id. NULL in case of error.
+ * @param create if the structure does not exist in the list, should we create a new one and include it?
+ * @return a pointer to the found or newly allocated struct file_t of file_id. NULL if it was not found (and create is false), or in case of error.
  */
-struct file_t *find_req_file(struct agios_list_head *hash_list, 
-					char *file_id)
+struct file_t *get_req_file(struct agios_list_head *hash_list, 
+					char *file_id,
+					bool create)
 {
 	struct file_t *req_file; /**< pointer that will be returned with the relevant file information. */
 	bool found_file= false; /**< as the name suggests. */
@@ -311,6 +392,7 @@ struct file_t *find_req_file(struct agios_list_head *hash_list,
 	} //end for all files in the list
 	if (!found_file) { //if we did not find it, make a new one
 		struct agios_list_head *insertion_place; /**< used to know where to insert the newly allocated file_t. */
+		if (!create) return NULL;
 		if (found_higher_handle) insertion_place = &(req_file->hashlist);
 		else insertion_place = hash_list;
 		req_file = file_constructor(file_id);
@@ -320,6 +402,20 @@ struct file_t *find_req_file(struct agios_list_head *hash_list,
 		}
 		agios_list_add_tail(&req_file->hashlist, insertion_place);
 	} //end if we did not find the structure
+	return req_file;
+}
+/** 
+ * goes through a list of file_t structures searching for the given file_id. If such structure does not exist in the list, creates a new one and includes it. It is used when a request to the file is being added. The caller MUST hold relevant lock (timeline or hashtable entry).
+ * @param hash_list the list of file_t structures where we will look.
+ * @param file_id the file handle.
+ * @return a pointer to the found or newly allocated struct file_t of file_id. NULL in case of error.
+ */
+struct file_t *find_req_file(struct agios_list_head *hash_list, 
+					char *file_id)
+{
+	struct file_t *req_file = get_req_file(hash_list, file_id, true); /**< pointer that will be returned with the relevant file information. */
+
+	if (!req_file) return NULL;
 	//update the file counter (that keeps track of how many files are being accessed right now
 	if (req_file->timeline_reqnb == 0) inc_current_filenb();
 	return req_file;
@@ -340,36 +436,86 @@ bool agios_add_request(char *file_id,
 			int64_t len, 
 			int64_t identifier, 
 			int32_t queue_id)
+{
+	return agios_add_request_with_deadline(file_id, type, offset, len, identifier, queue_id, -1);
+}
+/**
+ * allocates and fills a new request (or a piece of a request split at stripe boundaries), used by agios_add_request_with_deadline.
+ * @param file_id @see agios_add_request_with_deadline
+ * @param type @see agios_add_request_with_deadline
+ * @param offset @see agios_add_request_with_deadline
+ * @param len @see agios_add_request_with_deadline
+ * @param identifier @see agios_add_request_with_deadline
+ * @param queue_id @see agios_add_request_with_deadline
+ * @param server the server holding the request, from the stripe geometry of the file, -1 if not known.
+ * @param deadline @see agios_add_request_with_deadline
+ * @param piece true if this is a piece of a request (to be given back with the callback set by agios_set_split_callback).
+ * @return the new request, NULL if we could not allocate it.
+ */
+struct request_t *new_request(char *file_id, 
+			int32_t type, 
+			int64_t offset, 
+			int64_t len, 
+			int64_t identifier, 
+			int32_t queue_id,
+			int32_t server,
+			int64_t deadline,
+			bool piece)
 {
 	struct request_t *req;  /**< The request structure we will fill with the new request.*/
 	struct timespec arrival_time; /**< Filled with the time of arrival for this request */
 	int64_t timestamp; /**< It will receive a representation of arrival_time. */
-	int32_t hash = get_hashtable_position(file_id); /**< The position of the hashtable where information about this file is, calculated from the file handle. */ 
-	bool using_hashtable; /**< Used to control the used data structure in the case it is being changed while this function is running */
 
-	//build the request_t structure and fill it for the new request, also add it to the current pattern in case we are using the pattern matching mechanism
 	agios_gettime(&(arrival_time));
 	timestamp = get_timespec2long(arrival_time);
-//	add_request_to_pattern(timestamp, offset, len, type, file_id); 
 	req = request_constructor(file_id, type, offset, len, identifier, timestamp, queue_id);
-	if (!req) return false;
+	if (!req) return NULL;
+	if (deadline >= 0) req->deadline = timestamp + deadline;
+	req->server = server;
+	req->piece = piece;
+	return req;
+}
+/**
+ * adds a new request (or a piece of a request split at stripe boundaries) to the data structures, used by agios_add_request_with_deadline.
+ * @param req the request, filled by new_request.
+ * @param request_end false if this is a piece and other pieces of the same request will follow, true otherwise (the stream detector only predicts the next requests at the end of a request).
+ */
+void add_request(struct request_t *req, bool request_end)
+{
+	int32_t hash = get_hashtable_position(req->file_id); /**< The position of the hashtable where information about this file is, calculated from the file handle. */ 
+	bool using_hashtable; /**< Used to control the used data structure in the case it is being changed while this function is running */
+	struct processing_info_t *absorbed = NULL; /**< queued writes absorbed by this one, if write absorption is enabled */
+	struct read_ahead_hint_t hints[STREAM_MAX_HINTS]; /**< ranges to be hinted to the user, if the stream detector is enabled */
+	int32_t hintnb = 0; /**< how many */
+	bool noop_direct; /**< are we giving the request to the user right away (because we are using NOOP)? */
+
+	//add the request to the current pattern in case we are using the pattern matching mechanism
+	add_request_to_pattern(req->arrival_time, req->offset, req->len, req->type, req->file_id);
 	//acquire the lock for the right data structure (it depends on the current scheduling algorithm being used)
 	using_hashtable = acquire_adequate_lock(hash);
 	//add the request to the right data structure
-	if (current_scheduler->needs_hashtable) hashtable_add_req(req,hash,NULL);
+	if (current_scheduler->needs_hashtable) hashtable_add_req(req,hash,NULL,&absorbed);
 	else timeline_add_req(req, hash, NULL);
 	//update counters and statistics
 	hashlist_reqcounter[hash]++;
+	stats_write_begin(&req->globalinfo->req_file->stats_seq);
 	req->globalinfo->current_size += req->len;
 	req->globalinfo->req_file->timeline_reqnb++;
 	statistics_newreq(req);  
+	stats_write_end(&req->globalinfo->req_file->stats_seq);
+	if (__atomic_load_n(&user_callbacks.read_ahead_cb, __ATOMIC_ACQUIRE)) hintnb = detect_stream(req, request_end, hints);
 	debug("current status: there are %d requests in the scheduler to %d files",current_reqnb, current_filenb);
 	//trace this request arrival
 	if (config_trace_agios) agios_trace_add_request(req);  
 	//increase the number of current requests on the scheduler
 	inc_current_reqnb(); 
 	// Signalize to the consumer thread that a new request was added. In the case of NOOP scheduler, the agios thread does nothing, we will return the request right away
-	if (current_alg != NOOP_SCHEDULER) {
+	noop_direct = (current_alg == NOOP_SCHEDULER);
+	if (noop_direct && (!using_hashtable) && (!outstanding_allows(req->globalinfo->req_file, req->queue_id))) { //NOOP leaves requests waiting for their limits on outstanding requests in the timeline, for the agios thread
+		agios_list_add_tail(&req->related, &timeline);
+		noop_direct = false;
+	}
+	if (!noop_direct) {
 		signal_new_req_to_agios_thread(); 
 		if (using_hashtable) hashtable_unlock(hash);
 		else timeline_unlock();
@@ -382,5 +528,54 @@ bool agios_add_request(char *file_id,
 		else timeline_unlock();
 		process_requests_step2(info);
 	}
+	if (absorbed) process_absorbed_requests(absorbed);
+	if (hintnb > 0) give_read_ahead_hints(req->file_id, hints, hintnb);
+}
+/** 
+ * function called by the user to add a request to AGIOS, giving a deadline used by the EDF scheduling algorithm (other algorithms ignore it).
+ * @param file_id the file handle associated with the request.
+ * @param type is RT_READ or RT_WRITE.
+ * @param offset is the position of the file to be accessed (in bytes).
+ * @param len is the size of the request (in bytes).
+ * @param identifier is a 64-bit value that makes sense for the user to identify this request. It is the argument provided to the callback (so it must uniquely identify this request to the user).
+ * @param queue_id is used for the TWINS and SW algorithms to be the identifier of the server or application, respectively. If not relevant, provide 0. For files with a stripe geometry (see stripes.c), TWINS uses the server holding the request instead.
+ * @param deadline for how long (in ns, from now) the request can wait before being given back to the user. If negative, the edf_deadline configuration parameter is used.
+ * @return true of false for success. If the request is split into pieces, either all of them or none are added.
+ */
+bool agios_add_request_with_deadline(char *file_id, 
+			int32_t type, 
+			int64_t offset, 
+			int64_t len, 
+			int64_t identifier, 
+			int32_t queue_id,
+			int64_t deadline)
+{
+	struct stripe_geometry_t geometry; /**< how the file is striped, if we know */
+	int64_t piece_end; /**< the end of the current piece, when splitting the request at stripe boundaries */
+	struct request_t *req; /**< the new request (or one of its pieces) */
+	AGIOS_LIST_HEAD(pieces); /**< the pieces of a split request, all allocated before any of them is added */
+
+	get_file_stripes(file_id, &geometry);
+	//the request crosses stripe boundaries and the user can process pieces, so each stripe goes to its server in parallel
+	if (crosses_stripes(&geometry, offset, offset + len) && __atomic_load_n(&user_callbacks.process_split_cb, __ATOMIC_ACQUIRE)) {
+		for (int64_t piece_offset = offset; piece_offset < offset + len; piece_offset = piece_end) {
+			piece_end = agios_min(get_stripe_end(&geometry, piece_offset), offset + len);
+			req = new_request(file_id, type, piece_offset, piece_end - piece_offset, identifier, queue_id, get_stripe_server(&geometry, piece_offset), deadline, true);
+			if (!req) { //nothing was added yet, so the user is not waiting for any of them
+				list_of_requests_cleanup(&pieces);
+				return false;
+			}
+			agios_list_add_tail(&req->related, &pieces);
+		}
+		while (!agios_list_empty(&pieces)) {
+			req = agios_list_entry(pieces.next, struct request_t, related);
+			agios_list_del(&req->related);
+			add_request(req, agios_list_empty(&pieces));
+		}
+		return true;
+	}
+	req = new_request(file_id, type, offset, len, identifier, queue_id, get_stripe_server(&geometry, offset), deadline, false);
+	if (!req) return false;
+	add_request(req, true);
 	return true;
 }
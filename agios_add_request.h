@@ -6,13 +6,10 @@
 #include "agios_request.h"
 #include "mylist.h"
 
-/**
- * says if two requests to the same file are contiguous or not.
- */
-#define CHECK_AGGREGATE(req,nextreq) \
-     ( (req->offset <= nextreq->offset)&& \
-         ((req->offset+req->len)>=nextreq->offset))
-
+bool should_aggregate(struct request_t *req, struct request_t *nextreq);
+struct file_t *get_req_file(struct agios_list_head *hash_list, 
+					char *file_id,
+					bool create);
 struct file_t *find_req_file(struct agios_list_head *hash_list, 
 					char *file_id);
 int32_t insert_aggregations(struct request_t *req, 
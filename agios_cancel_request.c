@@ -9,139 +9,180 @@
 
 #include "agios.h"
 #include "agios_counters.h"
+#include "agios_stats.h"
 #include "common_functions.h"
 #include "data_structures.h"
 #include "hash.h"
 #include "mylist.h"
 #include "req_hashtable.h"
 #include "req_timeline.h"
+#include "scheduling_algorithms.h"
+#include "stripes.h"
+#include "trace.h"
 
-/** 
- * function used to remove a request from the scheduling queues
- * @param file_id the file handle associated with the request.
- * @param type is RT_READ or RT_WRITE.
+/**
+ * traces the cancellation of a request (only used with lifecycle traces).
+ * @param req the cancelled request.
+ * @param group the virtual request it was part of, 0 if none.
+ */
+void trace_cancel(struct request_t *req, int64_t group)
+{
+	struct timespec now; /**< when the request was cancelled. */
+
+	agios_gettime(&now);
+	agios_trace_request_event(req, AGIOS_TRACE_CANCEL, get_timespec2long(now), group, 1);
+}
+/**
+ * looks for a request in a queue (including inside virtual requests) and, if it is there, removes it and frees it. The caller must hold the lock to the data structure.
+ * @param list the queue (a queue from the hashtable, the timeline or a queue from the multi_timeline).
+ * @param queue the queue_t of the file and type of the request (the timeline has requests to many files).
+ * @param hash the line of the hashtable where the file is.
  * @param len is the size of the request (in bytes).
  * @param offset is the position of the file to be accessed (in bytes).
- * @return true or false for success 
+ * @param refused will be set to true if the request was found but it absorbed queued writes, so it cannot be cancelled (see absorb_overwritten_writes).
+ * @return true if the request was found (and removed).
  */
-//removes a request from the scheduling queues
-//returns 1 if success
-bool agios_cancel_request(char *file_id, 
-			int32_t type, 
+bool cancel_request_in_queue(struct agios_list_head *list, 
+			struct queue_t *queue,
+			int32_t hash,
 			int64_t len, 
-			int64_t offset)  
+			int64_t offset,
+			bool *refused)
 {
-	struct file_t *req_file; /**< used to look for information about the file accessed by the request */
-	int32_t hash = get_hashtable_position(file_id); /**< the position of the hashtable where information about the file is */ 
-	struct agios_list_head *list; /**< used to iterate over the line of the hashtable, and then over the queue */
+	struct file_t *req_file = queue->req_file; /**< the file accessed by the request */
 	struct request_t *req; /**< used to iterate over the queue */
 	struct request_t *aux_req; /**< used to iterate over the requests inside a virtual request */
-	bool found=false;
-	bool using_hashtable;
 
-	PRINT_FUNCTION_NAME;
-	//first acquire lock, we need to be careful because the data structure might me migrated while we are trying to do that
-	using_hashtable = acquire_adequate_lock(hash);
-	//now we have the appropriated lock
-	list = &hashlist[hash];
-	//find the structure for this file 
-	agios_list_for_each_entry (req_file, list, hashlist) {
-		if (strcmp(req_file->file_id, file_id) == 0) {
-			found = true;
-			break;
-		}
-	}
-	if (!found) { //that makes no sense, we are trying to cancel a request which was never added!!!
-		debug("PANIC! We cannot find the file structure for this request %s", file_id);
-		if (using_hashtable) hashtable_unlock(hash);
-		else timeline_unlock();
-		return false;
-	}
-	debug("REMOVING a request from file %s:", req_file->file_id );
-	//get the relevant queue
-	if (using_hashtable) {
-		if (type == RT_WRITE) list = &req_file->write_queue.list;
-		else list = &req_file->read_queue.list;
-	} else list = &timeline;
-	//find the request in the queue and remove it
-	found = false;
 	agios_list_for_each_entry (req, list, related) { //linearly search for this request in the queue. To each request in the queue, there are two possibilities: either it is a simple request, than we can just compare, or it is a virtual request, than we might have to look into the sub-requests of the virtual one
+		if (req->globalinfo != queue) continue; //another file or type (in the timeline)
 		if (req->reqnb == 1) { //simple request
 			if ((req->len == len) && (req->offset == offset)) {
+				if (req->absorbing) { //the data of the writes it absorbed would be lost, maybe there is another one with the same range
+					*refused = true;
+					continue;
+				}
 				//we found it
-				found = true;
 				//update information about the file and request counters
+				stats_write_begin(&req_file->stats_seq);
 				req->globalinfo->current_size -= req->len;
 				req->globalinfo->req_file->timeline_reqnb--;
+				stats_write_end(&req_file->stats_seq);
 				if (req->globalinfo->req_file->timeline_reqnb == 0) dec_current_filenb();
 				dec_current_reqnb(hash);
+				if (TRACE_LIFECYCLE) trace_cancel(req, 0);
 	 			//finally, free the structure
 				request_cleanup(req);
-				break;
+				return true;
 			}
 		} else { //aggregated request, the one we're looking for could be inside it
 			if ((req->offset <= offset) && (req->offset + req->len >= offset+len)) { //no need to look if the request we're looking for is not inside this one
 				agios_list_for_each_entry (aux_req, &req->reqs_list, related) {
 					if ((aux_req->len == len) && (aux_req->offset == offset)) {
-						bool first; /**< used to mark the first subrequest we visit */
-						struct request_t *tmp; /**< used to iterate over all sub-requests of this virtual request to update its information */
-						//we found it
-						found = true;
-						//remove it from the virtual request
-						agios_list_del(&aux_req->related);
-						//we need to update offset and len for the aggregated request without this one (and also timestamp)
-						first = true; 
-						//we will recalculate offset and len of the aggregation by going over all sub-requests
-						agios_list_for_each_entry (tmp, &req->reqs_list, related) {
-							if (first) {
-								first = false;
-								req->offset = tmp->offset;
-								req->len = tmp->len;
-								req->arrival_time = tmp->arrival_time;
-								req->timestamp = tmp->timestamp;
-							} else {
-								if (tmp->offset < req->offset) {
-									req->len += req->offset - tmp->offset;
-									req->offset = tmp->offset;
-								}
-								if ((tmp->offset + tmp->len) > (req->offset + req->len)) {
-									req->len += (tmp->offset + tmp->len) - (req->offset + req->len);
-								}
-								if (tmp->arrival_time < req->arrival_time) req->arrival_time = tmp->arrival_time;
-								if (tmp->timestamp < req->timestamp) req->timestamp = tmp->timestamp;
-							}	
-						} //end for all requests inside this virtual request
-						//now let's update aggregated request information
-						req->reqnb--;
-						if (req->reqnb == 1) { //it was a virtual request, now it's not anymore
-							struct agios_list_head *prev, *next; /**< used to place the sub-request in the place of the virtual request in the queue */
-							//remove the virtual request from the queue and add its only request in its place
-							prev = req->related.prev;
-							next = req->related.next;
-							agios_list_del(&req->related);
-							tmp = agios_list_entry(req->reqs_list.next, struct request_t, related);
-							__agios_list_add(&tmp->related, prev, next);
-							req->reqnb = 1; //otherwise the request_cleanup function will try to free the sub requests, that is not what we want here
-							request_cleanup(req);
+						if (aux_req->absorbing) {
+							*refused = true;
+							continue;
 						}
+						int64_t group = req->trace_group; /**< the virtual request, for the trace (req may be freed below) */
+						//we found it
+						remove_from_virtual_request(aux_req, req);
 						//the request is out of the queue, so now we update information about the file and request counters
+						stats_write_begin(&req_file->stats_seq);
 						aux_req->globalinfo->current_size -= aux_req->len;
 						aux_req->globalinfo->req_file->timeline_reqnb--;
+						stats_write_end(&req_file->stats_seq);
 						if(aux_req->globalinfo->req_file->timeline_reqnb == 0)
 							dec_current_filenb();
 						dec_current_reqnb(hash);
+						if (TRACE_LIFECYCLE) trace_cancel(aux_req, group);
 				 		//finally, free the structure
 						request_cleanup(aux_req);
-						break;
+						return true;
 					}
 				} //end for all requests inside the virtual request
-				if (found) break; 
 			} //end if request is inside a virtual request
 		} //end comparing to a virtual request
 	} //end going over all requests in the queue
-	if (!found) debug("PANIC! Could not find the request %ld %ld to file %s\n", offset, len, file_id);
+	return false;
+}
+/**
+ * looks for a request in the queues of the current data structure and, if it is there, removes it and frees it. The caller must hold the lock to the data structure.
+ * @param queue the queue_t of the file and type of the request.
+ * @param hash the line of the hashtable where the file is.
+ * @param using_hashtable is the current data structure the hashtable?
+ * @param len is the size of the request (in bytes).
+ * @param offset is the position of the file to be accessed (in bytes).
+ * @param refused @see cancel_request_in_queue
+ * @return true if the request was found (and removed).
+ */
+bool cancel_request_in_queues(struct queue_t *queue,
+			int32_t hash,
+			bool using_hashtable,
+			int64_t len, 
+			int64_t offset,
+			bool *refused)
+{
+	bool found = false; /**< the return of this function */
+
+	if (using_hashtable) found = cancel_request_in_queue(&queue->list, queue, hash, len, offset, refused);
+	else if (current_scheduler->needs_multi_timeline) { //we don't know the queue_id of the request, so we look in all queues
+		for (int32_t i = 0; (i < multi_timeline_size) && (!found); i++) found = cancel_request_in_queue(&multi_timeline[i], queue, hash, len, offset, refused);
+	} else found = cancel_request_in_queue(&timeline, queue, hash, len, offset, refused);
+	return found;
+}
+/** 
+ * function used to remove a request from the scheduling queues
+ * @param file_id the file handle associated with the request.
+ * @param type is RT_READ or RT_WRITE.
+ * @param len is the size of the request (in bytes).
+ * @param offset is the position of the file to be accessed (in bytes).
+ * @return true or false for success. A write that absorbed queued writes (see agios_set_absorbed_callback) cannot be cancelled, because their data would be lost: it returns false, and the request is given back to the user as usual.
+ */
+//removes a request from the scheduling queues
+//returns 1 if success
+bool agios_cancel_request(char *file_id, 
+			int32_t type, 
+			int64_t len, 
+			int64_t offset)  
+{
+	struct file_t *req_file; /**< used to look for information about the file accessed by the request */
+	int32_t hash = get_hashtable_position(file_id); /**< the position of the hashtable where information about the file is */ 
+	struct agios_list_head *list; /**< used to iterate over the line of the hashtable */
+	struct queue_t *queue; /**< the queue of the file for this type of request */
+	bool found=false;
+	bool refused=false; /**< did we find the request, but it absorbed queued writes? */
+	bool using_hashtable;
+
+	PRINT_FUNCTION_NAME;
+	//first acquire lock, we need to be careful because the data structure might me migrated while we are trying to do that
+	using_hashtable = acquire_adequate_lock(hash);
+	//now we have the appropriated lock
+	list = &hashlist[hash];
+	//find the structure for this file 
+	agios_list_for_each_entry (req_file, list, hashlist) {
+		if (strcmp(req_file->file_id, file_id) == 0) {
+			found = true;
+			break;
+		}
+	}
+	if (!found) { //that makes no sense, we are trying to cancel a request which was never added!!!
+		debug("PANIC! We cannot find the file structure for this request %s", file_id);
+		if (using_hashtable) hashtable_unlock(hash);
+		else timeline_unlock();
+		return false;
+	}
+	debug("REMOVING a request from file %s:", req_file->file_id );
+	//get the relevant queue, find the request in it and remove it
+	if (type == RT_WRITE) queue = &req_file->write_queue;
+	else queue = &req_file->read_queue;
+	found = cancel_request_in_queues(queue, hash, using_hashtable, len, offset, &refused);
+	if ((!found) && (!refused) && crosses_stripes(&req_file->stripes, offset, offset + len)) { //it may have been split in stripe-aligned pieces, we cancel the ones still queued
+		for (int64_t piece_offset = offset; piece_offset < offset + len; piece_offset = get_stripe_end(&req_file->stripes, piece_offset)) {
+			if (cancel_request_in_queues(queue, hash, using_hashtable, agios_min(get_stripe_end(&req_file->stripes, piece_offset), offset + len) - piece_offset, piece_offset, &refused)) found = true;
+		}
+	}
+	if ((!found) && (!refused)) debug("PANIC! Could not find the request %ld %ld to file %s\n", offset, len, file_id);
 	//release data structure lock
 	if (using_hashtable) hashtable_unlock(hash);
 	else timeline_unlock();
-	return true;
+	return !refused;
 }
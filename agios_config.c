@@ -1,7 +1,6 @@
 /*! \file agios_config.c
     \brief Configuration parameters, default values and a function to read them from a configuration file (with libconfig).
  */
-#include <assert.h>
 #include <libconfig.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -10,6 +9,7 @@
 #include "agios_config.h"
 #include "common_functions.h"
 #include "scheduling_algorithms.h"
+#include "stream_detector.h"
 
 int32_t config_agios_default_algorithm = SJF_SCHEDULER;	/**< scheduling algorithm to be used (the identifier of the scheduling algorithm) */
 int32_t config_agios_max_trace_buffer_size = 1*1024*1024; /**< in bytes. A buffer is used to keep trace messages before going to the file, to avoid small writes to the disk and decrease tracing overhead. This parameter gives the size allocated for the buffer. */
@@ -23,8 +23,40 @@ int64_t config_sw_size = 1000000000L;			/**< the window size used for the SW sch
 bool config_trace_agios=false;				/**< will agios create a trace file will all requests arrivals? */
 char *config_trace_agios_file_prefix=NULL; 		/**< if creating trace files, they will be named config_trace_agios_file_prefix.*.config_trace_agios_file_sufix. The value in the middle of prefix and sufix is a counter, the library will check for existing files so they are not overwritten. */
 char *config_trace_agios_file_sufix=NULL;		/**< @see config_trace_agios_file_prefix */
+bool config_trace_agios_binary=false;			/**< will trace files use the binary format (see agios_trace_format.h) instead of text? */
+bool config_trace_agios_lifecycle=false;		/**< will trace files also include aggregation, dispatch, release and cancel events, and scheduling algorithm changes? */
 int64_t config_twins_window=1000000L; 		/**< The amount of time TWINS will stay in one queue before moving on to the next one (in nanoseconds). The default is 1ms */
 int32_t config_waiting_time = 900000;			/**< when there are no requests, the scheduler sleep using this as a timeout. It is also used by aIOLi to wait if it thinks better aggregations are possible */
+bool config_adaptive_waiting_time = true;		/**< do aIOLi and MLF adapt the waiting time of each file to its requests (with config_waiting_time as the maximum)? */
+int64_t config_edf_deadline=1000000000L;		/**< in ns, deadline of requests added without one (with agios_add_request), used by EDF. */
+int64_t config_edf_slack=10000000L;			/**< in ns, when the earliest deadline is further than this in the future, EDF processes the shortest queue (as SJF) instead of the earliest deadline, to favor throughput. */
+int32_t *config_sfq_weights=NULL;			/**< weight of each queue_id, used by SFQ (queue_ids without a weight here have weight 1). */
+int32_t config_sfq_weights_len=0;			/**< length of config_sfq_weights. */
+int64_t config_bfq_budget=65536L;			/**< in bytes, the budget BFQ gives to queues at first, and the smallest one. */
+int64_t config_bfq_max_budget=1048576L;			/**< in bytes, the largest budget BFQ gives to sequential queues. */
+char *config_pattern_matching_file=NULL;		/**< file where PATTERN_MATCHING keeps the known access patterns between executions, NULL to learn them again every time. */
+int32_t config_pattern_matching_history=32;		/**< how many access patterns PATTERN_MATCHING remembers. */
+int32_t config_pattern_matching_threshold=300;		/**< largest distance (see get_pattern_distance) between two periods with the same access pattern. */
+struct throttle_config_t *config_throttle=NULL;		/**< bandwidth and IOPS limits, respected by all scheduling algorithms. */
+int32_t config_throttle_len=0;				/**< length of config_throttle. */
+int32_t config_max_outstanding=0;			/**< maximum number of requests given to the user and not released yet, 0 for no limit. */
+int32_t config_max_outstanding_per_file=0;		/**< maximum number of outstanding requests to each file, 0 for no limit. */
+int32_t config_max_outstanding_per_queue_id=0;		/**< maximum number of outstanding requests of each queue_id, 0 for no limit. */
+bool config_adaptive_outstanding=false;			/**< are max_outstanding and max_outstanding_per_queue_id adapted to the observed bandwidth? */
+int32_t config_adaptive_outstanding_max=256;		/**< the largest value adapted limits on outstanding requests can reach. */
+int64_t config_throttle_burst=100000000L;		/**< in ns, for how long a throttled queue_id or file prefix that was idle can go over its limits. The default is 100ms */
+struct stripe_config_t *config_stripes=NULL;		/**< stripe geometry of files in a parallel file system, by file_id prefix. */
+int32_t config_stripes_len=0;				/**< length of config_stripes. */
+int64_t config_max_aggregation_size=0;			/**< in bytes, maximum size of a virtual request (from the beginning of its first request to the end of its last one, holes included). 0 means there is no limit besides the number of requests (max_aggreg_size of the scheduling algorithm). */
+int64_t config_max_aggregation_hole=0;			/**< in bytes, maximum distance between two reads that can be aggregated (writes must be contiguous). The hole is accessed with them and its data discarded. 0 means only contiguous or overlapping requests are aggregated. */
+int32_t config_read_ahead_confidence=2;			/**< how many consecutive requests must follow the stride of a stream before its next requests are hinted to the user (between 1 and STREAM_MAX_CONFIDENCE). */
+int64_t config_read_ahead_max_size=1048576L;		/**< in bytes, the most data of a stream hinted ahead of its last request, 0 for no limit besides STREAM_MAX_HINTS requests. */
+char *config_metrics_socket=NULL;			/**< path of a Unix domain socket where the metrics exporter serves the Prometheus text format, NULL to disable. */
+char *config_metrics_file=NULL;			/**< path of a file periodically rewritten by the metrics exporter with the Prometheus text format, NULL to disable. */
+int32_t config_metrics_interval=1000;			/**< how often (in ms) the metrics exporter rewrites config_metrics_file. */
+bool config_metrics_per_file=false;			/**< does the metrics exporter include one series per file? (their number grows with the number of files accessed) */
+bool config_watch_config_file=false;			/**< should a thread watch the configuration file and reload the scheduler parameters when it changes? @see agios_reload_config */
+char *config_file_path=NULL;				/**< the configuration file given to agios_init (or DEFAULT_CONFIGFILE), read again by agios_reload_config. */
 
 /**
  * used to clean all memory allocated for the configuration parameters (at the end of the execution).
@@ -35,6 +67,61 @@ void cleanup_config_parameters(void)
 		free(config_trace_agios_file_prefix);
 	if(config_trace_agios_file_sufix)
 		free(config_trace_agios_file_sufix);
+	if (config_metrics_socket) {
+		free(config_metrics_socket);
+		config_metrics_socket = NULL;
+	}
+	if (config_metrics_file) {
+		free(config_metrics_file);
+		config_metrics_file = NULL;
+	}
+	if (config_pattern_matching_file) {
+		free(config_pattern_matching_file);
+		config_pattern_matching_file = NULL;
+	}
+	if (config_file_path) {
+		free(config_file_path);
+		config_file_path = NULL;
+	}
+	if (config_sfq_weights) {
+		free(config_sfq_weights);
+		config_sfq_weights = NULL;
+		config_sfq_weights_len = 0;
+	}
+	if (config_throttle) {
+		for (int32_t i = 0; i < config_throttle_len; i++) {
+			if (config_throttle[i].file_prefix) free(config_throttle[i].file_prefix);
+		}
+		free(config_throttle);
+		config_throttle = NULL;
+		config_throttle_len = 0;
+	}
+	if (config_stripes) {
+		for (int32_t i = 0; i < config_stripes_len; i++) {
+			if (config_stripes[i].file_prefix) free(config_stripes[i].file_prefix);
+		}
+		free(config_stripes);
+		config_stripes = NULL;
+		config_stripes_len = 0;
+	}
+}
+/**
+ * reads an optional string parameter. An empty string is the same as not providing it.
+ * @param agios_config the libconfig structure.
+ * @param path the name of the parameter.
+ * @param value will receive a newly allocated copy of the string, or NULL.
+ * @return true or false for success.
+ */
+bool config_lookup_optional_string(config_t *agios_config, const char *path, char **value)
+{
+	const char *ret_str; /**< used to capture return values from libconfig */
+
+	*value = NULL;
+	if ((config_lookup_string(agios_config, path, &ret_str) != CONFIG_TRUE) || (strlen(ret_str) < 1)) return true;
+	*value = malloc(sizeof(char)*(strlen(ret_str)+1));
+	if (!*value) return false;
+	strcpy(*value, ret_str);
+	return true;
 }
 /**
  * simple function that receives an int and returns a bool version of it. Used while reading the parameters (because libconfig does not have a bool type).
@@ -65,12 +152,194 @@ void config_print(void)
 	agios_just_print("If the scheduling algorithm is dynamic, we will start with %s and keep statistics about the last %d used algorithms.\n", get_algorithm_name_from_index(config_agios_starting_algorithm), config_agios_performance_values);
 	agios_just_print("Also, if the scheduling algorithm is dynamic, we will change the used scheduler every %ld ns, as long as %d requests were processed.\n",config_agios_select_algorithm_period, config_agios_select_algorithm_min_reqnumber);
 	agios_just_print("If aIOLi is used, its quantum is %d.\n If MLF is used, its quanutm is %d.\n If SW is used, its window size is %ld.\n If TWINS is used, its window duration is %ld.\n", config_aioli_quantum, config_mlf_quantum, config_sw_size, config_twins_window);
+	agios_just_print("If EDF is used, the default deadline is %ld ns and it favors throughput when deadlines are more than %ld ns away.\n", config_edf_deadline, config_edf_slack);
+	agios_just_print("If SFQ is used, %d queue_ids have weights in the configuration file, the others have weight 1.\n", config_sfq_weights_len);
+	agios_just_print("If BFQ is used, budgets go from %ld to %ld bytes.\n", config_bfq_budget, config_bfq_max_budget);
+	agios_just_print("If PATTERN_MATCHING is used, it remembers %d access patterns (in %s) and periods are matched to them up to a distance of %d.\n", config_pattern_matching_history, config_pattern_matching_file ? config_pattern_matching_file : "memory", config_pattern_matching_threshold);
+	for (int32_t i = 0; i < config_throttle_len; i++) {
+		if (config_throttle[i].file_prefix) agios_just_print("Requests to files starting with %s", config_throttle[i].file_prefix);
+		else agios_just_print("Requests with queue_id %d", config_throttle[i].queue_id);
+		agios_just_print(" are limited to %ld bytes/s and %ld requests/s (0 for no limit), with bursts of %ld ns.\n", config_throttle[i].bandwidth, config_throttle[i].iops, config_throttle_burst);
+	}
+	for (int32_t i = 0; i < config_stripes_len; i++) {
+		agios_just_print("Files starting with %s are striped over %d servers (from queue_id %d) in stripes of %ld bytes.\n", config_stripes[i].file_prefix, config_stripes[i].stripe_count, config_stripes[i].first_server, config_stripes[i].stripe_size);
+	}
+	agios_just_print("Outstanding requests are limited to %d in total, %d per file and %d per queue_id (0 for no limit).\n", config_max_outstanding, config_max_outstanding_per_file, config_max_outstanding_per_queue_id);
+	config_print_flag(config_adaptive_outstanding, "Are the limits in total and per queue_id adapted to the observed bandwidth? ");
 	agios_just_print("The default waiting time for the AGIOS thread is %d\n", config_waiting_time);
+	config_print_flag(config_adaptive_waiting_time, "Do aIOLi and MLF adapt the waiting time of each file to its requests? ");
+	if (config_max_aggregation_size > 0) agios_just_print("Virtual requests are limited to %ld bytes.\n", config_max_aggregation_size);
+	if (config_max_aggregation_hole > 0) agios_just_print("Reads separated by holes of up to %ld bytes are aggregated.\n", config_max_aggregation_hole);
+	agios_just_print("If read-ahead hints are enabled, streams are hinted after %d requests, with up to %ld bytes ahead.\n", config_read_ahead_confidence, config_read_ahead_max_size);
 	config_print_flag(config_trace_agios, "Will AGIOS generate trace files? ");
 	if (config_trace_agios) {
 		agios_just_print("\tTrace files are named %s.*.%s\n", config_trace_agios_file_prefix, config_trace_agios_file_sufix);
 		agios_just_print("\tTrace file buffer has size %d bytes\n", config_agios_max_trace_buffer_size);
+		config_print_flag(config_trace_agios_binary, "\tAre trace files binary? ");
+		config_print_flag(config_trace_agios_lifecycle, "\tDo trace files include the whole lifecycle of requests? ");
 	} //end if tracing
+	if (config_metrics_socket) agios_just_print("Metrics are served on the Unix socket %s\n", config_metrics_socket);
+	if (config_metrics_file) agios_just_print("Metrics are written to %s every %d ms\n", config_metrics_file, config_metrics_interval);
+	if (config_metrics_socket || config_metrics_file) config_print_flag(config_metrics_per_file, "\tDo metrics include one series per file? ");
+	config_print_flag(config_watch_config_file, "Will AGIOS reload scheduler parameters when the configuration file changes? ");
+}
+/**
+ * fills a scheduler_parameters_t with the current values of the scheduler parameters.
+ * @param params the structure to be filled.
+ */
+void get_scheduler_parameters(struct scheduler_parameters_t *params)
+{
+	params->waiting_time = config_waiting_time;
+	params->aioli_quantum = config_aioli_quantum;
+	params->mlf_quantum = config_mlf_quantum;
+	params->sw_size = config_sw_size;
+	params->twins_window = config_twins_window;
+}
+/**
+ * reads the scheduler parameters (the ones that can be changed by agios_reload_config) from libconfig. Parameters that are not in the file keep the values they have in params.
+ * @param agios_config the libconfig structure, already read from the file.
+ * @param params the structure that will receive the values.
+ * @return true or false for success (false if a value is not valid).
+ */
+bool lookup_scheduler_parameters(config_t *agios_config, struct scheduler_parameters_t *params)
+{
+	int32_t ret; /**< used to capture return values from libconfig */
+
+	if (config_lookup_int(agios_config, "library_options.waiting_time", &ret) == CONFIG_TRUE) params->waiting_time = ret;
+	if (config_lookup_int(agios_config, "library_options.aioli_quantum", &ret) == CONFIG_TRUE) params->aioli_quantum = ret;
+	if (config_lookup_int(agios_config, "library_options.mlf_quantum", &ret) == CONFIG_TRUE) params->mlf_quantum = ret;
+	if (config_lookup_int(agios_config, "library_options.SW_window", &ret) == CONFIG_TRUE) params->sw_size = ret*1000000L; //convert to ns
+	if (config_lookup_int(agios_config, "library_options.twins_window", &ret) == CONFIG_TRUE) params->twins_window = ret*1000L; //convert us to ns
+	if ((params->waiting_time < 0) || (params->aioli_quantum <= 0) || (params->mlf_quantum <= 0) || (params->sw_size <= 0) || (params->twins_window < 0)) {
+		agios_print("Configuration error! waiting_time and twins_window cannot be negative, aioli_quantum, mlf_quantum and SW_window must be positive");
+		return false;
+	}
+	return true;
+}
+/**
+ * reads the scheduler parameters again from the configuration file given to agios_init. Used by agios_reload_config.
+ * @param params the structure that will receive the values. Parameters that are not in the file keep the values they have in params.
+ * @return true or false for success.
+ */
+bool read_scheduler_parameters(struct scheduler_parameters_t *params)
+{
+	config_t agios_config; /**< used to interact with libconfig */
+	bool ret; /**< the return of this function */
+
+	if (!config_file_path) return false;
+	config_init(&agios_config);
+	if (config_read_file(&agios_config, config_file_path) != CONFIG_TRUE) {
+		agios_print("Error reading agios config file %s\n%s", config_file_path, config_error_text(&agios_config));
+		config_destroy(&agios_config);
+		return false;
+	}
+	ret = lookup_scheduler_parameters(&agios_config, params);
+	config_destroy(&agios_config);
+	return ret;
+}
+/**
+ * reads the optional sfq_weights parameter, a list with the weight of each queue_id (starting from 0).
+ * @param agios_config the libconfig structure.
+ * @return true or false for success (false if a weight is not larger than 0).
+ */
+bool lookup_sfq_weights(config_t *agios_config)
+{
+	config_setting_t *setting = config_lookup(agios_config, "library_options.sfq_weights"); /**< the list of weights */
+
+	if (!setting) return true;
+	config_sfq_weights_len = config_setting_length(setting);
+	if (config_sfq_weights_len <= 0) {
+		config_sfq_weights_len = 0;
+		return true;
+	}
+	config_sfq_weights = malloc(sizeof(int32_t)*config_sfq_weights_len);
+	if (!config_sfq_weights) return false;
+	for (int32_t i = 0; i < config_sfq_weights_len; i++) {
+		config_sfq_weights[i] = config_setting_get_int_elem(setting, i);
+		if (config_sfq_weights[i] <= 0) {
+			agios_print("Configuration error! sfq_weights must be larger than 0");
+			return false;
+		}
+	}
+	return true;
+}
+/**
+ * reads the optional throttle parameter, a list of limits, each one for a queue_id or for a file_id prefix.
+ * @param agios_config the libconfig structure.
+ * @return true or false for success (false if an entry is not valid).
+ */
+bool lookup_throttle(config_t *agios_config)
+{
+	config_setting_t *setting = config_lookup(agios_config, "library_options.throttle"); /**< the list of limits */
+	config_setting_t *entry; /**< one of the limits */
+	int32_t ret; /**< used to capture return values from libconfig */
+	const char *ret_str; /**< used to capture return values from libconfig */
+
+	if (!setting) return true;
+	config_throttle_len = config_setting_length(setting);
+	if (config_throttle_len <= 0) {
+		config_throttle_len = 0;
+		return true;
+	}
+	config_throttle = calloc(config_throttle_len, sizeof(struct throttle_config_t));
+	if (!config_throttle) return false;
+	for (int32_t i = 0; i < config_throttle_len; i++) {
+		entry = config_setting_get_elem(setting, i);
+		config_throttle[i].queue_id = -1;
+		if (config_setting_lookup_int(entry, "queue_id", &ret) == CONFIG_TRUE) config_throttle[i].queue_id = ret;
+		if ((config_setting_lookup_string(entry, "file_prefix", &ret_str) == CONFIG_TRUE) && (strlen(ret_str) > 0)) {
+			config_throttle[i].file_prefix = malloc(sizeof(char)*(strlen(ret_str)+1));
+			if (!config_throttle[i].file_prefix) return false;
+			strcpy(config_throttle[i].file_prefix, ret_str);
+		}
+		if (config_setting_lookup_int(entry, "bandwidth", &ret) == CONFIG_TRUE) config_throttle[i].bandwidth = ret*1024L; //it comes in KB/s, we store in bytes/s
+		if (config_setting_lookup_int(entry, "iops", &ret) == CONFIG_TRUE) config_throttle[i].iops = ret;
+		if (((config_throttle[i].queue_id < 0) == (config_throttle[i].file_prefix == NULL)) || 
+		   (config_throttle[i].bandwidth < 0) || (config_throttle[i].iops < 0) || 
+		   ((config_throttle[i].bandwidth == 0) && (config_throttle[i].iops == 0))) {
+			agios_print("Configuration error! each throttle entry needs either a queue_id or a file_prefix, and a positive bandwidth or iops");
+			return false;
+		}
+	}
+	return true;
+}
+/**
+ * reads the optional stripes parameter, a list of stripe geometries, each one for a file_id prefix.
+ * @param agios_config the libconfig structure.
+ * @return true or false for success (false if an entry is not valid).
+ */
+bool lookup_stripes(config_t *agios_config)
+{
+	config_setting_t *setting = config_lookup(agios_config, "library_options.stripes"); /**< the list of geometries */
+	config_setting_t *entry; /**< one of the geometries */
+	int32_t ret; /**< used to capture return values from libconfig */
+	const char *ret_str; /**< used to capture return values from libconfig */
+
+	if (!setting) return true;
+	config_stripes_len = config_setting_length(setting);
+	if (config_stripes_len <= 0) {
+		config_stripes_len = 0;
+		return true;
+	}
+	config_stripes = calloc(config_stripes_len, sizeof(struct stripe_config_t));
+	if (!config_stripes) return false;
+	for (int32_t i = 0; i < config_stripes_len; i++) {
+		entry = config_setting_get_elem(setting, i);
+		if (config_setting_lookup_string(entry, "file_prefix", &ret_str) == CONFIG_TRUE) {
+			config_stripes[i].file_prefix = malloc(sizeof(char)*(strlen(ret_str)+1));
+			if (!config_stripes[i].file_prefix) return false;
+			strcpy(config_stripes[i].file_prefix, ret_str);
+		}
+		if (config_setting_lookup_int(entry, "stripe_size", &ret) == CONFIG_TRUE) config_stripes[i].stripe_size = ret*1024L; //it comes in KB, we store in bytes
+		if (config_setting_lookup_int(entry, "stripe_count", &ret) == CONFIG_TRUE) config_stripes[i].stripe_count = ret;
+		if (config_setting_lookup_int(entry, "first_server", &ret) == CONFIG_TRUE) config_stripes[i].first_server = ret;
+		if ((!config_stripes[i].file_prefix) || (config_stripes[i].stripe_size <= 0) || 
+		   (config_stripes[i].stripe_count < 1) || (config_stripes[i].first_server < 0)) {
+			agios_print("Configuration error! each stripes entry needs a file_prefix, a positive stripe_size and stripe_count, and first_server cannot be negative");
+			return false;
+		}
+	}
+	return true;
 }
 /**
  * function used to read the configuration parameters from a configuration file. It uses libconfig to do so. 
@@ -82,12 +351,16 @@ bool read_configuration_file(char *config_file)
 	int32_t ret; /**< used to capture return values from libconfig */
 	const char *ret_str; /**< used to capture return values from libconfig */
 	config_t agios_config; /**< used to interact with libconfig */
+	struct scheduler_parameters_t params; /**< used to read the parameters that can also be changed by agios_reload_config */
 
 	//create a configuration with libconfig
 	config_init(&agios_config); 
-	//read it from a file
-	if ((!config_file) || (strlen(config_file) < 1)) ret = config_read_file(&agios_config, DEFAULT_CONFIGFILE);
-	else ret = config_read_file(&agios_config, config_file);
+	//read it from a file (and keep its name for agios_reload_config)
+	if ((!config_file) || (strlen(config_file) < 1)) config_file = DEFAULT_CONFIGFILE;
+	config_file_path = malloc(sizeof(char)*(strlen(config_file)+1));
+	if (!config_file_path) return false;
+	strcpy(config_file_path, config_file);
+	ret = config_read_file(&agios_config, config_file);
  	//check if it was possible to read from a file
 	if (ret != CONFIG_TRUE) { //it failed
 		agios_just_print("Error reading agios config file\n%s", config_error_text(&agios_config));
@@ -98,6 +371,8 @@ bool read_configuration_file(char *config_file)
 	/*1. library options*/
 	config_lookup_bool(&agios_config, "library_options.trace", &ret);
 	config_trace_agios = convert_inttobool(ret);
+	if (config_lookup_bool(&agios_config, "library_options.trace_binary", &ret) == CONFIG_TRUE) config_trace_agios_binary = convert_inttobool(ret);
+	if (config_lookup_bool(&agios_config, "library_options.trace_lifecycle", &ret) == CONFIG_TRUE) config_trace_agios_lifecycle = convert_inttobool(ret);
 	config_lookup_string(&agios_config, "library_options.trace_file_prefix", &ret_str);
 	config_trace_agios_file_prefix = malloc(sizeof(char)*(strlen(ret_str)+1));
 	if (!config_trace_agios_file_prefix) return false;
@@ -108,35 +383,88 @@ bool read_configuration_file(char *config_file)
 	strcpy(config_trace_agios_file_sufix, ret_str);
 	config_lookup_string(&agios_config, "library_options.default_algorithm", &ret_str);
 	if (false == get_algorithm_from_string(ret_str, &config_agios_default_algorithm)) return false;
-	config_lookup_int(&agios_config, "library_options.waiting_time", &ret);
-	config_waiting_time = ret;
-	config_lookup_int(&agios_config, "library_options.aioli_quantum", &ret);
-	config_aioli_quantum = ret;
-	config_lookup_int(&agios_config, "library_options.mlf_quantum", &ret);
-	config_mlf_quantum = ret;
+	get_scheduler_parameters(&params);
+	if (!lookup_scheduler_parameters(&agios_config, &params)) return false;
+	config_waiting_time = params.waiting_time;
+	if (config_lookup_bool(&agios_config, "library_options.adaptive_waiting_time", &ret) == CONFIG_TRUE) config_adaptive_waiting_time = convert_inttobool(ret);
+	config_aioli_quantum = params.aioli_quantum;
+	config_mlf_quantum = params.mlf_quantum;
+	config_sw_size = params.sw_size;
+	config_twins_window = params.twins_window;
 	config_lookup_int(&agios_config, "library_options.select_algorithm_period", &ret);
 	config_agios_select_algorithm_period = ret*1000000L; //convert it to ns
 	config_lookup_int(&agios_config, "library_options.select_algorithm_min_reqnumber", &config_agios_select_algorithm_min_reqnumber);
 	config_lookup_string(&agios_config, "library_options.starting_algorithm", &ret_str);
 	if (false == get_algorithm_from_string(ret_str, &config_agios_starting_algorithm)) return false;
-#if 0 //test if the starting algorithm is a dynamic one
-	if((config_agios_starting_algorithm == DYN_TREE_SCHEDULER) || (config_agios_starting_algorithm == ARMED_BANDIT_SCHEDULER))
-	{
+	//test if the starting algorithm is a dynamic one
+	if (find_io_scheduler(config_agios_starting_algorithm)->is_dynamic) {
 		config_agios_starting_algorithm = SJF_SCHEDULER;
 		agios_print("Configuration error! Starting algorithm cannot be a dynamic one. Using SJF instead");
 	}
-#endif
+	if (!config_lookup_optional_string(&agios_config, "library_options.pattern_matching_file", &config_pattern_matching_file)) return false;
+	config_lookup_int(&agios_config, "library_options.pattern_matching_history", &config_pattern_matching_history);
+	config_lookup_int(&agios_config, "library_options.pattern_matching_threshold", &config_pattern_matching_threshold);
+	if ((config_pattern_matching_history < 1) || (config_pattern_matching_history > 32768) || (config_pattern_matching_threshold < 0)) { //the transitions between patterns are indexed with int32_t
+		agios_print("Configuration error! pattern_matching_history must be between 1 and 32768 and pattern_matching_threshold cannot be negative");
+		return false;
+	}
 	config_lookup_int(&agios_config, "library_options.performance_values", &config_agios_performance_values);
 	config_lookup_bool(&agios_config, "library_options.enable_SW", &ret);
 	if (ret) enable_SW();
-	config_lookup_int(&agios_config, "library_options.SW_window", &ret);
-	config_sw_size = ret*1000000L; //convert to ns
-	assert(config_sw_size >= 0);
-	config_lookup_int(&agios_config, "library_options.twins_window", &ret);
-	config_twins_window = ret*1000L; //convert us to ns
-	assert(config_twins_window >= 0);
 	config_lookup_int(&agios_config, "library_options.max_trace_buffer_size", &ret);
 	config_agios_max_trace_buffer_size = ret*1024; //it comes in KB, we store in bytes
+	if (config_lookup_int(&agios_config, "library_options.edf_deadline", &ret) == CONFIG_TRUE) config_edf_deadline = ret*1000000L; //convert ms to ns
+	if (config_lookup_int(&agios_config, "library_options.edf_slack", &ret) == CONFIG_TRUE) config_edf_slack = ret*1000L; //convert us to ns
+	if ((config_edf_deadline < 0) || (config_edf_slack < 0)) {
+		agios_print("Configuration error! edf_deadline and edf_slack cannot be negative");
+		return false;
+	}
+	if (!lookup_sfq_weights(&agios_config)) return false;
+	if (config_lookup_int(&agios_config, "library_options.bfq_budget", &ret) == CONFIG_TRUE) config_bfq_budget = ret*1024L; //it comes in KB, we store in bytes
+	if (config_lookup_int(&agios_config, "library_options.bfq_max_budget", &ret) == CONFIG_TRUE) config_bfq_max_budget = ret*1024L; //it comes in KB, we store in bytes
+	if ((config_bfq_budget <= 0) || (config_bfq_max_budget < config_bfq_budget)) {
+		agios_print("Configuration error! bfq_budget must be larger than 0, and bfq_max_budget cannot be smaller than it");
+		return false;
+	}
+	if (!lookup_throttle(&agios_config)) return false;
+	if (!lookup_stripes(&agios_config)) return false;
+	if (config_lookup_int(&agios_config, "library_options.throttle_burst", &ret) == CONFIG_TRUE) config_throttle_burst = ret*1000000L; //convert ms to ns
+	if (config_throttle_burst < 0) {
+		agios_print("Configuration error! throttle_burst cannot be negative");
+		return false;
+	}
+	config_lookup_int(&agios_config, "library_options.max_outstanding", &config_max_outstanding);
+	config_lookup_int(&agios_config, "library_options.max_outstanding_per_file", &config_max_outstanding_per_file);
+	config_lookup_int(&agios_config, "library_options.max_outstanding_per_queue_id", &config_max_outstanding_per_queue_id);
+	if ((config_max_outstanding < 0) || (config_max_outstanding_per_file < 0) || (config_max_outstanding_per_queue_id < 0)) {
+		agios_print("Configuration error! max_outstanding, max_outstanding_per_file and max_outstanding_per_queue_id cannot be negative");
+		return false;
+	}
+	if (config_lookup_bool(&agios_config, "library_options.adaptive_outstanding", &ret) == CONFIG_TRUE) config_adaptive_outstanding = convert_inttobool(ret);
+	config_lookup_int(&agios_config, "library_options.adaptive_outstanding_max", &config_adaptive_outstanding_max);
+	if (config_adaptive_outstanding_max < agios_max(config_max_outstanding, config_max_outstanding_per_queue_id)) {
+		agios_print("Configuration error! adaptive_outstanding_max cannot be smaller than max_outstanding and max_outstanding_per_queue_id");
+		return false;
+	}
+	if (config_lookup_int(&agios_config, "library_options.max_aggregation_size", &ret) == CONFIG_TRUE) config_max_aggregation_size = ret*1024L; //it comes in KB, we store in bytes
+	if (config_lookup_int(&agios_config, "library_options.max_aggregation_hole", &ret) == CONFIG_TRUE) config_max_aggregation_hole = ret;
+	if ((config_max_aggregation_size < 0) || (config_max_aggregation_hole < 0)) {
+		agios_print("Configuration error! max_aggregation_size and max_aggregation_hole cannot be negative");
+		return false;
+	}
+	config_lookup_int(&agios_config, "library_options.read_ahead_confidence", &config_read_ahead_confidence);
+	if (config_lookup_int(&agios_config, "library_options.read_ahead_max_size", &ret) == CONFIG_TRUE) config_read_ahead_max_size = ret*1024L; //it comes in KB, we store in bytes
+	if ((config_read_ahead_confidence < 1) || (config_read_ahead_confidence > STREAM_MAX_CONFIDENCE) || (config_read_ahead_max_size < 0)) {
+		agios_print("Configuration error! read_ahead_confidence must be between 1 and %d, and read_ahead_max_size cannot be negative", STREAM_MAX_CONFIDENCE);
+		return false;
+	}
+	/*2. metrics exporter (all optional)*/
+	if (!config_lookup_optional_string(&agios_config, "library_options.metrics_socket", &config_metrics_socket)) return false;
+	if (!config_lookup_optional_string(&agios_config, "library_options.metrics_file", &config_metrics_file)) return false;
+	if ((config_lookup_int(&agios_config, "library_options.metrics_interval", &ret) == CONFIG_TRUE) && (ret > 0)) config_metrics_interval = ret;
+	if (config_lookup_bool(&agios_config, "library_options.metrics_per_file", &ret) == CONFIG_TRUE) config_metrics_per_file = convert_inttobool(ret);
+	/*3. live reconfiguration (optional)*/
+	if (config_lookup_bool(&agios_config, "library_options.watch_config_file", &ret) == CONFIG_TRUE) config_watch_config_file = convert_inttobool(ret);
 	//cleanup the libconfig structure
 	config_destroy(&agios_config);
 	config_print();
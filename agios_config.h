@@ -10,12 +10,46 @@
 
 #define DEFAULT_CONFIGFILE	"/etc/agios.conf" /**< If a filename is not provided in agios_init, we'll try to read from this one */
 
+/*! \struct scheduler_parameters_t
+    \brief The scheduler parameters that can be changed while AGIOS runs (see agios_reload_config), in the units of the config_* variables.
+ */
+struct scheduler_parameters_t {
+	int32_t waiting_time; /**< @see config_waiting_time */
+	int32_t aioli_quantum; /**< @see config_aioli_quantum */
+	int32_t mlf_quantum; /**< @see config_mlf_quantum */
+	int64_t sw_size; /**< @see config_sw_size */
+	int64_t twins_window; /**< @see config_twins_window */
+};
+
+/*! \struct throttle_config_t
+    \brief One entry of the throttle configuration parameter: a limit for the requests of a queue_id or to files whose file_id starts with a prefix.
+ */
+struct throttle_config_t {
+	int32_t queue_id; /**< the queue_id it applies to, -1 if it applies to a file prefix */
+	char *file_prefix; /**< the prefix of the file_ids it applies to, NULL if it applies to a queue_id */
+	int64_t bandwidth; /**< in bytes per second, 0 for no limit */
+	int64_t iops; /**< in requests per second, 0 for no limit */
+};
+/*! \struct stripe_config_t
+    \brief One entry of the stripes configuration parameter: the stripe geometry of the files whose file_id starts with a prefix.
+ */
+struct stripe_config_t {
+	char *file_prefix; /**< the prefix of the file_ids it applies to */
+	int64_t stripe_size; /**< in bytes */
+	int32_t stripe_count; /**< number of servers the files are striped over */
+	int32_t first_server; /**< the server (queue_id) holding the first stripe of the files */
+};
+
 bool read_configuration_file(char *config_file);
 void cleanup_config_parameters(void);
+void get_scheduler_parameters(struct scheduler_parameters_t *params);
+bool read_scheduler_parameters(struct scheduler_parameters_t *params);
 //about tracing
 extern bool config_trace_agios;
 extern char *config_trace_agios_file_prefix;
 extern char *config_trace_agios_file_sufix;
+extern bool config_trace_agios_binary;
+extern bool config_trace_agios_lifecycle;
 extern int32_t config_agios_max_trace_buffer_size;
 //about scheduling
 extern int32_t config_agios_default_algorithm;
@@ -23,9 +57,42 @@ extern int64_t config_agios_select_algorithm_period;
 extern int32_t config_agios_select_algorithm_min_reqnumber;
 extern int32_t config_agios_starting_algorithm;
 extern int32_t config_waiting_time;
+extern bool config_adaptive_waiting_time;
 extern int32_t config_aioli_quantum;
 extern int32_t config_mlf_quantum;
 extern int64_t config_sw_size;
 extern int64_t config_twins_window;
+extern int64_t config_edf_deadline;
+extern int64_t config_edf_slack;
+extern int32_t *config_sfq_weights;
+extern int32_t config_sfq_weights_len;
+extern int64_t config_bfq_budget;
+extern int64_t config_bfq_max_budget;
+extern char *config_pattern_matching_file;
+extern int32_t config_pattern_matching_history;
+extern int32_t config_pattern_matching_threshold;
+extern int64_t config_max_aggregation_size;
+extern int64_t config_max_aggregation_hole;
+extern int32_t config_read_ahead_confidence;
+extern int64_t config_read_ahead_max_size;
+//throttling
+extern struct throttle_config_t *config_throttle;
+extern int32_t config_throttle_len;
+extern int64_t config_throttle_burst;
+extern struct stripe_config_t *config_stripes;
+extern int32_t config_stripes_len;
+extern int32_t config_max_outstanding;
+extern int32_t config_max_outstanding_per_file;
+extern int32_t config_max_outstanding_per_queue_id;
+extern bool config_adaptive_outstanding;
+extern int32_t config_adaptive_outstanding_max;
 //performance module 
 extern int32_t config_agios_performance_values;
+//metrics exporter
+extern char *config_metrics_socket;
+extern char *config_metrics_file;
+extern int32_t config_metrics_interval;
+extern bool config_metrics_per_file;
+//live reconfiguration
+extern bool config_watch_config_file;
+extern char *config_file_path;
@@ -1,17 +1,22 @@
 /*! \file agios_release_request.c
     \brief Implementation of the agios_release_request function, called by the user after processing a request.
  */
+#include <stdlib.h>
 #include <string.h>
 
 #include "agios.h"
 #include "agios_request.h"
+#include "agios_stats.h"
 #include "common_functions.h"
 #include "data_structures.h"
 #include "hash.h"
+#include "histogram.h"
 #include "mylist.h"
 #include "performance.h"
 #include "req_hashtable.h"
 #include "req_timeline.h"
+#include "throttle.h"
+#include "trace.h"
 
 /**
  * This function is called by the release function, when the library user signaled it finished processing a request. In the case of a virtual request, its requests will be signaled separately, so here we are sure to receive a single request.
@@ -19,10 +24,12 @@
  */
 void generic_cleanup(struct request_t *req)
 {
+	stats_write_begin(&req->globalinfo->req_file->stats_seq);
 	//update the processed requests counter
 	req->globalinfo->stats.processedreq_nb++;
 	//update the data counter
 	req->globalinfo->stats.processed_req_size += req->len;
+	stats_write_end(&req->globalinfo->req_file->stats_seq);
 	request_cleanup(req); //remove from the list and free the memory
 }
 /** 
@@ -44,10 +51,15 @@ bool agios_release_request(char *file_id,
 	struct queue_t *related; /**< used to point to the queue where we should look (read or write). */
 	struct request_t *req; /**< used to iterate through all requests to the file. */
 	bool found=false; /**< did we find this request in the dispatch queues? */ 
+	struct timespec now; /**< the release time of this request. */
+	int64_t this_time; /**< now converted to a number. */
 	int64_t elapsed_time; /**< how long has it been since this request was issued? */
+	int64_t wait_time; /**< how long did this request stay in the scheduler queues? */
+	int64_t service_time; /**< how long did the user take to process this request? */
 	bool using_hashtable; /**< used to ensure we acquire the right lock. */
 	struct performance_entry_t *entry; /**< used to access performance information about the right scheduling algorithm */
-	int64_t this_bandwidth; /**< the bandwidth measured in the access by this request */
+	int64_t this_bandwidth; /**< the bandwidth measured in the access by this request (fixed point) */
+	struct request_histograms_t *histograms; /**< used to allocate the distributions of the queue at its first release */
 
 	PRINT_FUNCTION_NAME;
 
@@ -84,27 +96,47 @@ bool agios_release_request(char *file_id,
 		}
 		if (found) {
 			//let's see how long it took to process this request
-			elapsed_time = get_nanoelapsed_long(req->arrival_time);
+			agios_gettime(&now);
+			this_time = get_timespec2long(now);
+			elapsed_time = this_time - req->arrival_time;
+			wait_time = req->dispatch_timestamp - req->arrival_time;
+			service_time = this_time - req->dispatch_timestamp;
 			//update local performance information (we don't update processed_req_size here because it is updated in the generic_cleanup function)
+			this_bandwidth = get_fixed_point_bandwidth(req->len, elapsed_time);  //in bytes per nanosecond, fixed point
+			histograms = req->globalinfo->stats.histograms;
+			if (!histograms) { //the first release from this queue (if we cannot allocate them now, we will try again at the next release)
+				histograms = malloc(sizeof(struct request_histograms_t));
+				if (histograms) request_histograms_init(histograms);
+			}
+			stats_write_begin(&req_file->stats_seq);
+			req->globalinfo->stats.histograms = histograms;
 			req->globalinfo->stats.releasedreq_nb++;
-			/*! \todo do we need a different precision for bandwidth??? */
-			this_bandwidth = req->len/elapsed_time;  //in bytes per nanosecond
 			req->globalinfo->stats.processed_bandwidth = update_iterative_average(req->globalinfo->stats.processed_bandwidth, this_bandwidth, req->globalinfo->stats.releasedreq_nb);
+			req->globalinfo->stats.avg_service_time = update_iterative_average(req->globalinfo->stats.avg_service_time, service_time, req->globalinfo->stats.releasedreq_nb);
+			if (histograms) request_histograms_add(histograms, wait_time, service_time, this_bandwidth);
+			stats_write_end(&req_file->stats_seq);
 			
 			//update global performance information
 			pthread_mutex_lock(&performance_mutex);
 			//we need to figure out to each time slice this request belongs
 			entry = get_request_entry(req); //we use the timestamp from when the request was sent for processing, because we want to relate its performance to the scheduling algorithm who choose to process the request
 			if (entry) { //we need to check because maybe the request took so long to process we don't even have a record for the scheduling algorithm that issued it
+				stats_write_begin(&performance_seq);
 				entry->reqnb++;
 				entry->size += req->len;
 				entry->bandwidth = update_iterative_average(entry->bandwidth,this_bandwidth, entry->reqnb);
+				performance_account_request(entry, req->len, this_bandwidth);
+				stats_write_end(&performance_seq);
+				request_histograms_add(&entry->histograms, wait_time, service_time, this_bandwidth);
 				if (entry == current_performance_entry) { //if this request was issued by the current scheduling algorithm
 					agios_processed_reqnb++; //we only count it as a new processed request if it was issued by the current scheduling algorithm
 					debug("a request issued by the current scheduling algorithm is back! processed_reqnb is %ld", agios_processed_reqnb);
 				}
 			} //end if found a performance entry
+			request_histograms_add(&global_histograms, wait_time, service_time, this_bandwidth);
 			pthread_mutex_unlock(&performance_mutex);
+			if (TRACE_LIFECYCLE) agios_trace_request_event(req, AGIOS_TRACE_RELEASE, this_time, req->trace_group, 1);
+			throttle_release(req); //it may let other requests go
 			//now we can completely free this request
 			generic_cleanup(req);
 		} else {
@@ -0,0 +1,178 @@
+/*! \file agios_reload_config.c
+    \brief Implementation of the agios_reload_config function, and of the optional thread that calls it when the configuration file changes.
+
+    Only the scheduler parameters (waiting_time, aioli_quantum, mlf_quantum, SW_window and twins_window) can be changed while AGIOS runs, the other parameters are only read by agios_init. agios_reload_config reads them and leaves them pending. The agios thread applies all of them at once at the beginning of its next iteration, so a call to a scheduler never sees a mix of old and new values. Queued requests are kept. The scheduler state that depends on these parameters is the order of the timeline with SW (which depends on SW_window), so the timeline is reordered if SW is in use and SW_window changed, and the quantum aIOLi gives each queue (which it adjusts from the previous one), so it is reset to aioli_quantum when that changes. The other parameters are read by the schedulers every time they are used.
+    When the watch_config_file configuration parameter is set, a thread uses inotify to watch the directory of the configuration file, and calls agios_reload_config when the file is written or replaced (editors usually write a new file and rename it over the old one).
+*/
+#include <errno.h>
+#include <libgen.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "agios.h"
+#include "agios_config.h"
+#include "agios_reload_config.h"
+#include "agios_thread.h"
+#include "aIOLi.h"
+#include "common_functions.h"
+#include "req_timeline.h"
+#include "scheduling_algorithms.h"
+
+#define CONFIG_WATCHER_POLL_PERIOD 100 /**< the watcher thread checks whether it must stop at least this often (in ms). */
+
+static pthread_mutex_t g_pending_config_mutex = PTHREAD_MUTEX_INITIALIZER; /**< protects g_pending_config and g_config_is_pending. */
+static struct scheduler_parameters_t g_pending_config; /**< parameters read by agios_reload_config, waiting to be applied by the agios thread. */
+static bool g_config_is_pending = false; /**< is there something in g_pending_config? */
+static pthread_t g_watcher_thread; /**< the thread watching the configuration file. */
+static bool g_watcher_running = false; /**< was the watcher thread started? */
+static bool g_watcher_stop = false; /**< set to true to let the watcher thread know it must end. */
+static int g_inotify_fd = -1; /**< the inotify instance used by the watcher thread. */
+static char *g_watched_name = NULL; /**< name of the configuration file (without the directory), to filter inotify events. */
+
+/**
+ * function called by the user to apply changes made to the configuration file since agios_init, without restarting AGIOS. Only the scheduler parameters (waiting_time, aioli_quantum, mlf_quantum, SW_window and twins_window) are read. They are applied by the agios thread before it calls the scheduler again (in the simulation build, by the next agios_sim_run).
+ * @return true or false for success. If the file cannot be read or has invalid values, nothing changes.
+ */
+bool agios_reload_config(void)
+{
+	struct scheduler_parameters_t params; /**< the new parameters. */
+
+	//start from the most recent values, so parameters absent from the file are not changed
+	pthread_mutex_lock(&g_pending_config_mutex);
+	if (g_config_is_pending) params = g_pending_config;
+	else get_scheduler_parameters(&params);
+	pthread_mutex_unlock(&g_pending_config_mutex);
+	if (!read_scheduler_parameters(&params)) return false;
+	pthread_mutex_lock(&g_pending_config_mutex);
+	g_pending_config = params;
+	g_config_is_pending = true;
+	pthread_mutex_unlock(&g_pending_config_mutex);
+	signal_new_req_to_agios_thread(); //so it wakes up to apply them
+	return true;
+}
+/**
+ * called by the agios thread, between calls to the scheduler, to apply the parameters read by agios_reload_config (if any).
+ */
+void apply_pending_config(void)
+{
+	struct scheduler_parameters_t params; /**< the new parameters. */
+
+	pthread_mutex_lock(&g_pending_config_mutex);
+	if (!g_config_is_pending) {
+		pthread_mutex_unlock(&g_pending_config_mutex);
+		return;
+	}
+	params = g_pending_config;
+	g_config_is_pending = false;
+	pthread_mutex_unlock(&g_pending_config_mutex);
+	//only the agios thread reads these, and it is not running a scheduler now
+	config_waiting_time = params.waiting_time;
+	//aIOLi adjusts the quantum of each queue from the one it had before, so they have to start over from the new value
+	if (params.aioli_quantum != config_aioli_quantum) {
+		config_aioli_quantum = params.aioli_quantum;
+		aIOLi_reset_quanta();
+	}
+	config_mlf_quantum = params.mlf_quantum;
+	config_twins_window = params.twins_window;
+	//config_sw_size is also used to add requests to the timeline, which is done while holding the timeline lock
+	if (params.sw_size != config_sw_size) {
+		timeline_lock();
+		config_sw_size = params.sw_size;
+		if (current_alg == SW_SCHEDULER) reorder_timeline(); //requests already queued are placed in the new windows
+		timeline_unlock();
+	}
+	agios_print("applied new scheduler parameters: waiting_time %d, aioli_quantum %d, mlf_quantum %d, SW_window %ld ns, twins_window %ld ns", config_waiting_time, config_aioli_quantum, config_mlf_quantum, config_sw_size, config_twins_window);
+}
+/**
+ * main function of the watcher thread. Calls agios_reload_config every time the configuration file is written or replaced, until stop_config_watcher is called.
+ */
+static void * config_watcher_thread(void *arg)
+{
+	char events[sizeof(struct inotify_event) + NAME_MAX + 1] __attribute__ ((aligned(__alignof__(struct inotify_event)))); /**< buffer for inotify events. */
+	struct inotify_event *event; /**< used to iterate over the events in the buffer. */
+	struct pollfd pfd = { .fd = g_inotify_fd, .events = POLLIN }; /**< used to wait for events. */
+	ssize_t len; /**< how many bytes of events were read. */
+	bool changed; /**< was the configuration file among the events? */
+
+	while (!__atomic_load_n(&g_watcher_stop, __ATOMIC_ACQUIRE)) {
+		if (poll(&pfd, 1, CONFIG_WATCHER_POLL_PERIOD) <= 0) continue;
+		len = read(g_inotify_fd, events, sizeof(events));
+		if (len <= 0) continue;
+		changed = false;
+		for (char *ptr = events; ptr < events + len; ptr += sizeof(struct inotify_event) + event->len) {
+			event = (struct inotify_event *) ptr;
+			if ((event->len > 0) && (strcmp(event->name, g_watched_name) == 0)) changed = true;
+		}
+		if (changed) {
+			debug("configuration file %s changed, reloading it", config_file_path);
+			if (!agios_reload_config()) agios_print("could not reload %s, scheduler parameters were not changed", config_file_path);
+		}
+	}
+	return NULL;
+}
+/**
+ * called by agios_init to start the watcher thread, if the watch_config_file configuration parameter is set.
+ * @return true or false for success.
+ */
+bool init_config_watcher(void)
+{
+	char *dir_copy, *name_copy; /**< dirname and basename may modify their argument. */
+
+	if ((!config_watch_config_file) || (!config_file_path)) return true;
+	dir_copy = strdup(config_file_path);
+	name_copy = strdup(config_file_path);
+	if ((!dir_copy) || (!name_copy)) goto cleanup_on_error;
+	g_watched_name = strdup(basename(name_copy));
+	if (!g_watched_name) goto cleanup_on_error;
+	g_inotify_fd = inotify_init1(IN_CLOEXEC);
+	if (g_inotify_fd < 0) {
+		agios_print("Could not watch the configuration file: %s", strerror(errno));
+		goto cleanup_on_error;
+	}
+	if (inotify_add_watch(g_inotify_fd, dirname(dir_copy), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		agios_print("Could not watch the configuration file %s: %s", config_file_path, strerror(errno));
+		goto cleanup_on_error;
+	}
+	g_watcher_stop = false;
+	if (pthread_create(&g_watcher_thread, NULL, config_watcher_thread, NULL) != 0) {
+		agios_print("Unable to start the configuration watcher thread!");
+		goto cleanup_on_error;
+	}
+	g_watcher_running = true;
+	free(dir_copy);
+	free(name_copy);
+	return true;
+cleanup_on_error:
+	if (dir_copy) free(dir_copy);
+	if (name_copy) free(name_copy);
+	stop_config_watcher();
+	return false;
+}
+/**
+ * called by agios_exit to stop the watcher thread. Parameters still pending are discarded.
+ */
+void stop_config_watcher(void)
+{
+	if (g_watcher_running) {
+		__atomic_store_n(&g_watcher_stop, true, __ATOMIC_RELEASE);
+		pthread_join(g_watcher_thread, NULL);
+		g_watcher_running = false;
+	}
+	if (g_inotify_fd >= 0) {
+		close(g_inotify_fd);
+		g_inotify_fd = -1;
+	}
+	if (g_watched_name) {
+		free(g_watched_name);
+		g_watched_name = NULL;
+	}
+	pthread_mutex_lock(&g_pending_config_mutex);
+	g_config_is_pending = false;
+	pthread_mutex_unlock(&g_pending_config_mutex);
+}
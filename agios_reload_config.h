@@ -0,0 +1,12 @@
+/*! \file agios_reload_config.h
+    \brief Headers of the functions used to change scheduler parameters while AGIOS runs.
+
+    @see agios_reload_config.c
+*/
+#pragma once
+
+#include <stdbool.h>
+
+void apply_pending_config(void);
+bool init_config_watcher(void);
+void stop_config_watcher(void);
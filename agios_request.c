@@ -1,6 +1,7 @@
 /*! \file agios_request.c 
     \brief Some functions to deal with struct request_t (used to keep information about requests).
  */
+#include <stdbool.h>
 #include <stdlib.h>
 
 #include "agios_request.h"
@@ -19,6 +20,56 @@ void print_request(struct request_t *req)
 		agios_list_for_each_entry (aux_req, &req->reqs_list, related) debug("\t\t\t\t\t(%ld %ld %s)", aux_req->offset, aux_req->len, aux_req->file_id);
 	} else debug("\t\t\t%ld %ld", req->offset, req->len);
 }
+/**
+ * removes a request from a virtual request in a queue, updating the virtual request (offset, len, arrival time, timestamp and number of requests). If only one request is left in it, that request takes the place of the virtual request in the queue, and the virtual request is freed. The removed request is not freed. The caller must hold the lock to the data structure.
+ * @param aux_req the request being removed.
+ * @param req the virtual request that contains it.
+ */
+void remove_from_virtual_request(struct request_t *aux_req, struct request_t *req)
+{
+	bool first; /**< used to mark the first subrequest we visit */
+	struct request_t *tmp; /**< used to iterate over all sub-requests of this virtual request to update its information */
+
+	//remove it from the virtual request
+	agios_list_del(&aux_req->related);
+	//we need to update offset and len for the aggregated request without this one (and also timestamp)
+	first = true; 
+	//we will recalculate offset and len of the aggregation by going over all sub-requests
+	agios_list_for_each_entry (tmp, &req->reqs_list, related) {
+		if (first) {
+			first = false;
+			req->offset = tmp->offset;
+			req->len = tmp->len;
+			req->arrival_time = tmp->arrival_time;
+			req->timestamp = tmp->timestamp;
+			req->deadline = tmp->deadline;
+		} else {
+			if (tmp->offset < req->offset) {
+				req->len += req->offset - tmp->offset;
+				req->offset = tmp->offset;
+			}
+			if ((tmp->offset + tmp->len) > (req->offset + req->len)) {
+				req->len += (tmp->offset + tmp->len) - (req->offset + req->len);
+			}
+			if (tmp->arrival_time < req->arrival_time) req->arrival_time = tmp->arrival_time;
+			if (tmp->timestamp < req->timestamp) req->timestamp = tmp->timestamp;
+			if (tmp->deadline < req->deadline) req->deadline = tmp->deadline;
+		}	
+	} //end for all requests inside this virtual request
+	//now let's update aggregated request information
+	req->reqnb--;
+	if (req->reqnb == 1) { //it was a virtual request, now it's not anymore
+		struct agios_list_head *prev, *next; /**< used to place the sub-request in the place of the virtual request in the queue */
+		//remove the virtual request from the queue and add its only request in its place
+		prev = req->related.prev;
+		next = req->related.next;
+		agios_list_del(&req->related);
+		tmp = agios_list_entry(req->reqs_list.next, struct request_t, related);
+		__agios_list_add(&tmp->related, prev, next);
+		req->reqnb = 1; //otherwise the request_cleanup function will try to free the sub requests, that is not what we want here
+		request_cleanup(req);
+	}
+}
 /**
  * free all requests from a list of requests.
  * @see request_cleanup
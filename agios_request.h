@@ -8,9 +8,37 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "histogram.h"
 #include "mylist.h"
 
 struct request_t;
+/*! \struct outstanding_t
+    \brief counters used to limit the number of outstanding (selected but not released) requests of a file, of a queue_id or of the whole library. They are protected by the throttling mutex. @see throttle.c
+ */
+struct outstanding_t {
+	int32_t reqnb; /**< number of outstanding requests */
+};
+/*! \struct stripe_geometry_t
+    \brief how a file is striped over the servers of a parallel file system, from the stripes configuration parameter or from agios_set_file_stripes. @see stripes.c
+ */
+struct stripe_geometry_t {
+	int64_t stripe_size; /**< in bytes, 0 if the geometry is not known */
+	int32_t stripe_count; /**< number of servers the file is striped over */
+	int32_t first_server; /**< the server (queue_id) holding the first stripe of the file, the next stripes go to the next ones */
+};
+/*! \struct stream_t
+    \brief what the stream detector knows about the requests arriving to a read queue, used to give read-ahead hints to the user. @see stream_detector.c
+ */
+struct stream_t {
+	int64_t last_end; /**< offset+len of the last request */
+	int64_t last_len; /**< size of the last request, the predicted size of the next ones */
+	int64_t stride; /**< distance from the end of a request to the beginning of the next one (0 for a sequential stream) */
+	int32_t confidence; /**< how many consecutive requests followed the stride (halved when one does not), up to STREAM_MAX_CONFIDENCE */
+	int64_t hinted_next; /**< offset of the first predicted request that was not hinted to the user yet, -1 if none was hinted for the current stride */
+	int64_t last_user_id; /**< identifier of the last request, so the pieces of a request split at stripe boundaries are seen as one request */
+	bool last_piece; /**< was the last request a piece? */
+	int64_t reqnb; /**< requests seen by the detector */
+};
 /*! \struct queue_statistics_t 
     \brief the statistics we keep for each queue (one for write and another for read) of each file in the system
  */
@@ -18,7 +46,7 @@ struct queue_statistics_t  {
 	int64_t processedreq_nb; /**< number of processed requests */
 	int64_t receivedreq_nb; /**< number of received requests */
 	int64_t processed_req_size; /**< total amount of served data */
-	int64_t processed_bandwidth; /**< average bytes per ns */
+	int64_t processed_bandwidth; /**< average bytes per ns (fixed point, see BANDWIDTH_FIXED_POINT_SHIFT) */
 	int64_t releasedreq_nb; /**< number of released requests */
 	//statistics on request size
 	int64_t avg_req_size; /**< iteratively calculated average request size (among received requests). */ 
@@ -27,6 +55,8 @@ struct queue_statistics_t  {
 	//number of performed aggregations and of aggregated requests
 	int64_t 	aggs_no;	/**< number of performed aggregations */ 
 	int64_t 	avg_agg_size;  /**< iteratively calculated average aggregation size (in number of requests) */
+	int64_t avg_service_time; /**< iteratively calculated service time (between dispatch and release) of released requests, in ns. */
+	struct request_histograms_t *histograms; /**< distributions of waiting time, service time and bandwidth of released requests. They are large (see histogram.h), so they are only allocated when the first request of the queue is released, NULL before that (or if we could not allocate them). */
 };
 /*! \struct queue_t
     \brief A queue of requests with associated information and statistics.
@@ -44,6 +74,13 @@ struct queue_t {
 	int32_t nextquantum; /**< used by aIOLi to keep track of quanta */
 	int64_t shift_phenomena; /**< counter used to make decisions regarding waiting times (for aIOLi) */
 	int64_t better_aggregation; /**< counter used to make decisions regarding waiting times (for aIOLi) */
+	//fields used by BFQ
+	int64_t bfq_budget; /**< how much data (in bytes) BFQ serves from this queue each time it is selected, 0 if not decided yet */
+	int64_t bfq_finish; /**< finish tag of this queue for BFQ (in the virtual time, which is in ns of estimated service time) */
+	//used by EDF
+	int64_t edf_key; /**< key of the current entry of this queue in the EDF heap, INT64_MAX if it has none. Older entries with other keys may still be there */
+	//used by the stream detector (only for reads)
+	struct stream_t stream; /**< the sequential or strided stream of requests to this queue, used for read-ahead hints */
 	//fields used to keep statistics
 	struct queue_statistics_t stats;  /**< statistics */
 	int64_t current_size; /**< sum of all its requests' sizes (even if they overlap). Used by SJF and some statistics */ 
@@ -65,9 +102,19 @@ struct file_t {
 	int64_t timeline_reqnb; /**< counter for knowing how many requests in the timeline are accessing this file */
 	struct agios_list_head hashlist; /**< to insert this structure in a list (hashtable position or timeline_files) */ 
 	//used by aIOLi and SJF to handle waiting times (they apply to the whole file, not only the queue)
-	int32_t waiting_time; /**< for how long should we be waiting */
-	struct timespec waiting_start; /**< since when are we waiting */
+	int32_t waiting_time; /**< for how long the file was made to wait, 0 if it is not waiting */
+	int64_t waiting_end; /**< when the wait ends (in the clock of agios_gettime, in ns), the key of the file in the heap of waiting files (see waiting_common.c) */
+	int32_t wait_factor; /**< with adaptive_waiting_time, the waiting time of this file in average times between requests (see get_adaptive_waiting_time), 0 if waiting did not pay off */
+	struct queue_t *wait_queue; /**< the queue of the request we did not process when we made this file wait, so we can tell if waiting gave it a larger aggregation. NULL if we are not evaluating a wait */
+	int64_t wait_offset; /**< the offset of that request */
+	int32_t wait_reqnb; /**< how many requests it had */
+	int32_t wait_probe; /**< decisions to wait skipped since wait_factor became 0 */
 	int64_t first_request_time; /**< arrival time of the first request to this file, all requests' arrival times will be relative to this one */
+	int32_t trace_index; /**< index used to identify this file in binary traces, -1 if it was not traced yet */
+	uint32_t stats_seq; /**< sequence counter protecting timeline_reqnb and the statistics of both queues from agios_get_file_stats, see agios_stats.h */
+	struct file_t *stats_next; /**< next file in the list read by agios_get_file_stats (files are never removed from it before agios_exit) */
+	struct outstanding_t outstanding; /**< used to limit the number of outstanding requests to this file (max_outstanding_per_file) */
+	struct stripe_geometry_t stripes; /**< how the file is striped over the servers, used to keep virtual requests inside a stripe */
 };
 /*! \struct request_t
     \brief The structure holding information about one request in the system.
@@ -82,7 +129,10 @@ struct request_t {
 	int64_t offset; /**< position of the file in bytes */
 	int64_t len; /**< request size in bytes */
 	int32_t queue_id; /**< an identifier of the queue to be used for this request, relevant for SW and TWINS only */
+	int32_t server; /**< the server holding the request, from the stripe geometry of its file (see stripes.c), -1 if not known. TWINS uses it instead of queue_id */
+	int32_t dispatch_queue_id; /**< the queue_id of the (possibly virtual) request it was given to the user with, used to count outstanding requests per queue_id */
 	int64_t sw_priority; /**< value calculated by the SW algorithm to insert the request into the queue */
+	int64_t deadline; /**< when the request should be given back to the user (in the same clock as arrival_time), used by EDF. For virtual requests, the earliest deadline among its requests */
 	int64_t user_id;  /**< value passed by AGIOS' user (for knowing which request is this one)*/
 	int32_t sched_factor; /**< used by MLF and aIOLi */
 	int64_t timestamp; /**< the arrival order at the scheduler (a global value incremented each time a request arrives so the current value is given to that request as its timestamp)*/
@@ -93,9 +143,15 @@ struct request_t {
 	int32_t reqnb; /**< for virtual requests (real requests), it is the number of requests aggregated into this one. */
 	struct agios_list_head reqs_list; /**< list of requests inside this virtual request*/
 	struct request_t *agg_head; /**< pointer to the virtual request structure (if this one is part of an aggregation) */
+	int32_t duplicates; /**< for virtual read requests, how many of the aggregated requests were identical to, contained in or containing another one when they were included. process_requests_step1 only looks for duplicates if it is not 0 */
+	bool absorbing; /**< did this write absorb queued writes? Then it cannot be cancelled, because their data is only written by it (see absorb_overwritten_writes) */
+	bool piece; /**< is this a stripe-aligned piece of a request split by agios_add_request? (it is given back with the callback set by agios_set_split_callback) */
+	int32_t pieces; /**< for virtual requests, how many of the aggregated requests are pieces. process_requests_step1 only looks for pieces if it is not 0 */
+	int64_t trace_group; /**< identifies the virtual request in lifecycle traces. In sub-requests, it is the group they were dispatched with. 0 if not used */
 	struct agios_list_head list;  /**< to be inserted as part of a virtual request */
 };
 
 void request_cleanup(struct request_t *aux_req);
+void remove_from_virtual_request(struct request_t *aux_req, struct request_t *req);
 void list_of_requests_cleanup(struct agios_list_head *list);
 void print_request(struct request_t *req);
@@ -0,0 +1,121 @@
+/*! \file agios_set_scheduler.c
+    \brief Implementation of the agios_set_scheduler function, used to change the scheduling algorithm while AGIOS runs.
+
+    The change is not done by the caller: it leaves a request for the agios thread, which performs it between two scheduling rounds (at the beginning of its next iteration) and wakes up the caller with the cost of the migration. Only one change is pending at a time, other callers wait for their turn. In the simulation build, there is no agios thread, so the change is done by the caller.
+*/
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "agios.h"
+#include "agios_set_scheduler.h"
+#include "agios_thread.h"
+#include "common_functions.h"
+#include "req_timeline.h"
+#include "scheduling_algorithms.h"
+
+#ifndef AGIOS_SIMULATION
+static pthread_mutex_t g_set_scheduler_mutex = PTHREAD_MUTEX_INITIALIZER; /**< serializes callers of agios_set_scheduler, so only one change is pending at a time. */
+#endif
+static pthread_mutex_t g_switch_mutex = PTHREAD_MUTEX_INITIALIZER; /**< protects the variables below. */
+static pthread_cond_t g_switch_cond = PTHREAD_COND_INITIALIZER; /**< signaled by the agios thread when the pending change was done. */
+static bool g_switch_accepted = false; /**< is the agios thread running (so it will handle our request)? */
+static int32_t g_switch_alg = -1; /**< the scheduling algorithm asked by agios_set_scheduler, -1 if there is no pending change. */
+static bool g_switch_done; /**< was the pending change done? */
+static bool g_switch_result; /**< the result of the change. */
+static struct agios_scheduler_switch_t g_switch_report; /**< the cost of the change. */
+
+/**
+ * called by the agios thread when it starts (with true) and when it ends (with false). Pending changes are failed when it ends.
+ * @param accept true if the agios thread will handle requests from now on.
+ */
+void accept_scheduler_switch_requests(bool accept)
+{
+	pthread_mutex_lock(&g_switch_mutex);
+	g_switch_accepted = accept;
+	if ((!accept) && (g_switch_alg >= 0)) {
+		g_switch_alg = -1;
+		g_switch_result = false;
+		g_switch_done = true;
+		pthread_cond_broadcast(&g_switch_cond);
+	}
+	pthread_mutex_unlock(&g_switch_mutex);
+}
+/**
+ * called by the agios thread between scheduling rounds to perform the change asked by agios_set_scheduler, if any.
+ */
+void perform_scheduler_switch_request(void)
+{
+	int32_t alg; /**< the new scheduling algorithm. */
+	struct agios_scheduler_switch_t report; /**< the cost of the change. */
+	bool ret; /**< the result of the change. */
+
+	pthread_mutex_lock(&g_switch_mutex);
+	alg = g_switch_alg;
+	pthread_mutex_unlock(&g_switch_mutex);
+	if (alg < 0) return;
+	memset(&report, 0, sizeof(report));
+	ret = switch_scheduler(alg, &report);
+	pthread_mutex_lock(&g_switch_mutex);
+	g_switch_report = report;
+	g_switch_result = ret;
+	g_switch_done = true;
+	g_switch_alg = -1;
+	pthread_cond_broadcast(&g_switch_cond);
+	pthread_mutex_unlock(&g_switch_mutex);
+}
+/**
+ * function called by the user to change the scheduling algorithm (for instance between jobs). Queued requests are kept and migrated to the new scheduling algorithm. The call returns when the change is done, which happens at the end of the current scheduling round.
+ * @param name the name of the scheduling algorithm (as in the default_algorithm configuration parameter).
+ * @param report will be filled with the cost of the change (can be NULL).
+ * @return true or false for success. It fails if the name is unknown, if a dynamic scheduling algorithm is choosing the algorithms, or for TWINS and SFQ if agios_init was given no queues.
+ */
+bool agios_set_scheduler(const char *name, struct agios_scheduler_switch_t *report)
+{
+	int32_t alg; /**< identifier of the new scheduling algorithm. */
+#ifndef AGIOS_SIMULATION
+	struct timespec start, end; /**< used to measure for how long we waited. */
+	bool ret; /**< the return of this function. */
+#endif
+
+	if (report) memset(report, 0, sizeof(struct agios_scheduler_switch_t));
+	if ((!name) || (!get_algorithm_from_string(name, &alg))) {
+		agios_print("agios_set_scheduler: unknown scheduling algorithm %s", name ? name : "(null)");
+		return false;
+	}
+	if (find_io_scheduler(alg)->is_dynamic || is_dynamic_scheduler_in_use()) {
+		agios_print("agios_set_scheduler: cannot be used with dynamic scheduling algorithms");
+		return false;
+	}
+	if (find_io_scheduler(alg)->needs_multi_timeline && (multi_timeline_size == 0)) {
+		agios_print("agios_set_scheduler: %s needs a max_queue_id larger than 0 in agios_init", find_io_scheduler(alg)->name);
+		return false;
+	}
+#ifdef AGIOS_SIMULATION
+	if (!current_scheduler) return false; //agios_init was not called
+	return switch_scheduler(alg, report);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pthread_mutex_lock(&g_set_scheduler_mutex);
+	pthread_mutex_lock(&g_switch_mutex);
+	if (!g_switch_accepted) { //the agios thread is not running
+		pthread_mutex_unlock(&g_switch_mutex);
+		pthread_mutex_unlock(&g_set_scheduler_mutex);
+		return false;
+	}
+	g_switch_alg = alg;
+	g_switch_done = false;
+	pthread_mutex_unlock(&g_switch_mutex);
+	signal_new_req_to_agios_thread(); //so it wakes up if it is sleeping
+	pthread_mutex_lock(&g_switch_mutex);
+	while (!g_switch_done) pthread_cond_wait(&g_switch_cond, &g_switch_mutex);
+	ret = g_switch_result;
+	if (report) *report = g_switch_report;
+	pthread_mutex_unlock(&g_switch_mutex);
+	pthread_mutex_unlock(&g_set_scheduler_mutex);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (report) report->waited_ns = get_timespec2long(end) - get_timespec2long(start) - report->blocked_ns;
+	return ret;
+#endif
+}
@@ -0,0 +1,11 @@
+/*! \file agios_set_scheduler.h
+    \brief Headers of the functions used by the agios thread to perform changes of scheduling algorithm asked by agios_set_scheduler.
+
+    @see agios_set_scheduler.c
+*/
+#pragma once
+
+#include <stdbool.h>
+
+void perform_scheduler_switch_request(void);
+void accept_scheduler_switch_requests(bool accept);
@@ -0,0 +1,56 @@
+/*! \file agios_sim.c
+    \brief Implementation of the virtual clock and of the replacement for the agios thread used in the simulation build.
+
+    Only compiled in when AGIOS_SIMULATION is defined. In that build agios_gettime reads the virtual clock, which is only changed by the simulator. 
+    @see agios_sim.h
+ */
+#ifdef AGIOS_SIMULATION
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "agios_counters.h"
+#include "agios_sim.h"
+#include "agios_thread.h"
+#include "common_functions.h"
+#include "throttle.h"
+
+static int64_t g_sim_now=0; /**< the virtual time in ns. */
+
+/**
+ * sets the virtual time. Time must never go backwards.
+ * @param now the new virtual time in ns.
+ */
+void agios_sim_set_time(int64_t now)
+{
+	if (now > g_sim_now) g_sim_now = now;
+}
+/**
+ * @return the virtual time in ns.
+ */
+int64_t agios_sim_get_time(void)
+{
+	return g_sim_now;
+}
+/**
+ * used by agios_gettime in the simulation build.
+ * @param timev will receive the virtual time.
+ */
+void agios_sim_gettime(struct timespec *timev)
+{
+	get_long2timespec(g_sim_now, timev);
+}
+/**
+ * does what the agios thread would do when waking up at the current virtual time (one iteration of its loop).
+ * @param wake_on_arrival will be set to true if agios_sim_run must also be called as soon as a new request arrives, false if it must only be called after the returned time.
+ * @return for how long (in ns) the agios thread would sleep before running again. 0 means it must run again right away, -1 means it has nothing to do until a new request arrives (or, with limits on outstanding requests, until a request is released).
+ */
+int64_t agios_sim_run(bool *wake_on_arrival)
+{
+	int32_t waiting_time = agios_thread_iteration(wake_on_arrival);
+
+	//the real agios thread wakes up periodically even without requests, but that does not change anything if none arrives (unless requests are waiting for the throttling)
+	if ((*wake_on_arrival) && (get_current_reqnb() == 0) && (get_throttle_waiting_time() == 0)) return -1;
+	return waiting_time;
+}
+#endif
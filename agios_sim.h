@@ -0,0 +1,20 @@
+/*! \file agios_sim.h
+    \brief Interface to drive AGIOS from a discrete-event simulator (libagios_sim.so only).
+
+    In the simulation build (make simulation), there is no agios thread and AGIOS does not read the system clock. The simulator sets the virtual time with agios_sim_set_time before every call to the library (agios_add_request, agios_release_request, etc), and calls agios_sim_run where the agios thread would wake up. Everything happens in the caller's thread, so a simulation is deterministic. Callbacks are called from agios_sim_run (or from agios_add_request with the NOOP scheduler).
+    @see agios_sim.c
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void agios_sim_set_time(int64_t now);
+int64_t agios_sim_get_time(void);
+int64_t agios_sim_run(bool *wake_on_arrival);
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,156 @@
+/*! \file agios_stats.c
+    \brief Implementation of the agios_get_stats and agios_get_file_stats functions, used to monitor the library while it is running.
+
+    These functions do not take any of the locks used by the I/O path, so they can be called often (for instance by a monitoring thread) without slowing down the scheduler. Global statistics, performance and file statistics are each copied with a sequence counter (see agios_stats.h). Files are found through a list to which they are added when created and from which they are only removed by agios_exit, so it can be traversed without locks. These functions must not be called during or after agios_exit.
+    @see agios_stats.h
+*/
+#include <string.h>
+
+#include "agios.h"
+#include "agios_counters.h"
+#include "agios_request.h"
+#include "agios_stats.h"
+#include "common_functions.h"
+#include "histogram.h"
+#include "performance.h"
+#include "scheduling_algorithms.h"
+#include "statistics.h"
+
+_Static_assert(IO_SCHEDULER_COUNT <= AGIOS_STATS_MAX_ALGORITHMS, "AGIOS_STATS_MAX_ALGORITHMS must be increased");
+
+static struct file_t *all_files = NULL; /**< list (through stats_next) of all file_t structures, most recent first. */
+
+/**
+ * adds a newly created file to the list read by agios_get_file_stats. The caller holds the lock of the file's hashtable line, but files from other lines may be added at the same time.
+ * @param req_file the new file, already initialized.
+ */
+void stats_register_file(struct file_t *req_file)
+{
+	struct file_t *head = __atomic_load_n(&all_files, __ATOMIC_RELAXED); /**< the current first file of the list. */
+
+	do {
+		req_file->stats_next = head;
+	} while (!__atomic_compare_exchange_n(&all_files, &head, req_file, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)); //release so readers see an initialized file
+}
+/**
+ * called by agios_exit, before the files are freed with the hashtable.
+ */
+void cleanup_stats_module(void)
+{
+	__atomic_store_n(&all_files, NULL, __ATOMIC_RELEASE);
+}
+/**
+ * converts a bandwidth from bytes per ns in fixed point to bytes per second.
+ * @param bandwidth the fixed point bandwidth (see BANDWIDTH_FIXED_POINT_SHIFT).
+ * @return the bandwidth in bytes per second, 0 if it was not measured yet.
+ */
+static double bandwidth_to_bytes_per_second(int64_t bandwidth)
+{
+	if (bandwidth <= 0) return 0.0;
+	return (((double) bandwidth) / (1 << BANDWIDTH_FIXED_POINT_SHIFT)) * 1e9;
+}
+/**
+ * function called by the user to get a snapshot of the library state. It does not stop the scheduler.
+ * @param stats the structure that will be filled.
+ * @return true or false for success.
+ */
+bool agios_get_stats(struct agios_stats_t *stats)
+{
+	struct global_statistics_t global; /**< copy of the global statistics. */
+	struct performance_totals_t totals[IO_SCHEDULER_COUNT]; /**< copy of the performance of each scheduling algorithm. */
+	int64_t bandwidth; /**< bandwidth observed with the current scheduling algorithm. */
+
+	if (!stats) return false;
+	memset(stats, 0, sizeof(struct agios_stats_t));
+	stats->current_alg = __atomic_load_n(&current_alg, __ATOMIC_RELAXED);
+	stats->current_alg_name = get_algorithm_name_from_index(stats->current_alg);
+	stats->queued_reqnb = __atomic_load_n(&current_reqnb, __ATOMIC_RELAXED);
+	stats->queued_filenb = __atomic_load_n(&current_filenb, __ATOMIC_RELAXED);
+	get_global_stats(&global);
+	stats->received_reqnb = global.total_reqnb;
+	stats->reads = global.reads;
+	stats->writes = global.writes;
+	stats->avg_request_size = global.avg_request_size;
+	stats->avg_time_between_requests = global.avg_time_between_requests;
+	stats->aggs_no = global.aggs_no;
+	stats->avg_agg_size = (global.aggs_no > 0) ? (double) global.avg_agg_size : 0.0;
+	bandwidth = get_performance_snapshot(totals);
+	stats->current_bandwidth = bandwidth_to_bytes_per_second(bandwidth);
+	stats->algorithm_count = IO_SCHEDULER_COUNT;
+	for (int32_t i = 0; i < IO_SCHEDULER_COUNT; i++) {
+		stats->algorithms[i].name = get_algorithm_name_from_index(i);
+		stats->algorithms[i].released_reqnb = totals[i].reqnb;
+		stats->algorithms[i].released_bytes = totals[i].size;
+		stats->algorithms[i].bandwidth = bandwidth_to_bytes_per_second(totals[i].bandwidth);
+	}
+	return true;
+}
+/**
+ * fills the public statistics of a queue from its internal information. Called inside a read of the file's sequence counter.
+ * @param ret the structure that will be filled.
+ * @param queue the queue.
+ */
+static void fill_queue_stats(struct agios_queue_stats_t *ret, struct queue_t *queue)
+{
+	ret->queued_bytes = queue->current_size;
+	ret->received_reqnb = queue->stats.receivedreq_nb;
+	ret->released_reqnb = queue->stats.releasedreq_nb;
+	ret->processed_bytes = queue->stats.processed_req_size;
+	ret->bandwidth = bandwidth_to_bytes_per_second(queue->stats.processed_bandwidth);
+	ret->avg_req_size = (queue->stats.receivedreq_nb > 0) ? queue->stats.avg_req_size : -1;
+	ret->avg_time_between_requests = (queue->stats.receivedreq_nb > 1) ? queue->stats.avg_time_between_requests : -1;
+	ret->avg_distance = (queue->stats.receivedreq_nb > 1) ? queue->stats.avg_distance : -1;
+	ret->aggs_no = queue->stats.aggs_no;
+	ret->avg_agg_size = (queue->stats.aggs_no > 0) ? (double) queue->stats.avg_agg_size : 0.0;
+	if (queue->stats.histograms) {
+		ret->wait_p99 = histogram_percentile(&queue->stats.histograms->wait, 99.0);
+		ret->service_p50 = histogram_percentile(&queue->stats.histograms->service, 50.0);
+		ret->service_p99 = histogram_percentile(&queue->stats.histograms->service, 99.0);
+	} else {
+		ret->wait_p99 = -1;
+		ret->service_p50 = -1;
+		ret->service_p99 = -1;
+	}
+}
+/**
+ * gives the first file of the list of all files, to be traversed through stats_next without locks.
+ * @return the most recently created file, NULL if there are none.
+ */
+struct file_t *stats_first_file(void)
+{
+	return __atomic_load_n(&all_files, __ATOMIC_ACQUIRE);
+}
+/**
+ * copies the statistics about a file without holding its lock.
+ * @param req_file the file, obtained from the list of all files.
+ * @param stats the structure that will be filled.
+ */
+void get_file_stats(struct file_t *req_file, struct agios_file_stats_t *stats)
+{
+	uint32_t seq; /**< value of the sequence counter before the copy. */
+
+	do {
+		seq = stats_read_begin(&req_file->stats_seq);
+		stats->queued_reqnb = req_file->timeline_reqnb;
+		fill_queue_stats(&stats->read, &req_file->read_queue);
+		fill_queue_stats(&stats->write, &req_file->write_queue);
+	} while (stats_read_retry(&req_file->stats_seq, seq));
+}
+/**
+ * function called by the user to get a snapshot of the statistics about a file. It does not stop the scheduler.
+ * @param file_id the file handle.
+ * @param stats the structure that will be filled.
+ * @return true or false for success (false if AGIOS never received requests to this file).
+ */
+bool agios_get_file_stats(char *file_id, struct agios_file_stats_t *stats)
+{
+	struct file_t *req_file; /**< used to iterate over the list of files. */
+
+	if ((!file_id) || (!stats)) return false;
+	for (req_file = stats_first_file(); req_file; req_file = req_file->stats_next) {
+		if (strcmp(req_file->file_id, file_id) == 0) break;
+	}
+	if (!req_file) return false;
+	get_file_stats(req_file, stats);
+	return true;
+}
@@ -0,0 +1,60 @@
+/*! \file agios_stats.h
+    \brief Headers of the statistics snapshot module, and helpers for the sequence counters protecting the data it reads.
+
+    Statistics are updated by the I/O path while holding its usual locks. Readers (agios_get_stats and agios_get_file_stats) never take these locks: each group of statistics is protected by a sequence counter, which is odd while a writer is updating the data. A reader copies the data and tries again if the counter was odd or changed meanwhile. Writers of the same counter must already be serialized by a lock.
+    @see agios_stats.c
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "agios_request.h"
+
+/**
+ * called by a writer (holding the lock that serializes writers) before updating data protected by seq.
+ * @param seq the sequence counter.
+ */
+static inline void stats_write_begin(uint32_t *seq)
+{
+	__atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE); //the counter becomes odd before any of the data changes
+}
+/**
+ * called by a writer after updating data protected by seq.
+ * @param seq the sequence counter.
+ */
+static inline void stats_write_end(uint32_t *seq)
+{
+	__atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+/**
+ * called by a reader before copying data protected by seq. Waits while a writer is updating it.
+ * @param seq the sequence counter.
+ * @return the value to be given to stats_read_retry.
+ */
+static inline uint32_t stats_read_begin(uint32_t *seq)
+{
+	uint32_t ret;
+
+	while ((ret = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1) ;
+	return ret;
+}
+/**
+ * called by a reader after copying data protected by seq.
+ * @param seq the sequence counter.
+ * @param start the value returned by stats_read_begin.
+ * @return true if the copy may be inconsistent and must be done again.
+ */
+static inline bool stats_read_retry(uint32_t *seq, uint32_t start)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE); //the data was read before we check the counter again
+	return __atomic_load_n(seq, __ATOMIC_RELAXED) != start;
+}
+
+struct agios_file_stats_t;
+
+void stats_register_file(struct file_t *req_file);
+void cleanup_stats_module(void);
+struct file_t *stats_first_file(void);
+void get_file_stats(struct file_t *req_file, struct agios_file_stats_t *stats);
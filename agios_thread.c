@@ -3,22 +3,29 @@
 
     The agios thread stays in a loop of calling a scheduler to process new requests and waiting for new requests to arrive.
 */
+#include <errno.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <pthread.h>
+#include <time.h>
 
+#include "agios.h"
 #include "agios_config.h"
 #include "agios_counters.h"
+#include "agios_reload_config.h"
+#include "agios_set_scheduler.h"
 #include "agios_thread.h"
 #include "common_functions.h"
 #include "data_structures.h"
 #include "performance.h"
 #include "scheduling_algorithms.h"
 #include "statistics.h"
+#include "throttle.h"
 
 static pthread_cond_t g_request_added_cond = PTHREAD_COND_INITIALIZER;  /**< Used to let the agios thread know that we have new requests. */
 static pthread_mutex_t g_request_added_mutex = PTHREAD_MUTEX_INITIALIZER; /**< Used to protect the request_added_cond. */
 static bool g_agios_thread_stop = false; /**< Set to true when the agios_exit function calls stop_the_agios_thread. */
+static int64_t g_request_added_count = 0; /**< Incremented (protected by g_request_added_mutex) every time we signal g_request_added_cond, so the agios thread does not sleep if a request arrived after it last looked at the queues. */
 static struct timespec g_last_algorithm_update; //the time at the last time we've selected an algorithm
 static struct io_scheduler_instance_t *g_dynamic_scheduler=NULL; /**< The scheduling algorithm chosen in the configuration parameters. */ 
 
@@ -28,6 +35,7 @@ static struct io_scheduler_instance_t *g_dynamic_scheduler=NULL; /**< The schedu
 void signal_new_req_to_agios_thread(void)
 {
 	pthread_mutex_lock(&g_request_added_mutex);
+	g_request_added_count++;
 	pthread_cond_signal(&g_request_added_cond);
 	pthread_mutex_unlock(&g_request_added_mutex);
 }
@@ -63,15 +71,47 @@ void fill_struct_timespec(int32_t value_ns, struct timespec *str)
 	str->tv_sec = value_ns / 1000000000;
 	str->tv_nsec = value_ns % 1000000000;
 }
-/** 
- * the main function executed by the agios thread, which is responsible for processing requests that have been added to AGIOS.
+/**
+ * tells whether the scheduling algorithm is being chosen by a dynamic scheduling algorithm (so it cannot be set by agios_set_scheduler).
+ * @return true or false.
  */
-void * agios_thread(void *arg)
+bool is_dynamic_scheduler_in_use(void)
 {
-	struct timespec timeout; /**< Used to set a timeout for pthread_cond_timedwait, so the thread periodically checks if it has to end. */
-	int32_t remaining_time = 0; /**< Used to calculate how long until we change the scheduling algorithm again */
-	int32_t scheduler_waiting_time = 0; /**< Used to receive instructions from the scheduling algorithms to sleep for some time before calling them again (even if we have queued requests to be processed) */
+	return (g_dynamic_scheduler) && (g_dynamic_scheduler->is_dynamic);
+}
+/**
+ * changes the scheduling algorithm, migrating queued requests to its data structure. Used by agios_set_scheduler, it must be called between scheduling rounds (by the agios thread, or by the caller in the simulation build). The caller must NOT hold any data structure lock.
+ * @param new_alg the identifier of the new scheduling algorithm.
+ * @param report will be filled with the cost of the migration (can be NULL).
+ * @return true or false for success.
+ */
+bool switch_scheduler(int32_t new_alg, struct agios_scheduler_switch_t *report)
+{
+	struct timespec start, end; /**< used to measure for how long the data structures were locked (with the system clock, even in the simulation build). */
+	int32_t previous_alg = current_alg; /**< the scheduling algorithm being replaced. */
+	bool previous_needs_hashtable = current_scheduler->needs_hashtable; /**< to know if requests moved to another data structure. */
+	bool ret; /**< the return of this function. */
 
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = change_selected_alg(new_alg); //it locks all data structures
+	if (report) report->migrated_reqnb = (previous_alg != current_alg) ? current_reqnb : 0; //the counter does not change while we hold all locks
+	if (ret && (previous_alg != current_alg)) performance_set_new_algorithm(current_alg);
+	unlock_all_data_structures();
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	debug("scheduling algorithm changed from %s to %s by the user", get_algorithm_name_from_index(previous_alg), current_scheduler->name);
+	if (report) {
+		report->previous_alg = previous_alg;
+		report->new_alg = current_alg;
+		report->changed_data_structure = (previous_needs_hashtable != current_scheduler->needs_hashtable);
+		report->blocked_ns = get_timespec2long(end) - get_timespec2long(start);
+	}
+	return ret;
+}
+/**
+ * prepares the agios thread to run: selects the scheduling algorithm and allows requests to be added (all data structures are locked by agios_init until then). 
+ */
+void agios_thread_setup(void)
+{
 	//find out which I/O scheduling algorithm we need to use
 	g_dynamic_scheduler = initialize_scheduler(config_agios_default_algorithm); //if the scheduler has an init function, it will be called
 	//a dynamic scheduling algorithm is a scheduling algorithm that periodically selects other scheduling algorithms to be used
@@ -88,53 +128,115 @@ void * agios_thread(void *arg)
 	debug("selected algorithm: %s", current_scheduler->name);
 	//since the current algorithm is decided, we can allow requests to be included
 	unlock_all_data_structures();
-	
+	accept_scheduler_switch_requests(true);
+}
+/**
+ * the scheduling part of an iteration of the agios thread loop: changes the scheduling algorithm if it is time to do so, and calls the scheduler if we have queued requests.
+ * @param interruptible will be set to true if the sleep must be interrupted by the arrival of new requests, false if it must not (the scheduling algorithm asked us to wait).
+ * @return for how long (in ns) the agios thread should sleep before the next iteration. 
+ */
+int32_t scheduling_iteration(bool *interruptible)
+{
+	int32_t remaining_time = 0; /**< Used to calculate how long until we change the scheduling algorithm again */
+	int32_t scheduler_waiting_time = 0; /**< Used to receive instructions from the scheduling algorithms to sleep for some time before calling them again (even if we have queued requests to be processed) */
+
+	//apply parameters changed by agios_reload_config and the scheduling algorithm set by agios_set_scheduler, if any, before calling the scheduler
+	apply_pending_config();
+	perform_scheduler_switch_request();
+	//check if it is time to change the scheduling algorithm
+	if (g_dynamic_scheduler->is_dynamic) {
+		if (is_time_to_change_scheduler()) { //it is time to select!
+			//make a decision on the next scheduling algorithm
+			int32_t next_alg = g_dynamic_scheduler->select_algorithm();
+			//change it
+			debug("HEY IM CHANGING THE SCHEDULING ALGORITHM\n\n\n\n");
+			if (change_selected_alg(next_alg)) performance_set_new_algorithm(current_alg);
+			reset_all_statistics(); //reset all stats so they will not affect the next selection
+			unlock_all_data_structures(); //we can allow new requests to be added now
+			agios_gettime(&g_last_algorithm_update); 
+			debug("We've changed the scheduling algorithm to %s", current_scheduler->name);
+			remaining_time = config_agios_select_algorithm_period;
+		} else { //it is NOT time to select
+			remaining_time = config_agios_select_algorithm_period - get_nanoelapsed(g_last_algorithm_update);
+			if (remaining_time < 0) remaining_time = 0;
+		}
+	} //end scheduler is dynamic
+	//if we have queued requests, try to process them
+	if (0 < get_current_reqnb()) { //here we use the mutex to access the variable current_reqnb because we don't want to risk getting an outdated value and then sleeping for nothing
+		reset_outstanding_blocked();
+		scheduler_waiting_time = current_scheduler->schedule(); //the scheduler may have a reason to ask us for a sleeping time (for instance, TWINS keeps track of time windows) 
+		if (scheduler_waiting_time > 0) { //the scheduling algorithm wants us to sleep for a while, so we'll respect that, and not with a cond_timedwait because this sleep is not to be interrupted by new request arrivals, and is not conditional to not having queued requests (we assume the scheduling algorithm knows what it is doing)
+			//unless of course we are using TWINS. In that case the sleeping time is NOT to be respected unconditionally, we are sleeping because there are no requests to the server being accessed, but if some new requests arrive they could be to that server, and then we should call TWINS again
+			*interruptible = (TWINS_SCHEDULER == current_alg);
+			if (remaining_time > 0) return agios_min(scheduler_waiting_time, remaining_time); //if we are supposed to change the scheduling algorithm before the end of the waiting time provided by the scheduler, we just wait until then
+			return scheduler_waiting_time;
+		} //end if scheduler_waiting_time > 0	
+		if (outstanding_blocked()) { //the queued requests are waiting for their limits on outstanding requests, the next release will wake us up
+			*interruptible = true;
+			if (remaining_time > 0) return agios_min(config_waiting_time, remaining_time);
+			return config_waiting_time;
+		}
+		*interruptible = false;
+		return 0;
+	} 
+	//we have no requests, so we sleep for a while (the default waiting time is provided in the configuration parameters), but this sleeping uses a conditional variable because we want to be called up if some new requests arrive (not having requests is the only reason why we are sleeping)
+	//we have two possible scenarios here: first, remaining time is 0, that means we are not using a dynamic scheduler OR that we are, it is time to change the scheduling algorithm, but for some reason we are not ready to change it (because we have not processed enough requests in the period). In that case we may sleep at ease (for the usual amount of time) because if there are no queued requests, nothing will change (no requests will be processed so the decision of not changing the scheduling algorithm will not change). Second, if remaining time is greater than 0, that means we are using a dynamic scheduler AND we it is not yet time to change the scheduling algorithm. If that is supposed to happen earlier than our usual waiting time, we wake up earlier to respect that.
+	*interruptible = true;
+	if (remaining_time > 0) return agios_min(config_waiting_time, remaining_time);  
+	return config_waiting_time;
+}
+/**
+ * one iteration of the agios thread loop: gives to the user the requests whose bandwidth and IOPS limits now allow them, then changes the scheduling algorithm if it is time to do so and calls the scheduler if we have queued requests. It does not sleep, it tells the caller for how long to sleep instead (so it can be used by the simulation mode with a virtual clock).
+ * @param interruptible will be set to true if the sleep must be interrupted by the arrival of new requests, false if it must not (the scheduling algorithm asked us to wait).
+ * @return for how long (in ns) the agios thread should sleep before the next iteration. It is never longer than the time until the next request waiting for the throttling can go.
+ */
+int32_t agios_thread_iteration(bool *interruptible)
+{
+	int32_t waiting_time; /**< for how long the scheduling part asked us to sleep. */
+	int64_t throttle_time; /**< for how long until requests waiting for the throttling can go, 0 if there are none. */
+
+	process_throttled_requests(); //they were scheduled before the queued requests, so they go first
+	waiting_time = scheduling_iteration(interruptible);
+	throttle_time = get_throttle_waiting_time();
+	if ((throttle_time > 0) && (waiting_time > throttle_time)) waiting_time = throttle_time;
+	return waiting_time;
+}
+/** 
+ * the main function executed by the agios thread, which is responsible for processing requests that have been added to AGIOS.
+ */
+void * agios_thread(void *arg)
+{
+	struct timespec timeout; /**< Used to set a timeout for sleeping, so the thread periodically checks if it has to end. */
+	int32_t waiting_time; /**< for how long we should sleep after each iteration. */
+	bool interruptible; /**< can the sleep be interrupted by new requests? */
+	int64_t seen_count; /**< value of g_request_added_count before the iteration. */
+
+	agios_thread_setup();
 	//execution loop, it only stops when we close the library
 	do {
-		//check if it is time to change the scheduling algorithm
-		if (g_dynamic_scheduler->is_dynamic) {
-			if (is_time_to_change_scheduler()) { //it is time to select!
-				//make a decision on the next scheduling algorithm
-				int32_t next_alg = g_dynamic_scheduler->select_algorithm();
-				//change it
-				debug("HEY IM CHANGING THE SCHEDULING ALGORITHM\n\n\n\n");
-				change_selected_alg(next_alg);
-				performance_set_new_algorithm(current_alg);
-				reset_all_statistics(); //reset all stats so they will not affect the next selection
-				unlock_all_data_structures(); //we can allow new requests to be added now
-				agios_gettime(&g_last_algorithm_update); 
-				debug("We've changed the scheduling algorithm to %s", current_scheduler->name);
-				remaining_time = config_agios_select_algorithm_period;
-			} else { //it is NOT time to select
-				remaining_time = config_agios_select_algorithm_period - get_nanoelapsed(g_last_algorithm_update);
-				if (remaining_time < 0) remaining_time = 0;
-			}
-		} //end scheduler is dynamic
-		//if we have queued requests, try to process them
-		if (0 < get_current_reqnb()) { //here we use the mutex to access the variable current_reqnb because we don't want to risk getting an outdated value and then sleeping for nothing
-			scheduler_waiting_time = current_scheduler->schedule(); //the scheduler may have a reason to ask us for a sleeping time (for instance, TWINS keeps track of time windows) 
-			if (scheduler_waiting_time > 0) { //the scheduling algorithm wants us to sleep for a while, so we'll respect that, and not with a cond_timedwait because this sleep is not to be interrupted by new request arrivals, and is not conditional to not having queued requests (we assume the scheduling algorithm knows what it is doing)
-				fill_struct_timespec(agios_min(scheduler_waiting_time, remaining_time), &timeout); //if we are supposed to change the scheduling algorithm before the end of the waiting time provided by the scheduler, we just wait until then
-				if (TWINS_SCHEDULER != current_alg) {
-					nanosleep(&timeout, NULL);
-				} else { //unless of course we are using TWINS. In that case the sleeping time is NOT to be respected unconditionally, we are sleeping because there are no requests to the server being accessed, but if some new requests arrive they could be to that server, and then we should call TWINS again
-	 				pthread_mutex_lock(&g_request_added_mutex);
-					pthread_cond_timedwait(&g_request_added_cond, &g_request_added_mutex, &timeout);
-					pthread_mutex_unlock(&g_request_added_mutex);
-				} //end if using TWINS
-			} //end if scheduler_waiting_time > 0	
-		} else { //we have no requests, so we sleep for a while (the default waiting time is provided in the configuration parameters), but this sleeping uses a conditional variable because we want to be called up if some new requests arrive (not having requests is the only reason why we are sleeping)
-			 /* We use a timeout to avoid a situation where we missed the signal and will sleep forever, and
-                          * also because we have to check once in a while to see if we should end the execution.
-			  */
-			//we have two possible scenarios here: first, remaining time is 0, that means we are not using a dynamic scheduler OR that we are, it is time to change the scheduling algorithm, but for some reason we are not ready to change it (because we have not processed enough requests in the period). In that case we may sleep at ease (for the usual amount of time) because if there are no queued requests, nothing will change (no requests will be processed so the decision of not changing the scheduling algorithm will not change). Second, if remaining time is greater than 0, that means we are using a dynamic scheduler AND we it is not yet time to change the scheduling algorithm. If that is supposed to happen earlier than our usual waiting time, we wake up earlier to respect that.
-			if (remaining_time > 0) fill_struct_timespec(agios_min(config_waiting_time, remaining_time), &timeout);  
-			else fill_struct_timespec(config_waiting_time, &timeout);
+		pthread_mutex_lock(&g_request_added_mutex);
+		seen_count = g_request_added_count;
+		pthread_mutex_unlock(&g_request_added_mutex);
+		waiting_time = agios_thread_iteration(&interruptible);
+		if (waiting_time <= 0) continue;
+		if (!interruptible) {
+			fill_struct_timespec(waiting_time, &timeout);
+			nanosleep(&timeout, NULL);
+		} else {
+			/* We use a timeout to avoid a situation where we missed the signal and will sleep forever, and
+			 * also because we have to check once in a while to see if we should end the execution.
+			 * pthread_cond_timedwait takes an absolute time in the realtime clock.
+			 */
+			clock_gettime(CLOCK_REALTIME, &timeout);
+			get_long2timespec(get_timespec2long(timeout) + waiting_time, &timeout);
 	 		pthread_mutex_lock(&g_request_added_mutex);
-			pthread_cond_timedwait(&g_request_added_cond, &g_request_added_mutex, &timeout);
+			while ((seen_count == g_request_added_count) && (!g_agios_thread_stop)) { //if new requests arrived during the iteration, we don't sleep
+				if (pthread_cond_timedwait(&g_request_added_cond, &g_request_added_mutex, &timeout) == ETIMEDOUT) break;
+			}
 			pthread_mutex_unlock(&g_request_added_mutex);
 		}
         } while (!g_agios_thread_stop);
+	accept_scheduler_switch_requests(false); //so no one waits forever for us
 
 	return 0;
 }
@@ -5,8 +5,16 @@
 */
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
+struct agios_scheduler_switch_t;
 
 void * agios_thread(void *arg);
+void agios_thread_setup(void);
+int32_t agios_thread_iteration(bool *interruptible);
 void stop_the_agios_thread(void);
 void signal_new_req_to_agios_thread(void);
 bool is_time_to_change_scheduler(void);
+bool is_dynamic_scheduler_in_use(void);
+bool switch_scheduler(int32_t new_alg, struct agios_scheduler_switch_t *report);
@@ -0,0 +1,64 @@
+/*! \file agios_trace_format.h
+    \brief Layout of the binary trace files generated by AGIOS when the trace_binary configuration parameter is set.
+
+    This header is meant for tools that read trace files offline. A binary trace file starts with a struct agios_trace_file_header_t and is followed by chunks. Each chunk starts with a struct agios_trace_chunk_header_t. A AGIOS_TRACE_CHUNK_FILES chunk contains count file handles, each one as a uint32_t file index, a uint32_t length and the length characters of the handle (not NULL-terminated). A AGIOS_TRACE_CHUNK_RECORDS chunk contains count struct agios_trace_record_t. A file index is always defined in a chunk that appears before the first record that uses it. Arrivals are always recorded, the other events only when the trace_lifecycle configuration parameter is set. Records written by different threads may appear out of timestamp order. All values are in the byte order of the machine that generated the trace.
+    @see trace.c
+*/
+#pragma once
+
+#include <stdint.h>
+
+#define AGIOS_TRACE_MAGIC "AGIOSTRC" /**< the first 8 bytes of a binary trace file */
+#define AGIOS_TRACE_VERSION 2 /**< incremented every time the layout changes */
+#define AGIOS_TRACE_NO_FILE UINT32_MAX /**< file_index of records that are not about a file (AGIOS_TRACE_ALGORITHM) */
+
+/** \enum
+ *  \brief The types of chunks in a binary trace file.
+ */
+enum {
+	AGIOS_TRACE_CHUNK_FILES = 1,
+	AGIOS_TRACE_CHUNK_RECORDS = 2,
+};
+/** \enum
+ *  \brief The events recorded in a binary trace file.
+ */
+enum {
+	AGIOS_TRACE_ARRIVAL = 0, /**< the request was added with agios_add_request */
+	AGIOS_TRACE_AGGREGATE = 1, /**< the request was included in the virtual request identified by group */
+	AGIOS_TRACE_DISPATCH = 2, /**< the request was given back to the user as part of group (0 if it was not aggregated), which has reqnb requests */
+	AGIOS_TRACE_RELEASE = 3, /**< the request was released with agios_release_request */
+	AGIOS_TRACE_CANCEL = 4, /**< the request was cancelled with agios_cancel_request */
+	AGIOS_TRACE_ALGORITHM = 5, /**< the scheduling algorithm changed from offset to len (see agios.h), there is no request */
+};
+/*! \struct agios_trace_file_header_t
+    \brief The beginning of a binary trace file.
+ */
+struct agios_trace_file_header_t {
+	char magic[8]; /**< AGIOS_TRACE_MAGIC */
+	uint32_t version; /**< AGIOS_TRACE_VERSION */
+	uint32_t record_size; /**< sizeof(struct agios_trace_record_t) */
+	int64_t t0; /**< the (monotonic clock) time when tracing started, all timestamps are relative to it */
+};
+/*! \struct agios_trace_chunk_header_t
+    \brief The beginning of a chunk in a binary trace file.
+ */
+struct agios_trace_chunk_header_t {
+	uint32_t kind; /**< AGIOS_TRACE_CHUNK_FILES or AGIOS_TRACE_CHUNK_RECORDS */
+	uint32_t count; /**< number of file handles or records in this chunk */
+};
+/*! \struct agios_trace_record_t
+    \brief A traced event (fixed size).
+ */
+struct agios_trace_record_t {
+	int64_t timestamp; /**< ns since the start of the trace */
+	int64_t offset; /**< position of the file in bytes */
+	int64_t len; /**< request size in bytes */
+	int64_t user_id; /**< the identifier given to agios_add_request */
+	int64_t group; /**< identifies the virtual request (unique during the trace), 0 if the request is not aggregated */
+	uint32_t file_index; /**< the file handle, defined in a AGIOS_TRACE_CHUNK_FILES chunk, or AGIOS_TRACE_NO_FILE */
+	int32_t queue_id; /**< the queue_id given to agios_add_request */
+	int32_t reqnb; /**< number of requests in group when it was dispatched */
+	uint8_t event; /**< one of the AGIOS_TRACE_ARRIVAL... events */
+	uint8_t type; /**< RT_READ or RT_WRITE */
+	uint8_t padding[2];
+};
@@ -102,3 +102,14 @@ int64_t update_iterative_average(int64_t avg, int64_t value, int64_t count)
 	else return avg + ((value - avg)/count);
 }
 
+/**
+ * calculates the bandwidth of an access in fixed point.
+ * @param len the amount of accessed data in bytes.
+ * @param elapsed_time how long the access took in ns.
+ * @return the bandwidth in bytes per ns, with BANDWIDTH_FIXED_POINT_SHIFT fractional bits.
+ */
+int64_t get_fixed_point_bandwidth(int64_t len, int64_t elapsed_time)
+{
+	if (elapsed_time <= 0) elapsed_time = 1; //the clock may not have advanced
+	return (len << BANDWIDTH_FIXED_POINT_SHIFT) / elapsed_time;
+}
@@ -9,9 +9,16 @@
 #include <stdio.h>
 #include <pthread.h>
 
+#ifdef AGIOS_SIMULATION
+#include "agios_sim.h"
+#define agios_gettime(timev)					agios_sim_gettime(timev) /**< in the simulation build, time is given by the simulator */
+void agios_sim_gettime(struct timespec *timev);
+#else
 #define agios_gettime(timev)					clock_gettime(CLOCK_MONOTONIC, timev)
+#endif
 #define agios_print(f, a...) 					fprintf(stderr, "AGIOS: " f "\n", ## a)
 #define agios_just_print(f, a...) 				fprintf(stderr, f, ## a)
+#define BANDWIDTH_FIXED_POINT_SHIFT				16 /**< bandwidths are kept in bytes per ns with this many fractional bits, because most requests take longer than one ns per byte and an integer division would give 0. */
 //debug functions
 #ifdef AGIOS_DEBUG
 #define PRINT_FUNCTION_NAME agios_print("%s\n", __PRETTY_FUNCTION__)
@@ -33,5 +40,6 @@ void get_long2timespec(int64_t t, struct timespec *ret);
 int64_t get_nanoelapsed_long(int64_t t1);
 double get_ns2s(int64_t t1);
 int64_t update_iterative_average(int64_t avg, int64_t value, int64_t count);
+int64_t get_fixed_point_bandwidth(int64_t len, int64_t elapsed_time);
 
 
@@ -86,7 +86,7 @@ void put_req_in_hashtable(struct request_t *req)
 		//free the virtual request (which used to have many sub-requests but that is now empty)
 		if (req->file_id) free(req->file_id);
 		free(req);
-	} else hashtable_add_req(req, hash, req->globalinfo->req_file);
+	} else hashtable_add_req(req, hash, req->globalinfo->req_file, NULL);
 }
 /**
  * function used to move a list of requests from the timeline to the hashtable.
@@ -123,11 +123,10 @@ void migrate_from_hashtable_to_timeline()
 	}
 }
 /** 
- * This function gets all requests from the timeline and moves them to the hashtable. NO OTHER THREAD may be using any of these data structures. This will be used while migrating between scheduling algorithms, so after calling lock_all_data_structures.
+ * This function gets all requests from the timeline and moves them to the hashtable. NO OTHER THREAD may be using any of these data structures. This will be used while migrating between scheduling algorithms, so after calling lock_all_data_structures. When migrating from TWINS, the caller must first move requests from the multi_timeline with gather_multi_timeline.
  */
 void migrate_from_timeline_to_hashtable()
 {
-	/*! \todo make this TWINS-friendly if we ever want twins to be an option for dynamic algorithms */
 	put_all_requests_in_hashtable(&timeline);
 }
 /**
@@ -179,7 +178,7 @@ bool acquire_adequate_lock(int32_t hash)
 
 	while (true) { //we'll break out of this loop when we are sure to have acquired the lock for the right data structure
 		//check if the current scheduler uses the hashtable or not and then acquire the right lock
-		previous_needs_hashtable = current_scheduler->needs_hashtable;
+		previous_needs_hashtable = current_scheduler ? current_scheduler->needs_hashtable : true; //current_scheduler is NULL until the agios thread selects it, and in that case all locks are held, so we'll wait here until it is ready
 		if (previous_needs_hashtable) hashtable_lock(hash);
 		else timeline_lock();
 		//the problem is that the scheduling algorithm could have changed while we were waiting to acquire the lock, and then it is possible we have the wrong lock. 
@@ -0,0 +1,89 @@
+/*! \file depth_controller.c
+    \brief Implementation of the feedback controller that adapts limits on outstanding requests to the observed bandwidth.
+
+    When the adaptive_outstanding configuration parameter is set, the max_outstanding and max_outstanding_per_queue_id limits are only starting points. Storage targets differ widely (an NVMe device needs many outstanding requests, a disk gets slower with too many), so the limits are tuned while AGIOS runs, like the congestion window of TCP. Releases are grouped in epochs of at least two times the limit requests, and the bandwidth of each epoch (released bytes over its duration) is compared to the previous one. The limit keeps moving in the same direction while bandwidth improves, goes back when it gets worse (multiplicatively, by DEPTH_DECREASE_PERCENT, if the limit had just been increased, because we went past the knee), and is decreased by one when bandwidth does not change, so it settles at the smallest limit that reaches the best bandwidth: the knee of the latency/throughput curve, where more outstanding requests only make them wait longer. Epochs where the limit did not keep requests from going are not used, because the bandwidth then depends on the load and not on the limit.
+*/
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "agios_config.h"
+#include "common_functions.h"
+#include "depth_controller.h"
+
+#define DEPTH_EPOCH_MIN_REQNB 8 /**< an epoch has at least this many released requests, so a small limit is not decided from too few measurements. */
+#define DEPTH_GAIN_PERCENT 5 /**< bandwidth changes smaller than this (in percent) are considered noise. */
+#define DEPTH_DECREASE_PERCENT 25 /**< how much (in percent) the limit decreases when increasing it made bandwidth worse. */
+
+/**
+ * initializes the controller of a limit.
+ * @param controller the controller.
+ * @param limit the starting value of the limit (from the configuration file).
+ */
+void depth_controller_init(struct depth_controller_t *controller, int32_t limit)
+{
+	memset(controller, 0, sizeof(struct depth_controller_t));
+	controller->limit = limit;
+}
+/**
+ * decides the change to the limit at the end of an epoch.
+ * @param controller the controller.
+ * @param bandwidth the bandwidth measured in the epoch (fixed point).
+ * @return the new limit.
+ */
+int32_t depth_controller_decide(struct depth_controller_t *controller, int64_t bandwidth)
+{
+	if (controller->last_bandwidth == 0) { //nothing to compare to, explore
+		controller->last_change = 1;
+		return controller->limit + 1;
+	}
+	if (bandwidth*100 > controller->last_bandwidth*(100+DEPTH_GAIN_PERCENT)) { //better, keep going
+		if (controller->last_change == 0) controller->last_change = 1;
+		return controller->limit + controller->last_change;
+	}
+	if (bandwidth*100 < controller->last_bandwidth*(100-DEPTH_GAIN_PERCENT)) { //worse, go back
+		if (controller->last_change > 0) { //we went past the knee
+			controller->last_change = -1;
+			return (controller->limit*(100-DEPTH_DECREASE_PERCENT))/100;
+		}
+		controller->last_change = 1;
+		return controller->limit + 1;
+	}
+	//the same bandwidth with fewer outstanding requests means they wait less
+	controller->last_change = -1;
+	return controller->limit - 1;
+}
+/**
+ * called for each request released under a limit, to measure the bandwidth and adapt the limit at the end of each epoch. The caller must hold the lock protecting the limit.
+ * @param controller the controller.
+ * @param len the size of the released request.
+ * @param now the current time (ns).
+ */
+void depth_controller_release(struct depth_controller_t *controller, int64_t len, int64_t now)
+{
+	int64_t elapsed; /**< the duration of the epoch. */
+
+	if (controller->epoch_start == 0) controller->epoch_start = now;
+	controller->epoch_bytes += len;
+	controller->epoch_reqnb++;
+	if (controller->epoch_reqnb < agios_max(2*controller->limit, DEPTH_EPOCH_MIN_REQNB)) return;
+	elapsed = now - controller->epoch_start;
+	if (elapsed <= 0) return; //all released at once, keep measuring
+	if (controller->saturated) {
+		int64_t bandwidth = get_fixed_point_bandwidth(controller->epoch_bytes, elapsed); /**< the bandwidth of this epoch */
+		int32_t limit = depth_controller_decide(controller, bandwidth); /**< the new limit */
+
+		if (limit < 1) limit = 1;
+		if (limit > config_adaptive_outstanding_max) limit = config_adaptive_outstanding_max;
+		if (limit != controller->limit) debug("outstanding requests limit changed from %d to %d (bandwidth %ld)", controller->limit, limit, bandwidth);
+		controller->limit = limit;
+		controller->last_bandwidth = bandwidth;
+	} else { //the limit was not what decided the bandwidth
+		controller->last_bandwidth = 0;
+		controller->last_change = 0;
+	}
+	controller->epoch_start = now;
+	controller->epoch_bytes = 0;
+	controller->epoch_reqnb = 0;
+	controller->saturated = false;
+}
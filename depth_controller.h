@@ -0,0 +1,25 @@
+/*! \file depth_controller.h
+    \brief Headers of the feedback controller that adapts limits on outstanding requests to the observed bandwidth.
+
+    @see depth_controller.c
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*! \struct depth_controller_t
+    \brief The state of the controller of one limit on outstanding requests (of the whole library or of a queue_id).
+ */
+struct depth_controller_t {
+	int32_t limit; /**< the current limit on outstanding requests */
+	int32_t last_change; /**< the change made to the limit at the end of the previous epoch (-1, 0 or +1) */
+	int64_t last_bandwidth; /**< the bandwidth measured in the previous epoch (fixed point, see BANDWIDTH_FIXED_POINT_SHIFT), 0 if unknown */
+	int64_t epoch_start; /**< when the current epoch started (ns), 0 if it did not start yet */
+	int64_t epoch_bytes; /**< bytes released in the current epoch */
+	int32_t epoch_reqnb; /**< requests released in the current epoch */
+	bool saturated; /**< did the limit keep requests from going during the current epoch? */
+};
+
+void depth_controller_init(struct depth_controller_t *controller, int32_t limit);
+void depth_controller_release(struct depth_controller_t *controller, int64_t len, int64_t now);
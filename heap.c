@@ -0,0 +1,110 @@
+/*! \file heap.c
+    \brief Implementation of a binary min-heap of (key, pointer) pairs.
+
+    Entries are kept in an array where the children of entry i are 2i+1 and 2i+2. Insertion and removal of the smallest entry are O(log n). The array starts empty and doubles when it is full.
+*/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "heap.h"
+
+#define HEAP_INITIAL_CAPACITY 64 /**< size of the array the first time something is pushed. */
+
+/**
+ * initializes an empty heap. No memory is allocated until the first push.
+ * @param heap the heap.
+ */
+void heap_init(struct agios_heap_t *heap)
+{
+	heap->entries = NULL;
+	heap->size = 0;
+	heap->capacity = 0;
+}
+/**
+ * frees the memory used by a heap, which becomes empty (and can be used again).
+ * @param heap the heap.
+ */
+void heap_cleanup(struct agios_heap_t *heap)
+{
+	if (heap->entries) free(heap->entries);
+	heap_init(heap);
+}
+/**
+ * removes all entries from a heap without freeing its memory.
+ * @param heap the heap.
+ */
+void heap_clear(struct agios_heap_t *heap)
+{
+	heap->size = 0;
+}
+/**
+ * adds an entry to the heap.
+ * @param heap the heap.
+ * @param key the key of the new entry.
+ * @param data the pointer kept with the key.
+ * @return true or false for success (false if we could not allocate memory).
+ */
+bool heap_push(struct agios_heap_t *heap, int64_t key, void *data)
+{
+	int32_t i; /**< the position of the new entry while it goes up. */
+	int32_t parent; /**< the position of its parent. */
+
+	if (heap->size == heap->capacity) {
+		int32_t new_capacity = heap->capacity ? heap->capacity*2 : HEAP_INITIAL_CAPACITY; /**< the size of the new array. */
+		struct heap_entry_t *new_entries = realloc(heap->entries, sizeof(struct heap_entry_t)*new_capacity); /**< the new array. */
+		if (!new_entries) return false;
+		heap->entries = new_entries;
+		heap->capacity = new_capacity;
+	}
+	//the new entry goes up while it is smaller than its parent
+	i = heap->size;
+	heap->size++;
+	while (i > 0) {
+		parent = (i-1)/2;
+		if (heap->entries[parent].key <= key) break;
+		heap->entries[i] = heap->entries[parent];
+		i = parent;
+	}
+	heap->entries[i].key = key;
+	heap->entries[i].data = data;
+	return true;
+}
+/**
+ * gives the smallest entry of the heap without removing it.
+ * @param heap the heap.
+ * @param entry will receive the smallest entry.
+ * @return false if the heap is empty, true otherwise.
+ */
+bool heap_peek(struct agios_heap_t *heap, struct heap_entry_t *entry)
+{
+	if (heap->size == 0) return false;
+	*entry = heap->entries[0];
+	return true;
+}
+/**
+ * removes the smallest entry of the heap.
+ * @param heap the heap.
+ * @param entry will receive the removed entry (can be NULL).
+ * @return false if the heap is empty, true otherwise.
+ */
+bool heap_pop(struct agios_heap_t *heap, struct heap_entry_t *entry)
+{
+	struct heap_entry_t last; /**< the last entry of the array, which goes down from the root to its new place. */
+	int32_t i = 0; /**< the position of last while it goes down. */
+	int32_t child; /**< the smallest child of i. */
+
+	if (heap->size == 0) return false;
+	if (entry) *entry = heap->entries[0];
+	heap->size--;
+	if (heap->size == 0) return true;
+	last = heap->entries[heap->size];
+	while ((child = 2*i + 1) < heap->size) {
+		if ((child + 1 < heap->size) && (heap->entries[child+1].key < heap->entries[child].key)) child++;
+		if (last.key <= heap->entries[child].key) break;
+		heap->entries[i] = heap->entries[child];
+		i = child;
+	}
+	heap->entries[i] = last;
+	return true;
+}
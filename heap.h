@@ -0,0 +1,33 @@
+/*! \file heap.h
+    \brief A binary min-heap of (key, pointer) pairs, used by schedulers that need the element with the smallest key (the earliest deadline, for instance).
+
+    The heap does not lock anything, its users must protect it.
+    @see heap.c
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*! \struct heap_entry_t
+    \brief An element of the heap.
+ */
+struct heap_entry_t {
+	int64_t key; /**< the heap is ordered by this value (smallest first). */
+	void *data; /**< what the user of the heap wants to keep with the key. */
+};
+/*! \struct agios_heap_t
+    \brief A binary min-heap stored in an array that grows as needed.
+ */
+struct agios_heap_t {
+	struct heap_entry_t *entries; /**< the array, entries[0] is the smallest one. */
+	int32_t size; /**< how many entries are in the heap. */
+	int32_t capacity; /**< how many entries fit in the array. */
+};
+
+void heap_init(struct agios_heap_t *heap);
+void heap_cleanup(struct agios_heap_t *heap);
+bool heap_push(struct agios_heap_t *heap, int64_t key, void *data);
+bool heap_peek(struct agios_heap_t *heap, struct heap_entry_t *entry);
+bool heap_pop(struct agios_heap_t *heap, struct heap_entry_t *entry);
+void heap_clear(struct agios_heap_t *heap);
@@ -0,0 +1,134 @@
+/*! \file histogram.c
+    \brief Log-bucketed histograms used to keep latency and bandwidth distributions.
+
+    Averages calculated with update_iterative_average hide the tail of the distribution, so for released requests we also keep histograms of queue waiting time, service time and bandwidth. Values smaller than HISTOGRAM_SUB_BUCKETS have their own buckets, larger values go to one of the HISTOGRAM_SUB_BUCKETS linear sub-buckets of their power of two (like HdrHistogram does). Recording a value is constant time and does not allocate memory. These functions do not use locks, the caller must protect the histogram.
+    @see agios_release_request.c
+ */
+#include <string.h>
+
+#include "common_functions.h"
+#include "histogram.h"
+
+#define HISTOGRAM_MAX_VALUE ((1L << HISTOGRAM_MAX_VALUE_BITS) - 1)
+
+/**
+ * initializes (or resets) a histogram.
+ * @param hist the histogram.
+ */
+void histogram_init(struct histogram_t *hist)
+{
+	hist->count = 0;
+	hist->min = 0;
+	hist->max = 0;
+	memset(hist->buckets, 0, sizeof(hist->buckets));
+}
+/**
+ * gives the bucket where a value is counted.
+ * @param value a value between 0 and HISTOGRAM_MAX_VALUE.
+ * @return the index of the bucket.
+ */
+int32_t histogram_get_bucket(int64_t value)
+{
+	int32_t msb; /**< most significant bit of the value. */
+	int32_t shift; /**< how many least significant bits are ignored in this power of two. */
+
+	if (value < HISTOGRAM_SUB_BUCKETS) return (int32_t) value;
+	msb = 63 - __builtin_clzll((uint64_t) value);
+	shift = msb - HISTOGRAM_SUB_BUCKET_BITS;
+	return ((shift + 1) * HISTOGRAM_SUB_BUCKETS) + (int32_t)((value >> shift) - HISTOGRAM_SUB_BUCKETS);
+}
+/**
+ * gives the highest value that would be counted in a bucket.
+ * @param bucket the index of the bucket.
+ * @return the highest value of the bucket.
+ */
+int64_t histogram_get_bucket_top(int32_t bucket)
+{
+	int32_t shift; /**< how many least significant bits are ignored in this bucket. */
+	int64_t mantissa; /**< the most significant bits of values in this bucket. */
+
+	if (bucket < HISTOGRAM_SUB_BUCKETS) return bucket;
+	shift = (bucket / HISTOGRAM_SUB_BUCKETS) - 1;
+	mantissa = (bucket % HISTOGRAM_SUB_BUCKETS) + HISTOGRAM_SUB_BUCKETS;
+	return ((mantissa + 1) << shift) - 1;
+}
+/**
+ * records a value in a histogram. Negative values are recorded as 0 and values that are too large are recorded as HISTOGRAM_MAX_VALUE.
+ * @param hist the histogram.
+ * @param value the new observed value.
+ */
+void histogram_add(struct histogram_t *hist, int64_t value)
+{
+	if (value < 0) value = 0;
+	else if (value > HISTOGRAM_MAX_VALUE) value = HISTOGRAM_MAX_VALUE;
+	if ((hist->count == 0) || (value < hist->min)) hist->min = value;
+	if ((hist->count == 0) || (value > hist->max)) hist->max = value;
+	hist->buckets[histogram_get_bucket(value)]++;
+	hist->count++;
+}
+/**
+ * gives an estimation of a percentile of the recorded values. The returned value is the highest value of the bucket where the percentile falls, so it is never smaller than the real one by more than the bucket precision.
+ * @param hist the histogram.
+ * @param percentile between 0 and 100 (for instance 99.9).
+ * @return the estimated percentile, -1 if the histogram is empty.
+ */
+int64_t histogram_percentile(struct histogram_t *hist, double percentile)
+{
+	int64_t target; /**< how many values are smaller than or equal to the percentile. */
+	int64_t seen = 0; /**< how many values we have counted so far. */
+
+	if (hist->count == 0) return -1;
+	target = (int64_t)((percentile * hist->count) / 100.0);
+	if (((double) target) * 100.0 < percentile * hist->count) target++; //round up
+	if (target < 1) target = 1;
+	for (int32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		seen += hist->buckets[i];
+		if (seen >= target) return agios_max(agios_min(histogram_get_bucket_top(i), hist->max), hist->min);
+	}
+	return hist->max;
+}
+/**
+ * initializes (or resets) the histograms of waiting time, service time and bandwidth.
+ * @param hists the structure holding the histograms.
+ */
+void request_histograms_init(struct request_histograms_t *hists)
+{
+	histogram_init(&hists->wait);
+	histogram_init(&hists->service);
+	histogram_init(&hists->bandwidth);
+}
+/**
+ * records the measurements from a released request.
+ * @param hists the structure holding the histograms.
+ * @param wait_time the time between arrival and dispatch (ns).
+ * @param service_time the time between dispatch and release (ns).
+ * @param bandwidth the bandwidth observed by the request (fixed point).
+ */
+void request_histograms_add(struct request_histograms_t *hists,
+				int64_t wait_time,
+				int64_t service_time,
+				int64_t bandwidth)
+{
+	histogram_add(&hists->wait, wait_time);
+	histogram_add(&hists->service, service_time);
+	histogram_add(&hists->bandwidth, bandwidth);
+}
+/**
+ * prints the median and tail of the histograms, used for debug.
+ * @param hists the structure holding the histograms.
+ * @param name a string to identify the histograms in the output.
+ */
+void print_request_histograms(struct request_histograms_t *hists, const char *name)
+{
+	debug("%s: %ld requests, wait p50 %ld p99 %ld p999 %ld ns, service p50 %ld p99 %ld p999 %ld ns, bandwidth p50 %ld p1 %ld (fixed point)",
+		name,
+		hists->service.count,
+		histogram_percentile(&hists->wait, 50.0),
+		histogram_percentile(&hists->wait, 99.0),
+		histogram_percentile(&hists->wait, 99.9),
+		histogram_percentile(&hists->service, 50.0),
+		histogram_percentile(&hists->service, 99.0),
+		histogram_percentile(&hists->service, 99.9),
+		histogram_percentile(&hists->bandwidth, 50.0),
+		histogram_percentile(&hists->bandwidth, 1.0));
+}
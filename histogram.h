@@ -0,0 +1,41 @@
+/*! \file histogram.h
+    \brief Headers of the log-bucketed histograms used to keep latency and bandwidth distributions.
+
+    @see histogram.c
+*/
+#pragma once
+
+#include <stdint.h>
+
+#define HISTOGRAM_SUB_BUCKET_BITS 3 /**< each power of two is divided in 2^HISTOGRAM_SUB_BUCKET_BITS linear sub-buckets, so the relative error of a reported value is at most 1/8. */
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_MAX_VALUE_BITS 48 /**< values are clamped to 2^48-1 (that is more than three days in ns). */
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_VALUE_BITS - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+/*! \struct histogram_t
+    \brief A HDR-style histogram: exact buckets for small values, then a fixed number of sub-buckets per power of two.
+ */
+struct histogram_t {
+	int64_t count; /**< number of recorded values */
+	int64_t min; /**< smallest recorded value */
+	int64_t max; /**< largest recorded value */
+	uint32_t buckets[HISTOGRAM_BUCKETS]; /**< counters */
+};
+/*! \struct request_histograms_t
+    \brief The distributions we keep about released requests (per queue, per performance entry and globally).
+ */
+struct request_histograms_t {
+	struct histogram_t wait; /**< time between arrival and dispatch (ns) */
+	struct histogram_t service; /**< time between dispatch and release (ns) */
+	struct histogram_t bandwidth; /**< bandwidth observed by each request (fixed point, see BANDWIDTH_FIXED_POINT_SHIFT) */
+};
+
+void histogram_init(struct histogram_t *hist);
+void histogram_add(struct histogram_t *hist, int64_t value);
+int64_t histogram_percentile(struct histogram_t *hist, double percentile);
+void request_histograms_init(struct request_histograms_t *hists);
+void request_histograms_add(struct request_histograms_t *hists,
+				int64_t wait_time,
+				int64_t service_time,
+				int64_t bandwidth);
+void print_request_histograms(struct request_histograms_t *hists, const char *name);
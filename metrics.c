@@ -0,0 +1,395 @@
+/*! \file metrics.c
+    \brief The metrics exporter, an optional thread that gives AGIOS counters in the Prometheus text exposition format.
+
+    It is started by agios_init when the metrics_socket or metrics_file configuration parameters are set. With metrics_socket, the thread listens on a Unix domain socket and answers each connection with the current metrics (as a HTTP response if the client sends a GET request, so it can be scraped through a local proxy, or as plain text otherwise). With metrics_file, the thread rewrites the file every metrics_interval ms (writing to a temporary file and renaming it, as expected by the node exporter textfile collector). Metrics are built from the snapshots of agios_stats.c, so the exporter never takes the scheduler locks.
+    @see agios_stats.c
+*/
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "agios.h"
+#include "agios_config.h"
+#include "agios_request.h"
+#include "agios_stats.h"
+#include "common_functions.h"
+#include "metrics.h"
+#include "req_hashtable.h"
+
+#define METRICS_POLL_PERIOD 100 /**< the exporter thread checks whether it must stop at least this often (in ms). */
+#define METRICS_REQUEST_TIMEOUT 100 /**< for how long (in ms) we wait for a client to send its request before answering anyway. */
+
+/*! \struct metrics_buffer_t
+    \brief A growing buffer where the text of the metrics is built.
+ */
+struct metrics_buffer_t {
+	char *data; /**< the text, NULL-terminated. */
+	size_t len; /**< its length. */
+	size_t size; /**< allocated size. */
+};
+
+static pthread_t g_metrics_thread; /**< the exporter thread. */
+static bool g_metrics_running = false; /**< was the exporter thread started? */
+static bool g_metrics_stop = false; /**< set to true to let the exporter thread know it must end. */
+static int g_metrics_socket = -1; /**< the listening socket, -1 if metrics_socket is not set. */
+
+/**
+ * appends formatted text to the buffer, growing it if needed.
+ * @param buf the buffer.
+ * @param format printf-like format.
+ * @return true or false for success.
+ */
+static bool metrics_printf(struct metrics_buffer_t *buf, const char *format, ...)
+{
+	va_list args;
+	int32_t needed; /**< length of the formatted text. */
+
+	while (1) {
+		va_start(args, format);
+		needed = vsnprintf(buf->data + buf->len, buf->size - buf->len, format, args);
+		va_end(args);
+		if (needed < 0) return false;
+		if (buf->len + needed < buf->size) break;
+		//not enough space, double the buffer and try again
+		char *new_data = realloc(buf->data, buf->size*2 + needed);
+		if (!new_data) return false;
+		buf->data = new_data;
+		buf->size = buf->size*2 + needed;
+	}
+	buf->len += needed;
+	return true;
+}
+/**
+ * appends a label value to the buffer, escaping it as required by the text format.
+ * @param buf the buffer.
+ * @param value the label value.
+ * @return true or false for success.
+ */
+static bool metrics_print_label(struct metrics_buffer_t *buf, const char *value)
+{
+	for (; *value; value++) {
+		bool ret;
+
+		if (*value == '\\') ret = metrics_printf(buf, "\\\\");
+		else if (*value == '"') ret = metrics_printf(buf, "\\\"");
+		else if (*value == '\n') ret = metrics_printf(buf, "\\n");
+		else ret = metrics_printf(buf, "%c", *value);
+		if (!ret) return false;
+	}
+	return true;
+}
+/**
+ * appends the HELP and TYPE lines of a metric.
+ * @param buf the buffer.
+ * @param name the name of the metric.
+ * @param type "gauge" or "counter".
+ * @param help the description of the metric.
+ * @return true or false for success.
+ */
+static bool metrics_header(struct metrics_buffer_t *buf, const char *name, const char *type, const char *help)
+{
+	return metrics_printf(buf, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+/*! \enum
+ *  \brief The per-file metrics, see metrics_print_files.
+ */
+enum {
+	METRICS_FILE_QUEUED = 0,
+	METRICS_FILE_RECEIVED = 1,
+	METRICS_FILE_RELEASED_BYTES = 2,
+	METRICS_FILE_BANDWIDTH = 3,
+	METRICS_FILE_COUNT = 4,
+};
+static const char *g_metrics_file_names[METRICS_FILE_COUNT] = {"agios_file_queued_requests", "agios_file_received_requests_total", "agios_file_released_bytes_total", "agios_file_bandwidth_bytes_per_second"}; /**< names of the per-file metrics. */
+static const char *g_metrics_file_types[METRICS_FILE_COUNT] = {"gauge", "counter", "counter", "gauge"}; /**< types of the per-file metrics. */
+static const char *g_metrics_file_help[METRICS_FILE_COUNT] = {"Requests to the file waiting in the scheduler queues.", "Requests received to the file since the last statistics reset.", "Bytes released to the file since the last statistics reset.", "Average bandwidth observed by released requests to the file."}; /**< descriptions of the per-file metrics. */
+
+/**
+ * appends one sample of a per-file metric.
+ * @param buf the buffer.
+ * @param metric one of the METRICS_FILE_* values.
+ * @param file_id the file handle.
+ * @param type_name "read", "write" or NULL (for metrics about the whole file).
+ * @param value the value of the sample.
+ * @return true or false for success.
+ */
+static bool metrics_print_file_sample(struct metrics_buffer_t *buf, int32_t metric, const char *file_id, const char *type_name, double value)
+{
+	if (!metrics_printf(buf, "%s{file=\"", g_metrics_file_names[metric])) return false;
+	if (!metrics_print_label(buf, file_id)) return false;
+	if (type_name) return metrics_printf(buf, "\",type=\"%s\"} %.0f\n", type_name, value);
+	return metrics_printf(buf, "\"} %.0f\n", value);
+}
+/**
+ * appends the metrics of all files (only when the metrics_per_file configuration parameter is set). The text format requires all samples of a metric to be together, so we go over the files once per metric.
+ * @param buf the buffer.
+ * @return true or false for success.
+ */
+static bool metrics_print_files(struct metrics_buffer_t *buf)
+{
+	struct file_t *req_file; /**< used to iterate over all files. */
+	struct agios_file_stats_t stats; /**< snapshot of one file. */
+	bool ret = true; /**< return of the sample printing. */
+
+	for (int32_t metric = 0; metric < METRICS_FILE_COUNT; metric++) {
+		if (!metrics_header(buf, g_metrics_file_names[metric], g_metrics_file_types[metric], g_metrics_file_help[metric])) return false;
+		for (req_file = stats_first_file(); req_file; req_file = req_file->stats_next) {
+			get_file_stats(req_file, &stats);
+			switch (metric) {
+				case METRICS_FILE_QUEUED:
+					ret = metrics_print_file_sample(buf, metric, req_file->file_id, NULL, stats.queued_reqnb);
+					break;
+				case METRICS_FILE_RECEIVED:
+					ret = metrics_print_file_sample(buf, metric, req_file->file_id, "read", stats.read.received_reqnb) &&
+					      metrics_print_file_sample(buf, metric, req_file->file_id, "write", stats.write.received_reqnb);
+					break;
+				case METRICS_FILE_RELEASED_BYTES:
+					ret = metrics_print_file_sample(buf, metric, req_file->file_id, "read", stats.read.processed_bytes) &&
+					      metrics_print_file_sample(buf, metric, req_file->file_id, "write", stats.write.processed_bytes);
+					break;
+				case METRICS_FILE_BANDWIDTH:
+					ret = metrics_print_file_sample(buf, metric, req_file->file_id, "read", stats.read.bandwidth) &&
+					      metrics_print_file_sample(buf, metric, req_file->file_id, "write", stats.write.bandwidth);
+					break;
+			}
+			if (!ret) return false;
+		}
+	}
+	return true;
+}
+/**
+ * builds the text with all metrics in the buffer (replacing its previous content).
+ * @param buf the buffer.
+ * @return true or false for success.
+ */
+static bool metrics_build(struct metrics_buffer_t *buf)
+{
+	struct agios_stats_t stats; /**< snapshot of the library state. */
+	int32_t busy_lines = 0; /**< lines of the hashtable with queued requests. */
+	int32_t max_line = 0; /**< largest number of queued requests in a line of the hashtable. */
+	int32_t line; /**< number of queued requests in a line of the hashtable. */
+
+	buf->len = 0;
+	buf->data[0] = '\0';
+	agios_get_stats(&stats);
+	for (int32_t i = 0; i < AGIOS_HASH_ENTRIES; i++) {
+		line = __atomic_load_n(&hashlist_reqcounter[i], __ATOMIC_RELAXED);
+		if (line > 0) busy_lines++;
+		if (line > max_line) max_line = line;
+	}
+	if (!metrics_header(buf, "agios_queued_requests", "gauge", "Requests waiting in the scheduler queues.")) return false;
+	if (!metrics_printf(buf, "agios_queued_requests %d\n", stats.queued_reqnb)) return false;
+	if (!metrics_header(buf, "agios_queued_files", "gauge", "Files with requests waiting in the scheduler queues.")) return false;
+	if (!metrics_printf(buf, "agios_queued_files %d\n", stats.queued_filenb)) return false;
+	if (!metrics_header(buf, "agios_hashtable_busy_lines", "gauge", "Lines of the hashtable with queued requests.")) return false;
+	if (!metrics_printf(buf, "agios_hashtable_busy_lines %d\n", busy_lines)) return false;
+	if (!metrics_header(buf, "agios_hashtable_max_line_requests", "gauge", "Queued requests in the busiest line of the hashtable.")) return false;
+	if (!metrics_printf(buf, "agios_hashtable_max_line_requests %d\n", max_line)) return false;
+	if (!metrics_header(buf, "agios_received_requests_total", "counter", "Requests received since the last statistics reset.")) return false;
+	if (!metrics_printf(buf, "agios_received_requests_total{type=\"read\"} %ld\n", stats.reads)) return false;
+	if (!metrics_printf(buf, "agios_received_requests_total{type=\"write\"} %ld\n", stats.writes)) return false;
+	if (!metrics_header(buf, "agios_request_size_bytes_avg", "gauge", "Average size of the received requests.")) return false;
+	if (!metrics_printf(buf, "agios_request_size_bytes_avg %ld\n", (stats.received_reqnb > 0) ? stats.avg_request_size : 0)) return false;
+	if (!metrics_header(buf, "agios_aggregations_total", "counter", "Virtual requests with more than one request, since the last statistics reset.")) return false;
+	if (!metrics_printf(buf, "agios_aggregations_total %ld\n", stats.aggs_no)) return false;
+	if (!metrics_header(buf, "agios_aggregation_size_avg", "gauge", "Average number of requests in these virtual requests.")) return false;
+	if (!metrics_printf(buf, "agios_aggregation_size_avg %.2f\n", stats.avg_agg_size)) return false;
+	if (!metrics_header(buf, "agios_current_algorithm", "gauge", "1 for the scheduling algorithm in use, 0 for the others.")) return false;
+	for (int32_t i = 0; i < stats.algorithm_count; i++) {
+		if (!metrics_printf(buf, "agios_current_algorithm{algorithm=\"%s\"} %d\n", stats.algorithms[i].name, (i == stats.current_alg) ? 1 : 0)) return false;
+	}
+	if (!metrics_header(buf, "agios_current_bandwidth_bytes_per_second", "gauge", "Average bandwidth observed since the current scheduling algorithm was selected.")) return false;
+	if (!metrics_printf(buf, "agios_current_bandwidth_bytes_per_second %.0f\n", stats.current_bandwidth)) return false;
+	if (!metrics_header(buf, "agios_algorithm_released_requests_total", "counter", "Released requests dispatched by each scheduling algorithm.")) return false;
+	for (int32_t i = 0; i < stats.algorithm_count; i++) {
+		if (!metrics_printf(buf, "agios_algorithm_released_requests_total{algorithm=\"%s\"} %ld\n", stats.algorithms[i].name, stats.algorithms[i].released_reqnb)) return false;
+	}
+	if (!metrics_header(buf, "agios_algorithm_released_bytes_total", "counter", "Bytes of the released requests dispatched by each scheduling algorithm.")) return false;
+	for (int32_t i = 0; i < stats.algorithm_count; i++) {
+		if (!metrics_printf(buf, "agios_algorithm_released_bytes_total{algorithm=\"%s\"} %ld\n", stats.algorithms[i].name, stats.algorithms[i].released_bytes)) return false;
+	}
+	if (!metrics_header(buf, "agios_algorithm_bandwidth_bytes_per_second", "gauge", "Average bandwidth observed by the released requests dispatched by each scheduling algorithm.")) return false;
+	for (int32_t i = 0; i < stats.algorithm_count; i++) {
+		if (!metrics_printf(buf, "agios_algorithm_bandwidth_bytes_per_second{algorithm=\"%s\"} %.0f\n", stats.algorithms[i].name, stats.algorithms[i].bandwidth)) return false;
+	}
+	if (config_metrics_per_file) return metrics_print_files(buf);
+	return true;
+}
+/**
+ * writes the whole buffer to a file descriptor.
+ * @param fd the file descriptor (a file or a connected socket).
+ * @param data what to write.
+ * @param len how many bytes.
+ * @return true or false for success.
+ */
+static bool metrics_write_all(int fd, const char *data, size_t len)
+{
+	ssize_t ret;
+
+	while (len > 0) {
+		ret = send(fd, data, len, MSG_NOSIGNAL);
+		if ((ret < 0) && (errno == ENOTSOCK)) ret = write(fd, data, len);
+		if (ret < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		data += ret;
+		len -= ret;
+	}
+	return true;
+}
+/**
+ * rewrites the metrics file with the current metrics. The file is replaced at once, so readers never see it half written.
+ * @param buf the buffer used to build the metrics.
+ */
+static void metrics_write_file(struct metrics_buffer_t *buf)
+{
+	char tmp_path[strlen(config_metrics_file) + 5]; /**< the temporary file, renamed to config_metrics_file when complete. */
+	FILE *file;
+	bool ret;
+
+	if (!metrics_build(buf)) return;
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", config_metrics_file);
+	file = fopen(tmp_path, "w");
+	if (!file) {
+		debug("could not open %s to write metrics", tmp_path);
+		return;
+	}
+	ret = (fwrite(buf->data, 1, buf->len, file) == buf->len);
+	if ((fclose(file) != 0) || (!ret)) {
+		unlink(tmp_path);
+		return;
+	}
+	if (rename(tmp_path, config_metrics_file) != 0) unlink(tmp_path);
+}
+/**
+ * answers a client connected to the metrics socket, then closes the connection.
+ * @param fd the connection.
+ * @param buf the buffer used to build the metrics.
+ */
+static void metrics_answer_client(int fd, struct metrics_buffer_t *buf)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN }; /**< used to wait for the client request. */
+	struct timeval timeout = { .tv_sec = 1, .tv_usec = 0 }; /**< so a client that does not read cannot block the exporter. */
+	char request[512]; /**< the beginning of the client request. */
+	ssize_t request_len = 0; /**< its length. */
+	char header[128]; /**< the HTTP header of the answer. */
+
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	if (poll(&pfd, 1, METRICS_REQUEST_TIMEOUT) > 0) request_len = recv(fd, request, sizeof(request), MSG_DONTWAIT);
+	if (metrics_build(buf)) {
+		if ((request_len >= 4) && (strncmp(request, "GET ", 4) == 0)) { //answer with HTTP, we only need to know it's a scrape
+			snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %lu\r\n\r\n", buf->len);
+			if (metrics_write_all(fd, header, strlen(header))) metrics_write_all(fd, buf->data, buf->len);
+		} else metrics_write_all(fd, buf->data, buf->len);
+	}
+	close(fd);
+}
+/**
+ * main function of the exporter thread. Answers connections to the metrics socket and periodically rewrites the metrics file, until stop_metrics_exporter is called.
+ */
+static void * metrics_thread(void *arg)
+{
+	struct metrics_buffer_t buf; /**< the buffer used to build the metrics. */
+	struct timespec now; /**< used to know when to rewrite the metrics file. */
+	int64_t next_write = 0; /**< when to rewrite the metrics file (in ns). */
+	int32_t timeout; /**< how long we wait for connections (in ms). */
+	struct pollfd pfd; /**< used to wait for connections. */
+	int client; /**< an accepted connection. */
+
+	buf.size = 16384;
+	buf.len = 0;
+	buf.data = malloc(buf.size);
+	if (!buf.data) {
+		agios_print("PANIC! Could not allocate memory for the metrics exporter!");
+		return NULL;
+	}
+	while (!__atomic_load_n(&g_metrics_stop, __ATOMIC_ACQUIRE)) {
+		clock_gettime(CLOCK_MONOTONIC, &now); //the exporter uses the system clock even in the simulation build
+		if ((config_metrics_file) && (get_timespec2long(now) >= next_write)) {
+			metrics_write_file(&buf);
+			next_write = get_timespec2long(now) + config_metrics_interval*1000000L;
+		}
+		timeout = METRICS_POLL_PERIOD;
+		if ((config_metrics_file) && ((next_write - get_timespec2long(now))/1000000L < timeout)) timeout = (next_write - get_timespec2long(now))/1000000L;
+		if (g_metrics_socket >= 0) {
+			pfd.fd = g_metrics_socket;
+			pfd.events = POLLIN;
+			if (poll(&pfd, 1, timeout) > 0) {
+				client = accept(g_metrics_socket, NULL, NULL);
+				if (client >= 0) metrics_answer_client(client, &buf);
+			}
+		} else if (timeout > 0) {
+			usleep(timeout*1000);
+		}
+	}
+	if (config_metrics_file) metrics_write_file(&buf); //so the file has the final values
+	free(buf.data);
+	return NULL;
+}
+/**
+ * called by agios_init to start the exporter thread, if the metrics_socket or metrics_file configuration parameters are set.
+ * @return true or false for success.
+ */
+bool init_metrics_exporter(void)
+{
+	struct sockaddr_un addr; /**< the address of the metrics socket. */
+
+	if ((!config_metrics_socket) && (!config_metrics_file)) return true;
+	if (config_metrics_socket) {
+		if (strlen(config_metrics_socket) >= sizeof(addr.sun_path)) {
+			agios_print("metrics_socket path is too long: %s", config_metrics_socket);
+			return false;
+		}
+		g_metrics_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (g_metrics_socket < 0) {
+			agios_print("Could not create the metrics socket: %s", strerror(errno));
+			return false;
+		}
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strcpy(addr.sun_path, config_metrics_socket);
+		unlink(config_metrics_socket); //a previous execution may have left it behind
+		if ((bind(g_metrics_socket, (struct sockaddr *) &addr, sizeof(addr)) != 0) || (listen(g_metrics_socket, 8) != 0)) {
+			agios_print("Could not listen on the metrics socket %s: %s", config_metrics_socket, strerror(errno));
+			close(g_metrics_socket);
+			g_metrics_socket = -1;
+			return false;
+		}
+	}
+	g_metrics_stop = false;
+	if (pthread_create(&g_metrics_thread, NULL, metrics_thread, NULL) != 0) {
+		agios_print("Unable to start the metrics exporter thread!");
+		if (g_metrics_socket >= 0) {
+			close(g_metrics_socket);
+			unlink(config_metrics_socket);
+			g_metrics_socket = -1;
+		}
+		return false;
+	}
+	g_metrics_running = true;
+	return true;
+}
+/**
+ * called by agios_exit (before freeing the data structures) to stop the exporter thread.
+ */
+void stop_metrics_exporter(void)
+{
+	if (!g_metrics_running) return;
+	__atomic_store_n(&g_metrics_stop, true, __ATOMIC_RELEASE);
+	pthread_join(g_metrics_thread, NULL);
+	g_metrics_running = false;
+	if (g_metrics_socket >= 0) {
+		close(g_metrics_socket);
+		unlink(config_metrics_socket);
+		g_metrics_socket = -1;
+	}
+}
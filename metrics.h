@@ -0,0 +1,11 @@
+/*! \file metrics.h
+    \brief Headers of the metrics exporter, which gives AGIOS counters in the Prometheus text format.
+
+    @see metrics.c
+*/
+#pragma once
+
+#include <stdbool.h>
+
+bool init_metrics_exporter(void);
+void stop_metrics_exporter(void);
@@ -0,0 +1,163 @@
+/*! \file pattern_tracker.c
+    \brief Implementation of the access pattern tracker, which describes the requests received in each period of a dynamic scheduling algorithm.
+
+    When it is enabled (by the PATTERN_MATCHING dynamic scheduling algorithm), agios_add_request gives every new request to add_request_to_pattern, which updates counters for the current period: reads, request sizes (in power of two buckets), and, for each file (up to PATTERN_FILE_SLOTS files, identified by a hash of their file_id), whether the request starts where the previous one ended (contiguous) or at the same distance from it as the previous one was from its own previous one (strided). At the end of the period, get_current_pattern turns the counters into an access_pattern_t, where fractions are in permille so patterns with different numbers of requests can be compared, and starts a new period. It has its own mutex, so it is not affected by the data structure locks.
+*/
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "agios.h"
+#include "common_functions.h"
+#include "pattern_tracker.h"
+
+/*! \struct pattern_file_t
+    \brief What we know about the last request to one file in the current period.
+ */
+struct pattern_file_t {
+	uint64_t key; /**< hash of the file_id */
+	bool used; /**< was this slot used in the current period? */
+	int64_t last_end; /**< offset+len of the last request */
+	int64_t last_distance; /**< distance between the last request and the one before it */
+	bool has_distance; /**< is last_distance known? (false after the first request) */
+};
+/*! \struct pattern_period_t
+    \brief The counters of the current period.
+ */
+struct pattern_period_t {
+	int32_t reqnb; /**< received requests */
+	int32_t reads; /**< received reads */
+	int32_t contiguous; /**< requests starting where the previous one to the same file ended */
+	int32_t strided; /**< requests at the same distance from the previous one as that one from its previous one */
+	int32_t filenb; /**< accessed files */
+	int32_t sizes[PATTERN_SIZE_BUCKETS]; /**< requests per size bucket */
+	int64_t first_timestamp; /**< arrival time of the first request */
+	int64_t last_timestamp; /**< arrival time of the last request */
+	struct pattern_file_t files[PATTERN_FILE_SLOTS]; /**< the followed files */
+};
+
+static pthread_mutex_t g_pattern_mutex = PTHREAD_MUTEX_INITIALIZER; /**< protects g_period. */
+static bool g_pattern_enabled = false; /**< are requests being tracked? */
+static struct pattern_period_t g_period; /**< the current period. */
+
+/**
+ * starts or stops the tracking of requests. The current period is discarded.
+ * @param enable true to start tracking.
+ */
+void enable_pattern_tracker(bool enable)
+{
+	pthread_mutex_lock(&g_pattern_mutex);
+	memset(&g_period, 0, sizeof(struct pattern_period_t));
+	__atomic_store_n(&g_pattern_enabled, enable, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&g_pattern_mutex);
+}
+/**
+ * calculates the base 2 logarithm of a value, rounded down.
+ * @param value the value.
+ * @return its logarithm, 0 if it is smaller than 2.
+ */
+int16_t pattern_log2(int64_t value)
+{
+	int16_t ret = 0; /**< the return of this function */
+
+	while (value > 1) {
+		value >>= 1;
+		ret++;
+	}
+	return ret;
+}
+/**
+ * calculates a hash of a file_id (FNV-1a), used to identify files in the tracker.
+ * @param file_id the file handle.
+ * @return the hash.
+ */
+uint64_t pattern_hash_file_id(char *file_id)
+{
+	uint64_t hash = 14695981039346656037UL; /**< the return of this function */
+
+	for (char *c = file_id; *c; c++) {
+		hash ^= (uint8_t)*c;
+		hash *= 1099511628211UL;
+	}
+	return hash;
+}
+/**
+ * called by agios_add_request for every new request, to include it in the access pattern of the current period.
+ * @param timestamp the arrival time of the request.
+ * @param offset the position of the file being accessed.
+ * @param len the size of the request.
+ * @param type RT_READ or RT_WRITE.
+ * @param file_id the file handle.
+ */
+void add_request_to_pattern(int64_t timestamp, int64_t offset, int64_t len, int32_t type, char *file_id)
+{
+	uint64_t key; /**< identifies the file */
+	struct pattern_file_t *file; /**< the slot of the file */
+	int64_t distance; /**< from the end of the previous request to the file */
+	int32_t bucket; /**< the size bucket of the request */
+
+	if (!__atomic_load_n(&g_pattern_enabled, __ATOMIC_ACQUIRE)) return;
+	key = pattern_hash_file_id(file_id);
+	bucket = (len < 4096) ? 0 : agios_min(pattern_log2(len / 4096) + 1, PATTERN_SIZE_BUCKETS - 1);
+	pthread_mutex_lock(&g_pattern_mutex);
+	if (g_period.reqnb == 0) g_period.first_timestamp = timestamp;
+	g_period.last_timestamp = timestamp;
+	g_period.reqnb++;
+	if (type == RT_READ) g_period.reads++;
+	g_period.sizes[bucket]++;
+	file = &g_period.files[key % PATTERN_FILE_SLOTS];
+	if ((!file->used) || (file->key != key)) { //a new file (or one sharing the slot, then we follow the new one)
+		file->used = true;
+		file->key = key;
+		file->has_distance = false;
+		g_period.filenb++;
+	} else {
+		distance = offset - file->last_end;
+		if (distance == 0) g_period.contiguous++;
+		else if (file->has_distance && (distance == file->last_distance)) g_period.strided++;
+		file->last_distance = distance;
+		file->has_distance = true;
+	}
+	file->last_end = offset + len;
+	pthread_mutex_unlock(&g_pattern_mutex);
+}
+/**
+ * ends the current period: describes the requests received in it and starts a new one.
+ * @param pattern will receive the description (with reqnb 0 if no requests were received).
+ */
+void get_current_pattern(struct access_pattern_t *pattern)
+{
+	memset(pattern, 0, sizeof(struct access_pattern_t));
+	pthread_mutex_lock(&g_pattern_mutex);
+	pattern->reqnb = g_period.reqnb;
+	if (g_period.reqnb > 0) {
+		pattern->read_permille = (int32_t) (((int64_t) g_period.reads * PATTERN_PERMILLE) / g_period.reqnb);
+		pattern->contiguous_permille = (int32_t) (((int64_t) g_period.contiguous * PATTERN_PERMILLE) / g_period.reqnb);
+		pattern->strided_permille = (int32_t) (((int64_t) g_period.strided * PATTERN_PERMILLE) / g_period.reqnb);
+		pattern->filenb_log = agios_min(pattern_log2(g_period.filenb), pattern_log2(PATTERN_FILE_SLOTS));
+		if (g_period.reqnb > 1) pattern->interarrival_log = pattern_log2(((g_period.last_timestamp - g_period.first_timestamp) / (g_period.reqnb - 1)) / 1000);
+		for (int32_t i = 0; i < PATTERN_SIZE_BUCKETS; i++) pattern->size_permille[i] = (int32_t) (((int64_t) g_period.sizes[i] * PATTERN_PERMILLE) / g_period.reqnb);
+	}
+	memset(&g_period, 0, sizeof(struct pattern_period_t));
+	pthread_mutex_unlock(&g_pattern_mutex);
+}
+/**
+ * compares two access patterns.
+ * @param p1 one of them.
+ * @param p2 the other.
+ * @return the distance between them: the sum of the differences of their fractions (in permille, the size distribution counts half, so moving all requests to another bucket costs 1000), plus 100 for each power of two of difference in the number of files and 50 for each power of two of difference in the time between requests. 0 means they are the same.
+ */
+int32_t get_pattern_distance(struct access_pattern_t *p1, struct access_pattern_t *p2)
+{
+	int32_t sizes = 0; /**< the difference between the size distributions */
+
+	for (int32_t i = 0; i < PATTERN_SIZE_BUCKETS; i++) sizes += abs(p1->size_permille[i] - p2->size_permille[i]);
+	return abs(p1->read_permille - p2->read_permille) +
+		abs(p1->contiguous_permille - p2->contiguous_permille) +
+		abs(p1->strided_permille - p2->strided_permille) +
+		(sizes / 2) +
+		100*abs(p1->filenb_log - p2->filenb_log) +
+		50*abs(p1->interarrival_log - p2->interarrival_log);
+}
@@ -0,0 +1,31 @@
+/*! \file pattern_tracker.h
+    \brief Headers of the access pattern tracker, which describes the requests received in each period of a dynamic scheduling algorithm.
+
+    @see pattern_tracker.c
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PATTERN_SIZE_BUCKETS 10 /**< request sizes are counted in power of two buckets, from less than 4KB to 1MB or more */
+#define PATTERN_FILE_SLOTS 64 /**< how many files are followed to find contiguous and strided requests */
+#define PATTERN_PERMILLE 1000 /**< fractions in an access pattern are in permille */
+
+/*! \struct access_pattern_t
+    \brief A compact description of the requests received in a period. Fractions are in permille, so patterns with different numbers of requests can be compared.
+ */
+struct access_pattern_t {
+	int32_t reqnb; /**< number of requests received in the period */
+	int16_t read_permille; /**< fraction of reads */
+	int16_t contiguous_permille; /**< fraction of requests starting where the previous request to the same file ended (spatiality) */
+	int16_t strided_permille; /**< fraction of the other requests that are as far from the previous request to the same file as that one was from its own previous one */
+	int16_t filenb_log; /**< log2 of the number of accessed files (at most log2(PATTERN_FILE_SLOTS)) */
+	int16_t interarrival_log; /**< log2 of the average time between requests (in us) */
+	int16_t size_permille[PATTERN_SIZE_BUCKETS]; /**< distribution of request sizes */
+};
+
+void enable_pattern_tracker(bool enable);
+void add_request_to_pattern(int64_t timestamp, int64_t offset, int64_t len, int32_t type, char *file_id);
+void get_current_pattern(struct access_pattern_t *pattern);
+int32_t get_pattern_distance(struct access_pattern_t *p1, struct access_pattern_t *p2);
@@ -8,6 +8,7 @@
 
 #include "agios_config.h"
 #include "agios_request.h"
+#include "agios_stats.h"
 #include "common_functions.h"
 #include "mylist.h"
 #include "performance.h"
@@ -19,6 +20,10 @@ static AGIOS_LIST_HEAD(performance_info); /**< the list with all information we
 static int performance_info_len=0; /**< how many entries in performance_info. */
 struct performance_entry_t *current_performance_entry; /**< the latest entry to performance_info. */
 pthread_mutex_t performance_mutex = PTHREAD_MUTEX_INITIALIZER; /**< to protect the performance_info structure. */
+struct request_histograms_t global_histograms; /**< distributions of waiting time, service time and bandwidth of all released requests since agios_init. Also protected by performance_mutex. */
+static struct performance_totals_t performance_totals[IO_SCHEDULER_COUNT]; /**< performance of each scheduling algorithm since agios_init. Protected by performance_mutex and performance_seq. */
+static int64_t current_bandwidth; /**< copy of current_performance_entry->bandwidth for get_performance_snapshot, which cannot follow the pointer without the mutex. Protected by performance_mutex and performance_seq. */
+uint32_t performance_seq; /**< sequence counter so get_performance_snapshot can read performance_totals and current_bandwidth without the mutex (see agios_stats.h). Writers must hold performance_mutex. */
 
 /**
  * function called to clean up this module (at the end of the execution).
@@ -39,10 +44,16 @@ void cleanup_performance_module(void)
 		agios_list_del(&aux->list);
 		free(aux);
 	}
+	performance_info_len = 0;
+	request_histograms_init(&global_histograms); //so the next agios_init starts from empty distributions
+	stats_write_begin(&performance_seq);
+	memset(performance_totals, 0, sizeof(performance_totals));
+	current_bandwidth = 0;
+	stats_write_end(&performance_seq);
 }
 /**
  * Returns the bandwidth observed so far with the current scheduling algorithm. The caller must NOT hold performance mutex, as this function will lock it.
- * @return the bandwidth observed so far in bytes per ns.
+ * @return the bandwidth observed so far in bytes per ns (fixed point, see BANDWIDTH_FIXED_POINT_SHIFT).
  */
 int64_t get_current_performance_bandwidth(void)
 {
@@ -53,6 +64,19 @@ int64_t get_current_performance_bandwidth(void)
 	pthread_mutex_unlock(&performance_mutex);	
 	return ret;
 }
+/**
+ * Returns the median service time (between dispatch and release) of all requests released since agios_init. The caller must NOT hold performance mutex, as this function will lock it.
+ * @return the median service time in ns, -1 if no request was released yet.
+ */
+int64_t get_global_service_time(void)
+{
+	int64_t ret; /**< value that will be returned. */
+
+	pthread_mutex_lock(&performance_mutex);
+	ret = histogram_percentile(&global_histograms.service, 50.0);
+	pthread_mutex_unlock(&performance_mutex);
+	return ret;
+}
 /**
  * Function called when a new scheduling algorithm is selected, to add a slot to it in the performance data structures. The caller must NOT hold performance mutex.
  * @param the new scheduling algorithm (its identifier).
@@ -70,6 +94,7 @@ bool performance_set_new_algorithm(int32_t alg)
 	new->size = 0;
 	new->reqnb=0;
 	new->bandwidth =0;
+	request_histograms_init(&new->histograms);
 	agios_gettime(&now);
 	new->timestamp = get_timespec2long(now);
 	new->alg = alg;
@@ -77,6 +102,9 @@ bool performance_set_new_algorithm(int32_t alg)
 	pthread_mutex_lock(&performance_mutex);
 	agios_list_add_tail(&(new->list), &performance_info);
 	current_performance_entry = new;
+	stats_write_begin(&performance_seq);
+	current_bandwidth = 0;
+	stats_write_end(&performance_seq);
 	performance_info_len++;
 	agios_processed_reqnb=0; 
 	//need to check if we dont have too many entries
@@ -121,11 +149,45 @@ void print_all_performance_data(void)
 
 	debug("current situation of the performance model:");
 	agios_list_for_each_entry (aux, &performance_info, list) {
-		debug("%s - %ld bytes, %ld requests, %ld bytes/ns (timestamp %ld)",
+		debug("%s - %ld bytes, %ld requests, %f bytes/ns (timestamp %ld)",
 			get_algorithm_name_from_index(aux->alg),
 			aux->size,
 			aux->reqnb,
-			aux->bandwidth,
+			((double) aux->bandwidth) / (1 << BANDWIDTH_FIXED_POINT_SHIFT),
 			aux->timestamp);
+		print_request_histograms(&aux->histograms, get_algorithm_name_from_index(aux->alg));
 	}
+	print_request_histograms(&global_histograms, "all requests");
+}
+/**
+ * Accounts a released request to the totals of the scheduling algorithm that dispatched it, after its performance entry was updated. The caller MUST hold the performance mutex and be inside a write of performance_seq.
+ * @param entry the performance entry of the request (from get_request_entry).
+ * @param len the size of the request.
+ * @param bandwidth the bandwidth observed by the request (fixed point).
+ */
+void performance_account_request(struct performance_entry_t *entry, int64_t len, int64_t bandwidth)
+{
+	struct performance_totals_t *totals = &performance_totals[entry->alg]; /**< the totals of this algorithm. */
+
+	totals->reqnb++;
+	totals->size += len;
+	totals->bandwidth = update_iterative_average(totals->bandwidth, bandwidth, totals->reqnb);
+	if (entry == current_performance_entry) current_bandwidth = entry->bandwidth;
+}
+/**
+ * Copies the performance totals of all scheduling algorithms without holding the performance mutex, so it can be called by users while requests are being released.
+ * @param totals an array of IO_SCHEDULER_COUNT positions that will receive the copy.
+ * @return the bandwidth observed so far with the current scheduling algorithm (fixed point).
+ */
+int64_t get_performance_snapshot(struct performance_totals_t *totals)
+{
+	uint32_t seq; /**< value of the sequence counter before the copy. */
+	int64_t ret; /**< value that will be returned. */
+
+	do {
+		seq = stats_read_begin(&performance_seq);
+		memcpy(totals, performance_totals, sizeof(performance_totals));
+		ret = current_bandwidth;
+	} while (stats_read_retry(&performance_seq, seq));
+	return ret;
 }
@@ -4,6 +4,7 @@
 #pragma once
 
 #include "agios_request.h"
+#include "histogram.h"
 #include "mylist.h"
 
 extern int64_t agios_processed_reqnb; 
@@ -12,17 +13,32 @@ struct performance_entry_t //information about one time period, corresponding to
 {
 	int64_t timestamp;	/**< timestamp of when we started this time period. */
 	int32_t alg; /**< scheduling algorithm in use in this time period. */
-	int64_t bandwidth; /**< average bandwidth in this time period. */
+	int64_t bandwidth; /**< average bandwidth in this time period (fixed point, see BANDWIDTH_FIXED_POINT_SHIFT). */
 	int64_t size; /**< the sum of size of every request in this time period. */
 	int64_t reqnb; /**< the number of requests released from this time period. */
+	struct request_histograms_t histograms; /**< distributions of waiting time, service time and bandwidth of requests released from this time period. */
 	struct agios_list_head list; /**< to be inserted in a list. */
 };
 
 extern struct performance_entry_t *current_performance_entry; 
 extern pthread_mutex_t performance_mutex; 
+extern struct request_histograms_t global_histograms;
+extern uint32_t performance_seq;
+
+/*! \struct performance_totals_t
+    \brief Performance observed with one scheduling algorithm since agios_init (the performance_info list only keeps the most recent time periods).
+ */
+struct performance_totals_t {
+	int64_t reqnb; /**< number of released requests dispatched by this scheduling algorithm. */
+	int64_t size; /**< the sum of their sizes. */
+	int64_t bandwidth; /**< their average bandwidth (fixed point, see BANDWIDTH_FIXED_POINT_SHIFT). */
+};
 
 void cleanup_performance_module(void);
 int64_t get_current_performance_bandwidth(void);
+int64_t get_global_service_time(void);
 bool performance_set_new_algorithm(int32_t alg);
 struct performance_entry_t * get_request_entry(struct request_t *req);
 void print_all_performance_data(void);
+void performance_account_request(struct performance_entry_t *entry, int64_t len, int64_t bandwidth);
+int64_t get_performance_snapshot(struct performance_totals_t *totals);
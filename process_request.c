@@ -10,6 +10,7 @@
 
 #include "agios_counters.h"
 #include "agios_request.h"
+#include "agios_stats.h"
 #include "agios_thread.h"
 #include "common_functions.h"
 #include "mylist.h"
@@ -17,6 +18,8 @@
 #include "req_hashtable.h"
 #include "req_timeline.h"
 #include "scheduling_algorithms.h"
+#include "throttle.h"
+#include "trace.h"
 
 struct agios_client user_callbacks; /**< contains the pointers to the user-provided callbacks to be used to process requests */
 
@@ -48,14 +51,38 @@ void unlock_structure_mutex(int32_t hash)
  * @param req the request being processed.
  * @param this_time the timestamp of now.
  * @param dispatch the dispatch queue that will receive the request.
+ * @param head_req the (possibly virtual) request being processed, req itself if it is a single request.
  */
-void put_this_request_in_dispatch(struct request_t *req, int64_t this_time, struct agios_list_head *dispatch)
+void put_this_request_in_dispatch(struct request_t *req, int64_t this_time, struct agios_list_head *dispatch, struct request_t *head_req)
 {
 	agios_list_add_tail(&req->related, dispatch);
 	req->dispatch_timestamp = this_time;
+	req->dispatch_queue_id = head_req->queue_id;
 	debug("request - size %ld, offset %ld, file %s - going back to the file system", req->len, req->offset, req->file_id);
 	req->globalinfo->current_size -= req->len; //when we aggregate overlapping requests, we don't adjust the related list current_size, since it is simply the sum of all requests sizes. For this reason, we have to subtract all requests from it individually when processing a virtual request.
 	req->globalinfo->req_file->timeline_reqnb--;
+	if (TRACE_LIFECYCLE) {
+		req->trace_group = head_req->trace_group; //so release events can be related to the dispatched group
+		agios_trace_request_event(req, AGIOS_TRACE_DISPATCH, this_time, req->trace_group, head_req->reqnb);
+	}
+}
+/**
+ * fills the served_by list of a virtual read request that has duplicates. Each request is served by the largest request that contains it (the first one in the list among identical requests), so only requests served by themselves have to be read.
+ * @param info the processing_info_t being filled, with user_ids already filled.
+ * @param subreqs the requests in the same order as info->user_ids.
+ */
+void fill_served_by(struct processing_info_t *info, struct request_t **subreqs)
+{
+	int32_t best; /**< index of the largest request containing the current one. */
+
+	for (int32_t i = 0; i < info->reqnb; i++) {
+		best = i;
+		for (int32_t j = 0; j < info->reqnb; j++) {
+			if ((j == i) || (subreqs[j]->offset > subreqs[i]->offset) || ((subreqs[j]->offset + subreqs[j]->len) < (subreqs[i]->offset + subreqs[i]->len))) continue; //j does not contain i
+			if ((subreqs[j]->len > subreqs[best]->len) || ((subreqs[j]->len == subreqs[best]->len) && (j < best))) best = j;
+		}
+		info->served_by[i] = info->user_ids[best];
+	}
 }
 /**
  * this function will be called by scheduling algorithms as the first step into processing a request. It will add requests to the dispatch queue, update counters, and fill a structure with user-relevant information to be given to step 2.
@@ -69,6 +96,9 @@ struct processing_info_t *process_requests_step1(struct request_t *head_req, int
 	struct request_t *req; /**< used to iterate over all requests belonging to this virtual request. */
 	struct timespec now;	/**< used to get the dispatch timestamp for the requests. */
 	int64_t this_time;	/**< will receive now converted from a struct timespec to a number. */
+	struct request_t **subreqs = NULL; /**< the requests of a virtual request that has duplicates, to fill info->served_by. */
+	struct request_t *sub_req; /**< used to fill the pieces. */
+	int32_t index = 0; /**< used to fill the pieces. */
 
 	assert(head_req);
 	assert(head_req->reqnb >= 1);
@@ -85,53 +115,136 @@ struct processing_info_t *process_requests_step1(struct request_t *head_req, int
 		return NULL;
 	}
 	info->reqnb = head_req->reqnb;
-	//fill the list of requests
+	info->served_by = NULL;
+	info->piece_offsets = NULL;
+	info->piece_lens = NULL;
+	info->queue_id = head_req->queue_id;
+	info->req_file = head_req->globalinfo->req_file;
+	info->len = head_req->len;
+	//if duplicate reads were aggregated and the user wants to know about them, we'll tell which requests contain the others (unless there are pieces of split requests among them, those are given one by one, see give_requests_to_user)
+	if ((head_req->duplicates > 0) && (!head_req->piece) && (head_req->pieces == 0) && __atomic_load_n(&user_callbacks.process_duplicates_cb, __ATOMIC_ACQUIRE)) {
+		info->served_by = (int64_t *)malloc(sizeof(int64_t)*head_req->reqnb);
+		subreqs = (struct request_t **)malloc(sizeof(struct request_t *)*head_req->reqnb);
+		if ((!info->served_by) || (!subreqs)) { //we can still process the requests without this information
+			if (info->served_by) free(info->served_by);
+			if (subreqs) free(subreqs);
+			info->served_by = NULL;
+			subreqs = NULL;
+		}
+	}
+	//pieces of split requests are given back with their offsets and sizes, so the user knows which part to access
+	if (head_req->piece || (head_req->pieces > 0)) {
+		info->piece_offsets = (int64_t *)malloc(sizeof(int64_t)*head_req->reqnb);
+		info->piece_lens = (int64_t *)malloc(sizeof(int64_t)*head_req->reqnb);
+		if ((!info->piece_offsets) || (!info->piece_lens)) {
+			agios_print("PANIC! Cannot allocate memory for AGIOS.");
+			if (info->piece_offsets) free(info->piece_offsets);
+			if (info->piece_lens) free(info->piece_lens);
+			free(info->user_ids);
+			free(info);
+			return NULL;
+		}
+		if (head_req->reqnb == 1) {
+			info->piece_offsets[0] = head_req->offset;
+			info->piece_lens[0] = head_req->len;
+		} else { //in the same order the requests will be in user_ids
+			agios_list_for_each_entry (sub_req, &head_req->reqs_list, related) {
+				info->piece_offsets[index] = sub_req->offset;
+				info->piece_lens[index] = sub_req->piece ? sub_req->len : -1;
+				index++;
+			}
+		}
+	}
+	//fill the list of requests (the file statistics change as a whole for agios_get_file_stats)
+	stats_write_begin(&head_req->globalinfo->req_file->stats_seq);
 	if (head_req->reqnb > 1) { //a virtual request
  		struct request_t *aux_req=NULL; /**< used to avoid removing a request from the virtual request before moving the iterator to the next one, otherwise the loop breaks. */
 		info->reqnb = 0; //we'll use it as a index to fill the inside list, afterwards it will have the same value as before
 		agios_list_for_each_entry (req, &head_req->reqs_list, related) { //go through all sub-requests
 			if (aux_req) { //we can't just mess with req because the for won't be able to find the next requests after we've modified this one's pointers
-				put_this_request_in_dispatch(aux_req, this_time, &head_req->globalinfo->dispatch);
+				put_this_request_in_dispatch(aux_req, this_time, &head_req->globalinfo->dispatch, head_req);
 				info->user_ids[info->reqnb]=aux_req->user_id;
+				if (subreqs) subreqs[info->reqnb] = aux_req;
 				info->reqnb++;
 			}
 			aux_req = req;
 		}
 		if (aux_req) {
-			put_this_request_in_dispatch(aux_req, this_time, &head_req->globalinfo->dispatch);
+			put_this_request_in_dispatch(aux_req, this_time, &head_req->globalinfo->dispatch, head_req);
 			info->user_ids[info->reqnb]=aux_req->user_id;
+			if (subreqs) subreqs[info->reqnb] = aux_req;
 			info->reqnb++;
 		}
+		if (subreqs) {
+			fill_served_by(info, subreqs);
+			free(subreqs);
+		}
 	} else { //a simple request
-		put_this_request_in_dispatch(head_req, this_time, &head_req->globalinfo->dispatch);
+		put_this_request_in_dispatch(head_req, this_time, &head_req->globalinfo->dispatch, head_req);
 		*(info->user_ids) = head_req->user_id;
 	}
+	stats_write_end(&head_req->globalinfo->req_file->stats_seq);
 	//update requests and files counters
 	if (head_req->globalinfo->req_file->timeline_reqnb == 0) dec_current_filenb(); //timeline_reqnb is updated in the put_this_request_in_dispatch function
 	dec_many_current_reqnb(hash, head_req->reqnb);
+	outstanding_dispatch(info);
 	debug("current status. hashtable[%d] has %d requests, there are %d requests in the scheduler to %d files.", hash, hashlist_reqcounter[hash], current_reqnb, current_filenb); //attention: it could be outdated info since we are not using the lock
 	return info;
 }
-/** 
- * step 2 of the processing of requests by scheduling algorithms. Given a list of user-relevant information about requests to be processed, use the callbacks to process them. This is to be called after calling step 1 AND unlocking the appropriated mutexes.
- * @param info is the processing_info_t struct filled by process_requests_step1, containing a list of the user_id fields of the requests, and the number of requests in the list. (which may be 1). The data structure will be freed by the end of this function.
- * @return true if the scheduling algorithm must stop processing requests and give control back to the agios_thread (because some periodic event is happening), false otherwise.
+/**
+ * uses the callbacks to give requests to the user, and frees the processing_info_t struct. Used by process_requests_step2, and to process requests that were waiting for the throttling.
+ * @param info is the processing_info_t struct filled by process_requests_step1. The data structure will be freed by the end of this function.
  */
-bool process_requests_step2(struct processing_info_t *info) 
+void give_requests_to_user(struct processing_info_t *info)
 {
 	assert(info);
 	assert(info->reqnb >= 1);
-	if (info->reqnb == 1) { //simplest case, a single request
+	if (info->piece_lens) { //some of them are pieces of split requests, they are given one by one
+		void * (* split_cb)(int64_t req_id, int64_t offset, int64_t len) = __atomic_load_n(&user_callbacks.process_split_cb, __ATOMIC_ACQUIRE); /**< read once, the user may change it */
+		for (int32_t i = 0; i < info->reqnb; i++) {
+			if (split_cb && (info->piece_lens[i] >= 0)) split_cb(info->user_ids[i], info->piece_offsets[i], info->piece_lens[i]);
+			else user_callbacks.process_request_cb(info->user_ids[i]);
+		}
+	} else if (info->reqnb == 1) { //simplest case, a single request
 		user_callbacks.process_request_cb(*(info->user_ids));
 	} else { //more than one request
-		if (NULL != user_callbacks.process_requests_cb) { //we have a callback for a list of requests
+		void * (* duplicates_cb)(int64_t *reqs, int64_t *served_by, int32_t reqnb) = __atomic_load_n(&user_callbacks.process_duplicates_cb, __ATOMIC_ACQUIRE); /**< read once, the user may change it */
+		if (info->served_by && duplicates_cb) { //some of them are duplicates of others
+			duplicates_cb(info->user_ids, info->served_by, info->reqnb);
+		} else if (NULL != user_callbacks.process_requests_cb) { //we have a callback for a list of requests
 			user_callbacks.process_requests_cb(info->user_ids, info->reqnb);
 		} else { //we don't have a callback
 			for (int32_t i=0; i < info->reqnb; i++) user_callbacks.process_request_cb(info->user_ids[i]);
 		}
 	}
 	free(info->user_ids);
+	if (info->served_by) free(info->served_by);
+	if (info->piece_offsets) free(info->piece_offsets);
+	if (info->piece_lens) free(info->piece_lens);
 	free(info);
+}
+/** 
+ * step 2 of the processing of requests by scheduling algorithms. Given a list of user-relevant information about requests to be processed, use the callbacks to process them. This is to be called after calling step 1 AND unlocking the appropriated mutexes. If the requests go over a bandwidth or IOPS limit, they are kept by the throttling and given to the user later.
+ * @param info is the processing_info_t struct filled by process_requests_step1, containing a list of the user_id fields of the requests, and the number of requests in the list. (which may be 1). The data structure will be freed by the end of this function (or by the throttling).
+ * @return true if the scheduling algorithm must stop processing requests and give control back to the agios_thread (because some periodic event is happening), false otherwise.
+ */
+bool process_requests_step2(struct processing_info_t *info) 
+{
+	assert(info);
+	if (!throttle_requests(info)) give_requests_to_user(info);
 	//now check if the scheduling algorithms should stop because it is time to periodic events
 	return is_time_to_change_scheduler();
 }
+/**
+ * gives write requests absorbed by later writes back to the user, through the callback given to agios_set_absorbed_callback. This is to be called after unlocking the mutexes, like process_requests_step2.
+ * @param info the processing_info_t struct filled by absorb_overwritten_writes. It will be freed by the end of this function.
+ */
+void process_absorbed_requests(struct processing_info_t *info)
+{
+	void * (* absorbed_cb)(int64_t *reqs, int32_t reqnb) = __atomic_load_n(&user_callbacks.process_absorbed_cb, __ATOMIC_ACQUIRE); /**< read once, the user may change it */
+
+	assert(info);
+	if (absorbed_cb) absorbed_cb(info->user_ids, info->reqnb);
+	free(info->user_ids);
+	free(info);
+}
@@ -10,16 +10,28 @@
 struct agios_client {
 	void * (* process_request_cb)(int64_t req_id); /**< a function to process a single request. */
 	void * (* process_requests_cb)(int64_t *reqs, int32_t reqnb); /**< a function to process a list of requests at once. This one might be NULL if the user did not provide it. */
+	void * (* process_duplicates_cb)(int64_t *reqs, int64_t *served_by, int32_t reqnb); /**< a function to process a list of read requests where some are duplicates of others, set by agios_set_duplicates_callback. It might be NULL. */
+	void * (* process_absorbed_cb)(int64_t *reqs, int32_t reqnb); /**< a function to tell the user about write requests absorbed by later writes, set by agios_set_absorbed_callback. Write absorption is only done if it is not NULL. */
+	void * (* process_split_cb)(int64_t req_id, int64_t offset, int64_t len); /**< a function to process a piece of a request split at stripe boundaries, set by agios_set_split_callback. Requests are only split if it is not NULL. */
+	void * (* read_ahead_cb)(char *file_id, int64_t offset, int64_t len); /**< a function to receive read-ahead hints from the stream detector, set by agios_set_read_ahead_callback. Streams are only detected if it is not NULL. */
 };
 /* \struct processing_info_t is a struct to hold information about one or more requests that are to be processed. It is filled by the process_requests_step1 function and used in the process_requests_step2 to send requests back to the user through the provided callbacks. 
  */
 struct processing_info_t {
 	int64_t *user_ids; /**< a list of requests, each request is represented by the user_id field, provided to agios_add_request as a request identifier that makes sense to the user */
 	int32_t reqnb; /**< the lenght of the user_ids list (number of requests) */
-	struct agios_list_head list; /**< used to be inserted in a list (for MLF and aIOLi only) */
+	int64_t *served_by; /**< NULL, or for each request in user_ids, the user_id of the request whose data contains it (itself if it is not a duplicate). @see agios_set_duplicates_callback */
+	int64_t *piece_offsets; /**< NULL, or for each request in user_ids, its offset if it is a piece of a split request. @see agios_set_split_callback */
+	int64_t *piece_lens; /**< NULL, or for each request in user_ids, its size if it is a piece of a split request, -1 if it is not */
+	int32_t queue_id; /**< the queue_id of the requests, used by the throttling */
+	struct file_t *req_file; /**< the file accessed by the requests, used by the throttling */
+	int64_t len; /**< the size of the (possibly virtual) request, used by the throttling */
+	struct agios_list_head list; /**< used to be inserted in a list (by MLF, aIOLi and BFQ, and for requests waiting for the throttling) */
 };
 
 extern struct agios_client user_callbacks;	
 
 struct processing_info_t *process_requests_step1(struct request_t *head_req, int32_t hash);
 bool process_requests_step2(struct processing_info_t *info);
+void give_requests_to_user(struct processing_info_t *info);
+void process_absorbed_requests(struct processing_info_t *info);
@@ -13,11 +13,17 @@
 
 #include "agios.h"
 #include "agios_add_request.h"
+#include "agios_counters.h"
 #include "agios_request.h"
+#include "agios_stats.h"
 #include "common_functions.h"
+#include "EDF.h"
 #include "hash.h"
 #include "mylist.h"
+#include "process_request.h"
 #include "req_hashtable.h"
+#include "scheduling_algorithms.h"
+#include "trace.h"
 
 struct agios_list_head *hashlist;  /**< the hashtable. */
 int32_t *hashlist_reqcounter = NULL; /**< how many requests are present in each position from the hashtable (used to speed the search for requests in the scheduling algorithms). */
@@ -64,6 +70,7 @@ void queue_cleanup(struct queue_t *queue)
 {
 	list_of_requests_cleanup(&queue->list);
 	list_of_requests_cleanup(&queue->dispatch);
+	if (queue->stats.histograms) free(queue->stats.histograms);
 }
 /**
  * called at the end of the execution to clean up the hashtable structures.
@@ -99,16 +106,97 @@ void hashtable_cleanup(void)
 	if (hashlist_locks) free(hashlist_locks);
 	if (hashlist_reqcounter) free(hashlist_reqcounter);
 }
+/**
+ * write absorption: removes from a write queue the requests (including requests inside virtual requests) whose whole range is going to be written again by a new request. They are not going to be given to the user through the usual callbacks, but through the one given to agios_set_absorbed_callback. Pieces of split requests are never absorbed, because the callback only gives identifiers and all pieces of a request share one, so the user would think the whole request was done. The new request cannot be cancelled afterwards, since it is the only one writing the absorbed data. The caller must hold the mutex for the relevant line of the hashtable. 
+ * @param req the new write request, not in the queue yet.
+ * @param queue the write queue of its file.
+ * @param hash the line of the hashtable where the file is.
+ * @return a newly allocated processing_info_t with the user_id of the absorbed requests, or NULL if there were none (or if we could not allocate memory, then nothing is absorbed).
+ */
+struct processing_info_t *absorb_overwritten_writes(struct request_t *req, struct agios_list_head *queue, int32_t hash)
+{
+	struct processing_info_t *info = NULL; /**< the list of absorbed requests to be returned. */
+	int32_t size = 0; /**< how many user_ids fit in info. */
+	struct request_t *tmp; /**< used to iterate over the queue. */
+	struct request_t *sub_req; /**< used to iterate over the requests of a virtual request. */
+	struct request_t *victim; /**< the next request to be absorbed. */
+	struct request_t *virtual_req; /**< the virtual request containing victim, NULL if it is not part of one. */
+	struct timespec now; /**< used to trace the absorption. */
+
+	do {
+		//look for a request covered by the new one (the queue is sorted by offset, and a virtual request starts at the offset of its first request)
+		victim = NULL;
+		agios_list_for_each_entry (tmp, queue, related) {
+			if (tmp->offset > req->offset + req->len) break;
+			if (tmp->reqnb == 1) {
+				if ((!tmp->piece) && (tmp->offset >= req->offset) && ((tmp->offset + tmp->len) <= (req->offset + req->len))) { //the absorbed callback cannot tell which piece of a split request was absorbed
+					victim = tmp;
+					virtual_req = NULL;
+					break;
+				}
+			} else if ((tmp->offset + tmp->len) > req->offset) { //a virtual request, we look inside it only if it overlaps with the new request
+				agios_list_for_each_entry (sub_req, &tmp->reqs_list, related) {
+					if ((!sub_req->piece) && (sub_req->offset >= req->offset) && ((sub_req->offset + sub_req->len) <= (req->offset + req->len))) {
+						victim = sub_req;
+						virtual_req = tmp;
+						break;
+					}
+				}
+				if (victim) break;
+			}
+		}
+		if (!victim) break;
+		//keep its identifier to give it back to the user
+		if (!info) {
+			info = malloc(sizeof(struct processing_info_t));
+			if (!info) return NULL; //we have not absorbed anything yet
+			size = 8;
+			info->user_ids = malloc(sizeof(int64_t)*size);
+			if (!info->user_ids) {
+				free(info);
+				return NULL;
+			}
+			info->reqnb = 0;
+			info->served_by = NULL;
+			info->piece_offsets = NULL;
+			info->piece_lens = NULL;
+		} else if (info->reqnb == size) {
+			int64_t *new_ids = realloc(info->user_ids, sizeof(int64_t)*size*2); /**< larger list of identifiers. */
+			if (!new_ids) break; //we keep what we already absorbed, and leave this one in the queue
+			info->user_ids = new_ids;
+			size *= 2;
+		}
+		info->user_ids[info->reqnb] = victim->user_id;
+		info->reqnb++;
+		req->absorbing = true;
+		//remove it from the queue
+		if (TRACE_LIFECYCLE) {
+			agios_gettime(&now);
+			agios_trace_request_event(victim, AGIOS_TRACE_CANCEL, get_timespec2long(now), virtual_req ? virtual_req->trace_group : 0, 1);
+		}
+		if (virtual_req) remove_from_virtual_request(victim, virtual_req);
+		else agios_list_del(&victim->related);
+		stats_write_begin(&victim->globalinfo->req_file->stats_seq);
+		victim->globalinfo->current_size -= victim->len;
+		victim->globalinfo->req_file->timeline_reqnb--; //we don't decrement the number of files if it becomes 0 because the new request is about to be added to this file
+		stats_write_end(&victim->globalinfo->req_file->stats_seq);
+		dec_current_reqnb(hash);
+		request_cleanup(victim);
+	} while (true);
+	return info;
+}
 /**
  * called to add a request to the hashtable. The caller must hold the mutex for the relevant line of the hashtable.
  * @param req the newly arrived request.
  * @param hash_val the line of the hashtable where the file accessed by this request belongs.
  * @param given_req_file to be provided ONLY when using this function to migrate from timeline to hashtable. In that case, it is the file structure.
+ * @param absorbed if not NULL and write absorption is enabled (with agios_set_absorbed_callback), it receives the list of queued write requests absorbed by this one (or NULL if none), to be given to process_absorbed_requests after unlocking the mutex. 
  * @return true or false for success.
  */ 
 bool hashtable_add_req(struct request_t *req, 
 			int32_t hash_val, 
-			struct file_t *given_req_file)
+			struct file_t *given_req_file,
+			struct processing_info_t **absorbed)
 {
 	struct agios_list_head *queue; /**< will receive the queue where the request is to be added (read or write) */
 	struct file_t *req_file = given_req_file; /**< the file that is being accessed by this request. */
@@ -130,6 +218,8 @@ bool hashtable_add_req(struct request_t *req,
 	} else {
 		queue = &req_file->write_queue.list;
 		req->globalinfo = &req_file->write_queue;
+		//queued writes to the same range are not needed anymore if the user asked for write absorption
+		if (absorbed && __atomic_load_n(&user_callbacks.process_absorbed_cb, __ATOMIC_ACQUIRE)) *absorbed = absorb_overwritten_writes(req, queue, hash_val);
 	}
 	/* search for the position in the offset-sorted list. */ 
 	insertion_place = queue;
@@ -146,6 +236,8 @@ bool hashtable_add_req(struct request_t *req,
 	//try to aggregate the request with the neighboors. If it is not possible, just add it in the place we found for it.
 	if(!insert_aggregations(req, insertion_place->prev, queue))
 		agios_list_add(&req->related, insertion_place->prev);
+	//EDF keeps the deadlines in a heap (requests being migrated are added to it by EDF itself)
+	if ((current_alg == EDF_SCHEDULER) && (!given_req_file)) EDF_new_request(req);
 	return true;
 }
 /**
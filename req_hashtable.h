@@ -13,9 +13,12 @@ extern int32_t *hashlist_reqcounter;
 
 bool hashtable_init(void);
 void hashtable_cleanup(void);
+struct processing_info_t;
+
 bool hashtable_add_req(struct request_t *req, 
 			int32_t hash_val, 
-			struct file_t *given_req_file);
+			struct file_t *given_req_file,
+			struct processing_info_t **absorbed);
 void hashtable_safely_del_req(struct request_t *req);
 void hashtable_del_req(struct request_t *req);
 struct agios_list_head *hashtable_lock(int32_t index);
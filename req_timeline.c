@@ -1,7 +1,7 @@
 /*! \file req_timeline.c
     \brief Implementation of the timeline, used as request queue to some scheduling algorithms.
 
-    There is a timeline (queue) of requests, protected with a single mutex. The insertion order in this queue is usually FIFO, but may differ depending on the used scheduling algorithm. If a max_queue_id was provided to agios_init, the initialization function will also allocate the multi_timeline, a list of max_queue_id+1 request queues, which is used by some scheduling algorithms (for now just TWINS) and is also protected by the same timeline_mutex.
+    There is a timeline (queue) of requests, protected with a single mutex. The insertion order in this queue is usually FIFO, but may differ depending on the used scheduling algorithm. If a max_queue_id was provided to agios_init, the initialization function will also allocate the multi_timeline, a list of max_queue_id+1 request queues, which is used by some scheduling algorithms (TWINS and SFQ) and is also protected by the same timeline_mutex.
  */
 #include <pthread.h>
 #include <stdbool.h>
@@ -17,9 +17,10 @@
 #include "mylist.h"
 #include "req_hashtable.h"
 #include "scheduling_algorithms.h"
+#include "throttle.h"
 
 AGIOS_LIST_HEAD(timeline); /**< the request queue. */ 
-struct agios_list_head *multi_timeline; /**< multiple request queues, indexed by the queue_id provided by the user with each request to agios_add_request. This structure is used by TWINS. */
+struct agios_list_head *multi_timeline; /**< multiple request queues, indexed by the queue_id provided by the user with each request to agios_add_request. This structure is used by TWINS and SFQ. */
 int32_t multi_timeline_size=0; /**< number of queues in multi_timeline. */
 static pthread_mutex_t timeline_mutex = PTHREAD_MUTEX_INITIALIZER; /**< a lock to access all timeline structures. */
 
@@ -39,6 +40,20 @@ void timeline_unlock(void)
 {
 	pthread_mutex_unlock(&timeline_mutex);
 }
+/**
+ * inserts a request in a queue ordered by arrival (timestamp). We look for its place from the end of the queue, because it is usually close to it when migrating.
+ * @param req the request.
+ * @param queue the queue (the timeline or one of the multi_timeline queues).
+ */
+void add_req_in_arrival_order(struct request_t *req, struct agios_list_head *queue)
+{
+	struct agios_list_head *pos; /**< the request after which req will be inserted. */
+
+	for (pos = queue->prev; pos != queue; pos = pos->prev) {
+		if (agios_list_entry(pos, struct request_t, related)->timestamp <= req->timestamp) break;
+	}
+	agios_list_add(&req->related, pos);
+}
 /**
  * function used by timeline_add_request to add a request to the timeline. This is a separated function because when migrating to or from SW or TWINS we need to completely reorder the timeline, so we'll add requests to a temporary timeline in the process. 
  * @see reorder_timeline
@@ -55,8 +70,8 @@ bool __timeline_add_req(struct request_t *req,
 {
 	struct file_t *req_file = given_req_file; /**< used to find the structure holding information about the file being accessed. */
 	struct request_t *tmp; /**< used to iterate over the timeline to find the insertion place for the request (depending on the scheduling algorithm being used). */
-	int32_t sw_priority; /**< a value that will define the position in the timeline when using the SW scheduling algorithm. */
 	struct agios_list_head *insertion_place; /**< the insertion place of the new request in the queue. */
+	int32_t queue; /**< the queue of the multi_timeline where the request goes. */
 
 	if (!req_file) { //if a req_file structure has been given, we are actually migrating from hashtable to timeline and will copy the file_t structures, so no need to create new. Also the request pointers are already set, and we don't need to use locks here
 		debug("adding request %ld %ld to file %s, app_id %u", req->offset, req->len, req->file_id, req->queue_id);	
@@ -71,10 +86,10 @@ bool __timeline_add_req(struct request_t *req,
 	//the SW scheduling algorithm separates requests into windows
 	if (current_alg == SW_SCHEDULER) {
 		// Calculate the request priority
-		sw_priority = ((req->arrival_time / config_sw_size) * 32768) + req->queue_id; //we assume 32768 here is the maximum value app_id could ever assume (not max_queue_id, but the maximum max_queue_id the user could ever give us). This is an ugly hardcoded value.
+		req->sw_priority = ((req->arrival_time / config_sw_size) * 32768) + req->queue_id; //we assume 32768 here is the maximum value app_id could ever assume (not max_queue_id, but the maximum max_queue_id the user could ever give us). This is an ugly hardcoded value.
 		// Find the position to insert the request
 		agios_list_for_each_entry (tmp, this_timeline, related) { //go through all requests in the queue
-			if (tmp->sw_priority > sw_priority) {
+			if (tmp->sw_priority > req->sw_priority) {
 				agios_list_add(&req->related, tmp->related.prev);
 				return true;
 			}
@@ -83,20 +98,22 @@ bool __timeline_add_req(struct request_t *req,
 		agios_list_add_tail(&req->related, this_timeline);
 		return true;
 	} 
-	if (current_alg == TWINS_SCHEDULER) {
-		agios_list_add_tail(&req->related, &(multi_timeline[req->queue_id]));
+	if (current_scheduler->needs_multi_timeline) {
+		if ((req->queue_id < 0) || (req->queue_id >= multi_timeline_size)) req->queue_id = 0; //an invalid queue_id would write out of the multi_timeline
+		queue = ((current_alg == TWINS_SCHEDULER) && (req->server >= 0)) ? req->server : req->queue_id; //TWINS serves one server at a time, and knows the server of requests to striped files
+		if (given_req_file) { //we are migrating, requests may come in any order
+			add_req_in_arrival_order(req, &(multi_timeline[queue]));
+		} else agios_list_add_tail(&req->related, &(multi_timeline[queue]));
 		return true;
 	}
 	//the TO-agg scheduling algorithm searches the queue for contiguous requests. If it finds any, then aggregate them.	
 	if ((current_alg == TOAGG_SCHEDULER) && (current_scheduler->max_aggreg_size > 1)) {	
 		agios_list_for_each_entry (tmp, this_timeline, related) { //go through all requests in the queue
 			if (tmp->globalinfo == req->globalinfo) { //same type and to the same file
-				if (tmp->reqnb < current_scheduler->max_aggreg_size) { //if the virtual request can hold another one
-					if (CHECK_AGGREGATE(req,tmp) || CHECK_AGGREGATE(tmp, req)) { //and they are contiguous
-						include_in_aggregation(req, &tmp);
-						return true;
-					}
-				} 
+				if (should_aggregate(req, tmp) || should_aggregate(tmp, req)) { //if they are close enough and the virtual request can hold another one
+					include_in_aggregation(req, &tmp);
+					return true;
+				}
 			}
 		} //end loop going over all requests 
 	}
@@ -132,7 +149,7 @@ bool timeline_add_req(struct request_t *req, int32_t hash, struct file_t *given_
 	return __timeline_add_req(req, hash, given_req_file, &timeline);
 }
 /** 
- * This function is called when migrating between two scheduling algorithms when both use timeline and one of them is the TIME_WINDOW or TWINS. In this case, it is necessary to redo the timeline so requests will be processed in the new relevant order.
+ * This function is called when migrating between two scheduling algorithms when both use timeline and one of them is the TIME_WINDOW or uses the multi_timeline (TWINS and SFQ). In this case, it is necessary to redo the timeline so requests will be processed in the new relevant order.
  */
 void reorder_timeline(void)
 {
@@ -160,6 +177,11 @@ void reorder_timeline(void)
 		__timeline_add_req(aux_req, hash, aux_req->globalinfo->req_file, new_timeline);	
 	}
 	//redefine the pointers and replace the old timeline by the new one
+	if (agios_list_empty(new_timeline)) { //all requests went to the multi_timeline (we are migrating to TWINS or SFQ)
+		init_agios_list_head(&timeline);
+		free(new_timeline);
+		return;
+	}
 	new_timeline->prev->next = &timeline;
 	new_timeline->next->prev = &timeline;
 	timeline.next = new_timeline->next;
@@ -167,23 +189,49 @@ void reorder_timeline(void)
 	free(new_timeline);
 }
 /**
- * removes the first request from the queue and also calculates its hash. The caller must hold the timeline lock before calling this.
+ * moves all requests from the multi_timeline (used by TWINS and SFQ) to the timeline, in arrival order. Used when migrating from TWINS or SFQ to another scheduling algorithm, before the usual migration from the timeline. The caller must hold the timeline lock.
+ */
+void gather_multi_timeline(void)
+{
+	struct request_t *req; /**< used to iterate over all requests of a queue. */
+	struct request_t *aux_req; /**< used to avoid moving a request before moving the iterator to the next one, otherwise the loop breaks. */
+
+	for (int32_t i=0; i < multi_timeline_size; i++) {
+		aux_req = NULL;
+		agios_list_for_each_entry (req, &multi_timeline[i], related) {
+			if (aux_req) {
+				agios_list_del(&aux_req->related);
+				add_req_in_arrival_order(aux_req, &timeline);
+			}
+			aux_req = req;
+		}
+		if (aux_req) {
+			agios_list_del(&aux_req->related);
+			add_req_in_arrival_order(aux_req, &timeline);
+		}
+	}
+}
+/**
+ * removes the first request whose limits on outstanding requests allow it from the queue and also calculates its hash. The caller must hold the timeline lock before calling this.
  * @param hash the value that will be updated in this function to hold the line of the hashtable with information about the file that is accessed by the returned request.
- * @return the first request from the queue, removed from it, NULL if the queue is empty. 
+ * @return the first request from the queue that can be processed, removed from it, NULL if the queue is empty or all its requests are waiting for their limits. 
  */
 struct request_t *timeline_oldest_req(int32_t *hash)
 {
 	struct request_t *tmp; /**< the request that will be returned. */
 
-	if (agios_list_empty(&timeline)) return NULL;
-	tmp = agios_list_entry(timeline.next, struct request_t, related);
-	agios_list_del(&tmp->related);
-	*hash = get_hashtable_position(tmp->file_id);
-	return tmp;
+	agios_list_for_each_entry (tmp, &timeline, related) {
+		if (outstanding_allows(tmp->globalinfo->req_file, tmp->queue_id)) {
+			agios_list_del(&tmp->related);
+			*hash = get_hashtable_position(tmp->file_id);
+			return tmp;
+		}
+	}
+	return NULL;
 }
 /**
  * Initializes data structures used for the timeline, the multi_timeline and the lock. 
- * @param max_queue_id the number of queues in multi_timeline. It is only relevant for TWINS. Pass 0 otherwise to prevent unnecessary memory allocation.
+ * @param max_queue_id the number of queues in multi_timeline. It is only relevant for TWINS and SFQ. Pass 0 otherwise to prevent unnecessary memory allocation.
  * @return true or false for success. 
  */
 bool timeline_init(int32_t max_queue_id)
@@ -193,7 +241,7 @@ bool timeline_init(int32_t max_queue_id)
 		multi_timeline = (struct agios_list_head *) malloc(sizeof(struct agios_list_head)*(max_queue_id+1));
 		multi_timeline_size = max_queue_id+1;
 		if (!multi_timeline) {
-			agios_print("PANIC! No memory to allocate the app timeline for TWINS");
+			agios_print("PANIC! No memory to allocate the multi_timeline");
 			return false;
 		}
 		for (int32_t i=0; i< multi_timeline_size; i++) {
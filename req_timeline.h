@@ -13,6 +13,8 @@ struct agios_list_head *timeline_lock(void);
 void timeline_unlock(void);
 bool timeline_add_req(struct request_t *req, int32_t hash, struct file_t *given_req_file);
 void reorder_timeline(void);
+void add_req_in_arrival_order(struct request_t *req, struct agios_list_head *queue);
+void gather_multi_timeline(void);
 struct request_t *timeline_oldest_req(int32_t *hash);
 bool timeline_init(int32_t max_queue_id);
 void timeline_cleanup(void);
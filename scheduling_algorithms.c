@@ -8,16 +8,22 @@
 #include <string.h>
 
 #include "aIOLi.h"
+#include "BFQ.h"
+#include "common_functions.h"
 #include "data_structures.h"
+#include "EDF.h"
 #include "MLF.h"
 #include "NOOP.h"
+#include "PATTERN_MATCHING.h"
 #include "req_hashtable.h"
 #include "req_timeline.h"
 #include "scheduling_algorithms.h"
+#include "SFQ.h"
 #include "SJF.h"
 #include "statistics.h"
 #include "SW.h"
 #include "TO.h"
+#include "trace.h"
 #include "TWINS.h"
 
 int32_t current_alg = 0; /**< the identifier of the scheduling algorithm being currently used. @see scheduling_algorithms.h */
@@ -67,7 +73,7 @@ static struct io_scheduler_instance_t io_schedulers[] = {
 			.index = AIOLI_SCHEDULER,
 			.init = NULL,
 			.schedule = &aIOLi,
-			.exit = NULL,
+			.exit = &aIOLi_exit,
 			.select_algorithm = NULL,
 			.max_aggreg_size = MAX_AGGREG_SIZE,
 			.needs_hashtable=true,
@@ -119,27 +125,88 @@ static struct io_scheduler_instance_t io_schedulers[] = {
 			.select_algorithm = NULL,
 			.max_aggreg_size = 1,
 			.needs_hashtable = false, 
+			.needs_multi_timeline = true,
 			.can_be_dynamically_selected = false, //The functions that implement the migration between different scheduling algorithms were not adapted for this algorithm, so it should never be used with a dynamic algorithm until we fix that.  
 			.is_dynamic=false,
+		},
+		{
+			.name = "EDF",
+			.index = EDF_SCHEDULER,
+			.init = &EDF_init,
+			.schedule = &EDF,
+			.exit = &EDF_exit,
+			.select_algorithm = NULL,
+			.max_aggreg_size = MAX_AGGREG_SIZE,
+			.needs_hashtable = true,
+			.can_be_dynamically_selected = false, //it only makes sense if the user is giving deadlines to requests
+			.is_dynamic=false,
+		},
+		{
+			.name = "SFQ",
+			.index = SFQ_SCHEDULER,
+			.init = &SFQ_init,
+			.schedule = &SFQ,
+			.exit = &SFQ_exit,
+			.select_algorithm = NULL,
+			.max_aggreg_size = 1,
+			.needs_hashtable = false,
+			.needs_multi_timeline = true,
+			.can_be_dynamically_selected = false, //it needs queue_ids and weights given by the user
+			.is_dynamic=false,
+		},
+		{
+			.name = "BFQ",
+			.index = BFQ_SCHEDULER,
+			.init = &BFQ_init,
+			.schedule = &BFQ,
+			.exit = NULL,
+			.select_algorithm = NULL,
+			.max_aggreg_size = MAX_AGGREG_SIZE,
+			.needs_hashtable = true,
+			.can_be_dynamically_selected = true,
+			.is_dynamic=false,
+		},
+		{
+			.name = "PATTERN_MATCHING",
+			.index = PATTERN_MATCHING_SCHEDULER,
+			.init = &PATTERN_MATCHING_init,
+			.schedule = NULL,
+			.exit = NULL, //the known patterns are kept until agios_exit (cleanup_PATTERN_MATCHING)
+			.select_algorithm = &PATTERN_MATCHING_select,
+			.max_aggreg_size = 1,
+			.needs_hashtable = false,
+			.can_be_dynamically_selected = false,
+			.is_dynamic=true,
 		}
 	};
 /**
  * Called to change the current scheduling algorithm and update local parameters. Here we assume the scheduling thread is NOT running, so it won't mess with the structures. This function will acquire the lock to all data structures, must call unlock afterwards 
  * @param new_alg identifier of the new scheduling algorithm.
+ * @return true or false for success. If the new scheduling algorithm could not be initialized, the current one is kept.
  */
-void change_selected_alg(int32_t new_alg)
+bool change_selected_alg(int32_t new_alg)
 {
 	int32_t previous_alg; /**< will receive the current_alg while we are changing it to new_alg. */
 	struct io_scheduler_instance_t *previous_scheduler; /**< will receive current_scheduler while we are changing it to the new one. */
+	struct io_scheduler_instance_t *new_scheduler; /**< the initialized new_alg. */
 
 	//lock all data structures so no one is adding or releasing requests while we migrate
 	lock_all_data_structures();
 	if (current_alg != new_alg) { //if we are indeed changing something
+		new_scheduler = initialize_scheduler(new_alg);
+		if (!new_scheduler) {
+			agios_print("could not initialize the %s scheduling algorithm, keeping %s", get_algorithm_name_from_index(new_alg), current_scheduler->name);
+			return false;
+		}
 		//change scheduling algorithm
 		previous_scheduler = current_scheduler;
 		previous_alg = current_alg;
-		current_scheduler = initialize_scheduler(new_alg);
+		if (previous_scheduler->exit) previous_scheduler->exit(); //the exit function is not mandatory for schedulers
+		current_scheduler = new_scheduler;
 		current_alg = new_alg;
+		if (TRACE_LIFECYCLE) agios_trace_change_alg(previous_alg, new_alg);
+		//TWINS and SFQ keep requests in the multi_timeline, we move them to the timeline so the usual migrations apply
+		if (previous_scheduler->needs_multi_timeline) gather_multi_timeline();
 		//do we need to migrate data structure?
 		//first situation: both use hashtable
 		if (current_scheduler->needs_hashtable && previous_scheduler->needs_hashtable) {
@@ -160,14 +227,15 @@ void change_selected_alg(int32_t new_alg)
 		} else { //fourth situation: both algorithms use timeline
 			//now it depends on the algorithms. 
 			//if we are changing to NOOP, it does not matter because it does not really use the data structure
-			//if we are changing from or to SW or TWINS, we need to reorder the list
+			//if we are changing from or to SW or a scheduler that uses the multi_timeline, we need to reorder the list
 			//if we are changing to the timeorder with aggregation, we need to reorder the list
 			if ((current_alg != NOOP_SCHEDULER) && 
-			   ((previous_alg == SW_SCHEDULER) || (current_alg == SW_SCHEDULER) || (current_alg == TWINS_SCHEDULER) || (previous_alg == TWINS_SCHEDULER))) {
+			   ((previous_alg == SW_SCHEDULER) || (current_alg == SW_SCHEDULER) || current_scheduler->needs_multi_timeline || previous_scheduler->needs_multi_timeline)) {
 				reorder_timeline(); 
 			}
 		} //end fourth situation 
 	} //end if changing the scheduler
+	return true;
 }
 /**
  * finds and returns the current scheduler indicated by index. If this scheduler needs an initialization function, calls it.
@@ -17,7 +17,11 @@
 #define SW_SCHEDULER 5
 #define NOOP_SCHEDULER 6
 #define TWINS_SCHEDULER 7
-#define IO_SCHEDULER_COUNT 8  /*! \warning this has to be updated if adding or removing schedulign algorithms */
+#define EDF_SCHEDULER 8
+#define SFQ_SCHEDULER 9
+#define BFQ_SCHEDULER 10
+#define PATTERN_MATCHING_SCHEDULER 11
+#define IO_SCHEDULER_COUNT 12  /*! \warning this has to be updated if adding or removing schedulign algorithms */
 
 struct io_scheduler_instance_t {
 	bool (*init)(void); /**< called to initialize the scheduler. MUST return true or false for success. This function is not mandatory, can be NULL. */ 
@@ -25,6 +29,7 @@ struct io_scheduler_instance_t {
 	int64_t (*schedule)(void); /**< called to schedule some requests. This function MUST NOT sleep. Instead, a waiting time can be provided to the caller. That waiting time will be respected EVEN IF there are queued requests, so it is to be used wisely. This function is mandatory, except for dynamic schedulers, which can provide NULL. */
 	int32_t (*select_algorithm)(void); /**< Normal scheduling algorithms must provide NULL, this function is only provided by dynamic schedulers. It returns the next algorithm to be used. */
 	bool needs_hashtable; /**< Does this scheduler uses the hashtable to hold the requests? If not, then timeline is used. */
+	bool needs_multi_timeline; /**< Does this scheduler keep the requests in the multi_timeline (one queue per queue_id) instead of the timeline? Only relevant if needs_hashtable is false. */
 	int32_t max_aggreg_size; /**< Maximum number of requests to be aggregated at once. */
 	bool can_be_dynamically_selected; /**< Can this algorithm be selected by dynamic algorithms? Some algorithms need special conditions (like available trace files or application ids) or are still experimental, so we may not want them to be selected by the dynamic selectors. */
 	bool is_dynamic; /**< is this algorithm a dynamic one, which does not schedule requests but instead periodically choses another scheduling algorithm to do so? */
@@ -35,7 +40,7 @@ struct io_scheduler_instance_t {
 extern int32_t current_alg;
 extern struct io_scheduler_instance_t *current_scheduler;
 
-void change_selected_alg(int32_t new_alg);
+bool change_selected_alg(int32_t new_alg);
 bool get_algorithm_from_string(const char *alg, int32_t *index);
 char *get_algorithm_name_from_index(int32_t index);
 struct io_scheduler_instance_t *find_io_scheduler(int32_t index);
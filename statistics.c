@@ -6,7 +6,9 @@
 #include <string.h>
 
 #include "agios.h"
+#include "agios_stats.h"
 #include "common_functions.h"
+#include "histogram.h"
 #include "mylist.h"
 #include "req_hashtable.h"
 #include "statistics.h"
@@ -14,6 +16,7 @@
 static struct timespec last_req; /**< time of the last request arrival. */
 static struct global_statistics_t global_stats; /**< global statistics. */
 static pthread_mutex_t global_statistics_mutex = PTHREAD_MUTEX_INITIALIZER; /**< to protectthe global statistics */
+static uint32_t global_stats_seq; /**< sequence counter so get_global_stats can read the global statistics without the mutex (see agios_stats.h) */
 
 /**
  * function called to update the local statistics to a queue after the arrival of a new request.
@@ -76,7 +79,9 @@ void statistics_newreq(struct request_t *req)
 	req->globalinfo->stats.receivedreq_nb++;
 	//update global statistics
 	pthread_mutex_lock(&global_statistics_mutex);
+	stats_write_begin(&global_stats_seq);
 	update_global_stats_newreq(&global_stats, req);
+	stats_write_end(&global_stats_seq);
 	pthread_mutex_unlock(&global_statistics_mutex);
 	//update local statistics
 	update_local_stats(&req->globalinfo->stats, req);
@@ -87,11 +92,15 @@ void statistics_newreq(struct request_t *req)
 void reset_global_stats(void)
 {
 	pthread_mutex_lock(&global_statistics_mutex);
+	stats_write_begin(&global_stats_seq);
 	global_stats.total_reqnb =0;
 	global_stats.reads = 0;
 	global_stats.writes = 0;
 	global_stats.avg_time_between_requests = -1;
 	global_stats.avg_request_size = -1;
+	global_stats.aggs_no = 0;
+	global_stats.avg_agg_size = -1;
+	stats_write_end(&global_stats_seq);
 	pthread_mutex_unlock(&global_statistics_mutex);
 }
 /**
@@ -109,6 +118,8 @@ void reset_stats_queue(struct queue_t *queue)
 	queue->stats.avg_distance = -1;
 	queue->stats.aggs_no = 0;
 	queue->stats.avg_agg_size = -1;
+	queue->stats.avg_service_time = -1;
+	if (queue->stats.histograms) request_histograms_init(queue->stats.histograms);
 }
 /**
  * function called once in a while to completely reset all statistics (local and global) we have been keeping about the access pattern. Must hold ALL mutexes (this function is called after lock_all_data_structures, so no other locks are necessary). 
@@ -121,22 +132,45 @@ void reset_all_statistics(void)
 	for (int32_t i=0; i< AGIOS_HASH_ENTRIES; i++) {
 		list = &hashlist[i];
 		agios_list_for_each_entry (req_file, list, hashlist) { //goes over all files of this line of the hashtable
+			stats_write_begin(&req_file->stats_seq);
 			reset_stats_queue(&req_file->read_queue);
 			reset_stats_queue(&req_file->write_queue);
+			stats_write_end(&req_file->stats_seq);
 		}
 	}
 	//reset global statistics as well
 	reset_global_stats();
 }
 /**
- * updates the local statistics for a queue after an aggregation. The size of the aggregation is not provided because it is already in related->lastaggregation.
+ * updates the local and global statistics after an aggregation. The size of the aggregation is not provided because it is already in related->lastaggregation. The caller must hold the lock to the queue's file. Must NOT hold the global statistics mutex.
  * @param related the queue.
  */
 void stats_aggregation(struct queue_t *related)
 {
 	if (related->lastaggregation > 1) {
+		stats_write_begin(&related->req_file->stats_seq);
 		related->stats.aggs_no++;
 		related->stats.avg_agg_size = update_iterative_average(related->stats.avg_agg_size, related->lastaggregation, related->stats.aggs_no);
+		stats_write_end(&related->req_file->stats_seq);
 		if (related->best_agg < related->lastaggregation) related->best_agg = related->lastaggregation;
+		pthread_mutex_lock(&global_statistics_mutex);
+		stats_write_begin(&global_stats_seq);
+		global_stats.aggs_no++;
+		global_stats.avg_agg_size = update_iterative_average(global_stats.avg_agg_size, related->lastaggregation, global_stats.aggs_no);
+		stats_write_end(&global_stats_seq);
+		pthread_mutex_unlock(&global_statistics_mutex);
 	}
 }
+/**
+ * copies the global statistics without holding the global statistics mutex, so it can be called by users while requests are being added. 
+ * @param ret the structure that will receive the copy.
+ */
+void get_global_stats(struct global_statistics_t *ret)
+{
+	uint32_t seq; /**< value of the sequence counter before the copy. */
+
+	do {
+		seq = stats_read_begin(&global_stats_seq);
+		memcpy(ret, &global_stats, sizeof(struct global_statistics_t));
+	} while (stats_read_retry(&global_stats_seq, seq));
+}
@@ -14,9 +14,12 @@ struct global_statistics_t
 	int64_t writes; /**< number of received write requests. */
 	int64_t avg_time_between_requests; /**< iteratively calculated average time between consecutive requests. */
 	int64_t avg_request_size; /**< iteratively calculated average request size. */
+	int64_t aggs_no; /**< number of performed aggregations (in all queues). */
+	int64_t avg_agg_size; /**< iteratively calculated average aggregation size (in number of requests). */
 };
 
 void statistics_newreq(struct request_t *req);
 void reset_global_stats(void);
 void reset_all_statistics(void);
 void stats_aggregation(struct queue_t *related);
+void get_global_stats(struct global_statistics_t *ret);
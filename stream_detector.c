@@ -0,0 +1,105 @@
+/*! \file stream_detector.c
+    \brief Implementation of the stream detector, which recognizes sequential and strided streams of reads and gives read-ahead hints to the user.
+
+    If the user sets a callback with agios_set_read_ahead_callback, agios_add_request gives every new read to detect_stream (while holding the lock of the data structure). Each read queue keeps a stream_t with the stride of its stream (the distance from the end of a request to the beginning of the next one, 0 for a sequential stream) and a confidence, increased for every request that follows the stride and halved for every one that does not (when it reaches 0, the stride of the last request is the new one). Once the confidence reaches read_ahead_confidence, the next requests of the stream are predicted (with the size of the last one) and hinted to the user, so the forwarding layer can prefetch them into its cache before clients ask. We keep 1 << confidence requests hinted ahead (at most read_ahead_max_size bytes of them), and only hint again when less than half of them are left, so a sequential stream receives a few large hints instead of one per request. Only forward streams are hinted. Hints are given after the lock is released, with give_read_ahead_hints.
+*/
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "agios.h"
+#include "agios_config.h"
+#include "agios_request.h"
+#include "common_functions.h"
+#include "process_request.h"
+#include "stream_detector.h"
+
+/**
+ * initializes the stream of a queue, called by init_queue.
+ * @param stream the stream.
+ */
+void init_stream(struct stream_t *stream)
+{
+	memset(stream, 0, sizeof(struct stream_t));
+	stream->hinted_next = -1;
+}
+/**
+ * includes a new read in the stream of its queue, and decides what should be hinted to the user. The caller must hold the lock of the data structure where the request is.
+ * @param req the new request (its globalinfo must be set).
+ * @param request_end false if req is a piece of a request split at stripe boundaries and other pieces will follow, then the next requests are only predicted with the last piece.
+ * @param hints will receive the ranges to be hinted (it must have room for STREAM_MAX_HINTS).
+ * @return the number of hints, to be given to give_read_ahead_hints after releasing the lock.
+ */
+int32_t detect_stream(struct request_t *req, bool request_end, struct read_ahead_hint_t *hints)
+{
+	struct stream_t *stream = &req->globalinfo->stream; /**< the stream of the queue */
+	int64_t distance; /**< from the end of the previous request to this one */
+	int64_t next; /**< offset of the next predicted request */
+	int64_t step; /**< distance between the beginnings of two predicted requests */
+	int32_t depth; /**< how many requests we want hinted ahead */
+	int32_t ahead; /**< how many predicted requests were already hinted */
+	int32_t count; /**< how many requests we will hint now */
+
+	if (req->type != RT_READ) return 0;
+	//the pieces of a request split at stripe boundaries arrive one after the other, they only extend the request
+	if (req->piece && stream->last_piece && (req->user_id == stream->last_user_id) && (req->offset == stream->last_end)) {
+		stream->last_end += req->len;
+		stream->last_len += req->len;
+	} else {
+		distance = req->offset - stream->last_end;
+		if ((stream->reqnb > 0) && (distance == stream->stride)) {
+			if (stream->confidence < STREAM_MAX_CONFIDENCE) stream->confidence++;
+		} else {
+			stream->confidence /= 2;
+			if (stream->confidence == 0) { //it is a new stream
+				stream->stride = distance;
+				stream->hinted_next = -1;
+			}
+		}
+		stream->last_end = req->offset + req->len;
+		stream->last_len = req->len;
+		stream->last_user_id = req->user_id;
+		stream->last_piece = req->piece;
+		stream->reqnb++;
+	}
+	if ((!request_end) || (stream->confidence < config_read_ahead_confidence)) return 0;
+	//predict the next requests
+	step = stream->last_len + stream->stride;
+	next = stream->last_end + stream->stride;
+	if ((step <= 0) || (next < 0)) return 0; //we only hint forward streams
+	depth = 1 << stream->confidence;
+	if ((config_read_ahead_max_size > 0) && ((depth * stream->last_len) > config_read_ahead_max_size)) depth = agios_max(config_read_ahead_max_size / stream->last_len, 1);
+	if ((stream->hinted_next < next) || (((stream->hinted_next - next) % step) != 0)) stream->hinted_next = next; //the requests we hinted before are not the predicted ones anymore
+	ahead = (stream->hinted_next - next) / step;
+	if (ahead > depth / 2) return 0; //we still have enough requests hinted ahead
+	count = agios_min(depth - ahead, STREAM_MAX_HINTS);
+	if (count <= 0) return 0;
+	if (stream->stride == 0) { //sequential, a single hint for all of them
+		hints[0].offset = stream->hinted_next;
+		hints[0].len = count * stream->last_len;
+		stream->hinted_next += count * step;
+		return 1;
+	}
+	for (int32_t i = 0; i < count; i++) {
+		hints[i].offset = stream->hinted_next;
+		hints[i].len = stream->last_len;
+		stream->hinted_next += step;
+	}
+	return count;
+}
+/**
+ * gives read-ahead hints to the user, through the callback given to agios_set_read_ahead_callback. This is to be called after unlocking the mutexes, like process_requests_step2.
+ * @param file_id the file handle.
+ * @param hints the ranges filled by detect_stream.
+ * @param hintnb how many.
+ */
+void give_read_ahead_hints(char *file_id, struct read_ahead_hint_t *hints, int32_t hintnb)
+{
+	void * (* read_ahead_cb)(char *file_id, int64_t offset, int64_t len) = __atomic_load_n(&user_callbacks.read_ahead_cb, __ATOMIC_ACQUIRE); /**< read once, the user may change it */
+
+	if (!read_ahead_cb) return;
+	for (int32_t i = 0; i < hintnb; i++) {
+		debug("read-ahead hint for file %s: offset %ld, len %ld", file_id, hints[i].offset, hints[i].len);
+		read_ahead_cb(file_id, hints[i].offset, hints[i].len);
+	}
+}
@@ -0,0 +1,26 @@
+/*! \file stream_detector.h
+    \brief Headers of the stream detector, which recognizes sequential and strided streams of reads and gives read-ahead hints to the user.
+
+    @see stream_detector.c
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "agios_request.h"
+
+#define STREAM_MAX_CONFIDENCE 4 /**< the confidence of a stream stops growing here, so at most 1 << STREAM_MAX_CONFIDENCE requests are hinted ahead */
+#define STREAM_MAX_HINTS (1 << STREAM_MAX_CONFIDENCE) /**< largest number of hints given for one new request */
+
+/*! \struct read_ahead_hint_t
+    \brief a range of a file the user should prefetch.
+ */
+struct read_ahead_hint_t {
+	int64_t offset; /**< position of the file in bytes */
+	int64_t len; /**< size in bytes */
+};
+
+void init_stream(struct stream_t *stream);
+int32_t detect_stream(struct request_t *req, bool request_end, struct read_ahead_hint_t *hints);
+void give_read_ahead_hints(char *file_id, struct read_ahead_hint_t *hints, int32_t hintnb);
@@ -0,0 +1,139 @@
+/*! \file stripes.c
+    \brief Implementation of the stripe geometry of files, used to keep virtual requests inside a stripe, to split requests and to find their servers.
+
+    In a parallel file system, a file is split into stripes of stripe_size bytes, distributed round-robin over stripe_count servers, starting at first_server. A virtual request that crosses a stripe boundary is split again by the file system and waits for two servers, so should_aggregate does not build them. If the user sets a callback with agios_set_split_callback, agios_add_request splits requests that cross stripe boundaries into stripe-aligned pieces, which are scheduled (and given back) independently, so they are served by their servers in parallel. For striped files, requests also know the server holding their first byte (modulo max_queue_id+1), and TWINS uses it instead of the queue_id given by the user, so it works per server without the user having to know the striping. The queue_id is kept for the other uses (SW, SFQ weights, throttling and limits on outstanding requests).
+    The geometry comes from the stripes configuration parameter (by file_id prefix, the first matching entry is used) or from agios_set_file_stripes (for one file, it has priority over the configuration file). It is kept in the file_t structure of the file (created by agios_set_file_stripes if needed), so new requests find it under the lock of their line of the hashtable. Only files striped over more than one server are affected.
+*/
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "agios.h"
+#include "agios_add_request.h"
+#include "agios_config.h"
+#include "agios_request.h"
+#include "common_functions.h"
+#include "data_structures.h"
+#include "hash.h"
+#include "mylist.h"
+#include "process_request.h"
+#include "req_hashtable.h"
+#include "req_timeline.h"
+#include "stripes.h"
+
+static bool g_file_stripes_set = false; /**< was agios_set_file_stripes called? If not (and the stripes configuration parameter is empty), no file is striped. */
+
+/**
+ * finds the geometry of a file from the stripes configuration parameter. It is called when a file_t structure is created.
+ * @param file_id the file handle.
+ * @param geometry will receive the geometry (with stripe_size 0 if it is not known).
+ */
+void find_stripe_geometry(char *file_id, struct stripe_geometry_t *geometry)
+{
+	memset(geometry, 0, sizeof(struct stripe_geometry_t));
+	for (int32_t i = 0; i < config_stripes_len; i++) {
+		if (strncmp(file_id, config_stripes[i].file_prefix, strlen(config_stripes[i].file_prefix)) == 0) {
+			geometry->stripe_size = config_stripes[i].stripe_size;
+			geometry->stripe_count = config_stripes[i].stripe_count;
+			geometry->first_server = config_stripes[i].first_server;
+			return;
+		}
+	}
+}
+/**
+ * finds the geometry of a file, from its file_t structure (or from the stripes configuration parameter, if there is none yet). It is called for every new request, before adding it.
+ * @param file_id the file handle.
+ * @param geometry will receive the geometry (with stripe_size 0 if it is not known).
+ */
+void get_file_stripes(char *file_id, struct stripe_geometry_t *geometry)
+{
+	int32_t hash; /**< the line of the hashtable where the file is */
+	struct file_t *req_file; /**< the file */
+	bool using_hashtable; /**< the lock we are holding */
+
+	memset(geometry, 0, sizeof(struct stripe_geometry_t));
+	if ((config_stripes_len == 0) && (!__atomic_load_n(&g_file_stripes_set, __ATOMIC_ACQUIRE))) return; //the common case
+	hash = get_hashtable_position(file_id);
+	using_hashtable = acquire_adequate_lock(hash);
+	req_file = get_req_file(&hashlist[hash], file_id, false);
+	if (req_file) *geometry = req_file->stripes;
+	else find_stripe_geometry(file_id, geometry);
+	if (using_hashtable) hashtable_unlock(hash);
+	else timeline_unlock();
+}
+/**
+ * answers if stripe boundaries matter for a file (if it is striped over more than one server).
+ * @param geometry its geometry.
+ * @return true if it is striped.
+ */
+bool is_striped(struct stripe_geometry_t *geometry)
+{
+	return (geometry->stripe_size > 0) && (geometry->stripe_count > 1);
+}
+/**
+ * finds where the stripe containing an offset ends.
+ * @param geometry the geometry of the file (it must be striped).
+ * @param offset the position in the file.
+ * @return the offset of the next stripe.
+ */
+int64_t get_stripe_end(struct stripe_geometry_t *geometry, int64_t offset)
+{
+	return ((offset / geometry->stripe_size) + 1) * geometry->stripe_size;
+}
+/**
+ * answers if a range of a file is in more than one stripe.
+ * @param geometry the geometry of the file.
+ * @param offset the beginning of the range.
+ * @param end the end of the range (offset + len).
+ * @return true if the file is striped and the range crosses a stripe boundary.
+ */
+bool crosses_stripes(struct stripe_geometry_t *geometry, int64_t offset, int64_t end)
+{
+	if (!is_striped(geometry)) return false;
+	return end > get_stripe_end(geometry, offset);
+}
+/**
+ * finds the server holding a position of a file, used by TWINS instead of the queue_id of requests.
+ * @param geometry the geometry of the file.
+ * @param offset the position in the file.
+ * @return the server (between 0 and max_queue_id), or -1 if the file is not striped or agios_init was given no queues.
+ */
+int32_t get_stripe_server(struct stripe_geometry_t *geometry, int64_t offset)
+{
+	if ((!is_striped(geometry)) || (multi_timeline_size == 0)) return -1;
+	return (geometry->first_server + ((offset / geometry->stripe_size) % geometry->stripe_count)) % multi_timeline_size;
+}
+/**
+ * function called by the user to give the stripe geometry of a file (for instance after asking the parallel file system about its layout), instead of using the stripes configuration parameter. Requests queued before the call keep their server, and are not split again.
+ * @param file_id the file handle.
+ * @param stripe_size the stripe size in bytes, 0 if the file is not striped.
+ * @param stripe_count the number of servers the file is striped over.
+ * @param first_server the server holding the first stripe (the queue TWINS uses for requests to it).
+ * @return true or false for success (false if the values are not valid or AGIOS is not initialized).
+ */
+bool agios_set_file_stripes(char *file_id, int64_t stripe_size, int32_t stripe_count, int32_t first_server)
+{
+	struct stripe_geometry_t geometry = { .stripe_size = stripe_size, .stripe_count = stripe_count, .first_server = first_server }; /**< the new geometry */
+	int32_t hash; /**< the line of the hashtable where the file is */
+	struct file_t *req_file; /**< the file */
+	bool using_hashtable; /**< the lock we are holding */
+
+	if ((!user_callbacks.process_request_cb) || (!file_id) || (stripe_size < 0) || (stripe_count < 1) || (first_server < 0)) return false;
+	hash = get_hashtable_position(file_id);
+	using_hashtable = acquire_adequate_lock(hash);
+	req_file = get_req_file(&hashlist[hash], file_id, true); //the file may not have requests yet
+	if (req_file) {
+		req_file->stripes = geometry;
+		__atomic_store_n(&g_file_stripes_set, true, __ATOMIC_RELEASE);
+	}
+	if (using_hashtable) hashtable_unlock(hash);
+	else timeline_unlock();
+	return req_file != NULL;
+}
+/**
+ * called by agios_exit, the geometries given with agios_set_file_stripes are forgotten with the file_t structures.
+ */
+void cleanup_stripes(void)
+{
+	__atomic_store_n(&g_file_stripes_set, false, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,19 @@
+/*! \file stripes.h
+    \brief Headers of the stripe geometry of files, used to keep virtual requests inside a stripe, to split requests and to find their servers.
+
+    @see stripes.c
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "agios_request.h"
+
+void find_stripe_geometry(char *file_id, struct stripe_geometry_t *geometry);
+void get_file_stripes(char *file_id, struct stripe_geometry_t *geometry);
+bool is_striped(struct stripe_geometry_t *geometry);
+int64_t get_stripe_end(struct stripe_geometry_t *geometry, int64_t offset);
+bool crosses_stripes(struct stripe_geometry_t *geometry, int64_t offset, int64_t end);
+int32_t get_stripe_server(struct stripe_geometry_t *geometry, int64_t offset);
+void cleanup_stripes(void);
@@ -0,0 +1,370 @@
+/*! \file throttle.c
+    \brief Implementation of the bandwidth, IOPS and outstanding requests limits respected by all scheduling algorithms.
+
+    Limits are given in the throttle configuration parameter, each one for the requests of a queue_id or to the files whose file_id starts with a prefix (a request may be subject to more than one). They are used to keep background jobs from saturating the storage during production runs. Each limit is a token bucket, implemented as a GCRA (generic cell rate algorithm): instead of a number of tokens, it keeps the time at which the bucket would be full again if nothing else was dispatched (tat). A request can be given to the user if the tat is at most throttle_burst in the future, and then moves the tat by its size divided by the rate.
+    There are also limits on the number of outstanding requests (selected by the scheduling algorithm but not released yet), for the whole library (max_outstanding), for each file (max_outstanding_per_file) and for each queue_id (max_outstanding_per_queue_id), so a single file or server cannot have hundreds of requests in flight while others wait. They are not enforced here but by the scheduling algorithms themselves, which ask outstanding_allows before selecting requests from a queue and leave it alone while its limits are full (so its requests can still be aggregated or cancelled). process_requests_step1 counts the selected requests (outstanding_dispatch). Virtual requests count as the number of requests they contain, so they may go over the limit. With adaptive_outstanding, the global and per queue_id limits are tuned while AGIOS runs (see depth_controller.c). agios_release_request calls throttle_release, which wakes up the agios thread if a queue was left alone because of its limits.
+    Scheduling algorithms choose requests as usual, and process_requests_step2 gives them to throttle_requests. Requests that go over a bandwidth or IOPS limit are kept here, in arrival order, instead of being given to the user. The agios thread gives them to the user (process_throttled_requests) when their limits allow, and does not sleep for longer than the time until a rate limit allows one of them (get_throttle_waiting_time). Requests waiting here are already out of the scheduling queues (they are counted as dispatched and outstanding, and the time they wait here counts as service time in the statistics), so they cannot be cancelled.
+*/
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "agios_config.h"
+#include "agios_request.h"
+#include "agios_thread.h"
+#include "common_functions.h"
+#include "depth_controller.h"
+#include "mylist.h"
+#include "process_request.h"
+#include "throttle.h"
+
+/*! \struct throttle_bucket_t
+    \brief The state of one limit.
+ */
+struct throttle_bucket_t {
+	struct throttle_config_t *config; /**< the limit, from the configuration file */
+	size_t prefix_len; /**< length of config->file_prefix */
+	int64_t bytes_tat; /**< time (ns) at which the bandwidth bucket would be full */
+	int64_t reqs_tat; /**< time (ns) at which the IOPS bucket would be full */
+	bool blocked; /**< set when a request cannot go because of this limit, so the next ones subject to it wait too (to keep their order). Reset by process_throttled_requests before going over the waiting requests again */
+};
+
+static struct throttle_bucket_t *g_buckets = NULL; /**< one per entry of config_throttle */
+static int32_t g_bucket_nb = 0; /**< length of g_buckets */
+static AGIOS_LIST_HEAD(g_deferred); /**< processing_info_t structs of requests waiting for their limits, in the order they were scheduled */
+static struct outstanding_t g_outstanding; /**< outstanding requests of the whole library (max_outstanding) */
+static struct outstanding_t *g_queue_outstanding = NULL; /**< outstanding requests of each queue_id (max_outstanding_per_queue_id) */
+static int32_t g_queue_outstanding_nb = 0; /**< length of g_queue_outstanding (max_queue_id+1) */
+static struct depth_controller_t g_controller; /**< adapts max_outstanding, if adaptive_outstanding is set */
+static struct depth_controller_t *g_queue_controllers = NULL; /**< adapt max_outstanding_per_queue_id (one per queue_id), if adaptive_outstanding is set */
+static bool g_throttle_enabled = false; /**< is there any bandwidth or IOPS limit? */
+static bool g_outstanding_enabled = false; /**< is there any limit on outstanding requests? */
+static bool g_outstanding_skipped = false; /**< set when a scheduling algorithm left a queue alone because of its limits on outstanding requests, so releases wake up the agios thread. Reset by the agios thread before calling the scheduling algorithm */
+static pthread_mutex_t g_throttle_mutex = PTHREAD_MUTEX_INITIALIZER; /**< protects the buckets, the outstanding_t counters and g_deferred (NOOP gives requests to the user from the threads calling agios_add_request). It is taken while holding the hashtable or timeline locks, never the other way around */
+
+/**
+ * called by agios_init to create the buckets and counters from the configuration parameters.
+ * @param max_queue_id the max_queue_id given to agios_init. Requests with a larger queue_id are not subject to max_outstanding_per_queue_id.
+ * @return true or false for success.
+ */
+bool init_throttle(int32_t max_queue_id)
+{
+	memset(&g_outstanding, 0, sizeof(struct outstanding_t));
+	depth_controller_init(&g_controller, config_max_outstanding);
+	if (config_throttle_len > 0) {
+		g_buckets = calloc(config_throttle_len, sizeof(struct throttle_bucket_t));
+		if (!g_buckets) return false;
+		for (int32_t i = 0; i < config_throttle_len; i++) {
+			g_buckets[i].config = &config_throttle[i];
+			if (config_throttle[i].file_prefix) g_buckets[i].prefix_len = strlen(config_throttle[i].file_prefix);
+		}
+		g_bucket_nb = config_throttle_len;
+	}
+	if ((config_max_outstanding_per_queue_id > 0) && (max_queue_id > 0)) {
+		g_queue_outstanding = calloc(max_queue_id+1, sizeof(struct outstanding_t));
+		g_queue_controllers = malloc(sizeof(struct depth_controller_t)*(max_queue_id+1));
+		if ((!g_queue_outstanding) || (!g_queue_controllers)) return false;
+		g_queue_outstanding_nb = max_queue_id+1;
+		for (int32_t i = 0; i < g_queue_outstanding_nb; i++) depth_controller_init(&g_queue_controllers[i], config_max_outstanding_per_queue_id);
+	}
+	g_outstanding_enabled = (config_max_outstanding > 0) || (config_max_outstanding_per_file > 0) || (g_queue_outstanding_nb > 0);
+	g_throttle_enabled = (g_bucket_nb > 0);
+	return true;
+}
+/**
+ * called by agios_exit to free the buckets and counters. Requests still waiting for their limits are never given to the user.
+ */
+void cleanup_throttle(void)
+{
+	struct processing_info_t *info; /**< used to go over g_deferred */
+
+	pthread_mutex_lock(&g_throttle_mutex);
+	while (!agios_list_empty(&g_deferred)) {
+		info = agios_list_entry(g_deferred.next, struct processing_info_t, list);
+		agios_list_del(&info->list);
+		free(info->user_ids);
+		if (info->served_by) free(info->served_by);
+		if (info->piece_offsets) free(info->piece_offsets);
+		if (info->piece_lens) free(info->piece_lens);
+		free(info);
+	}
+	if (g_buckets) {
+		free(g_buckets);
+		g_buckets = NULL;
+	}
+	g_bucket_nb = 0;
+	if (g_queue_outstanding) {
+		free(g_queue_outstanding);
+		g_queue_outstanding = NULL;
+	}
+	if (g_queue_controllers) {
+		free(g_queue_controllers);
+		g_queue_controllers = NULL;
+	}
+	g_queue_outstanding_nb = 0;
+	g_throttle_enabled = false;
+	g_outstanding_enabled = false;
+	pthread_mutex_unlock(&g_throttle_mutex);
+}
+/**
+ * answers if requests are subject to a limit.
+ * @param bucket the limit.
+ * @param info the requests.
+ * @return true if they have its queue_id or access a file with its prefix.
+ */
+bool throttle_applies(struct throttle_bucket_t *bucket, struct processing_info_t *info)
+{
+	if (bucket->config->file_prefix) return strncmp(info->req_file->file_id, bucket->config->file_prefix, bucket->prefix_len) == 0;
+	return info->queue_id == bucket->config->queue_id;
+}
+/**
+ * converts an amount (of bytes or requests) to the time it takes at a rate, without overflowing for large amounts.
+ * @param amount the amount.
+ * @param rate the rate, per second (larger than 0).
+ * @return the time, in ns.
+ */
+int64_t throttle_cost(int64_t amount, int64_t rate)
+{
+	return (amount / rate) * 1000000000L + ((amount % rate) * 1000000000L) / rate;
+}
+/**
+ * answers if requests can go now as far as a limit is concerned. The caller must hold g_throttle_mutex.
+ * @param bucket the limit.
+ * @param now the current time (ns).
+ * @return true if the bucket has tokens.
+ */
+bool throttle_bucket_allows(struct throttle_bucket_t *bucket, int64_t now)
+{
+	if ((bucket->config->bandwidth > 0) && (bucket->bytes_tat - now > config_throttle_burst)) return false;
+	if ((bucket->config->iops > 0) && (bucket->reqs_tat - now > config_throttle_burst)) return false;
+	return true;
+}
+/**
+ * takes the tokens used by requests from a limit. The caller must hold g_throttle_mutex.
+ * @param bucket the limit.
+ * @param info the requests.
+ * @param now the current time (ns).
+ */
+void throttle_bucket_charge(struct throttle_bucket_t *bucket, struct processing_info_t *info, int64_t now)
+{
+	if (bucket->config->bandwidth > 0) bucket->bytes_tat = agios_max(bucket->bytes_tat, now) + throttle_cost(info->len, bucket->config->bandwidth);
+	if (bucket->config->iops > 0) bucket->reqs_tat = agios_max(bucket->reqs_tat, now) + throttle_cost(info->reqnb, bucket->config->iops);
+}
+/**
+ * finds the limits on outstanding requests that apply to requests. The caller must hold g_throttle_mutex.
+ * @param req_file the file they access.
+ * @param queue_id their queue_id.
+ * @param counters will receive the counters of the limits (it must have space for 3).
+ * @param limits will receive the limits.
+ * @param controllers will receive the controllers adapting the limits (NULL for limits that are not adapted).
+ * @return the number of limits.
+ */
+int32_t get_outstanding_limits(struct file_t *req_file, int32_t queue_id, struct outstanding_t **counters, int32_t *limits, struct depth_controller_t **controllers)
+{
+	int32_t ret = 0; /**< the return of this function. */
+
+	if (config_max_outstanding > 0) {
+		counters[ret] = &g_outstanding;
+		controllers[ret] = config_adaptive_outstanding ? &g_controller : NULL;
+		limits[ret++] = config_adaptive_outstanding ? g_controller.limit : config_max_outstanding;
+	}
+	if (config_max_outstanding_per_file > 0) {
+		counters[ret] = &req_file->outstanding;
+		controllers[ret] = NULL;
+		limits[ret++] = config_max_outstanding_per_file;
+	}
+	if ((queue_id >= 0) && (queue_id < g_queue_outstanding_nb)) {
+		counters[ret] = &g_queue_outstanding[queue_id];
+		controllers[ret] = config_adaptive_outstanding ? &g_queue_controllers[queue_id] : NULL;
+		limits[ret++] = config_adaptive_outstanding ? g_queue_controllers[queue_id].limit : config_max_outstanding_per_queue_id;
+	}
+	return ret;
+}
+/**
+ * answers if a scheduling algorithm may select requests now, considering the limits on outstanding requests they are subject to. Scheduling algorithms call it before selecting requests from a queue (with the lock of the queue held), and leave the queue alone if it says no. The agios thread is then woken up by the next release.
+ * @param req_file the file the requests access.
+ * @param queue_id their queue_id.
+ * @return true if none of these limits is full.
+ */
+bool outstanding_allows(struct file_t *req_file, int32_t queue_id)
+{
+	bool ret = true; /**< the return of this function. */
+	struct outstanding_t *counters[3]; /**< the limits on outstanding requests that apply to the requests. */
+	int32_t limits[3]; /**< their values. */
+	struct depth_controller_t *controllers[3]; /**< the controllers adapting them. */
+	int32_t limit_nb; /**< how many apply. */
+
+	if (!g_outstanding_enabled) return true; //the limits are only created or removed while the agios thread is not running
+	pthread_mutex_lock(&g_throttle_mutex);
+	limit_nb = get_outstanding_limits(req_file, queue_id, counters, limits, controllers);
+	for (int32_t i = 0; i < limit_nb; i++) {
+		if (counters[i]->reqnb >= limits[i]) {
+			if (controllers[i]) controllers[i]->saturated = true;
+			ret = false;
+		}
+	}
+	if (!ret) __atomic_store_n(&g_outstanding_skipped, true, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&g_throttle_mutex);
+	return ret;
+}
+/**
+ * called by process_requests_step1 to count requests selected by the scheduling algorithm as outstanding.
+ * @param info the processing_info_t struct filled by process_requests_step1.
+ */
+void outstanding_dispatch(struct processing_info_t *info)
+{
+	struct outstanding_t *counters[3]; /**< the limits on outstanding requests that apply to the requests. */
+	int32_t limits[3]; /**< their values. */
+	struct depth_controller_t *controllers[3]; /**< the controllers adapting them. */
+	int32_t limit_nb; /**< how many apply. */
+
+	if (!g_outstanding_enabled) return;
+	pthread_mutex_lock(&g_throttle_mutex);
+	limit_nb = get_outstanding_limits(info->req_file, info->queue_id, counters, limits, controllers);
+	for (int32_t i = 0; i < limit_nb; i++) counters[i]->reqnb += info->reqnb;
+	pthread_mutex_unlock(&g_throttle_mutex);
+}
+/**
+ * called by the agios thread before calling the scheduling algorithm, to find out later if it left queues alone because of their limits on outstanding requests.
+ */
+void reset_outstanding_blocked(void)
+{
+	__atomic_store_n(&g_outstanding_skipped, false, __ATOMIC_RELEASE);
+}
+/**
+ * used by the agios thread to decide if it can sleep while there are queued requests.
+ * @return true if the scheduling algorithm left a queue alone because of its limits on outstanding requests since the last call to reset_outstanding_blocked.
+ */
+bool outstanding_blocked(void)
+{
+	return __atomic_load_n(&g_outstanding_skipped, __ATOMIC_ACQUIRE);
+}
+/**
+ * answers if requests can go now, considering the bandwidth and IOPS limits they are subject to. The limits that do not let them go are marked as blocked, so the next requests subject to them wait too, but requests waiting for one limit do not hold the others. The caller must hold g_throttle_mutex.
+ * @param info the requests.
+ * @param now the current time (ns).
+ * @return true if they can go. In that case, the tokens were taken from the limits.
+ */
+bool throttle_admit(struct processing_info_t *info, int64_t now)
+{
+	bool ret = true; /**< the return of this function. */
+
+	for (int32_t i = 0; i < g_bucket_nb; i++) {
+		if (!throttle_applies(&g_buckets[i], info)) continue;
+		if (g_buckets[i].blocked || (!throttle_bucket_allows(&g_buckets[i], now))) {
+			g_buckets[i].blocked = true;
+			ret = false;
+		}
+	}
+	if (!ret) return false;
+	for (int32_t i = 0; i < g_bucket_nb; i++) {
+		if (throttle_applies(&g_buckets[i], info)) throttle_bucket_charge(&g_buckets[i], info, now);
+	}
+	return true;
+}
+/**
+ * called by process_requests_step2 before giving requests to the user. If they go over a bandwidth or IOPS limit (or if other requests are waiting for one of their limits), they are kept to be given to the user later by process_throttled_requests.
+ * @param info the processing_info_t struct filled by process_requests_step1.
+ * @return true if the requests were kept (and the caller must not use info anymore), false if they can be given to the user now.
+ */
+bool throttle_requests(struct processing_info_t *info)
+{
+	struct timespec now; /**< the current time. */
+	bool ret = false; /**< the return of this function. */
+
+	if (!g_throttle_enabled) return false; //the limits are only created or removed while the agios thread is not running
+	agios_gettime(&now);
+	pthread_mutex_lock(&g_throttle_mutex);
+	if (!throttle_admit(info, get_timespec2long(now))) {
+		agios_list_add_tail(&info->list, &g_deferred);
+		ret = true;
+	}
+	pthread_mutex_unlock(&g_throttle_mutex);
+	return ret;
+}
+/**
+ * called by the agios thread to give to the user the requests kept by throttle_requests whose limits now allow them. The requests subject to each limit are given in the order they were kept.
+ */
+void process_throttled_requests(void)
+{
+	struct timespec now; /**< the current time. */
+	int64_t this_time; /**< now converted to a number. */
+	struct processing_info_t *info, *aux; /**< used to iterate over g_deferred. */
+	AGIOS_LIST_HEAD(ready); /**< the requests we will give to the user after unlocking the mutex. */
+
+	if (!g_throttle_enabled) return;
+	agios_gettime(&now);
+	this_time = get_timespec2long(now);
+	pthread_mutex_lock(&g_throttle_mutex);
+	//nothing is blocked yet
+	for (int32_t i = 0; i < g_bucket_nb; i++) g_buckets[i].blocked = false;
+	//go over the waiting requests in order
+	info = agios_list_entry(g_deferred.next, struct processing_info_t, list);
+	while (&info->list != &g_deferred) {
+		aux = agios_list_entry(info->list.next, struct processing_info_t, list);
+		if (throttle_admit(info, this_time)) {
+			agios_list_del(&info->list);
+			agios_list_add_tail(&info->list, &ready);
+		}
+		info = aux;
+	}
+	pthread_mutex_unlock(&g_throttle_mutex);
+	//give them to the user
+	while (!agios_list_empty(&ready)) {
+		info = agios_list_entry(ready.next, struct processing_info_t, list);
+		agios_list_del(&info->list);
+		give_requests_to_user(info);
+	}
+}
+/**
+ * used by the agios thread to decide for how long it can sleep.
+ * @return the time (ns) until the next blocked rate limit allows requests, at least 1. 0 if there are no requests waiting for a rate limit.
+ */
+int64_t get_throttle_waiting_time(void)
+{
+	struct timespec now; /**< the current time. */
+	int64_t this_time; /**< now converted to a number. */
+	int64_t ret = 0; /**< the return of this function. */
+	int64_t wait; /**< the time until a limit allows requests. */
+
+	if (!g_throttle_enabled) return 0;
+	agios_gettime(&now);
+	this_time = get_timespec2long(now);
+	pthread_mutex_lock(&g_throttle_mutex);
+	for (int32_t i = 0; i < g_bucket_nb; i++) {
+		if (!g_buckets[i].blocked) continue; //no request is waiting for it
+		wait = 1;
+		if (g_buckets[i].config->bandwidth > 0) wait = agios_max(wait, g_buckets[i].bytes_tat - config_throttle_burst - this_time);
+		if (g_buckets[i].config->iops > 0) wait = agios_max(wait, g_buckets[i].reqs_tat - config_throttle_burst - this_time);
+		if ((ret == 0) || (wait < ret)) ret = wait;
+	}
+	pthread_mutex_unlock(&g_throttle_mutex);
+	return ret;
+}
+/**
+ * called by agios_release_request for each released request, to update the limits on outstanding requests (and let the controllers measure the bandwidth, if adaptive_outstanding is set). If the scheduling algorithm left queues alone because of these limits, it wakes up the agios thread so it can select their requests.
+ * @param req the released request.
+ */
+void throttle_release(struct request_t *req)
+{
+	struct outstanding_t *counters[3]; /**< the limits on outstanding requests that apply to the request. */
+	int32_t limits[3]; /**< their values. */
+	struct depth_controller_t *controllers[3]; /**< the controllers adapting them. */
+	int32_t limit_nb; /**< how many apply. */
+	bool waiting; /**< are there queues waiting for these limits? */
+	struct timespec now; /**< the release time. */
+
+	if (!g_outstanding_enabled) return;
+	agios_gettime(&now);
+	pthread_mutex_lock(&g_throttle_mutex);
+	limit_nb = get_outstanding_limits(req->globalinfo->req_file, req->dispatch_queue_id, counters, limits, controllers);
+	for (int32_t i = 0; i < limit_nb; i++) {
+		if (counters[i]->reqnb > 0) counters[i]->reqnb--;
+		if (controllers[i]) depth_controller_release(controllers[i], req->len, get_timespec2long(now));
+	}
+	waiting = (limit_nb > 0) && __atomic_load_n(&g_outstanding_skipped, __ATOMIC_ACQUIRE);
+	pthread_mutex_unlock(&g_throttle_mutex);
+	if (waiting) signal_new_req_to_agios_thread();
+}
@@ -0,0 +1,23 @@
+/*! \file throttle.h
+    \brief Headers of the bandwidth, IOPS and outstanding requests limits respected by all scheduling algorithms.
+
+    @see throttle.c
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "agios_request.h"
+#include "process_request.h"
+
+bool init_throttle(int32_t max_queue_id);
+void cleanup_throttle(void);
+bool throttle_requests(struct processing_info_t *info);
+void process_throttled_requests(void);
+int64_t get_throttle_waiting_time(void);
+void throttle_release(struct request_t *req);
+bool outstanding_allows(struct file_t *req_file, int32_t queue_id);
+void outstanding_dispatch(struct processing_info_t *info);
+void reset_outstanding_blocked(void);
+bool outstanding_blocked(void);
@@ -2,7 +2,10 @@
     \brief Trace Module, that creates a trace file during execution with information about all requests arrivals.
 
     Trace files are named according as prefix.N.sufix with prefix and sufix given as configuration parameters and N being a counter. In the initialization of this module, it tries to open trace files with increasing values to N until finding an unused one that will be used as the new trace file. A buffer is used to write information before sending it to disk, in order to avoid generating a large number of small requests to the local storage (and also to minimize the interference with the scheduled requests in case they are also to the local storage). The length of this buffer is also a configuration parameter.
+    Arrivals are always traced. When the trace_lifecycle configuration parameter is set, we also trace when requests are aggregated, dispatched, released and cancelled, and when the scheduling algorithm changes, so what the scheduler did can be reconstructed offline.
+    There are two trace formats. The text format has one tab-separated line per event (arrivals are "timestamp file R|W offset len", other events are "timestamp EVENT file R|W offset len user_id group reqnb", and algorithm changes are "timestamp ALGORITHM previous new"), and all threads serialize on the trace mutex to write to the buffer. The binary format (trace_binary configuration parameter) uses fixed-size records (see agios_trace_format.h) and a file handle dictionary. Each thread writes its records to its own ring buffer without locks, and a writer thread periodically moves them to the main buffer and writes it to the trace file with large writes. If a ring buffer is full (the writer thread is late), new records from that thread are dropped and counted. When a thread exits, its ring buffer is marked as orphaned (by the destructor of a thread-specific key), and the writer thread frees it after collecting its last records, so servers that create a thread per connection do not accumulate ring buffers.
     @see agios_config.c
+    @see agios_trace_format.h
  */
 #include <pthread.h>
 #include <stdbool.h>
@@ -13,8 +16,32 @@
 #include "agios.h"
 #include "agios_config.h"
 #include "agios_request.h"
+#include "agios_trace_format.h"
 #include "common_functions.h"
+#include "scheduling_algorithms.h"
 
+#define AGIOS_TRACE_RING_SIZE 8192 /**< number of records in the ring buffer of each thread (binary format). Must be a power of two. */
+#define AGIOS_TRACE_WRITER_PERIOD 100000000L /**< how often (in ns) the writer thread collects records from the ring buffers (binary format). It is also woken up earlier when a ring buffer is half full. */
+
+/*! \struct trace_ring_t
+    \brief The ring buffer of records of a thread (binary format). The thread that owns it is the only one to move head, and the writer thread is the only one to move tail.
+ */
+struct trace_ring_t {
+	struct agios_trace_record_t records[AGIOS_TRACE_RING_SIZE]; /**< the records */
+	uint64_t head; /**< number of records written by the owner thread */
+	uint64_t tail; /**< number of records consumed by the writer thread */
+	int64_t dropped; /**< number of records we could not write because the ring was full */
+	bool orphaned; /**< set when the owner thread exits, so the writer thread frees the ring once it is empty */
+	struct trace_ring_t *next; /**< to be included in the list of all ring buffers */
+};
+/*! \struct trace_file_name_t
+    \brief An entry of the file handle dictionary that was not written to the trace file yet (binary format).
+ */
+struct trace_file_name_t {
+	uint32_t index; /**< the index used in records to identify this file */
+	char *file_id; /**< the file handle */
+	struct trace_file_name_t *next; /**< to be included in the list of new dictionary entries */
+};
 
 static FILE *agios_tracefile_fd; /**< the current trace file*/
 static pthread_mutex_t agios_trace_mutex = PTHREAD_MUTEX_INITIALIZER; /**< since multiple threads call the Trace Module's functions, this mutex makes sure only one tries to access the trace file at a time. The thread calling the functions MUST NOT lock it, the function itself handles it. */
@@ -23,6 +50,23 @@ static char *agios_tracefile_buffer=NULL; /**< a buffer avoids generating many I
 static int32_t agios_tracefile_buffer_size=0; /**< occupancy of the buffer. Used to control when to flush it. */
 static char *aux_buf = NULL; /**< this smaller buffer is used by the functions to write a line at a time to the main buffer. We keep it global to avoid having to allocate it multiple times (it is allocated during initialization). */
 static int32_t aux_buf_size = 300*sizeof(char); /**< the size for the smaller buffer. This is hardcoded. Shame!*/
+static struct trace_ring_t *g_trace_rings=NULL; /**< list of the ring buffers of all threads that generated records (binary format). */
+static pthread_mutex_t g_trace_rings_mutex = PTHREAD_MUTEX_INITIALIZER; /**< protects g_trace_rings and the dictionary, it is NOT used when writing records. */
+static struct trace_file_name_t *g_new_file_names=NULL; /**< dictionary entries that still need to be written to the trace file (binary format). */
+static uint32_t g_trace_file_index=0; /**< the next index to be given to a file (binary format). */
+static int32_t g_trace_generation=0; /**< incremented every time the trace is closed, so threads know their ring buffer was freed. */
+static __thread struct trace_ring_t *t_trace_ring=NULL; /**< the ring buffer of this thread. */
+static __thread int32_t t_trace_generation=-1; /**< the value of g_trace_generation when t_trace_ring was allocated. */
+static pthread_key_t g_trace_ring_key; /**< its destructor is called when a thread that has a ring buffer exits (see orphan_thread_trace_ring). */
+static pthread_once_t g_trace_ring_key_once = PTHREAD_ONCE_INIT; /**< to create g_trace_ring_key only once. */
+static bool g_trace_ring_key_created = false; /**< false if we could not create g_trace_ring_key (then ring buffers are only freed when the trace is closed). */
+static int64_t g_trace_dropped=0; /**< records dropped by threads whose ring buffers were already freed. Protected by g_trace_rings_mutex. */
+static pthread_t g_trace_writer_thread; /**< the thread that writes records to the trace file (binary format). */
+static pthread_cond_t g_trace_writer_cond = PTHREAD_COND_INITIALIZER; /**< used to wake up the writer thread. */
+static pthread_mutex_t g_trace_writer_mutex = PTHREAD_MUTEX_INITIALIZER; /**< used with g_trace_writer_cond. */
+static bool g_trace_writer_stop = false; /**< set to true to let the writer thread know the trace is being closed. */
+static int64_t g_trace_last_group=0; /**< the last identifier given to a virtual request (lifecycle events). */
+static const char *trace_event_names[] = {"ARRIVAL", "AGGREGATE", "DISPATCH", "RELEASE", "CANCEL", "ALGORITHM"}; /**< how events are named in text traces, indexed by the AGIOS_TRACE_ARRIVAL... values. */
 
 /**
  * flushes the buffer to the tracefile and resets it. The caller must have the trace lock.
@@ -61,17 +105,330 @@ void agios_trace_print_request(struct request_t *req)
 	else snprintf(aux_buf+index, aux_buf_size - index, "%s\tW\t%ld\t%ld\n", req->file_id, req->offset, req->len);	
 }
 /**
- * called by agios_add_request when a new request was added to the library. It will trace its arrival. The caller must NOT hold the trace mutex.
+ * destructor of g_trace_ring_key, called when a thread that has a ring buffer exits. The ring buffer is marked as orphaned so the writer thread frees it after collecting its records. If the trace was closed since the ring was allocated, it was already freed.
+ * @param ring the ring buffer of the exiting thread (not used, we check t_trace_ring and t_trace_generation instead, because this pointer may have been freed by close_agios_trace).
+ */
+void orphan_thread_trace_ring(void *ring)
+{
+	pthread_mutex_lock(&g_trace_rings_mutex);
+	if ((t_trace_ring) && (t_trace_generation == g_trace_generation)) __atomic_store_n(&t_trace_ring->orphaned, true, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&g_trace_rings_mutex);
+	t_trace_ring = NULL;
+}
+/**
+ * creates g_trace_ring_key, called once through pthread_once.
+ */
+void create_trace_ring_key(void)
+{
+	if (pthread_key_create(&g_trace_ring_key, orphan_thread_trace_ring) == 0) g_trace_ring_key_created = true;
+	else agios_print("Could not create the key used to free the trace ring buffers of threads that exit, they will only be freed when the trace is closed\n");
+}
+/**
+ * returns the ring buffer of the calling thread, allocating and registering it the first time the thread generates a record (binary format).
+ * @return the ring buffer, NULL if we could not allocate it.
+ */
+struct trace_ring_t *get_thread_trace_ring(void)
+{
+	if ((t_trace_ring) && (t_trace_generation == __atomic_load_n(&g_trace_generation, __ATOMIC_ACQUIRE))) return t_trace_ring;
+	t_trace_ring = (struct trace_ring_t *)malloc(sizeof(struct trace_ring_t));
+	if (!t_trace_ring) {
+		agios_print("PANIC! Could not allocate memory for trace ring buffer!\n");
+		return NULL;
+	}
+	t_trace_ring->head = 0;
+	t_trace_ring->tail = 0;
+	t_trace_ring->dropped = 0;
+	t_trace_ring->orphaned = false;
+	pthread_mutex_lock(&g_trace_rings_mutex);
+	t_trace_generation = g_trace_generation;
+	t_trace_ring->next = g_trace_rings;
+	g_trace_rings = t_trace_ring;
+	pthread_mutex_unlock(&g_trace_rings_mutex);
+	if (g_trace_ring_key_created) pthread_setspecific(g_trace_ring_key, t_trace_ring); //so we know when this thread exits
+	return t_trace_ring;
+}
+/**
+ * gives the index that identifies a file in the binary trace. The first time a file is traced, it receives an index and a new entry is added to the dictionary. The caller must hold the lock for the data structure where this file is (hashtable line or timeline).
+ * @param req_file the file.
+ * @return the index of the file.
+ */
+uint32_t get_trace_file_index(struct file_t *req_file)
+{
+	struct trace_file_name_t *name; /**< the new dictionary entry. */
+
+	if (req_file->trace_index >= 0) return (uint32_t) req_file->trace_index;
+	name = (struct trace_file_name_t *)malloc(sizeof(struct trace_file_name_t));
+	if (name) name->file_id = malloc(sizeof(char)*(strlen(req_file->file_id)+1));
+	if ((!name) || (!name->file_id)) {
+		agios_print("PANIC! Could not allocate memory for trace file dictionary!\n");
+		if (name) free(name);
+		return UINT32_MAX;
+	}
+	strcpy(name->file_id, req_file->file_id);
+	pthread_mutex_lock(&g_trace_rings_mutex);
+	name->index = g_trace_file_index++;
+	name->next = g_new_file_names;
+	g_new_file_names = name;
+	pthread_mutex_unlock(&g_trace_rings_mutex);
+	req_file->trace_index = name->index;
+	return name->index;
+}
+/**
+ * reserves the next record in the ring buffer of the calling thread (binary format). It does not use locks unless this is the first record of this thread. The record becomes visible to the writer thread after agios_trace_binary_commit.
+ * @param ring will receive the ring buffer of this thread.
+ * @return the record to be filled, NULL if the ring buffer is full (the record is dropped) or could not be allocated.
+ */
+struct agios_trace_record_t *agios_trace_binary_reserve(struct trace_ring_t **ring)
+{
+	struct agios_trace_record_t *record; /**< the record to be filled. */
+
+	*ring = get_thread_trace_ring();
+	if (!(*ring)) return NULL;
+	if ((*ring)->head - __atomic_load_n(&(*ring)->tail, __ATOMIC_ACQUIRE) >= AGIOS_TRACE_RING_SIZE) { //the writer thread is late, we don't wait for it
+		(*ring)->dropped++;
+		return NULL;
+	}
+	record = &(*ring)->records[(*ring)->head & (AGIOS_TRACE_RING_SIZE - 1)];
+	memset(record->padding, 0, sizeof(record->padding));
+	return record;
+}
+/**
+ * makes the record reserved with agios_trace_binary_reserve visible to the writer thread (binary format).
+ * @param ring the ring buffer of this thread.
+ */
+void agios_trace_binary_commit(struct trace_ring_t *ring)
+{
+	uint64_t head = ring->head + 1; /**< the new number of records written to this ring buffer. */
+
+	__atomic_store_n(&ring->head, head, __ATOMIC_RELEASE); //now the writer thread can see it
+	if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == AGIOS_TRACE_RING_SIZE / 2) pthread_cond_signal(&g_trace_writer_cond); //we don't hold the mutex here, the writer thread also wakes up periodically in case it misses this signal
+}
+/**
+ * writes a record about a request to the ring buffer of the calling thread (binary format). The caller must hold the lock for the data structure where the request is.
+ * @param req the request.
+ * @param event the traced event (see agios_trace_format.h).
+ * @param timestamp when it happened (in ns, from the same clock as agios_gettime).
+ * @param group the virtual request this request is part of, 0 if none.
+ * @param reqnb the number of requests in the group (only relevant for AGIOS_TRACE_DISPATCH).
+ */
+void agios_trace_binary_record(struct request_t *req, uint8_t event, int64_t timestamp, int64_t group, int32_t reqnb)
+{
+	struct trace_ring_t *ring; /**< the ring buffer of this thread. */
+	struct agios_trace_record_t *record = agios_trace_binary_reserve(&ring); /**< the record we are filling. */
+
+	if (!record) return;
+	record->timestamp = timestamp - get_timespec2long(agios_trace_t0);
+	record->offset = req->offset;
+	record->len = req->len;
+	record->user_id = req->user_id;
+	record->group = group;
+	record->file_index = get_trace_file_index(req->globalinfo->req_file);
+	record->queue_id = req->queue_id;
+	record->reqnb = reqnb;
+	record->event = event;
+	record->type = (uint8_t) req->type;
+	agios_trace_binary_commit(ring);
+}
+/**
+ * writes all dictionary entries that were not written yet to the trace file (binary format). The caller must hold the trace mutex.
+ */
+void agios_trace_write_file_names(void)
+{
+	struct trace_file_name_t *names; /**< the new dictionary entries. */
+	struct trace_file_name_t *name; /**< used to iterate over the new entries. */
+	struct agios_trace_chunk_header_t chunk = {.kind = AGIOS_TRACE_CHUNK_FILES, .count = 0}; /**< the header of the chunk we will write. */
+	uint32_t len; /**< length of a file handle. */
+
+	pthread_mutex_lock(&g_trace_rings_mutex);
+	names = g_new_file_names;
+	g_new_file_names = NULL;
+	pthread_mutex_unlock(&g_trace_rings_mutex);
+	if (!names) return;
+	for (name = names; name; name = name->next) chunk.count++;
+	fwrite(&chunk, sizeof(chunk), 1, agios_tracefile_fd);
+	while (names) {
+		name = names;
+		names = names->next;
+		len = strlen(name->file_id);
+		fwrite(&name->index, sizeof(uint32_t), 1, agios_tracefile_fd);
+		fwrite(&len, sizeof(uint32_t), 1, agios_tracefile_fd);
+		fwrite(name->file_id, sizeof(char), len, agios_tracefile_fd);
+		free(name->file_id);
+		free(name);
+	}
+}
+/**
+ * writes the records accumulated in the main buffer to the trace file, preceded by the dictionary entries they may need (binary format). The caller must hold the trace mutex.
+ */
+void agios_trace_binary_flush_buffer(void)
+{
+	struct agios_trace_chunk_header_t chunk = {.kind = AGIOS_TRACE_CHUNK_RECORDS}; /**< the header of the chunk we will write. */
+
+	//all records in the buffer were read after their files were added to the dictionary, so we write the dictionary first
+	agios_trace_write_file_names();
+	if (agios_tracefile_buffer_size > 0) {
+		chunk.count = agios_tracefile_buffer_size / sizeof(struct agios_trace_record_t);
+		fwrite(&chunk, sizeof(chunk), 1, agios_tracefile_fd);
+		if (fwrite(agios_tracefile_buffer, 1, agios_tracefile_buffer_size, agios_tracefile_fd) < agios_tracefile_buffer_size) {
+			agios_print("PANIC! Could not write trace buffer to trace file!\n");
+		}
+	}
+	fflush(agios_tracefile_fd);
+	agios_tracefile_buffer_size = 0;
+}
+/**
+ * removes an orphaned ring buffer from the list and frees it (binary format). Only the writer thread (or close_agios_trace after stopping it) calls this function, after collecting the records of the ring.
+ * @param ring the ring buffer.
+ * @param prev the ring before it in the list, NULL if it was the first one when agios_trace_collect_records started (other rings may have been added before it since then).
+ */
+void free_orphan_trace_ring(struct trace_ring_t *ring, struct trace_ring_t *prev)
+{
+	pthread_mutex_lock(&g_trace_rings_mutex);
+	if (!prev) {
+		if (g_trace_rings == ring) g_trace_rings = ring->next;
+		else {
+			for (prev = g_trace_rings; prev->next != ring; prev = prev->next);
+			prev->next = ring->next;
+		}
+	} else prev->next = ring->next; //only the writer thread removes rings, so prev is still in the list
+	g_trace_dropped += ring->dropped;
+	pthread_mutex_unlock(&g_trace_rings_mutex);
+	free(ring);
+}
+/**
+ * moves all records from the ring buffers of all threads to the main buffer, writing it to the trace file when it is full (binary format). The ring buffers of threads that exited are freed. Only the writer thread (or close_agios_trace after stopping it) calls this function. The caller must hold the trace mutex.
+ */
+void agios_trace_collect_records(void)
+{
+	struct trace_ring_t *ring; /**< used to iterate over all ring buffers. */
+	struct trace_ring_t *prev = NULL; /**< the ring before it in the list. */
+	struct trace_ring_t *next; /**< the ring after it in the list. */
+	bool orphaned; /**< did the owner of the ring exit? */
+	uint64_t head; /**< number of records written by the owner of a ring buffer. */
+	uint64_t tail; /**< number of records from that ring buffer already in the main buffer. */
+	int32_t record_size = sizeof(struct agios_trace_record_t); /**< size of a record in bytes. */
+
+	pthread_mutex_lock(&g_trace_rings_mutex);
+	ring = g_trace_rings; //new rings are added to the beginning of the list, so we can go through it without the lock
+	pthread_mutex_unlock(&g_trace_rings_mutex);
+	for (; ring; ring = next) {
+		next = ring->next;
+		orphaned = __atomic_load_n(&ring->orphaned, __ATOMIC_ACQUIRE); //read before head, so we collect everything the owner wrote before exiting
+		head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		for (tail = ring->tail; tail < head; tail++) {
+			if (agios_tracefile_buffer_size + record_size > config_agios_max_trace_buffer_size) agios_trace_binary_flush_buffer();
+			memcpy(agios_tracefile_buffer + agios_tracefile_buffer_size, &ring->records[tail & (AGIOS_TRACE_RING_SIZE - 1)], record_size);
+			agios_tracefile_buffer_size += record_size;
+		}
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE); //the owner can now reuse these positions
+		if (orphaned) free_orphan_trace_ring(ring, prev);
+		else prev = ring;
+	}
+}
+/**
+ * main function of the writer thread (binary format). It periodically moves records from the ring buffers to the main buffer, which is written to the trace file when full.
+ */
+void * agios_trace_writer(void *arg)
+{
+	struct timespec timeout; /**< until when we sleep. */
+
+	while (!__atomic_load_n(&g_trace_writer_stop, __ATOMIC_ACQUIRE)) {
+		clock_gettime(CLOCK_REALTIME, &timeout); //pthread_cond_timedwait uses the realtime clock
+		get_long2timespec(get_timespec2long(timeout) + AGIOS_TRACE_WRITER_PERIOD, &timeout);
+		pthread_mutex_lock(&g_trace_writer_mutex);
+		if (!g_trace_writer_stop) pthread_cond_timedwait(&g_trace_writer_cond, &g_trace_writer_mutex, &timeout);
+		pthread_mutex_unlock(&g_trace_writer_mutex);
+		pthread_mutex_lock(&agios_trace_mutex);
+		agios_trace_collect_records();
+		pthread_mutex_unlock(&agios_trace_mutex);
+	}
+	return 0;
+}
+/**
+ * called by agios_add_request when a new request was added to the library. It will trace its arrival. The caller must NOT hold the trace mutex, and must hold the lock for the data structure where the request was added.
  * @param req the newly arrived request. Its arrival_time must be filled BEFORE calling this function.
  */
 void agios_trace_add_request(struct request_t *req)
 {
+	if (config_trace_agios_binary) {
+		agios_trace_binary_record(req, AGIOS_TRACE_ARRIVAL, req->arrival_time, 0, 1);
+		return;
+	}
 	pthread_mutex_lock(&agios_trace_mutex);
 	snprintf(aux_buf, aux_buf_size, "%ld\t", (req->arrival_time - get_timespec2long(agios_trace_t0)));
 	agios_trace_print_request(req);
 	agios_trace_write_to_buffer();
 	pthread_mutex_unlock(&agios_trace_mutex);
 }
+/**
+ * gives a new identifier for a virtual request, used to group requests in lifecycle events.
+ * @return the new identifier (never 0).
+ */
+int64_t agios_trace_new_group(void)
+{
+	return __atomic_add_fetch(&g_trace_last_group, 1, __ATOMIC_RELAXED);
+}
+/**
+ * traces a lifecycle event (everything but arrivals) of a request. Called by the library only when the trace_lifecycle configuration parameter is set (see TRACE_LIFECYCLE). The caller must NOT hold the trace mutex, and must hold the lock for the data structure where the request is.
+ * @param req the request. It must be a single request, virtual requests generate one event per sub-request.
+ * @param event one of the events from agios_trace_format.h (but not AGIOS_TRACE_ARRIVAL or AGIOS_TRACE_ALGORITHM).
+ * @param timestamp when it happened (in ns, from the same clock as agios_gettime).
+ * @param group the virtual request this request is part of, 0 if none.
+ * @param reqnb the number of requests in the group (only relevant for AGIOS_TRACE_DISPATCH).
+ */
+void agios_trace_request_event(struct request_t *req, uint8_t event, int64_t timestamp, int64_t group, int32_t reqnb)
+{
+	if (config_trace_agios_binary) {
+		agios_trace_binary_record(req, event, timestamp, group, reqnb);
+		return;
+	}
+	pthread_mutex_lock(&agios_trace_mutex);
+	snprintf(aux_buf, aux_buf_size, "%ld\t%s\t%s\t%c\t%ld\t%ld\t%ld\t%ld\t%d\n", 
+		timestamp - get_timespec2long(agios_trace_t0),
+		trace_event_names[event],
+		req->file_id,
+		(req->type == RT_READ) ? 'R' : 'W',
+		req->offset,
+		req->len,
+		req->user_id,
+		group,
+		reqnb);
+	agios_trace_write_to_buffer();
+	pthread_mutex_unlock(&agios_trace_mutex);
+}
+/**
+ * traces a change in the scheduling algorithm. Called by the library only when the trace_lifecycle configuration parameter is set (see TRACE_LIFECYCLE). The caller must NOT hold the trace mutex.
+ * @param previous_alg the algorithm we were using.
+ * @param new_alg the algorithm we are now using.
+ */
+void agios_trace_change_alg(int32_t previous_alg, int32_t new_alg)
+{
+	struct timespec now; /**< when the change happened. */
+	struct trace_ring_t *ring; /**< the ring buffer of this thread. */
+	struct agios_trace_record_t *record; /**< the record we are filling. */
+
+	agios_gettime(&now);
+	if (config_trace_agios_binary) {
+		record = agios_trace_binary_reserve(&ring);
+		if (!record) return;
+		memset(record, 0, sizeof(struct agios_trace_record_t));
+		record->timestamp = get_timespec2long(now) - get_timespec2long(agios_trace_t0);
+		record->offset = previous_alg;
+		record->len = new_alg;
+		record->file_index = AGIOS_TRACE_NO_FILE;
+		record->event = AGIOS_TRACE_ALGORITHM;
+		agios_trace_binary_commit(ring);
+		return;
+	}
+	pthread_mutex_lock(&agios_trace_mutex);
+	snprintf(aux_buf, aux_buf_size, "%ld\t%s\t%s\t%s\n", 
+		get_timespec2long(now) - get_timespec2long(agios_trace_t0),
+		trace_event_names[AGIOS_TRACE_ALGORITHM],
+		get_algorithm_name_from_index(previous_alg),
+		get_algorithm_name_from_index(new_alg));
+	agios_trace_write_to_buffer();
+	pthread_mutex_unlock(&agios_trace_mutex);
+}
 /**
  * function called at the beginning of the execution. It checks for existing trace files given the prefix and sufix in the configuration parameters. Then it creates and opens the next one. It also allocates the buffers used to write to the trace file. The caller must NOT hold the trace mutex.
  * @return true or false for success. 
@@ -95,6 +452,23 @@ bool init_trace_module(void)
 	agios_tracefile_fd = fopen(filename,  "w+");
 	if (!agios_tracefile_fd) {
 		ret = false; //we will return an error but we can't leave right now because we need to unlock the mutex first. 
+	} else if (config_trace_agios_binary) {
+		struct agios_trace_file_header_t header = {.magic = AGIOS_TRACE_MAGIC, .version = AGIOS_TRACE_VERSION, .record_size = sizeof(struct agios_trace_record_t)}; /**< the beginning of the binary trace file. */
+		header.t0 = get_timespec2long(agios_trace_t0);
+		fwrite(&header, sizeof(header), 1, agios_tracefile_fd);
+		g_trace_file_index = 0;
+		pthread_once(&g_trace_ring_key_once, create_trace_ring_key);
+		if (config_agios_max_trace_buffer_size < (int32_t) sizeof(struct agios_trace_record_t)) config_agios_max_trace_buffer_size = sizeof(struct agios_trace_record_t);
+		agios_tracefile_buffer_size = 0;
+		if (!agios_tracefile_buffer) agios_tracefile_buffer = (char *)malloc(config_agios_max_trace_buffer_size); 
+		if (!agios_tracefile_buffer) ret = false;
+		else {
+			g_trace_writer_stop = false;
+			if (pthread_create(&g_trace_writer_thread, NULL, agios_trace_writer, NULL) != 0) {
+				agios_print("PANIC! Could not start the trace writer thread!\n");
+				ret = false;
+			}
+		}
 	} else {
 		/*prepare the buffer*/
 		if (agios_tracefile_buffer) agios_tracefile_buffer_size=0; //we already have a buffer, just have to reset it
@@ -126,6 +500,36 @@ void cleanup_agios_trace(void)
  */
 void close_agios_trace()
 {
+	struct trace_ring_t *ring; /**< used to free all ring buffers. */
+	int64_t dropped = 0; /**< how many records were dropped because ring buffers were full. */
+
+	if (config_trace_agios_binary) {
+		//stop the writer thread, then collect whatever is left in the ring buffers
+		pthread_mutex_lock(&g_trace_writer_mutex);
+		__atomic_store_n(&g_trace_writer_stop, true, __ATOMIC_RELEASE);
+		pthread_cond_signal(&g_trace_writer_cond);
+		pthread_mutex_unlock(&g_trace_writer_mutex);
+		pthread_join(g_trace_writer_thread, NULL);
+		pthread_mutex_lock(&agios_trace_mutex);
+		agios_trace_collect_records();
+		agios_trace_binary_flush_buffer();
+		fclose(agios_tracefile_fd);
+		pthread_mutex_unlock(&agios_trace_mutex);
+		//free the ring buffers. Threads will notice the new generation and allocate new ones if tracing is started again
+		pthread_mutex_lock(&g_trace_rings_mutex);
+		__atomic_store_n(&g_trace_generation, g_trace_generation + 1, __ATOMIC_RELEASE);
+		dropped = g_trace_dropped;
+		g_trace_dropped = 0;
+		while (g_trace_rings) {
+			ring = g_trace_rings;
+			g_trace_rings = ring->next;
+			dropped += ring->dropped;
+			free(ring);
+		}
+		pthread_mutex_unlock(&g_trace_rings_mutex);
+		if (dropped > 0) agios_print("%ld trace records were dropped because the trace writer could not keep up\n", dropped);
+		return;
+	}
 	pthread_mutex_lock(&agios_trace_mutex);
 	agios_tracefile_flush_buffer();
 	fclose(agios_tracefile_fd);
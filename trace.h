@@ -3,9 +3,16 @@
  */
 #pragma once
 
+#include "agios_config.h"
 #include "agios_request.h"
+#include "agios_trace_format.h"
+
+#define TRACE_LIFECYCLE (config_trace_agios && config_trace_agios_lifecycle) /**< should we trace other events besides arrivals? */
 
 void agios_trace_add_request(struct request_t *req);
+int64_t agios_trace_new_group(void);
+void agios_trace_request_event(struct request_t *req, uint8_t event, int64_t timestamp, int64_t group, int32_t reqnb);
+void agios_trace_change_alg(int32_t previous_alg, int32_t new_alg);
 bool init_trace_module(void);
 void cleanup_agios_trace(void);
 void close_agios_trace();
@@ -2,26 +2,104 @@
     \brief Functions used by aIOLi and MLF.
 
     aIOLi and MLF are the scheduling algorithms that try to predict shift phenomena and better aggregations, and then impose waiting times on files to improve the access pattern. Here we have some functions common to both.
+    With the adaptive_waiting_time configuration parameter, the waiting time is not the same for all files: each file waits for wait_factor times the average time between requests to the queue (so it can expect that many new requests), at most waiting_time. When the file is selected again after waiting, we check if the wait paid off (if the request we did not process was aggregated to new ones). wait_factor grows by one when it did, and is halved when it did not, so files with random accesses quickly stop waiting and do not add pure latency. These files still wait once in a while, in case their access pattern changed.
+    Waiting files are kept in a heap ordered by the end of their wait, so the schedulers do not have to check the clock for every waiting file: update_waiting_files ends the waits that are over (reading the clock once) and gives the time until the next one. Files are not removed from the heap when their wait is reset, so an entry only counts if its key is still the waiting_end of its file. The heap is only used by the agios thread, while running aIOLi or MLF (their exit functions empty it).
  */
 
+#include <stdint.h>
+
 #include "agios_config.h"
 #include "common_functions.h"
+#include "heap.h"
 #include "process_request.h"
 #include "scheduling_algorithms.h"
 #include "waiting_common.h"
+
+static struct agios_heap_t g_waiting_files = { .entries = NULL, .size = 0, .capacity = 0 }; /**< the waiting files, by the end of their waits. Each entry points to a struct file_t. */
+
+/**
+ * function used by AIOLI and MLF before looking for requests to process. Since we try not to wait (when waiting on one file, we go on processing requests to other files), we need to know which files are done waiting. Only the files whose waits are over are visited.
+ * @param shortest_waiting_time is updated in this function to the time until the end of the next wait, if it is shorter. It is not changed if no file is waiting.
+ * @return the number of files that are done waiting.
+ */
+int32_t update_waiting_files(int32_t *shortest_waiting_time)
+{
+	struct heap_entry_t entry; /**< the file whose wait ends first */
+	struct file_t *req_file; /**< its file */
+	struct timespec now_t; /**< the current time */
+	int64_t now; /**< the current time in ns */
+	int32_t ret = 0; /**< the return of this function */
+
+	if (!heap_peek(&g_waiting_files, &entry)) return 0; //no file is waiting, we do not need the clock
+	agios_gettime(&now_t);
+	now = get_timespec2long(now_t);
+	do {
+		req_file = (struct file_t *)entry.data;
+		if ((req_file->waiting_time > 0) && (req_file->waiting_end == entry.key)) { //it is really waiting
+			if (entry.key > now) { //and the others end later
+				if ((entry.key - now) < *shortest_waiting_time) *shortest_waiting_time = entry.key - now;
+				break;
+			}
+			req_file->waiting_time = 0; //we are done waiting for this file
+			ret++;
+		}
+		heap_pop(&g_waiting_files, NULL);
+	} while (heap_peek(&g_waiting_files, &entry));
+	return ret;
+}
+/**
+ * called by the exit functions of aIOLi and MLF to end all waits and free the heap of waiting files. All data structures must be locked (or the agios thread stopped).
+ */
+void cleanup_waiting_files(void)
+{
+	struct heap_entry_t entry; /**< used to go through the heap */
+
+	while (heap_pop(&g_waiting_files, &entry)) ((struct file_t *)entry.data)->waiting_time = 0;
+	heap_cleanup(&g_waiting_files);
+}
 /**
- * function used by AIOLI and MLF when we find a file that is currently waiting. Since we try not to wait (when waiting on one file, we go on processing requests to other files), every time we try to get requests from a file we need to update its waiting time to see if it is still waiting or not. 
- * @param req_file the pointer to the structure containing information about a file that is waiting
- * @param shortest_waiting_time is updated in this function and kept by the caller to find the shortest waiting time among all waiting files.
+ * decides for how long a file should wait, when check_selection thinks it is worth it.
+ * @param req the selected request, which will not be processed if we wait.
+ * @param req_file the file for this request.
+ * @return the waiting time in ns, 0 if the file should not wait.
  */
-void update_waiting_time_counters(struct file_t *req_file, 
-					int32_t *shortest_waiting_time)
+int32_t get_adaptive_waiting_time(struct request_t *req, 
+				struct file_t *req_file)
 {
-	int64_t elapsed = get_nanoelapsed(req_file->waiting_start); /**< for how long has it been waiting? */
-	if (req_file->waiting_time > elapsed) { //we have not waited enough
-		req_file->waiting_time = req_file->waiting_time - elapsed; //update waiting time
-		if (req_file->waiting_time < *shortest_waiting_time) *shortest_waiting_time = req_file->waiting_time;
-	} else req_file->waiting_time=0; //we are done waiting for this file
+	int64_t interarrival = req->globalinfo->stats.avg_time_between_requests; /**< average time between requests to the queue, in ns */
+
+	if (!config_adaptive_waiting_time) return config_waiting_time;
+	if (req_file->wait_factor == 0) { //waiting did not pay off for this file
+		req_file->wait_probe++;
+		if (req_file->wait_probe < ADAPTIVE_WAIT_PROBE_PERIOD) return 0;
+		req_file->wait_probe = 0;
+		req_file->wait_factor = 1; //try again, it will go back to 0 if it still does not pay off
+	}
+	if (interarrival <= 0) return config_waiting_time; //we do not know the queue yet
+	return (int32_t)agios_min(req_file->wait_factor * interarrival, (int64_t)config_waiting_time);
+}
+/**
+ * called when a file that was made to wait is selected again, to check if the wait gave a larger aggregation to the request we did not process, and adapt its next waiting time. The caller must hold the lock of the file.
+ * @param req_file the file.
+ */
+void evaluate_waiting_time(struct file_t *req_file)
+{
+	struct request_t *tmp; /**< used to iterate over the queue */
+	int32_t reqnb = 0; /**< requests in the (possibly virtual) request that now contains the one we did not process */
+
+	if (!req_file->wait_queue) return; //we did not make it wait
+	agios_list_for_each_entry (tmp, &req_file->wait_queue->list, related) {
+		if (tmp->offset > req_file->wait_offset) break; //the queue is sorted by offset
+		if ((tmp->offset + tmp->len) > req_file->wait_offset) {
+			reqnb = tmp->reqnb;
+			break;
+		}
+	}
+	if (reqnb > req_file->wait_reqnb) { //it paid off
+		if (req_file->wait_factor < ADAPTIVE_WAIT_MAX_FACTOR) req_file->wait_factor++;
+	} else req_file->wait_factor /= 2;
+	debug("file %s waited for a request with %d requests, got %d, its wait factor is now %d", req_file->file_id, req_file->wait_reqnb, reqnb, req_file->wait_factor);
+	req_file->wait_queue = NULL;
 }
 /**
  * function used to check if a selected request can proceed or if we should impose waiting time for its file.
@@ -32,23 +110,35 @@ void update_waiting_time_counters(struct file_t *req_file,
 bool check_selection(struct request_t *req, 
 			struct file_t *req_file)
 {
+	struct timespec now; /**< used to know when the wait ends */
+
+	if (req_file->waiting_time > 0) return false; //it is still waiting (update_waiting_files tells us when it is over)
+	if (config_adaptive_waiting_time) evaluate_waiting_time(req_file);
 	/*waiting times are cause by 2 phenomena:*/
 	/*1. shift phenomenon. One of the processes issuing requests to this queue is a little delayed, causing a contiguous request to arrive shortly after the other ones*/
 	if (req->globalinfo->predictedoff != 0) {
 		if (req->offset > req->globalinfo->predictedoff) { //we detected a shift, so we will impose a waiting time for this file
-			req_file->waiting_time = config_waiting_time;
+			req_file->waiting_time = get_adaptive_waiting_time(req, req_file);
 		}
 		/*set to 0 to avoid starvation*/
 		req->globalinfo->predictedoff = 0;
 	} 
 	/*2. better aggregation. If we just performed a larger aggregation on this queue, we believe we could do it again*/
 	else if ((req->offset > req->globalinfo->lastfinaloff) && (req->globalinfo->lastaggregation > req->reqnb)) {
-		req_file->waiting_time = config_waiting_time;
+		req_file->waiting_time = get_adaptive_waiting_time(req, req_file);
 		/*set to zero to avoid starvation*/
 		req->globalinfo->lastaggregation = 0;
 	}
 	if(req_file->waiting_time) { //we decided not to proceed with this request and to make this file wait
-		agios_gettime(&req_file->waiting_start);
+		agios_gettime(&now);
+		req_file->waiting_end = get_timespec2long(now) + req_file->waiting_time;
+		if (!heap_push(&g_waiting_files, req_file->waiting_end, req_file)) { //we would never know when it is over
+			req_file->waiting_time = 0;
+			return true;
+		}
+		req_file->wait_queue = req->globalinfo;
+		req_file->wait_offset = req->offset;
+		req_file->wait_reqnb = req->reqnb;
 		return false;
 	}
 	return true;
@@ -60,7 +150,7 @@ bool check_selection(struct request_t *req,
 void increment_sched_factor(struct request_t *req)
 {
 	if(req->sched_factor == 0) req->sched_factor = 1;
-	else req->sched_factor = req->sched_factor << 1;
+	else if (req->sched_factor <= (INT32_MAX >> 1)) req->sched_factor = req->sched_factor << 1; //it stops growing instead of overflowing, requests may stay queued for long while waiting for their limits on outstanding requests
 }
 /**
  * post process function for scheduling algorithms which use waiting times (AIOLI and MLF).
@@ -77,7 +167,7 @@ void waiting_algorithms_postprocess(struct request_t *req)
 	generic_post_process(req);
 }
 /**
- * used by aIOLi and MLF to call step2 for a list of processing_info_t structures filled by multiple calls to process_requests_step1.
+ * used by aIOLi, MLF and BFQ to call step2 for a list of processing_info_t structures filled by multiple calls to process_requests_step1.
  * @param info_list a list of filled processing_info_t structs. It will be empty (and all elements freed) after the call.
  * @return true if any of the calls to process_requests_step2 returned true, false otherwise.
  */ 
@@ -89,13 +179,13 @@ bool call_step2_for_info_list(struct agios_list_head *info_list)
 	agios_list_for_each_entry (info, info_list, list) {
 		if (aux) {
 			agios_list_del(&aux->list);
-			ret = ret || process_requests_step2(aux);
+			if (process_requests_step2(aux)) ret = true; //all of them must be given to the user, even after one tells us to stop
 		}
 		aux = info;
 	}
 	if (aux) {
 		agios_list_del(&aux->list);
-		ret = ret || process_requests_step2(aux);
+		if (process_requests_step2(aux)) ret = true;
 	}
 	return ret; 
 }
@@ -5,8 +5,15 @@
 #pragma once
 #include "agios_request.h"
 
-void update_waiting_time_counters(struct file_t *req_file, 
-					int32_t *shortest_waiting_time);
+#define ADAPTIVE_WAIT_INITIAL_FACTOR 2 /**< new files wait for two average times between requests */
+#define ADAPTIVE_WAIT_MAX_FACTOR 16 /**< the largest waiting time of a file, in average times between requests (waiting_time is also a limit) */
+#define ADAPTIVE_WAIT_PROBE_PERIOD 32 /**< when waiting did not pay off for a file, we still wait once in every these many decisions, in case its access pattern changed */
+
+int32_t update_waiting_files(int32_t *shortest_waiting_time);
+void cleanup_waiting_files(void);
+int32_t get_adaptive_waiting_time(struct request_t *req, 
+				struct file_t *req_file);
+void evaluate_waiting_time(struct file_t *req_file);
 bool check_selection(struct request_t *req, 
 			struct file_t *req_file);
 void increment_sched_factor(struct request_t *req);